@@ -7,6 +7,10 @@
 #include <string>
 #include <iostream>
 #include <stack>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
 
 #include <cmath>
 
@@ -16,6 +20,7 @@
 #include "stb/stb_image.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw_gl3.h"
+#include "imgui/imgui_impl_glfw_gl3_cached.h"
 
 #include "glm/glm.hpp"
 #include "glm/vec3.hpp" // glm::vec3
@@ -29,6 +34,20 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "culling.h"
+#include "frame_encoder.h"
+#include "image_io.h"
+#include "mesh_lod.h"
+#include "profiler.h"
+#include "resources.h"
+#include "scene.h"
+#include "scene_instances.h"
+#include "scene_stream.h"
+#include "tlsf.h"
+#include "transforms.h"
+// Last, the GL calls of this file go through the frame capture
+#include "gl_capture_hooks.h"
+
 #ifndef DEBUG_PRINT
 #define DEBUG_PRINT 1
 #endif
@@ -60,6 +79,7 @@ GLuint compile_shader_from_file(GLenum shaderType, const char * fileName);
 
 // OpenGL utils
 bool checkError(const char* title);
+float halton(int index, int base);
 
 struct Camera
 {
@@ -94,6 +114,398 @@ const float GUIStates::MOUSE_ZOOM_SPEED = 0.05f;
 const float GUIStates::MOUSE_TURN_SPEED = 0.005f;
 void init_gui_states(GUIStates & guiStates);
 
+struct FramePacing
+{
+    static const int MAX_FRAMES_IN_FLIGHT = 4;
+    enum SwapMode { SWAP_IMMEDIATE = 0, SWAP_VSYNC, SWAP_ADAPTIVE };
+    int maxFramesInFlight;
+    int swapMode;
+    int appliedSwapMode;
+    bool adaptiveSupported;
+    bool lateLatch;
+    float frameRateCap;
+    unsigned int frame;
+    double frameStart;
+    // Per frame slot : fence guarding the slot, time input was latched and
+    // GPU timestamp taken right after the swap
+    GLsync fences[MAX_FRAMES_IN_FLIGHT];
+    double latchTimes[MAX_FRAMES_IN_FLIGHT];
+    GLuint presentQueries[MAX_FRAMES_IN_FLIGHT];
+    bool pending[MAX_FRAMES_IN_FLIGHT];
+    // Offset between GL timestamps and glfwGetTime, in seconds
+    double gpuClockOffset;
+    // Stats, in milliseconds
+    float waitTime;
+    float latency;
+};
+void frame_pacing_init(FramePacing & fp);
+void frame_pacing_begin(FramePacing & fp);
+void frame_pacing_latch(FramePacing & fp);
+void frame_pacing_end(FramePacing & fp, GLFWwindow * window);
+void frame_pacing_shutdown(FramePacing & fp);
+
+enum GpuPass
+{
+    GPU_PASS_SCENE = 0,
+    GPU_PASS_SHADOW,
+    GPU_PASS_LIGHTING,
+    GPU_PASS_POST,
+    GPU_PASS_UPSCALE,
+    GPU_PASS_UI,
+    GPU_PASS_COUNT
+};
+extern const char * const GPU_PASS_NAMES[GPU_PASS_COUNT];
+
+// GPU timestamps taken at pass boundaries, read back a few frames later to
+// avoid stalling the pipeline. A pass marked several times in a frame, once
+// per view, adds up its intervals
+struct GpuTimers
+{
+    static const int FRAME_LATENCY = FramePacing::MAX_FRAMES_IN_FLIGHT + 1;
+    static const int MAX_MARKS = 32;
+    GLuint queries[FRAME_LATENCY][MAX_MARKS + 1];
+    int marks[FRAME_LATENCY][MAX_MARKS];
+    int markCount[FRAME_LATENCY];
+    unsigned int frame;
+    // Times of the last resolved frame, in milliseconds
+    bool resolved;
+    float passTimes[GPU_PASS_COUNT];
+    float frameTime;
+};
+void gpu_timers_init(GpuTimers & timers);
+void gpu_timers_begin_frame(GpuTimers & timers);
+void gpu_timers_mark(GpuTimers & timers, GpuPass pass);
+void gpu_timers_end_frame(GpuTimers & timers);
+void gpu_timers_shutdown(GpuTimers & timers);
+
+#ifdef AOGL_PROFILE
+// Trace captures of the profiler : startup until the scene is streamed, then
+// windows of frames. A capture is written a few frames after its last one,
+// once the GPU timers of that frame are resolved
+struct TraceCapture
+{
+    const char * output;        // of the open capture
+    char framesOutput[256];
+    int firstFrame;
+    int frameCount;             // frames requested and not captured yet
+    int endFrame;               // first frame after the capture, -1 until the scene is streamed for startup
+    int writeFrame;             // -1 while recording
+};
+void trace_capture_init(TraceCapture & tc, const char * startupOutput);
+void trace_capture_request(TraceCapture & tc, const char * output, int firstFrame, int frameCount);
+void trace_capture_frame(TraceCapture & tc, int frameIndex, bool startupDone);
+void trace_capture_shutdown(TraceCapture & tc);
+// Pairs the GL_TIMESTAMP clock with the profiler clock
+void profiler_gpu_sync();
+#endif
+
+// Fragments passing the depth test during the scene pass, read back a few
+// frames later like the timers
+struct OverdrawCounter
+{
+    static const int FRAME_LATENCY = GpuTimers::FRAME_LATENCY;
+    GLuint queries[FRAME_LATENCY];
+    bool pending[FRAME_LATENCY];
+    int pixelCounts[FRAME_LATENCY];
+    unsigned int frame;
+    // Shaded fragments per pixel of the last resolved frame
+    float fragmentsPerPixel;
+};
+void overdraw_counter_init(OverdrawCounter & oc);
+void overdraw_counter_begin(OverdrawCounter & oc, int pixelCount);
+void overdraw_counter_end(OverdrawCounter & oc);
+void overdraw_counter_shutdown(OverdrawCounter & oc);
+
+// Scale applied to the render viewport, driven by measured GPU frame time
+struct ResolutionScaling
+{
+    bool dynamic;
+    float scale;
+    float fixedScale;
+    float minScale;
+    float targetFrameTime;
+    int overBudgetFrames;
+    int underBudgetFrames;
+};
+void resolution_scaling_init(ResolutionScaling & rs);
+void resolution_scaling_update(ResolutionScaling & rs, float gpuFrameTime);
+
+
+// Cascaded shadow maps of the directional light. Static casters are cached
+// and a cascade is only re-rendered when invalidated or when the camera
+// slice it covers leaves the area it was rendered for
+struct ShadowCascades
+{
+    static const int CASCADE_COUNT = 4;
+    static const int SIZE = 1024;
+    GLuint staticTexture;
+    GLuint dynamicTexture;
+    float distance;
+    float margin;
+    float extrusion;
+    // View space far distance of each cascade
+    float splits[CASCADE_COUNT];
+    // World to shadow clip space and bounding sphere each cascade was rendered with
+    glm::mat4 matrices[CASCADE_COUNT];
+    glm::vec3 centers[CASCADE_COUNT];
+    float radii[CASCADE_COUNT];
+    bool valid[CASCADE_COUNT];
+    glm::vec3 direction;
+    int nextFarCascade;
+};
+void shadow_cascades_init(ShadowCascades & sc, ResourceRegistry & resources);
+void shadow_cascades_invalidate(ShadowCascades & sc);
+void shadow_cascades_update(ShadowCascades & sc, const glm::mat4 & projection, const glm::mat4 & worldToView, const glm::vec3 & direction, bool refresh[]);
+void shadow_cascades_shutdown(ShadowCascades & sc, ResourceRegistry & resources);
+
+// Cube shadow maps of the static point lights, one cube per light in a cube
+// map array. Faces are rendered at most FACES_PER_FRAME at a time and kept
+// until the light moves or the cache is invalidated
+struct ShadowAtlas
+{
+    static const int MAX_LIGHTS = 32;
+    static const int SIZE = 256;
+    static const int FACES_PER_FRAME = 12;
+    GLuint texture;
+    int lightCount;
+    float nearPlane;
+    float farPlane;
+    glm::vec3 positions[MAX_LIGHTS];
+    int validFaces[MAX_LIGHTS];
+};
+void shadow_atlas_init(ShadowAtlas & sa, int lightCount, ResourceRegistry & resources);
+void shadow_atlas_invalidate(ShadowAtlas & sa);
+glm::mat4 shadow_atlas_face_matrix(const ShadowAtlas & sa, const glm::vec3 & position, int face);
+void shadow_atlas_shutdown(ShadowAtlas & sa, ResourceRegistry & resources);
+
+// Several cameras drawn by a single scene pass. Each view owns a layer of the
+// G-buffer array textures, scene draws are instanced once per view and a
+// geometry shader routes every instance to its layer and viewport. Lighting
+// and post then run on 2D texture views of each layer, and the outputs are
+// tiled on the back buffer. View 0 is always the camera
+struct MultiView
+{
+    static const int MAX_VIEWS = 8;
+    enum Layout
+    {
+        LAYOUT_STEREO = 0,                  // the camera is the left eye
+        LAYOUT_PANORAMA,                    // the camera turned around its up axis
+        LAYOUT_CUBE,                        // the camera and the 6 faces of a probe at its eye
+        LAYOUT_COUNT
+    };
+    int layerCount;                         // allocated at startup, 0 when disabled
+    int layout;
+    int panoramaViews;
+    float eyeSeparation;
+    GLuint fbo;                             // every layer, through layered attachments
+    GLuint arrays[4];                       // color, normal, depth and velocity, as gbufferTextures
+    GLuint layers[MAX_VIEWS][4];            // 2D views of each layer of the arrays
+    glm::mat4 previousViewProjections[MAX_VIEWS];
+};
+extern const char * MULTI_VIEW_LAYOUT_NAMES[MultiView::LAYOUT_COUNT];
+bool multi_view_init(MultiView & mv, int layerCount, int width, int height, ResourceRegistry & resources);
+// Views of the current layout, no more than the layers
+int multi_view_count(const MultiView & mv);
+void multi_view_cameras(const MultiView & mv, const Camera & camera, const glm::mat4 & projection, glm::mat4 worldToView[], glm::mat4 projections[]);
+// Viewport of a view in its layer, cube faces are square
+glm::ivec2 multi_view_size(const MultiView & mv, int view, int renderWidth, int renderHeight);
+// Back buffer rectangle a view is shown in, x, y, width and height
+glm::ivec4 multi_view_tile(int view, int viewCount, int width, int height);
+void multi_view_shutdown(MultiView & mv, ResourceRegistry & resources);
+
+// Multisampled G-buffer. The scene pass writes every sample, a resolve fills
+// the single sample G-buffer read by post processing, and pixels whose
+// samples differ in depth or normal are marked in a stencil buffer attached
+// to the lighting framebuffer. Lights then run once per pixel outside the
+// mask and once per sample inside it
+struct MsaaGbuffer
+{
+    static const int FRAME_LATENCY = GpuTimers::FRAME_LATENCY;
+    int samples;                            // 0 when disabled
+    GLuint fbo;
+    GLuint textures[4];                     // color, normal, depth and velocity, as gbufferTextures
+    GLuint stencil;                         // depth stencil renderbuffer, 1 on edge pixels
+    float depthThreshold;
+    float normalThreshold;
+    // Edge pixels counted by the classification, read FRAME_LATENCY frames later
+    GLuint queries[FRAME_LATENCY];
+    bool pending[FRAME_LATENCY];
+    int pixelCounts[FRAME_LATENCY];
+    unsigned int frame;
+    float edgeFraction;
+};
+// Samples are clamped to what the formats support, the stencil is attached to lightingFbo
+bool msaa_gbuffer_init(MsaaGbuffer & mg, int samples, int width, int height, GLuint lightingFbo, ResourceRegistry & resources);
+void msaa_gbuffer_edges_begin(MsaaGbuffer & mg, int pixelCount);
+void msaa_gbuffer_edges_end(MsaaGbuffer & mg);
+// Draws a light quad, in two passes split by the edge stencil when samples
+// is not zero. samplesLocation is the Samples uniform of the light program
+void msaa_light_draw(GLuint program, GLint samplesLocation, int samples, GLsizei indexCount);
+void msaa_gbuffer_shutdown(MsaaGbuffer & mg, ResourceRegistry & resources);
+
+// Vertex and index data of the scene in a few large buffers. Arenas are
+// immutable storage when the driver has it and are split into regions by a
+// TLSF allocator. Compaction moves the highest region of an arena to a free
+// block lower down, so that a few bytes at a time the free space gathers at
+// the end of the arenas
+struct BufferRegion
+{
+    int arena;
+    int block;                              // -1 when the region is free
+    int owner;                              // user value, the mesh for the scene
+};
+struct BufferMove
+{
+    int region;
+    size_t from;                            // byte offsets in the arena buffer
+    size_t to;
+};
+struct BufferHeap
+{
+    size_t arenaBytes;
+    size_t alignment;                       // of every region offset
+    ResourceCategory category;
+    std::vector<GLuint> buffers;
+    std::vector<Tlsf> arenas;
+    std::vector<std::vector<int> > blockRegions;  // region of each block handle of each arena
+    std::vector<BufferRegion> regions;
+    std::vector<int> freeRegions;
+    bool immutable;                         // glBufferStorage, else glBufferData
+    size_t movedBytes;
+};
+struct BufferHeapStats
+{
+    int arenas;
+    int regions;
+    size_t capacity;
+    size_t used;
+    size_t largestFree;
+    int freeBlocks;
+    float fragmentation;                    // 1 - largest free block over free bytes
+};
+// alignment is a power of two
+void buffer_heap_init(BufferHeap & heap, size_t arenaBytes, size_t alignment, ResourceCategory category);
+// Region handle, a new arena is created when none has room
+int buffer_heap_alloc(BufferHeap & heap, size_t bytes, int owner, ResourceRegistry & resources);
+void buffer_heap_upload(const BufferHeap & heap, int region, size_t offset, size_t bytes, const void * data);
+inline GLuint buffer_heap_buffer(const BufferHeap & heap, int region) { return heap.buffers[heap.regions[region].arena]; }
+inline size_t buffer_heap_offset(const BufferHeap & heap, int region) { const BufferRegion & r = heap.regions[region]; return tlsf_offset(heap.arenas[r.arena], r.block); }
+void buffer_heap_free(BufferHeap & heap, int region);
+// Moves regions down until maxBytes are copied or nothing moves, buffers
+// and offsets of the moved regions have to be bound again
+void buffer_heap_compact(BufferHeap & heap, size_t maxBytes, std::vector<BufferMove> & moves);
+void buffer_heap_stats(const BufferHeap & heap, BufferHeapStats & stats);
+void buffer_heap_shutdown(BufferHeap & heap, ResourceRegistry & resources);
+// Uploads the light slots of a view to its part of a light region, returns
+// the buffer offset of the first slot
+size_t light_slots_upload(const BufferHeap & heap, int region, int view, const std::vector<unsigned char> & slots);
+// Points a scene vertex array at the regions of a mesh, the vertex region
+// holds positions, then normals, then uvs
+void mesh_vertex_array_bind(GLuint vao, const BufferHeap & heap, int indexRegion, int vertexRegion, unsigned int vertexCount);
+
+// Visibility buffer : the scene pass only writes a draw and triangle id per
+// pixel and the depth. The G-buffer is resolved from the geometry heap, a
+// classification pass writes the material of each pixel as a depth and one
+// quad per material drawn at that depth with an equal depth test fetches the
+// triangle and samples the material once per visible pixel
+struct VisibilityRecord
+{
+    glm::mat4 mvp;
+    glm::mat4 prevMvp;
+    glm::vec4 normalMatrix[3];              // columns
+    glm::vec3 diffuseColor;
+    GLuint material;                        // 0 untextured, material + 1 otherwise
+    GLuint vertexBase;                      // word of the first position in the vertex arena
+    GLuint vertexCount;
+    GLuint indexBase;                       // word of the first index of the level
+    GLuint arenas;                          // index arena, vertex arena << 16
+};
+struct VisibilityBuffer
+{
+    static const int RECORD_TEXELS = sizeof(VisibilityRecord) / 16;
+    static const int MAX_ARENAS = 4;        // heap buffers the resolve reads
+    // Material key k is drawn at depth (k + 1) / MATERIAL_DEPTH_STEPS, 1 is the clear value
+    static const int MATERIAL_DEPTH_STEPS = 65536;
+    static const int MAX_MATERIALS = MATERIAL_DEPTH_STEPS - 2;
+    GLuint fbo;                             // ids and the G-buffer depth
+    GLuint ids;
+    GLuint materialFbo;                     // G-buffer colors and the material depth
+    GLuint materialDepth;
+    GLuint records;                         // records of the frame
+    GLuint recordTextures[2];               // float and integer views of the records
+    size_t recordCapacity;
+    GLuint arenaTextures[MAX_ARENAS];       // views of the heap buffers
+    int arenaCount;
+    GLint maxTexels;
+    std::vector<VisibilityRecord> frameRecords;
+    std::vector<int> frameMaterials;        // keys of the frame in order of appearance
+    std::vector<unsigned int> materialFrames;   // last frame of each key
+    unsigned int frame;
+    int triangleBits;
+};
+bool visibility_buffer_init(VisibilityBuffer & vb, int width, int height, const GLuint * gbufferTextures, ResourceRegistry & resources);
+// Splits the ids between draws and triangles for the frame. False when they
+// do not fit in 32 bits, when the records of the draws do not fit in a texture
+// buffer or when the heap has more arenas than the resolve reads
+bool visibility_buffer_begin(VisibilityBuffer & vb, const BufferHeap & heap, int draws, int maxTriangles);
+// Streams of a mesh and the first index of its level, matrices and material
+// are set per draw
+void visibility_record_geometry(VisibilityRecord & record, const BufferHeap & heap, int indexRegion, int vertexRegion, unsigned int vertexCount, GLuint indexOffset);
+// Draw id of the record
+int visibility_buffer_add(VisibilityBuffer & vb, const VisibilityRecord & record);
+// Records the instances of a draw and points the scene program at them
+void visibility_buffer_add_instances(VisibilityBuffer & vb, VisibilityRecord & record, const glm::mat4 * mvps, const glm::mat4 * prevMvps, const glm::mat3 * normalMatrices, int instances,
+                                     GLuint program, GLint mvpsLocation, GLint drawBaseLocation);
+void visibility_buffer_upload(VisibilityBuffer & vb, ResourceRegistry & resources);
+void visibility_buffer_shutdown(VisibilityBuffer & vb, ResourceRegistry & resources);
+
+
+// Per frame timings recorded by the --benchmark mode
+struct BenchmarkRecord
+{
+    std::vector<float> cpuFrameTimes;
+    std::vector<float> gpuFrameTimes;
+    std::vector<float> passTimes[GPU_PASS_COUNT];
+    std::vector<float> fragmentsPerPixel;
+    int visibilityFrames;                   // measured frames drawn with the visibility buffer
+};
+bool write_benchmark_json(const char * path, const BenchmarkRecord & record, const ResourceRegistry & resources, int width, int height, float scale);
+
+// Output frames of the --batch mode, read back into a ring of pixel buffers.
+// A slot is mapped once its fence has passed, so the GPU never waits on the
+// readback, and its pixels go to the encoder workers. The output pass draws
+// to an offscreen framebuffer : the back buffer of a hidden window may fail
+// the pixel ownership test and read back undefined pixels
+struct BatchReadback
+{
+    static const int RING_SIZE = 4;
+    GLuint fbo;                 // output of the frame in place of the back buffer
+    GLuint color;
+    GLuint buffers[RING_SIZE];
+    GLsync fences[RING_SIZE];
+    int frames[RING_SIZE];      // -1 when the slot is free
+    int head;                   // next slot read into, the oldest one when busy
+    int width;
+    int height;
+    int stalls;                 // slots waited on because the ring was full
+};
+bool batch_readback_init(BatchReadback & br, int width, int height, ResourceRegistry & resources);
+// Reads the output framebuffer, hands the frames whose readback is done to the encoder
+void batch_readback_push(BatchReadback & br, int frame, FrameEncoder & encoder);
+void batch_readback_flush(BatchReadback & br, FrameEncoder & encoder);
+void batch_readback_shutdown(BatchReadback & br, ResourceRegistry & resources);
+
+// Debug heatmaps drawn over the frame
+enum DebugView
+{
+    DEBUG_VIEW_NONE = 0,
+    DEBUG_VIEW_LIGHT_COUNT,
+    DEBUG_VIEW_OVERDRAW,
+    DEBUG_VIEW_TILE_COST,
+    DEBUG_VIEW_COUNT
+};
+extern const char * const DEBUG_VIEW_NAMES[DEBUG_VIEW_COUNT];
+
 
 
 
@@ -103,7 +515,112 @@ int main( int argc, char **argv )
     float widthf = (float) width, heightf = (float) height;
     double t;
 
+    // Command line : --benchmark <frames> runs in a hidden window for a fixed
+    // number of frames and writes per frame and per pass timings to --output
+    int benchmarkFrames = 0;
+    const char * benchmarkOutput = "benchmark.json";
+    float fixedScale = 0.f;
+    bool depthPrepass = false;
+    bool forceAssimp = false;
+    // --static-batch <cells> merges the meshes sharing a material in each cell
+    // of a grid of that many cells along the longest side of the scene
+    int staticBatchCells = 0;
+    // --instances <triangles> makes copies of the pieces of geometry repeated
+    // in the scene with at least that many triangles, drawn instanced
+    int instanceMinTriangles = 0;
+    // --trace <file.json> writes a profiler trace of the startup, up to the
+    // scene being streamed, --trace-frames <first> <count> <file.json> one of
+    // a window of frames. Both need a build with AOGL_PROFILE
+    const char * traceStartupOutput = NULL;
+    const char * traceFramesOutput = NULL;
+    int traceFirstFrame = 0;
+    int traceFrameCount = 0;
+    // --capture <frame> <file.aoglcap> records the GL calls of a frame for aogl_replay
+    int captureFrame = -1;
+    std::string captureOutput;
+    // --batch <frames> <output> renders the camera path in a hidden window to
+    // an image sequence, png files named by a printf pattern or a single .y4m.
+    // The window still needs a display, Xvfb on a machine without one
+    int batchFrames = 0;
+    const char * batchOutput = NULL;
+    int batchFps = 60;
+    int batchThreads = std::max((int) std::thread::hardware_concurrency() - 1, 1);
+    // --views <count> draws up to that many cameras per frame with a single
+    // scene pass and tiles them on the window
+    int multiViewLayers = 0;
+    // --msaa <samples> renders a multisampled G-buffer, edge pixels are lit per sample
+    int msaaSamples = 0;
+    // --visibility starts with the visibility buffer in place of the scene pass G-buffer
+    bool visibilityEnabled = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--benchmark") && i + 1 < argc)
+            benchmarkFrames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            benchmarkOutput = argv[++i];
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+            fixedScale = (float) atof(argv[++i]);
+        else if (!strcmp(argv[i], "--prepass"))
+            depthPrepass = true;
+        else if (!strcmp(argv[i], "--assimp"))
+            forceAssimp = true;
+        else if (!strcmp(argv[i], "--static-batch") && i + 1 < argc)
+            staticBatchCells = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--instances") && i + 1 < argc)
+            instanceMinTriangles = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+            traceStartupOutput = argv[++i];
+        else if (!strcmp(argv[i], "--trace-frames") && i + 3 < argc)
+        {
+            traceFirstFrame = atoi(argv[++i]);
+            traceFrameCount = atoi(argv[++i]);
+            traceFramesOutput = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--batch") && i + 2 < argc)
+        {
+            batchFrames = atoi(argv[++i]);
+            batchOutput = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--batch-fps") && i + 1 < argc)
+            batchFps = std::max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "--batch-threads") && i + 1 < argc)
+            batchThreads = std::max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "--views") && i + 1 < argc)
+            multiViewLayers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--msaa") && i + 1 < argc)
+            msaaSamples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--visibility"))
+            visibilityEnabled = true;
+        else if (!strcmp(argv[i], "--capture") && i + 2 < argc)
+        {
+            captureFrame = atoi(argv[++i]);
+            captureOutput = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage : %s [--benchmark <frames>] [--output <file.json>] [--scale <fixed resolution scale>] [--prepass] [--assimp] [--static-batch <cells>] [--instances <min triangles>] [--trace <file.json>] [--trace-frames <first> <count> <file.json>] [--capture <frame> <file.aoglcap>] [--batch <frames> <frame_%%05d.png|file.y4m>] [--batch-fps <fps>] [--batch-threads <count>] [--views <2 to 8>] [--msaa <samples>] [--visibility]\n", argv[0]);
+            exit( EXIT_FAILURE );
+        }
+    }
+    bool benchmark = benchmarkFrames > 0;
+    bool batch = batchFrames > 0 && batchOutput;
+
+#ifdef AOGL_PROFILE
+    PROFILE_THREAD("main");
+    TraceCapture traceCapture;
+    trace_capture_init(traceCapture, traceStartupOutput);
+    if (traceFramesOutput)
+        trace_capture_request(traceCapture, traceFramesOutput, traceFirstFrame, traceFrameCount);
+    int traceUiFrameCount = 60;
+#else
+    if (traceStartupOutput)
+        fprintf(stderr, "Warning: built without AOGL_PROFILE, %s is not written\n", traceStartupOutput);
+    if (traceFramesOutput)
+        fprintf(stderr, "Warning: built without AOGL_PROFILE, frames %d to %d are not written to %s\n", traceFirstFrame, traceFirstFrame + traceFrameCount - 1, traceFramesOutput);
+#endif
+
     // Initialise GLFW
+    PROFILE_PHASE_BEGIN(glfwZone, "glfw init");
     if( !glfwInit() )
     {
         fprintf( stderr, "Failed to initialize GLFW\n" );
@@ -111,7 +628,7 @@ int main( int argc, char **argv )
     }
     glfwInit();
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-    glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, benchmark || batch ? GL_FALSE : GL_TRUE);
     glfwWindowHint(GLFW_DECORATED, GL_TRUE);
     glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -137,8 +654,10 @@ int main( int argc, char **argv )
         exit( EXIT_FAILURE );
     }
     glfwMakeContextCurrent(window);
+    PROFILE_PHASE_END(glfwZone);
 
     // Init glew
+    PROFILE_PHASE_BEGIN(glewZone, "glew init");
     glewExperimental = GL_TRUE;
     GLenum err = glewInit();
     if (GLEW_OK != err)
@@ -147,30 +666,49 @@ int main( int argc, char **argv )
           fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
           exit( EXIT_FAILURE );
     }
+    PROFILE_PHASE_END(glewZone);
+#ifdef AOGL_PROFILE
+    if (profiler_capture_open())
+        profiler_gpu_sync();
+#endif
 
     // Ensure we can capture the escape key being pressed below
     glfwSetInputMode( window, GLFW_STICKY_KEYS, GL_TRUE );
 
-    // Enable vertical sync (on cards that support it)
+    // Enable vertical sync (on cards that support it), frame pacing applies
+    // the requested swap interval at the end of each frame
     glfwSwapInterval( 1 );
     GLenum glerr = GL_NO_ERROR;
     glerr = glGetError();
     if (glerr != GL_NO_ERROR)
         std::cerr<<glerr;
 
+    PROFILE_PHASE_BEGIN(imguiZone, "imgui init");
     ImGui_ImplGlfwGL3_Init(window, true);
+    // The UI is drawn last, straight to the default framebuffer with blending and depth test off
+    ImGui_ImplGlfwGL3Cached_Init();
+    ImGui_ImplGlfwGL3Cached_HostState uiHostState = { 0, false, false, false };
+    ImGui_ImplGlfwGL3Cached_SetHostState(uiHostState);
+    bool uiOverlayCaching = true;
+    ImGui_ImplGlfwGL3Cached_Stats uiStats;
+    ImGui_ImplGlfwGL3Cached_GetStats(&uiStats);
+    PROFILE_PHASE_END(imguiZone);
 
     // Init viewer structures
     Camera camera;
     camera_defaults(camera);
     GUIStates guiStates;
     init_gui_states(guiStates);
-    float instanceCount = 2500;
+    int instanceCount = 0;
+    float instanceSpacing = 2.f;
     int pointLightCount = 0;
     int directionalLightCount = 1;
     //int spotLightCount = 0;
     float speed = 1.f;
     float gamma = 1.f;
+    float exposure = 1.f;
+    int tonemapOperator = 2;
+    const char * TONEMAP_NAMES[] = { "Clamp", "Reinhard", "ACES filmic" };
     float factor = 0.1f;
     int sampleCount = 10.0;
     float focusPlane = 5.0;
@@ -185,7 +723,11 @@ int main( int argc, char **argv )
     float B = 0.5;
     float I = 1;
 
+    ResourceRegistry resources;
+    resource_registry_init(resources);
+
     // Load images and upload textures
+    PROFILE_PHASE_BEGIN(texturesZone, "textures");
     GLuint textures[2];
     glGenTextures(2, textures);
     int x;
@@ -201,6 +743,8 @@ int main( int argc, char **argv )
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glGenerateMipmap(GL_TEXTURE_2D);
+    resource_track(resources, GL_TEXTURE, textures[0], RESOURCE_MATERIAL_TEXTURES, texture_bytes(GL_RGB, x, y, 1, true));
+    stbi_image_free(diffuse);
     unsigned char * spec = stbi_load("textures/spnza_bricks_a_spec.tga", &x, &y, &comp, 1);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, textures[1]);
@@ -210,9 +754,13 @@ int main( int argc, char **argv )
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glGenerateMipmap(GL_TEXTURE_2D);
+    resource_track(resources, GL_TEXTURE, textures[1], RESOURCE_MATERIAL_TEXTURES, texture_bytes(GL_RED, x, y, 1, true));
+    stbi_image_free(spec);
     checkError("Texture Initialization");
+    PROFILE_PHASE_END(texturesZone);
 
     // Try to load and compile blit shaders
+    PROFILE_PHASE_BEGIN(shadersZone, "shaders");
     GLuint vertBlitShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "blit.vert");
     GLuint fragBlitShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "blit.frag");
     GLuint blitProgramObject = glCreateProgram();
@@ -224,24 +772,101 @@ int main( int argc, char **argv )
     GLuint blitTextureLocation = glGetUniformLocation(blitProgramObject, "Texture");
     glProgramUniform1i(blitProgramObject, blitTextureLocation, 0);
 
+    // The instanced field fetches its transforms from shader storage buffers
+    // filled by compute shaders, which needs an OpenGL 4.3 context
+    bool instancingSupported = GLEW_VERSION_4_3 != 0;
+    if (!instancingSupported)
+        fprintf(stderr, "OpenGL 4.3 not available, instanced field disabled\n");
+
     // Try to load and compile gbuffer shaders
-    GLuint vertgbufferShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "gbuffer.vert");
-    GLuint fraggbufferShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "gbuffer.frag");
-    GLuint gbufferProgramObject = glCreateProgram();
-    glAttachShader(gbufferProgramObject, vertgbufferShaderId);
-    glAttachShader(gbufferProgramObject, fraggbufferShaderId);
-    glLinkProgram(gbufferProgramObject);
-    if (check_link_error(gbufferProgramObject) < 0)
+    GLuint gbufferProgramObject = 0;
+    GLuint mvpLocation = 0;
+    GLuint mvLocation = 0;
+    GLuint prevMvpLocation = 0;
+    GLuint jitterLocation = 0;
+    GLuint diffuseLocation = 0;
+    GLuint specLocation = 0;
+    GLuint specularPowerLocation = 0;
+    if (instancingSupported)
+    {
+        GLuint vertgbufferShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "gbuffer.vert");
+        GLuint fraggbufferShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "gbuffer.frag");
+        gbufferProgramObject = glCreateProgram();
+        glAttachShader(gbufferProgramObject, vertgbufferShaderId);
+        glAttachShader(gbufferProgramObject, fraggbufferShaderId);
+        glLinkProgram(gbufferProgramObject);
+        if (check_link_error(gbufferProgramObject) < 0)
+            exit(1);
+        mvpLocation = glGetUniformLocation(gbufferProgramObject, "MVP");
+        mvLocation = glGetUniformLocation(gbufferProgramObject, "MV");
+        prevMvpLocation = glGetUniformLocation(gbufferProgramObject, "PrevMVP");
+        jitterLocation = glGetUniformLocation(gbufferProgramObject, "Jitter");
+        diffuseLocation = glGetUniformLocation(gbufferProgramObject, "Diffuse");
+        specLocation = glGetUniformLocation(gbufferProgramObject, "Specular");
+        specularPowerLocation = glGetUniformLocation(gbufferProgramObject, "SpecularPower");
+        glProgramUniform1i(gbufferProgramObject, diffuseLocation, 0);
+        glProgramUniform1i(gbufferProgramObject, specLocation, 1);
+    }
+
+    // Try to load and compile instance update and culling compute shaders
+    GLuint instancesProgramObject = 0;
+    GLuint instancesTimeLocation = 0;
+    GLuint instancesCountLocation = 0;
+    GLuint instancesSideLocation = 0;
+    GLuint instancesSpacingLocation = 0;
+    GLuint instanceCullProgramObject = 0;
+    GLuint instanceCullCountLocation = 0;
+    GLuint instanceCullRadiusLocation = 0;
+    GLuint instanceCullPlanesLocation = 0;
+    if (instancingSupported)
+    {
+        GLuint compInstancesShaderId = compile_shader_from_file(GL_COMPUTE_SHADER, "instances.comp");
+        instancesProgramObject = glCreateProgram();
+        glAttachShader(instancesProgramObject, compInstancesShaderId);
+        glLinkProgram(instancesProgramObject);
+        if (check_link_error(instancesProgramObject) < 0)
+            exit(1);
+        instancesTimeLocation = glGetUniformLocation(instancesProgramObject, "Time");
+        instancesCountLocation = glGetUniformLocation(instancesProgramObject, "InstanceCount");
+        instancesSideLocation = glGetUniformLocation(instancesProgramObject, "Side");
+        instancesSpacingLocation = glGetUniformLocation(instancesProgramObject, "Spacing");
+
+        GLuint compInstanceCullShaderId = compile_shader_from_file(GL_COMPUTE_SHADER, "instancecull.comp");
+        instanceCullProgramObject = glCreateProgram();
+        glAttachShader(instanceCullProgramObject, compInstanceCullShaderId);
+        glLinkProgram(instanceCullProgramObject);
+        if (check_link_error(instanceCullProgramObject) < 0)
+            exit(1);
+        instanceCullCountLocation = glGetUniformLocation(instanceCullProgramObject, "InstanceCount");
+        instanceCullRadiusLocation = glGetUniformLocation(instanceCullProgramObject, "Radius");
+        instanceCullPlanesLocation = glGetUniformLocation(instanceCullProgramObject, "Planes");
+    }
+
+    // Try to load and compile shadow shaders
+    GLuint vertShadowShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "shadow.vert");
+    GLuint fragShadowShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "shadow.frag");
+    GLuint shadowProgramObject = glCreateProgram();
+    glAttachShader(shadowProgramObject, vertShadowShaderId);
+    glAttachShader(shadowProgramObject, fragShadowShaderId);
+    glLinkProgram(shadowProgramObject);
+    if (check_link_error(shadowProgramObject) < 0)
         exit(1);
-    GLuint mvpLocation = glGetUniformLocation(gbufferProgramObject, "MVP");
-    GLuint mvLocation = glGetUniformLocation(gbufferProgramObject, "MV");
-    GLuint timeLocation = glGetUniformLocation(gbufferProgramObject, "Time");
-    GLuint diffuseLocation = glGetUniformLocation(gbufferProgramObject, "Diffuse");
-    GLuint specLocation = glGetUniformLocation(gbufferProgramObject, "Specular");
-    GLuint specularPowerLocation = glGetUniformLocation(gbufferProgramObject, "SpecularPower");
-    GLuint instanceCountLocation = glGetUniformLocation(gbufferProgramObject, "InstanceCount");
-    glProgramUniform1i(gbufferProgramObject, diffuseLocation, 0);
-    glProgramUniform1i(gbufferProgramObject, specLocation, 1);
+    GLuint shadowMvpLocation = glGetUniformLocation(shadowProgramObject, "MVP");
+
+    // Dynamic casters are the instanced field
+    GLuint shadowInstancedProgramObject = 0;
+    GLuint shadowInstancedMvpLocation = 0;
+    if (instancingSupported)
+    {
+        GLuint vertShadowInstancedShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "shadowinstanced.vert");
+        shadowInstancedProgramObject = glCreateProgram();
+        glAttachShader(shadowInstancedProgramObject, vertShadowInstancedShaderId);
+        glAttachShader(shadowInstancedProgramObject, fragShadowShaderId);
+        glLinkProgram(shadowInstancedProgramObject);
+        if (check_link_error(shadowInstancedProgramObject) < 0)
+            exit(1);
+        shadowInstancedMvpLocation = glGetUniformLocation(shadowInstancedProgramObject, "MVP");
+    }
 
     // Try to load and compile pointlight shaders
     GLuint fragpointlightShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "pointlight.frag");
@@ -256,9 +881,17 @@ int main( int argc, char **argv )
     GLuint pointlightDepthLocation = glGetUniformLocation(pointlightProgramObject, "DepthBuffer");
     GLuint pointlightLightLocation = glGetUniformBlockIndex(pointlightProgramObject, "light");
     GLuint pointInverseProjectionLocation = glGetUniformLocation(pointlightProgramObject, "InverseProjection");
+    GLuint pointViewToWorldLocation = glGetUniformLocation(pointlightProgramObject, "ViewToWorld");
+    GLuint pointShadowNearLocation = glGetUniformLocation(pointlightProgramObject, "ShadowNear");
+    GLuint pointShadowFarLocation = glGetUniformLocation(pointlightProgramObject, "ShadowFar");
     glProgramUniform1i(pointlightProgramObject, pointlightColorLocation, 0);
     glProgramUniform1i(pointlightProgramObject, pointlightNormalLocation, 1);
     glProgramUniform1i(pointlightProgramObject, pointlightDepthLocation, 2);
+    glProgramUniform1i(pointlightProgramObject, glGetUniformLocation(pointlightProgramObject, "ShadowMap"), 3);
+    glProgramUniform1i(pointlightProgramObject, glGetUniformLocation(pointlightProgramObject, "ColorSamples"), 5);
+    glProgramUniform1i(pointlightProgramObject, glGetUniformLocation(pointlightProgramObject, "NormalSamples"), 6);
+    glProgramUniform1i(pointlightProgramObject, glGetUniformLocation(pointlightProgramObject, "DepthSamples"), 7);
+    GLuint pointSamplesLocation = glGetUniformLocation(pointlightProgramObject, "Samples");
 
     // Try to load and compile directionallight shaders
     GLuint fragdirectionallightShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "directionallight.frag");
@@ -273,9 +906,19 @@ int main( int argc, char **argv )
     GLuint directionallightDepthLocation = glGetUniformLocation(directionallightProgramObject, "DepthBuffer");
     GLuint directionallightLightLocation = glGetUniformBlockIndex(directionallightProgramObject, "light");
     GLuint directionalInverseProjectionLocation = glGetUniformLocation(directionallightProgramObject, "InverseProjection");
+    GLuint directionalShadowsLocation = glGetUniformLocation(directionallightProgramObject, "Shadows");
+    GLuint directionalDynamicShadowsLocation = glGetUniformLocation(directionallightProgramObject, "DynamicShadows");
+    GLuint directionalViewToShadowLocation = glGetUniformLocation(directionallightProgramObject, "ViewToShadow");
+    GLuint directionalCascadeSplitsLocation = glGetUniformLocation(directionallightProgramObject, "CascadeSplits");
     glProgramUniform1i(directionallightProgramObject, directionallightColorLocation, 0);
     glProgramUniform1i(directionallightProgramObject, directionallightNormalLocation, 1);
     glProgramUniform1i(directionallightProgramObject, directionallightDepthLocation, 2);
+    glProgramUniform1i(directionallightProgramObject, glGetUniformLocation(directionallightProgramObject, "ShadowMap"), 3);
+    glProgramUniform1i(directionallightProgramObject, glGetUniformLocation(directionallightProgramObject, "DynamicShadowMap"), 4);
+    glProgramUniform1i(directionallightProgramObject, glGetUniformLocation(directionallightProgramObject, "ColorSamples"), 5);
+    glProgramUniform1i(directionallightProgramObject, glGetUniformLocation(directionallightProgramObject, "NormalSamples"), 6);
+    glProgramUniform1i(directionallightProgramObject, glGetUniformLocation(directionallightProgramObject, "DepthSamples"), 7);
+    GLuint directionalSamplesLocation = glGetUniformLocation(directionallightProgramObject, "Samples");
 
     // Try to load and compile spotlight shaders
     GLuint fragspotlightShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "spotlight.frag");
@@ -304,6 +947,21 @@ int main( int argc, char **argv )
     GLuint gammaTextureLocation = glGetUniformLocation(gammaProgramObject, "Texture");
     glProgramUniform1i(gammaProgramObject, gammaTextureLocation, 0);
     GLuint gammaGammaLocation = glGetUniformLocation(gammaProgramObject, "Gamma");
+    GLuint gammaSharpenLocation = glGetUniformLocation(gammaProgramObject, "Sharpen");
+    GLuint gammaSharpnessLocation = glGetUniformLocation(gammaProgramObject, "Sharpness");
+    GLuint gammaExposureLocation = glGetUniformLocation(gammaProgramObject, "Exposure");
+    GLuint gammaTonemapLocation = glGetUniformLocation(gammaProgramObject, "Tonemap");
+
+    // Try to load and compile upscale shaders
+    GLuint fragUpscaleShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "upscale.frag");
+    GLuint upscaleProgramObject = glCreateProgram();
+    glAttachShader(upscaleProgramObject, vertBlitShaderId);
+    glAttachShader(upscaleProgramObject, fragUpscaleShaderId);
+    glLinkProgram(upscaleProgramObject);
+    if (check_link_error(upscaleProgramObject) < 0)
+        exit(1);
+    GLuint upscaleTextureLocation = glGetUniformLocation(upscaleProgramObject, "Texture");
+    glProgramUniform1i(upscaleProgramObject, upscaleTextureLocation, 0);
 
     // Try to load and compile freichen shaders
     //GLuint fragfreichenlightShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "freichen.frag");
@@ -318,6 +976,33 @@ int main( int argc, char **argv )
     glProgramUniform1i(freichenProgramObject, freichenTextureLocation, 0);
     GLuint freichenFactorLocation = glGetUniformLocation(freichenProgramObject, "Factor");
 
+    // Try to load and compile the multisampled G-buffer resolve and edge classification shaders
+    GLuint fragMsaaResolveShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "msaaresolve.frag");
+    GLuint msaaResolveProgramObject = glCreateProgram();
+    glAttachShader(msaaResolveProgramObject, vertBlitShaderId);
+    glAttachShader(msaaResolveProgramObject, fragMsaaResolveShaderId);
+    glLinkProgram(msaaResolveProgramObject);
+    if (check_link_error(msaaResolveProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(msaaResolveProgramObject, glGetUniformLocation(msaaResolveProgramObject, "ColorSamples"), 0);
+    glProgramUniform1i(msaaResolveProgramObject, glGetUniformLocation(msaaResolveProgramObject, "NormalSamples"), 1);
+    glProgramUniform1i(msaaResolveProgramObject, glGetUniformLocation(msaaResolveProgramObject, "DepthSamples"), 2);
+    glProgramUniform1i(msaaResolveProgramObject, glGetUniformLocation(msaaResolveProgramObject, "VelocitySamples"), 3);
+    GLuint msaaResolveSamplesLocation = glGetUniformLocation(msaaResolveProgramObject, "Samples");
+    GLuint fragMsaaEdgesShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "msaaedges.frag");
+    GLuint msaaEdgesProgramObject = glCreateProgram();
+    glAttachShader(msaaEdgesProgramObject, vertBlitShaderId);
+    glAttachShader(msaaEdgesProgramObject, fragMsaaEdgesShaderId);
+    glLinkProgram(msaaEdgesProgramObject);
+    if (check_link_error(msaaEdgesProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(msaaEdgesProgramObject, glGetUniformLocation(msaaEdgesProgramObject, "NormalSamples"), 1);
+    glProgramUniform1i(msaaEdgesProgramObject, glGetUniformLocation(msaaEdgesProgramObject, "DepthSamples"), 2);
+    GLuint msaaEdgesSamplesLocation = glGetUniformLocation(msaaEdgesProgramObject, "Samples");
+    GLuint msaaEdgesInverseProjectionLocation = glGetUniformLocation(msaaEdgesProgramObject, "InverseProjection");
+    GLuint msaaEdgesDepthThresholdLocation = glGetUniformLocation(msaaEdgesProgramObject, "DepthThreshold");
+    GLuint msaaEdgesNormalThresholdLocation = glGetUniformLocation(msaaEdgesProgramObject, "NormalThreshold");
+
     // Try to load and compile blur shaders
     GLuint fragblurlightShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "blur.frag");
     GLuint blurProgramObject = glCreateProgram();
@@ -359,6 +1044,102 @@ int main( int argc, char **argv )
     GLuint dofBlurLocation = glGetUniformLocation(dofProgramObject, "Blur");
     glProgramUniform1i(dofProgramObject, dofBlurLocation, 2);
 
+    // Try to load and compile temporal blur shaders
+    GLuint fragTemporalBlurShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "temporalblur.frag");
+    GLuint temporalBlurProgramObject = glCreateProgram();
+    glAttachShader(temporalBlurProgramObject, vertBlitShaderId);
+    glAttachShader(temporalBlurProgramObject, fragTemporalBlurShaderId);
+    glLinkProgram(temporalBlurProgramObject);
+    if (check_link_error(temporalBlurProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(temporalBlurProgramObject, glGetUniformLocation(temporalBlurProgramObject, "Texture"), 0);
+    glProgramUniform1i(temporalBlurProgramObject, glGetUniformLocation(temporalBlurProgramObject, "History"), 1);
+    glProgramUniform1i(temporalBlurProgramObject, glGetUniformLocation(temporalBlurProgramObject, "Velocity"), 2);
+    glProgramUniform1i(temporalBlurProgramObject, glGetUniformLocation(temporalBlurProgramObject, "Depth"), 3);
+    GLuint temporalBlurSampleCountLocation = glGetUniformLocation(temporalBlurProgramObject, "SampleCount");
+    GLuint temporalBlurFrameLocation = glGetUniformLocation(temporalBlurProgramObject, "Frame");
+    GLuint temporalBlurFeedbackLocation = glGetUniformLocation(temporalBlurProgramObject, "Feedback");
+    GLuint temporalBlurHistoryValidLocation = glGetUniformLocation(temporalBlurProgramObject, "HistoryValid");
+    GLuint temporalBlurCurrentToPreviousLocation = glGetUniformLocation(temporalBlurProgramObject, "CurrentToPrevious");
+    GLuint temporalBlurJitterLocation = glGetUniformLocation(temporalBlurProgramObject, "Jitter");
+
+    // Try to load and compile taa shaders
+    GLuint fragTaaShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "taa.frag");
+    GLuint taaProgramObject = glCreateProgram();
+    glAttachShader(taaProgramObject, vertBlitShaderId);
+    glAttachShader(taaProgramObject, fragTaaShaderId);
+    glLinkProgram(taaProgramObject);
+    if (check_link_error(taaProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(taaProgramObject, glGetUniformLocation(taaProgramObject, "Texture"), 0);
+    glProgramUniform1i(taaProgramObject, glGetUniformLocation(taaProgramObject, "History"), 1);
+    glProgramUniform1i(taaProgramObject, glGetUniformLocation(taaProgramObject, "Velocity"), 2);
+    glProgramUniform1i(taaProgramObject, glGetUniformLocation(taaProgramObject, "Depth"), 3);
+    GLuint taaFeedbackLocation = glGetUniformLocation(taaProgramObject, "Feedback");
+    GLuint taaHistoryValidLocation = glGetUniformLocation(taaProgramObject, "HistoryValid");
+    GLuint taaCurrentToPreviousLocation = glGetUniformLocation(taaProgramObject, "CurrentToPrevious");
+    GLuint taaJitterLocation = glGetUniformLocation(taaProgramObject, "Jitter");
+
+    // Try to load and compile debug view shaders
+    GLuint fragLightCountShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "lightcount.frag");
+    GLuint lightCountProgramObject = glCreateProgram();
+    glAttachShader(lightCountProgramObject, vertBlitShaderId);
+    glAttachShader(lightCountProgramObject, fragLightCountShaderId);
+    glLinkProgram(lightCountProgramObject);
+    if (check_link_error(lightCountProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(lightCountProgramObject, glGetUniformLocation(lightCountProgramObject, "DepthBuffer"), 0);
+    GLuint lightCountInverseProjectionLocation = glGetUniformLocation(lightCountProgramObject, "InverseProjection");
+    GLuint lightCountLightsLocation = glGetUniformLocation(lightCountProgramObject, "Lights");
+    GLuint lightCountLightCountLocation = glGetUniformLocation(lightCountProgramObject, "LightCount");
+    GLuint lightCountDirectionalLightCountLocation = glGetUniformLocation(lightCountProgramObject, "DirectionalLightCount");
+
+    GLuint fragOverdrawShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "overdraw.frag");
+    GLuint overdrawProgramObject = glCreateProgram();
+    glAttachShader(overdrawProgramObject, vertShadowShaderId);
+    glAttachShader(overdrawProgramObject, fragOverdrawShaderId);
+    glLinkProgram(overdrawProgramObject);
+    if (check_link_error(overdrawProgramObject) < 0)
+        exit(1);
+    GLuint overdrawMvpLocation = glGetUniformLocation(overdrawProgramObject, "MVP");
+
+    GLuint fragTileCostShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "tilecost.frag");
+    GLuint tileCostProgramObject = glCreateProgram();
+    glAttachShader(tileCostProgramObject, vertBlitShaderId);
+    glAttachShader(tileCostProgramObject, fragTileCostShaderId);
+    glLinkProgram(tileCostProgramObject);
+    if (check_link_error(tileCostProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(tileCostProgramObject, glGetUniformLocation(tileCostProgramObject, "LightCount"), 0);
+    glProgramUniform1i(tileCostProgramObject, glGetUniformLocation(tileCostProgramObject, "Overdraw"), 1);
+    GLuint tileCostTileSizeLocation = glGetUniformLocation(tileCostProgramObject, "TileSize");
+    GLuint tileCostRenderSizeLocation = glGetUniformLocation(tileCostProgramObject, "RenderSize");
+
+    GLuint fragHeatmapShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "heatmap.frag");
+    GLuint heatmapProgramObject = glCreateProgram();
+    glAttachShader(heatmapProgramObject, vertBlitShaderId);
+    glAttachShader(heatmapProgramObject, fragHeatmapShaderId);
+    glLinkProgram(heatmapProgramObject);
+    if (check_link_error(heatmapProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(heatmapProgramObject, glGetUniformLocation(heatmapProgramObject, "LightCount"), 0);
+    glProgramUniform1i(heatmapProgramObject, glGetUniformLocation(heatmapProgramObject, "Overdraw"), 1);
+    glProgramUniform1i(heatmapProgramObject, glGetUniformLocation(heatmapProgramObject, "Tiles"), 2);
+    GLuint heatmapModeLocation = glGetUniformLocation(heatmapProgramObject, "Mode");
+    GLuint heatmapMaxValueLocation = glGetUniformLocation(heatmapProgramObject, "MaxValue");
+    GLuint heatmapTileSizeLocation = glGetUniformLocation(heatmapProgramObject, "TileSize");
+    GLuint heatmapRenderSizeLocation = glGetUniformLocation(heatmapProgramObject, "RenderSize");
+
+    // Programs running inside the scaled viewport, they read the fraction of
+    // the render targets covered by it
+    GLuint scaledPrograms[] = { pointlightProgramObject, directionallightProgramObject, spotlightProgramObject,
+                                freichenProgramObject, blurProgramObject, cocProgramObject, dofProgramObject, upscaleProgramObject,
+                                temporalBlurProgramObject, taaProgramObject, lightCountProgramObject, heatmapProgramObject };
+    const int SCALED_PROGRAM_COUNT = sizeof(scaledPrograms) / sizeof(GLuint);
+    GLuint scaledProgramsViewportScaleLocations[SCALED_PROGRAM_COUNT];
+    for (int i = 0; i < SCALED_PROGRAM_COUNT; ++i)
+        scaledProgramsViewportScaleLocations[i] = glGetUniformLocation(scaledPrograms[i], "ViewportScale");
+
    
    // Try to load and compile objects shaders
     GLuint vertSceneShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "trineGL.vert");
@@ -379,143 +1160,161 @@ int main( int argc, char **argv )
     GLuint specLocation2 = glGetUniformLocation(sceneProgramObject, "Specular");
     GLuint lightLocation2 = glGetUniformLocation(sceneProgramObject, "Light");
     GLuint specularPowerLocation2 = glGetUniformLocation(sceneProgramObject, "SpecularPower");
-    GLuint instanceCountLocation2 = glGetUniformLocation(sceneProgramObject, "InstanceCount");
+    GLuint prevMvpLocation2 = glGetUniformLocation(sceneProgramObject, "PrevMVP");
+    GLuint jitterLocation2 = glGetUniformLocation(sceneProgramObject, "Jitter");
     glProgramUniform1i(sceneProgramObject, diffuseLocation2, 0);
     glProgramUniform1i(sceneProgramObject, specLocation2, 1);
 
-
-   if (!checkError("Shaders"))
+    // Copies of repeated geometry, the fragment shader of the scene program
+    const int MAX_SCENE_INSTANCES = 16; // MAX_INSTANCES of trineGLinstanced.vert
+    GLuint vertSceneInstancedShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "trineGLinstanced.vert");
+    GLuint sceneInstancedProgramObject = glCreateProgram();
+    glAttachShader(sceneInstancedProgramObject, vertSceneInstancedShaderId);
+    glAttachShader(sceneInstancedProgramObject, fragSceneShaderId);
+    glLinkProgram(sceneInstancedProgramObject);
+    if (check_link_error(sceneInstancedProgramObject) < 0)
         exit(1);
-
-
-    // Load the scene
-    const aiScene* scene = NULL;
-
-    std::string pathFile3D = "./scene_v4/scene_v4.obj";
-
-    const char * charPathFile3D = pathFile3D.c_str();
-
-    scene = aiImportFile(charPathFile3D, aiProcessPreset_TargetRealtime_MaxQuality);
-
-    if (!scene) {
-          fprintf(stderr, "Error: impossible to open the scene\n");
-          exit( EXIT_FAILURE );
+    GLuint sceneInstancedMvpsLocation = glGetUniformLocation(sceneInstancedProgramObject, "MVPs");
+    GLuint sceneInstancedPrevMvpsLocation = glGetUniformLocation(sceneInstancedProgramObject, "PrevMVPs");
+    GLuint sceneInstancedNormalMatricesLocation = glGetUniformLocation(sceneInstancedProgramObject, "NormalMatrices");
+    GLuint sceneInstancedDiffuseColorLocation = glGetUniformLocation(sceneInstancedProgramObject, "DiffuseColor");
+    GLuint sceneInstancedJitterLocation = glGetUniformLocation(sceneInstancedProgramObject, "Jitter");
+    glProgramUniform1i(sceneInstancedProgramObject, glGetUniformLocation(sceneInstancedProgramObject, "Diffuse"), 0);
+
+    // Visibility buffer scene pass, material classification and resolve. The
+    // resolve reads the ids, the records and the heap arenas from units 1 to 7
+    GLuint vertVisibilityShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "visibility.vert");
+    GLuint fragVisibilityShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "visibility.frag");
+    GLuint visibilityProgramObject = glCreateProgram();
+    glAttachShader(visibilityProgramObject, vertVisibilityShaderId);
+    glAttachShader(visibilityProgramObject, fragVisibilityShaderId);
+    glLinkProgram(visibilityProgramObject);
+    if (check_link_error(visibilityProgramObject) < 0)
+        exit(1);
+    GLuint visibilityMvpsLocation = glGetUniformLocation(visibilityProgramObject, "MVPs");
+    GLuint visibilityDrawBaseLocation = glGetUniformLocation(visibilityProgramObject, "DrawBase");
+    GLuint visibilityTriangleBitsLocation = glGetUniformLocation(visibilityProgramObject, "TriangleBits");
+    GLuint fragVisibilityMaterialShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "visibilitymaterial.frag");
+    GLuint visibilityMaterialProgramObject = glCreateProgram();
+    glAttachShader(visibilityMaterialProgramObject, vertBlitShaderId);
+    glAttachShader(visibilityMaterialProgramObject, fragVisibilityMaterialShaderId);
+    glLinkProgram(visibilityMaterialProgramObject);
+    if (check_link_error(visibilityMaterialProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(visibilityMaterialProgramObject, glGetUniformLocation(visibilityMaterialProgramObject, "Ids"), 1);
+    glProgramUniform1i(visibilityMaterialProgramObject, glGetUniformLocation(visibilityMaterialProgramObject, "RecordInts"), 3);
+    GLuint visibilityMaterialTriangleBitsLocation = glGetUniformLocation(visibilityMaterialProgramObject, "TriangleBits");
+    GLuint vertVisibilityResolveShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "visibilityresolve.vert");
+    GLuint fragVisibilityResolveShaderId = compile_shader_from_file(GL_FRAGMENT_SHADER, "visibilityresolve.frag");
+    GLuint visibilityResolveProgramObject = glCreateProgram();
+    glAttachShader(visibilityResolveProgramObject, vertVisibilityResolveShaderId);
+    glAttachShader(visibilityResolveProgramObject, fragVisibilityResolveShaderId);
+    glLinkProgram(visibilityResolveProgramObject);
+    if (check_link_error(visibilityResolveProgramObject) < 0)
+        exit(1);
+    glProgramUniform1i(visibilityResolveProgramObject, glGetUniformLocation(visibilityResolveProgramObject, "Diffuse"), 0);
+    glProgramUniform1i(visibilityResolveProgramObject, glGetUniformLocation(visibilityResolveProgramObject, "Ids"), 1);
+    glProgramUniform1i(visibilityResolveProgramObject, glGetUniformLocation(visibilityResolveProgramObject, "Records"), 2);
+    glProgramUniform1i(visibilityResolveProgramObject, glGetUniformLocation(visibilityResolveProgramObject, "RecordInts"), 3);
+    for (int a = 0; a < VisibilityBuffer::MAX_ARENAS; ++a)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "Arena%d", a);
+        glProgramUniform1i(visibilityResolveProgramObject, glGetUniformLocation(visibilityResolveProgramObject, name), 4 + a);
+    }
+    GLuint visibilityResolveTriangleBitsLocation = glGetUniformLocation(visibilityResolveProgramObject, "TriangleBits");
+    GLuint visibilityResolveTexturedLocation = glGetUniformLocation(visibilityResolveProgramObject, "Textured");
+    GLuint visibilityResolveRenderSizeLocation = glGetUniformLocation(visibilityResolveProgramObject, "RenderSize");
+    GLuint visibilityResolveJitterLocation = glGetUniformLocation(visibilityResolveProgramObject, "Jitter");
+    GLuint visibilityResolveMaterialDepthLocation = glGetUniformLocation(visibilityResolveProgramObject, "MaterialDepth");
+
+    // Multi-view scene program, the fragment shader of the scene program.
+    // Layers are read through texture views, an OpenGL 4.3 feature
+    bool multiViewSupported = multiViewLayers > 1 && GLEW_VERSION_4_3;
+    if (multiViewLayers > 1 && !multiViewSupported)
+        fprintf(stderr, "OpenGL 4.3 not available, multi-view disabled\n");
+    GLuint multiViewProgramObject = 0;
+    GLuint multiViewModelLocation = 0;
+    GLuint multiViewNormalMatrixLocation = 0;
+    GLuint multiViewViewProjectionsLocation = 0;
+    GLuint multiViewPrevViewProjectionsLocation = 0;
+    GLuint multiViewDiffuseColorLocation = 0;
+    GLuint multiViewJitterLocation = 0;
+    if (multiViewSupported)
+    {
+        GLuint vertMultiViewShaderId = compile_shader_from_file(GL_VERTEX_SHADER, "trineGLmultiview.vert");
+        GLuint geomMultiViewShaderId = compile_shader_from_file(GL_GEOMETRY_SHADER, "multiview.geom");
+        multiViewProgramObject = glCreateProgram();
+        glAttachShader(multiViewProgramObject, vertMultiViewShaderId);
+        glAttachShader(multiViewProgramObject, geomMultiViewShaderId);
+        glAttachShader(multiViewProgramObject, fragSceneShaderId);
+        glLinkProgram(multiViewProgramObject);
+        if (check_link_error(multiViewProgramObject) < 0)
+            exit(1);
+        multiViewModelLocation = glGetUniformLocation(multiViewProgramObject, "Model");
+        multiViewNormalMatrixLocation = glGetUniformLocation(multiViewProgramObject, "NormalMatrix");
+        multiViewViewProjectionsLocation = glGetUniformLocation(multiViewProgramObject, "ViewProjections");
+        multiViewPrevViewProjectionsLocation = glGetUniformLocation(multiViewProgramObject, "PrevViewProjections");
+        multiViewDiffuseColorLocation = glGetUniformLocation(multiViewProgramObject, "DiffuseColor");
+        multiViewJitterLocation = glGetUniformLocation(multiViewProgramObject, "Jitter");
+        glProgramUniform1i(multiViewProgramObject, glGetUniformLocation(multiViewProgramObject, "Diffuse"), 0);
     }
-
-    GLuint * assimp_vao = new GLuint[scene->mNumMeshes];
-    glm::mat4 * assimp_objectToWorld = new glm::mat4[scene->mNumMeshes];
-    glGenVertexArrays(scene->mNumMeshes, assimp_vao);
-    GLuint * assimp_vbo = new GLuint[scene->mNumMeshes*4];
-    glGenBuffers(scene->mNumMeshes*4, assimp_vbo);
-
-    float * assimp_diffuse_colors = new float[scene->mNumMeshes*3];
-    GLuint * assimp_diffuse_texture_ids = new GLuint[scene->mNumMeshes*3];
-
-
-    for (unsigned int i =0; i < scene->mNumMeshes; ++i)
-    {
-        const aiMesh* m = scene->mMeshes[i];
-        GLuint * faces = new GLuint[m->mNumFaces*3];
-        for (unsigned int j = 0; j < m->mNumFaces; ++j)
-        {
-            const aiFace& f = m->mFaces[j];
-            faces[j*3] = f.mIndices[0];
-            faces[j*3+1] = f.mIndices[1];
-            faces[j*3+2] = f.mIndices[2];
-        }
-
-      
-        glBindVertexArray(assimp_vao[i]);
-        // Bind indices and upload data
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, assimp_vbo[i*4]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m->mNumFaces*3 *sizeof(GLuint), faces, GL_STATIC_DRAW);
-
-        // Bind vertices and upload data
-        glBindBuffer(GL_ARRAY_BUFFER, assimp_vbo[i*4+1]);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
-        glBufferData(GL_ARRAY_BUFFER, m->mNumVertices*3*sizeof(float), m->mVertices, GL_STATIC_DRAW);
-        
-        // Bind normals and upload data
-        glBindBuffer(GL_ARRAY_BUFFER, assimp_vbo[i*4+2]);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
-        glBufferData(GL_ARRAY_BUFFER, m->mNumVertices*3*sizeof(float), m->mNormals, GL_STATIC_DRAW);
-        
-        // Bind uv coords and upload data
-        glBindBuffer(GL_ARRAY_BUFFER, assimp_vbo[i*4+3]);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
-        if (m->HasTextureCoords(0))
-            glBufferData(GL_ARRAY_BUFFER, m->mNumVertices*3*sizeof(float), m->mTextureCoords[0], GL_STATIC_DRAW);
-        else
-            glBufferData(GL_ARRAY_BUFFER, m->mNumVertices*3*sizeof(float), m->mVertices, GL_STATIC_DRAW);
-        delete[] faces;
-
-
-        const aiMaterial * mat = scene->mMaterials[m->mMaterialIndex];
-        int texIndex = 0;
-        aiString texPath;
-
-
-        if(AI_SUCCESS == mat->GetTexture(aiTextureType_DIFFUSE, texIndex, &texPath))
-        {
-            std::string path = pathFile3D;
-            size_t pos = path.find_last_of("\\/");
-            std::string basePath = (std::string::npos == pos) ? "" : path.substr(0, pos + 1);
-            std::string fileloc = basePath + texPath.data;
-            pos = fileloc.find_last_of("\\");
-            fileloc = (std::string::npos == pos) ? fileloc : fileloc.replace(pos, 1, "/");
-            int x;
-            int y;
-            int comp;
-            glGenTextures(1, assimp_diffuse_texture_ids + i);
-            unsigned char * diffuse = stbi_load(fileloc.c_str(), &x, &y, &comp, 3);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, assimp_diffuse_texture_ids[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, x, y, 0, GL_RGB, GL_UNSIGNED_BYTE, diffuse);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        }
-        else
-        {
-            assimp_diffuse_texture_ids[i] = 0;
-        }
 
 
-        aiColor4D diffuse;
-        if(AI_SUCCESS == aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &diffuse))
-        {
-            assimp_diffuse_colors[i*3] = diffuse.r;
-            assimp_diffuse_colors[i*3+1] = diffuse.g;
-            assimp_diffuse_colors[i*3+2] = diffuse.b;
-        }
-        else
-        {
-            assimp_diffuse_colors[i*3] = 1.f;
-            assimp_diffuse_colors[i*3+1] = 0.f;
-            assimp_diffuse_colors[i*3+2] = 1.f;
-        }
-    }
+   if (!checkError("Shaders"))
+        exit(1);
+    PROFILE_PHASE_END(shadersZone);
 
 
-    std::stack<aiNode*> stack;
-    stack.push(scene->mRootNode);
-    while(stack.size()>0)
-    {
-        aiNode * node = stack.top();
-        for (unsigned int i =0; i < node->mNumMeshes; ++i)
-        {
-            aiMatrix4x4 t = node->mTransformation;
-            assimp_objectToWorld[i] = glm::mat4(t.a1, t.a2, t.a3, t.a4,
-                                                t.b1, t.b2, t.b3, t.b4,
-                                                t.c1, t.c2, t.c3, t.c4,
-                                                t.d1, t.d2, t.d3, t.d4);
-        }
-        stack.pop();
-    }
+    // The scene is streamed : a worker thread imports it then prepares its
+    // meshes and textures nearest to the camera first, the frame loop uploads
+    // them under a per frame budget and draws the meshes already resident.
+    // OBJ files go through the native importer unless --assimp is given
+    std::string pathFile3D = "./scene_v4/scene_v4.obj";
+    const glm::mat4 sceneScale = glm::scale(glm::mat4(), glm::vec3(0.01));
+    const glm::mat4 worldToScene = glm::inverse(sceneScale);
+    SceneStream sceneStream;
+    scene_stream_start(sceneStream, pathFile3D.c_str(), forceAssimp, staticBatchCells, instanceMinTriangles, glm::vec3(worldToScene * glm::vec4(camera.eye, 1.f)), 64 << 20);
+    size_t sceneStreamCpuBytes = 0;
+    bool sceneStreamed = false;
+    int sceneStreamedFrame = -1;
+    int uploadBudgetKB = 8192;
+    size_t streamUploadBytes = 0;
+    // Mesh vertices and indices, regions in large shared buffers
+    BufferHeap bufferHeap;
+    buffer_heap_init(bufferHeap, 64 << 20, 256, RESOURCE_GEOMETRY);
+    int compactBudgetKB = 256;
+    std::vector<BufferMove> bufferMoves;
+    int residentMeshCount = 0;
+    int residentTextureCount = 0;
+    bool shadowsStale = false;
+    std::vector<StreamedMesh *> pendingMeshes;
+    std::vector<std::pair<float, StreamedMesh *> > pendingMeshDistances;
+    std::vector<StreamedTexture *> pendingTextures;
+    int pendingTextureRows = 0;
+
+    // Per mesh arrays, allocated once the import is done
+    unsigned int sceneMeshCount = 0;
+    size_t sceneArraysBytes = 0;
+    GLuint * assimp_vao = NULL;
+    glm::mat4 * assimp_objectToWorld = NULL;
+    // Heap regions of the indices of all levels and of the vertices, -1 until uploaded
+    std::vector<int> meshIndexRegions;
+    std::vector<int> meshVertexRegions;
+    std::vector<unsigned int> meshVertexCounts;
+    MeshLod * assimp_lods = NULL;
+    float * assimp_diffuse_colors = NULL;
+    GLuint * assimp_diffuse_texture_ids = NULL;
+    std::vector<char> meshResident;
+    std::vector<int> meshMaterials;
+    // Repeated geometry : the mesh each mesh draws the streams of, the copies
+    // of each mesh and the normal matrix from the source to a copy
+    std::vector<int> meshSources;
+    std::vector<std::vector<unsigned int> > meshCopies;
+    std::vector<glm::mat3> meshNormalMatrices;
+    // Material textures, 0 until fully uploaded in materialResident
+    std::vector<GLuint> materialTextures;
+    std::vector<char> materialResident;
 
     // // Unbind everything. Potentially illegal on some implementations
     // glBindVertexArray(0);
@@ -524,7 +1323,8 @@ int main( int argc, char **argv )
     
 
     // Load geometry
-    //int cube_triangleCount = 12;
+    PROFILE_PHASE_BEGIN(geometryZone, "geometry");
+    int cube_triangleCount = 12;
     int cube_triangleList[] = {0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7, 8, 9, 10, 10, 9, 11, 12, 13, 14, 14, 13, 15, 16, 17, 18, 19, 17, 20, 21, 22, 23, 24, 25, 26, };
     float cube_uvs[] = {0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f,  1.f, 0.f,  1.f, 1.f,  0.f, 1.f,  1.f, 1.f,  0.f, 0.f, 0.f, 0.f, 1.f, 1.f,  1.f, 0.f,  };
     float cube_vertices[] = {-0.5, -0.5, 0.5, 0.5, -0.5, 0.5, -0.5, 0.5, 0.5, 0.5, 0.5, 0.5, -0.5, 0.5, 0.5, 0.5, 0.5, 0.5, -0.5, 0.5, -0.5, 0.5, 0.5, -0.5, -0.5, 0.5, -0.5, 0.5, 0.5, -0.5, -0.5, -0.5, -0.5, 0.5, -0.5, -0.5, -0.5, -0.5, -0.5, 0.5, -0.5, -0.5, -0.5, -0.5, 0.5, 0.5, -0.5, 0.5, 0.5, -0.5, 0.5, 0.5, -0.5, -0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, -0.5, -0.5, -0.5, -0.5, -0.5, -0.5, 0.5, -0.5, 0.5, -0.5, -0.5, 0.5, -0.5, -0.5, -0.5, 0.5, -0.5, 0.5, 0.5 };
@@ -551,78 +1351,128 @@ int main( int argc, char **argv )
     // Bind indices and upload data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[0]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_triangleList), cube_triangleList, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[0], RESOURCE_GEOMETRY, sizeof(cube_triangleList));
     // Bind vertices and upload data
     glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[1], RESOURCE_GEOMETRY, sizeof(cube_vertices));
     // Bind normals and upload data
     glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_normals), cube_normals, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[2], RESOURCE_GEOMETRY, sizeof(cube_normals));
     // Bind uv coords and upload data
     glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*2, (void*)0);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_uvs), cube_uvs, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[3], RESOURCE_GEOMETRY, sizeof(cube_uvs));
 
     // Plane
     glBindVertexArray(vao[1]);
     // Bind indices and upload data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[4]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(plane_triangleList), plane_triangleList, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[4], RESOURCE_GEOMETRY, sizeof(plane_triangleList));
     // Bind vertices and upload data
     glBindBuffer(GL_ARRAY_BUFFER, vbo[5]);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
     glBufferData(GL_ARRAY_BUFFER, sizeof(plane_vertices), plane_vertices, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[5], RESOURCE_GEOMETRY, sizeof(plane_vertices));
     // Bind normals and upload data
     glBindBuffer(GL_ARRAY_BUFFER, vbo[6]);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
     glBufferData(GL_ARRAY_BUFFER, sizeof(plane_normals), plane_normals, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[6], RESOURCE_GEOMETRY, sizeof(plane_normals));
     // Bind uv coords and upload data
     glBindBuffer(GL_ARRAY_BUFFER, vbo[7]);
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*2, (void*)0);
     glBufferData(GL_ARRAY_BUFFER, sizeof(plane_uvs), plane_uvs, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[7], RESOURCE_GEOMETRY, sizeof(plane_uvs));
 
     // Quad
     glBindVertexArray(vao[2]);
     // Bind indices and upload data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[8]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quad_triangleList), quad_triangleList, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[8], RESOURCE_GEOMETRY, sizeof(quad_triangleList));
     // Bind vertices and upload data
     glBindBuffer(GL_ARRAY_BUFFER, vbo[9]);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*2, (void*)0);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
+    resource_track(resources, GL_BUFFER, vbo[9], RESOURCE_GEOMETRY, sizeof(quad_vertices));
 
     // Unbind everything. Potentially illegal on some implementations
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    // Update and bind uniform buffer object
-    GLuint ubo[1];
-    glGenBuffers(1, ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-    GLint uboSize = 0;
-    glGetActiveUniformBlockiv(pointlightProgramObject, pointlightLightLocation, GL_UNIFORM_BLOCK_DATA_SIZE, &uboSize);
-    glGetActiveUniformBlockiv(directionallightProgramObject, pointlightLightLocation, GL_UNIFORM_BLOCK_DATA_SIZE, &uboSize);
-
-    // Ignore ubo size, allocate it sufficiently big for all light data structures
-    uboSize = 512;
-
-    glBufferData(GL_UNIFORM_BUFFER, uboSize, 0, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // Light uniforms, regions of a heap of uniform buffers bound by range.
+    // Each kind of light has a region with a slot per light and per view,
+    // allocated again when their count changes
+    GLint uniformAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    GLint pointLightBlockSize = 0, directionalLightBlockSize = 0;
+    glGetActiveUniformBlockiv(pointlightProgramObject, pointlightLightLocation, GL_UNIFORM_BLOCK_DATA_SIZE, &pointLightBlockSize);
+    glGetActiveUniformBlockiv(directionallightProgramObject, directionallightLightLocation, GL_UNIFORM_BLOCK_DATA_SIZE, &directionalLightBlockSize);
+    // Both light structures are 32 bytes, slots start at bindable offsets
+    pointLightBlockSize = std::max(pointLightBlockSize, 32);
+    directionalLightBlockSize = std::max(directionalLightBlockSize, 32);
+    const size_t lightSlotBytes = (std::max(pointLightBlockSize, directionalLightBlockSize) + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+    BufferHeap uniformHeap;
+    buffer_heap_init(uniformHeap, 64 << 10, uniformAlignment, RESOURCE_UNIFORMS);
+    std::vector<BufferMove> uniformMoves;
+    enum { LIGHT_REGION_POINT, LIGHT_REGION_STATIC_POINT, LIGHT_REGION_DIRECTIONAL, LIGHT_REGION_COUNT };
+    int lightRegions[LIGHT_REGION_COUNT] = { -1, -1, -1 };
+    int lightRegionSlots[LIGHT_REGION_COUNT] = { 0, 0, 0 };
+    std::vector<unsigned char> lightSlots;
+
+    // Instanced field buffers : per-instance transforms, indices of the
+    // instances surviving frustum culling and the indirect draw command
+    struct InstanceTransform
+    {
+        glm::vec4 position;
+        glm::vec4 rotation;
+    };
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLuint baseVertex;
+        GLuint baseInstance;
+    };
+    const DrawElementsIndirectCommand instanceDrawCommand = { (GLuint) cube_triangleCount * 3, 0, 0, 0, 0 };
+    const float instanceRadius = 0.8660254f; // Bounding sphere of the unit cube
+    GLuint instanceBuffers[3] = { 0, 0, 0 };
+    int instanceCapacity = 0;
+    // Last parameters the transforms were computed with
+    double instanceUpdateTime = -1.0;
+    int instanceUpdateCount = -1;
+    float instanceUpdateSpacing = -1.f;
+    if (instancingSupported)
+    {
+        glGenBuffers(3, instanceBuffers);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceBuffers[2]);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), &instanceDrawCommand, GL_DYNAMIC_DRAW);
+        resource_track(resources, GL_BUFFER, instanceBuffers[2], RESOURCE_GEOMETRY, sizeof(DrawElementsIndirectCommand));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    PROFILE_PHASE_END(geometryZone);
 
     // Init frame buffers
+    PROFILE_PHASE_BEGIN(framebuffersZone, "framebuffers");
     GLuint gbufferFbo;
-    GLuint gbufferTextures[3];
-    GLuint gbufferDrawBuffers[2];
-    glGenTextures(3, gbufferTextures);
+    GLuint gbufferTextures[4];
+    GLuint gbufferDrawBuffers[3];
+    glGenTextures(4, gbufferTextures);
 
     // Create color texture
     glBindTexture(GL_TEXTURE_2D, gbufferTextures[0]);
@@ -632,6 +1482,7 @@ int main( int argc, char **argv )
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    resource_track(resources, GL_TEXTURE, gbufferTextures[0], RESOURCE_RENDER_TARGETS, texture_bytes(GL_RGBA8, width, height, 1, false));
 
     // Create normal texture
     glBindTexture(GL_TEXTURE_2D, gbufferTextures[1]);
@@ -641,6 +1492,7 @@ int main( int argc, char **argv )
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    resource_track(resources, GL_TEXTURE, gbufferTextures[1], RESOURCE_RENDER_TARGETS, texture_bytes(GL_RGBA32F, width, height, 1, false));
 
     // Create depth texture
     glBindTexture(GL_TEXTURE_2D, gbufferTextures[2]);
@@ -649,17 +1501,29 @@ int main( int argc, char **argv )
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    resource_track(resources, GL_TEXTURE, gbufferTextures[2], RESOURCE_RENDER_TARGETS, texture_bytes(GL_DEPTH_COMPONENT24, width, height, 1, false));
+
+    // Create velocity texture
+    glBindTexture(GL_TEXTURE_2D, gbufferTextures[3]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    resource_track(resources, GL_TEXTURE, gbufferTextures[3], RESOURCE_RENDER_TARGETS, texture_bytes(GL_RG16F, width, height, 1, false));
 
     // Create Framebuffer Object
     glGenFramebuffers(1, &gbufferFbo);
     glBindFramebuffer(GL_FRAMEBUFFER, gbufferFbo);
     gbufferDrawBuffers[0] = GL_COLOR_ATTACHMENT0;
     gbufferDrawBuffers[1] = GL_COLOR_ATTACHMENT1;
-    glDrawBuffers(2, gbufferDrawBuffers);
+    gbufferDrawBuffers[2] = GL_COLOR_ATTACHMENT2;
+    glDrawBuffers(3, gbufferDrawBuffers);
 
     // Attach textures to framebuffer
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, gbufferTextures[0], 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1 , GL_TEXTURE_2D, gbufferTextures[1], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2 , GL_TEXTURE_2D, gbufferTextures[3], 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbufferTextures[2], 0);
 
     // Create Fx Framebuffer Object
@@ -670,20 +1534,39 @@ int main( int argc, char **argv )
     fxDrawBuffers[0] = GL_COLOR_ATTACHMENT0;
     glDrawBuffers(1, fxDrawBuffers);
 
-    // Create Fx textures
+    // Create Fx textures. Lights are accumulated and post-processed in HDR,
+    // packed floats keep the 32 bits per texel of RGBA8 (half of RGBA16F),
+    // the gamma pass tonemaps to the displayable range
     const int FX_TEXTURE_COUNT = 4;
     GLuint fxTextures[FX_TEXTURE_COUNT];
     glGenTextures(FX_TEXTURE_COUNT, fxTextures);
     for (int i = 0; i < FX_TEXTURE_COUNT; ++i)
     {
         glBindTexture(GL_TEXTURE_2D, fxTextures[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, width, height, 0, GL_RGB, GL_FLOAT, 0);
+        resource_track(resources, GL_TEXTURE, fxTextures[i], RESOURCE_RENDER_TARGETS, texture_bytes(GL_R11F_G11F_B10F, width, height, 1, false));
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
 
+    // Create temporal history textures : blur history ping-pong in #0 and #1,
+    // anti-aliased color history ping-pong in #2 and #3. They are sampled at
+    // reprojected positions hence the linear filtering. HDR like the fx chain
+    GLuint temporalTextures[4];
+    glGenTextures(4, temporalTextures);
+    for (int i = 0; i < 4; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, temporalTextures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, width, height, 0, GL_RGB, GL_FLOAT, 0);
+        resource_track(resources, GL_TEXTURE, temporalTextures[i], RESOURCE_RENDER_TARGETS, texture_bytes(GL_R11F_G11F_B10F, width, height, 1, false));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
     // Attach first fx texture to framebuffer
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
 
@@ -692,17 +1575,312 @@ int main( int argc, char **argv )
         fprintf(stderr, "Error on building framebuffer\n");
         exit( EXIT_FAILURE );
     }
+    // Create debug view textures : light count and scene overdraw per pixel,
+    // per tile cost, the heatmap output and a depth buffer for the overdraw
+    const int DEBUG_TILE_SIZE = 16;
+    GLuint debugTextures[5];
+    glGenTextures(5, debugTextures);
+    for (int i = 0; i < 5; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, debugTextures[i]);
+        if (i < 2)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, 0);
+            resource_track(resources, GL_TEXTURE, debugTextures[i], RESOURCE_RENDER_TARGETS, texture_bytes(GL_R32F, width, height, 1, false));
+        }
+        else if (i == 2)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, (width + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE, (height + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE, 0, GL_RG, GL_FLOAT, 0);
+            resource_track(resources, GL_TEXTURE, debugTextures[i], RESOURCE_RENDER_TARGETS, texture_bytes(GL_RG32F, (width + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE, (height + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE, 1, false));
+        }
+        else if (i == 3)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+            resource_track(resources, GL_TEXTURE, debugTextures[i], RESOURCE_RENDER_TARGETS, texture_bytes(GL_RGBA8, width, height, 1, false));
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+            resource_track(resources, GL_TEXTURE, debugTextures[i], RESOURCE_RENDER_TARGETS, texture_bytes(GL_DEPTH_COMPONENT24, width, height, 1, false));
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    // Create debug Framebuffer Object
+    GLuint debugFbo;
+    glGenFramebuffers(1, &debugFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, debugFbo);
+    glDrawBuffers(1, fxDrawBuffers);
+
+    // Create shadow Framebuffer Object, depth only
+    GLuint shadowFbo;
+    glGenFramebuffers(1, &shadowFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadowFbo);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    // Layered G-buffer of the multi-view mode
+    MultiView multiView;
+    multiView.layerCount = 0;
+    if (multiViewSupported && !multi_view_init(multiView, multiViewLayers, width, height, resources))
+    {
+        fprintf(stderr, "Error on building the multi-view framebuffer\n");
+        exit( EXIT_FAILURE );
+    }
+    bool multiViewActive = multiView.layerCount > 0;
+
+    // Multisampled G-buffer, the multi-view layers are single sampled
+    MsaaGbuffer msaa;
+    msaa.samples = 0;
+    if (msaaSamples > 1 && multiViewActive)
+        fprintf(stderr, "MSAA is not available with multi-view, disabled\n");
+    else if (msaaSamples > 1 && !msaa_gbuffer_init(msaa, msaaSamples, width, height, fxFbo, resources))
+    {
+        fprintf(stderr, "Error on building the multisampled framebuffer\n");
+        exit( EXIT_FAILURE );
+    }
+    bool msaaEnabled = msaa.samples > 1;
+
+    // Visibility buffer, its ids share the depth of the G-buffer
+    VisibilityBuffer visibility;
+    visibility.fbo = 0;
+    if (visibilityEnabled && (multiViewActive || msaaEnabled))
+    {
+        fprintf(stderr, "The visibility buffer is not available with multi-view or MSAA, disabled\n");
+        visibilityEnabled = false;
+    }
+    else if (visibilityEnabled && !visibility_buffer_init(visibility, width, height, gbufferTextures, resources))
+    {
+        fprintf(stderr, "Error on building the visibility buffer framebuffers\n");
+        exit( EXIT_FAILURE );
+    }
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     checkError("Framebuffers");
+    PROFILE_PHASE_END(framebuffersZone);
+
+    // Static point lights of the scene
+    struct StaticPointLight
+    {
+        glm::vec3 position;
+        glm::vec3 color;
+        float intensity;
+    };
+    const StaticPointLight staticPointLights[] = {
+        { glm::vec3(1.5,0.5,-4.8), glm::vec3(0,0,1), 1.5 },
+        { glm::vec3(-10,2.681,-5.83), glm::vec3(1,0.357,1), 10 },
+        { glm::vec3(-13.872,0.936,-3.319), glm::vec3(1,0.46,0.009), 2.085 },
+        { glm::vec3(-10.818,0.085,-1.617), glm::vec3(0,1,0.809), 0.183 },
+        { glm::vec3(-6.043,-1.957,0.426), glm::vec3(1,0,1), 2.213 },
+        { glm::vec3(0.596,3.149,-6.553), glm::vec3(1,0.272,0.489), 7.149 },
+        { glm::vec3(11.149,7.234,-5.702), glm::vec3(1,0,0), 10 },
+        { glm::vec3(8.085,-2.979,-1.617), glm::vec3(0.268,1,1), 3.957 },
+        { glm::vec3(12.34,0.426,-4.34), glm::vec3(0.889,0.396,0), 0.736 },
+        { glm::vec3(17.277,0.085,2.638), glm::vec3(0.723,0.311,0.779), 0.723 },
+        { glm::vec3(17.277,3.489,-5.872), glm::vec3(1,0.532,0.311), 5.234 },
+        { glm::vec3(16.085,0.255,-7.915), glm::vec3(0,0.532,0.604), 9.894 },
+        { glm::vec3(-14.553,1.277,-0.426), glm::vec3(1,0.196,0), 3.957 },
+        { glm::vec3(-7.064,1.957,-0.426), glm::vec3(1,0.536,0.745), 4.213 },
+        { glm::vec3(-3.489,-0.255,0.596), glm::vec3(1,0.174,0), 10 },
+        { glm::vec3(4.34,4.851,0.596), glm::vec3(1,1,1), 10 },
+        { glm::vec3(16.085,5.362,1.106), glm::vec3(1,0,1), 10 },
+    };
+    const int staticPointLightCount = sizeof(staticPointLights) / sizeof(staticPointLights[0]);
+    glm::vec3 staticPointLightPositions[staticPointLightCount];
+    glm::vec3 staticPointLightViewPositions[staticPointLightCount];
+    for (int i = 0; i < staticPointLightCount; ++i)
+        staticPointLightPositions[i] = staticPointLights[i].position;
+    glm::vec3 directionalLightDirection(1.0, -1.0, -1.0);
+
+    // Shadow caches
+    PROFILE_PHASE_BEGIN(shadowCachesZone, "shadow caches");
+    bool shadows = true;
+    ShadowCascades shadowCascades;
+    shadow_cascades_init(shadowCascades, resources);
+    ShadowAtlas shadowAtlas;
+    shadow_atlas_init(shadowAtlas, staticPointLightCount, resources);
+    int shadowCascadesRendered = 0;
+    int shadowFacesRendered = 0;
+    checkError("Shadows");
+    PROFILE_PHASE_END(shadowCachesZone);
 
     camera_pan(camera, 3, 0);
 
+    FramePacing framePacing;
+    frame_pacing_init(framePacing);
+    GpuTimers gpuTimers;
+    gpu_timers_init(gpuTimers);
+    ResolutionScaling resolutionScaling;
+    resolution_scaling_init(resolutionScaling);
+    float sharpness = 0.2f;
+    // Benchmarks and batches always run at a fixed scale, full resolution by default
+    if (fixedScale > 0.f || benchmark || batch)
+    {
+        resolutionScaling.dynamic = false;
+        resolutionScaling.fixedScale = fixedScale > 0.f ? glm::clamp(fixedScale, resolutionScaling.minScale, 1.f) : 1.f;
+        resolutionScaling.scale = resolutionScaling.fixedScale;
+    }
+    int renderWidth = 0, renderHeight = 0;
+
+    // Distance based level of detail, in pixels of projected error
+    bool lodEnabled = true;
+    float lodThreshold = 1.f;
+    int sceneTriangles = 0, sceneTrianglesDrawn = 0;
+
+    // Debug views
+    int debugView = DEBUG_VIEW_NONE;
+    float debugMaxValues[DEBUG_VIEW_COUNT] = { 1.f, 16.f, 8.f, 24.f };
+    float debugLightCutoff = 0.01f;
+    bool debugExport = false;
+
+    // Scene pass ordering and per mesh state of the frame
+    bool sortFrontToBack = true;
+    std::vector<unsigned int> drawOrder(sceneMeshCount);
+    for (unsigned int i = 0; i < sceneMeshCount; ++i)
+        drawOrder[i] = i;
+    std::vector<int> meshLevels(sceneMeshCount);
+    std::vector<float> meshDepths(sceneMeshCount);
+    std::vector<glm::mat4> meshMvp(sceneMeshCount);
+    std::vector<glm::mat4> meshMv(sceneMeshCount);
+    std::vector<char> meshVisible(sceneMeshCount, 1);
+    // Copies already drawn by an instanced draw of the frame
+    std::vector<char> meshInstanced(sceneMeshCount, 0);
+    int sceneInstancedDraws = 0;
+    int sceneInstancedMeshes = 0;
+    std::vector<unsigned int> visibleMeshes;
+    visibleMeshes.reserve(sceneMeshCount);
+
+    // The scene is static, its meshes are frustum culled through a hierarchy
+    // of their world space bounding spheres
+    bool sceneFrustumCulling = true;
+    int sceneMeshesVisible = sceneMeshCount;
+    SphereBvh sceneBvh;
+    // Object to world matrices as structure of arrays for the batched transform stage
+    TransformSoa sceneTransforms;
+    int transformPath = transform_path_best();
+    OverdrawCounter overdrawCounter;
+    overdraw_counter_init(overdrawCounter);
+
+    // Temporal accumulation state
+    bool temporal = true;
+    float temporalBlurFeedback = 0.85f;
+    float taaFeedback = 0.9f;
+    bool historyValid = false;
+    int temporalIndex = 0;
+    glm::mat4 previousViewProjection;
+
+    BenchmarkRecord benchmarkRecord;
+    benchmarkRecord.visibilityFrames = 0;
+    const int BENCHMARK_WARMUP_FRAMES = 10;
+    int frameIndex = 0;
+    double lastFrameStart = glfwGetTime();
+    if (benchmark || batch)
+        framePacing.swapMode = FramePacing::SWAP_IMMEDIATE;
+
+    // Batch frames start once the scene is streamed
+    FrameEncoder frameEncoder;
+    BatchReadback batchReadback;
+    int batchFrame = 0;
+    double batchStart = 0.0;
+    if (batch)
+    {
+        if (!frame_encoder_start(frameEncoder, frame_format_from_path(batchOutput), batchOutput, width, height, batchFps, batchThreads))
+            exit( EXIT_FAILURE );
+        if (!batch_readback_init(batchReadback, width, height, resources))
+        {
+            fprintf(stderr, "Error on building the batch output framebuffer\n");
+            exit( EXIT_FAILURE );
+        }
+    }
+    // Framebuffer of the output pass, the window unless frames are read back
+    const GLuint outputFbo = batch ? batchReadback.fbo : 0;
+
     do
     {
+#ifdef AOGL_PROFILE
+        trace_capture_frame(traceCapture, frameIndex, sceneStreamed);
+#endif
+        PROFILE_ZONE("frame");
+
+        // Wait until the GPU is no more than maxFramesInFlight frames behind
+        PROFILE_PHASE_BEGIN(pacingZone, "pacing wait");
+        frame_pacing_begin(framePacing);
+        PROFILE_PHASE_END(pacingZone);
+        // The capture holds every call from here to the swap. It does not
+        // record texture views, layered attachments, multisampled targets and
+        // texture buffers
+        if (frameIndex == captureFrame && multiViewActive)
+            fprintf(stderr, "Error: frames rendered with --views cannot be captured\n");
+        else if (frameIndex == captureFrame && msaaEnabled)
+            fprintf(stderr, "Error: frames rendered with MSAA cannot be captured\n");
+        else if (frameIndex == captureFrame && visibilityEnabled)
+            fprintf(stderr, "Error: frames rendered with the visibility buffer cannot be captured\n");
+        else if (frameIndex == captureFrame && !gl_capture_begin(captureOutput.c_str(), width, height))
+            fprintf(stderr, "Error: a frame capture is already open\n");
+        double frameStart = glfwGetTime();
+        float cpuFrameTime = (float) ((frameStart - lastFrameStart) * 1000.0);
+        lastFrameStart = frameStart;
+
+        // Fetch GPU times of an older frame and adapt the resolution scale
+        gpu_timers_begin_frame(gpuTimers);
+        if (gpuTimers.resolved)
+        {
+            resolution_scaling_update(resolutionScaling, gpuTimers.frameTime);
+            if (benchmark && sceneStreamed && frameIndex > sceneStreamedFrame + BENCHMARK_WARMUP_FRAMES)
+            {
+                benchmarkRecord.cpuFrameTimes.push_back(cpuFrameTime);
+                benchmarkRecord.gpuFrameTimes.push_back(gpuTimers.frameTime);
+                for (int i = 0; i < GPU_PASS_COUNT; ++i)
+                    benchmarkRecord.passTimes[i].push_back(gpuTimers.passTimes[i]);
+                benchmarkRecord.fragmentsPerPixel.push_back(overdrawCounter.fragmentsPerPixel);
+            }
+        }
+        int scaledWidth = glm::max(1, (int) (width * resolutionScaling.scale));
+        int scaledHeight = glm::max(1, (int) (height * resolutionScaling.scale));
+        if (scaledWidth != renderWidth || scaledHeight != renderHeight)
+        {
+            renderWidth = scaledWidth;
+            renderHeight = scaledHeight;
+            historyValid = false;
+            for (int i = 0; i < SCALED_PROGRAM_COUNT; ++i)
+                glProgramUniform2f(scaledPrograms[i], scaledProgramsViewportScaleLocations[i], renderWidth / widthf, renderHeight / heightf);
+        }
+
+        ImGui_ImplGlfwGL3_NewFrame();
+
+        // Default states
+        glEnable(GL_DEPTH_TEST);
+
+        // Clear the front buffer
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Viewport 
+        glViewport( 0, 0, renderWidth, renderHeight  );
+
+        // Bind gbuffer, all its layers in multi-view, its samples with MSAA
+        const bool msaaActive = msaaEnabled && !multiViewActive;
+        glBindFramebuffer(GL_FRAMEBUFFER, multiViewActive ? multiView.fbo : msaaActive ? msaa.fbo : gbufferFbo);
+
+        // Clear the gbuffer
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Late latch : sample input and time right before building the camera
+        // matrices used by the scene pass
+        PROFILE_PHASE_BEGIN(cameraZone, "input and camera");
+        if (framePacing.lateLatch)
+            glfwPollEvents();
+        frame_pacing_latch(framePacing);
         if (camera.o.x <17)
             camera_pan(camera, -0.001, 0);
-        t = glfwGetTime() * speed;
-        ImGui_ImplGlfwGL3_NewFrame();
+        // Benchmarks and batches advance time by a fixed step for repeatable frames
+        if (batch)
+            t = batchFrame / (double) batchFps * speed;
+        else
+            t = (benchmark ? frameIndex / 60.0 : glfwGetTime()) * speed;
 
         // Mouse states
         int leftButton = glfwGetMouseButton( window, GLFW_MOUSE_BUTTON_LEFT );
@@ -763,33 +1941,46 @@ int main( int argc, char **argv )
             guiStates.lockPositionY = mousey;
         }
 
-        // Default states
-        glEnable(GL_DEPTH_TEST);
-
-        // Clear the front buffer
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Viewport 
-        glViewport( 0, 0, width, height  );
-
-        // Bind gbuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFbo);
-
-        // Clear the gbuffer
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
         // Get camera matrices
         glm::mat4 projection = glm::perspective(45.0f, widthf / heightf, 0.1f, 100.f); 
         glm::mat4 worldToView = glm::lookAt(camera.eye, camera.o, camera.up);
+        glm::mat4 viewProjection = projection * worldToView;
+        if (!historyValid)
+            previousViewProjection = viewProjection;
+        glm::mat4 currentToPrevious = previousViewProjection * glm::inverse(viewProjection);
+        // Sub-pixel jitter of the projection, cycling through a Halton (2,3) sequence
+        glm::vec2 jitter(0.f);
+        if (temporal)
+        {
+            int jitterIndex = frameIndex % 8 + 1;
+            jitter = glm::vec2((halton(jitterIndex, 2) - 0.5f) * 2.f / renderWidth, (halton(jitterIndex, 3) - 0.5f) * 2.f / renderHeight);
+        }
+        glm::mat4 jitteredProjection = glm::translate(glm::mat4(), glm::vec3(jitter, 0.f)) * projection;
         glm::mat4 objectToWorld;
         glm::mat4 mv = worldToView * objectToWorld;
-        glm::mat4 mvp = projection * mv;
+        glm::mat4 mvp = jitteredProjection * mv;
         //glm::mat4 inverseProjection = glm::transpose(glm::inverse(projection));
-        glm::mat4 inverseProjection = glm::inverse(projection);
+        glm::mat4 inverseProjection = glm::inverse(jitteredProjection);
+        glm::mat4 viewToWorld = glm::inverse(worldToView);
 
         glm::vec4 light = worldToView * glm::vec4(10.0, 10.0, 0.0, 0.0);
 
-        
+        // Cameras of the multi-view mode, view 0 is the one above. Only view
+        // 0 is jittered, the others have no temporal history
+        int viewCount = 1;
+        glm::mat4 viewsWorldToView[MultiView::MAX_VIEWS];
+        glm::mat4 viewsProjection[MultiView::MAX_VIEWS];
+        viewsWorldToView[0] = worldToView;
+        viewsProjection[0] = projection;
+        if (multiViewActive)
+        {
+            viewCount = multi_view_count(multiView);
+            multi_view_cameras(multiView, camera, projection, viewsWorldToView, viewsProjection);
+        }
+
+        PROFILE_PHASE_END(cameraZone);
+
+        gpu_timers_mark(gpuTimers, GPU_PASS_SCENE);
 
         // Select shader
         glUseProgram(sceneProgramObject);
@@ -798,539 +1989,1117 @@ int main( int argc, char **argv )
         glProgramUniformMatrix4fv(sceneProgramObject, mvpLocation2, 1, 0, glm::value_ptr(mvp));
         glProgramUniformMatrix4fv(sceneProgramObject, mvLocation2, 1, 0, glm::value_ptr(mv));
         glProgramUniform3fv(sceneProgramObject, lightLocation2, 1, glm::value_ptr(glm::vec3(light) / light.w));
-        glProgramUniform1i(sceneProgramObject, instanceCountLocation2, (int) instanceCount);
         glProgramUniform1f(sceneProgramObject, specularPowerLocation2, 30.f);
         glProgramUniform1f(sceneProgramObject, timeLocation2, t);
-
-        // Render vaos
-        glActiveTexture(GL_TEXTURE0);
-        glm::mat4 scale = glm::scale(glm::mat4(), glm::vec3(0.01));
-        for (unsigned int i =0; i < scene->mNumMeshes; ++i)
+        glProgramUniform2fv(sceneProgramObject, jitterLocation2, 1, glm::value_ptr(jitter));
+        glProgramUniform2fv(sceneInstancedProgramObject, sceneInstancedJitterLocation, 1, glm::value_ptr(jitter));
+
+        // Scene streaming : per mesh arrays once the import is done, then
+        // uploads of what the worker prepared within the budget
+        PROFILE_PHASE_BEGIN(streamingZone, "streaming");
+        SceneStreamState streamState = sceneStreamed ? SCENE_STREAM_PREPARED : scene_stream_state(sceneStream);
+        if (streamState == SCENE_STREAM_FAILED)
         {
-            GLuint subIndex = 1;
-            if (assimp_diffuse_texture_ids[i] > 0) {
-                glBindTexture(GL_TEXTURE_2D, assimp_diffuse_texture_ids[i]);
-                subIndex = 0;
+            fprintf(stderr, "Error: impossible to open the scene\n");
+            exit( EXIT_FAILURE );
+        }
+        if (sceneMeshCount == 0 && !sceneStreamed && streamState != SCENE_STREAM_IMPORTING)
+        {
+            const SceneData & sceneData = sceneStream.data;
+            sceneMeshCount = sceneData.meshes.size();
+            printf("Scene import (%s) : %.1f ms, %d meshes, %d materials\n", sceneStream.importPathName, sceneStream.importMs, sceneMeshCount, (int) sceneData.materials.size());
+            sceneArraysBytes = sceneMeshCount * (sizeof(GLuint) * 5 + 2 * sizeof(int) + sizeof(glm::mat4) + sizeof(MeshLod) + sizeof(float) * 3 + sizeof(char) + 2 * sizeof(int) + sizeof(glm::mat3) + sizeof(std::vector<unsigned int>));
+            cpu_heap_alloc(resources, CPU_SCENE, sceneArraysBytes);
+            assimp_vao = new GLuint[sceneMeshCount];
+            assimp_objectToWorld = new glm::mat4[sceneMeshCount];
+            glGenVertexArrays(sceneMeshCount, assimp_vao);
+            meshIndexRegions.assign(sceneMeshCount, -1);
+            meshVertexRegions.assign(sceneMeshCount, -1);
+            meshVertexCounts.assign(sceneMeshCount, 0);
+            // Meshes not resident yet have no level and draw nothing
+            assimp_lods = new MeshLod[sceneMeshCount]();
+            assimp_diffuse_colors = new float[sceneMeshCount*3];
+            assimp_diffuse_texture_ids = new GLuint[sceneMeshCount]();
+            meshResident.assign(sceneMeshCount, 0);
+            meshMaterials.resize(sceneMeshCount);
+            meshSources.resize(sceneMeshCount);
+            meshCopies.assign(sceneMeshCount, std::vector<unsigned int>());
+            meshNormalMatrices.resize(sceneMeshCount);
+            materialTextures.assign(sceneData.materials.size(), 0);
+            materialResident.assign(sceneData.materials.size(), 0);
+            std::vector<glm::vec4> spheres(sceneMeshCount);
+            for (unsigned int i = 0; i < sceneMeshCount; ++i)
+            {
+                const SceneMesh & m = sceneData.meshes[i];
+                const SceneMaterial & mat = sceneData.materials[m.material];
+                meshMaterials[i] = m.material;
+                assimp_objectToWorld[i] = m.objectToWorld;
+                meshSources[i] = m.source >= 0 ? m.source : (int) i;
+                meshNormalMatrices[i] = glm::mat3(1.f);
+                if (m.source >= 0)
+                {
+                    meshCopies[m.source].push_back(i);
+                    glm::mat3 copyLinear = glm::mat3(m.objectToWorld * glm::inverse(assimp_objectToWorld[m.source]));
+                    meshNormalMatrices[i] = glm::transpose(glm::inverse(copyLinear));
+                    sceneArraysBytes += sizeof(unsigned int);
+                    cpu_heap_alloc(resources, CPU_SCENE, sizeof(unsigned int));
+                }
+                assimp_lods[i].center = glm::vec3(sceneStream.bounds[i]);
+                assimp_lods[i].radius = sceneStream.bounds[i].w;
+                assimp_diffuse_colors[i*3] = mat.diffuse[0];
+                assimp_diffuse_colors[i*3+1] = mat.diffuse[1];
+                assimp_diffuse_colors[i*3+2] = mat.diffuse[2];
+                glm::mat4 model = sceneScale * assimp_objectToWorld[i];
+                glm::mat3 linear = glm::mat3(model);
+                float worldScale = std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+                spheres[i] = glm::vec4(glm::vec3(model * glm::vec4(assimp_lods[i].center, 1.f)), assimp_lods[i].radius * worldScale);
+            }
+            // Culling works on the bounds of all the meshes from the start
+            sphere_bvh_build(sceneBvh, spheres.empty() ? NULL : &spheres[0], sceneMeshCount);
+            transform_soa_assign(sceneTransforms, assimp_objectToWorld, sceneMeshCount);
+            cpu_heap_alloc(resources, CPU_SCENE, sceneTransforms.elements.size() * sizeof(float));
+
+            drawOrder.resize(sceneMeshCount);
+            for (unsigned int i = 0; i < sceneMeshCount; ++i)
+                drawOrder[i] = i;
+            meshLevels.resize(sceneMeshCount);
+            meshDepths.resize(sceneMeshCount);
+            meshMvp.resize(sceneMeshCount);
+            meshMv.resize(sceneMeshCount);
+            meshVisible.assign(sceneMeshCount, 0);
+            meshInstanced.assign(sceneMeshCount, 0);
+            visibleMeshes.reserve(sceneMeshCount);
+            cpu_heap_alloc(resources, CPU_FRAME, sceneMeshCount * (sizeof(unsigned int) * 2 + sizeof(int) + sizeof(float) + 2 * sizeof(char) + 2 * sizeof(glm::mat4)));
+            // Nothing to stream, the scene is complete as it is and the
+            // benchmark and batch modes run on it
+            if (sceneMeshCount == 0)
+            {
+                fprintf(stderr, "Warning: the scene has no meshes\n");
+                sceneStreamed = true;
+                sceneStreamedFrame = frameIndex;
             }
-            glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subIndex);
-            glm::mat4 mvScaled = worldToView * scale * assimp_objectToWorld[i];
-            glm::mat4 mvpScaled = projection * mvScaled;
-            glProgramUniformMatrix4fv(sceneProgramObject, mvpLocation2, 1, 0, glm::value_ptr(mvpScaled));
-            glProgramUniformMatrix4fv(sceneProgramObject, mvLocation2, 1, 0, glm::value_ptr(mvScaled));
-            glProgramUniform3fv(sceneProgramObject, diffuseColorLocation, 1, assimp_diffuse_colors + 3*i);
-            const aiMesh* m = scene->mMeshes[i];
-            glBindVertexArray(assimp_vao[i]);
-            glDrawElements(GL_TRIANGLES, m->mNumFaces * 3, GL_UNSIGNED_INT, (void*)0);
         }
+        streamUploadBytes = 0;
+        if (sceneMeshCount > 0 && !sceneStreamed)
+        {
+            scene_stream_set_viewpoint(sceneStream, glm::vec3(worldToScene * glm::vec4(camera.eye, 1.f)));
+            scene_stream_poll(sceneStream, pendingMeshes, pendingTextures);
+            const size_t uploadBudget = (size_t) uploadBudgetKB * 1024;
+            int meshesArrived = 0;
+
+            // Meshes nearest to the camera first, at least one per frame. The
+            // camera moves, the heap of the pending meshes by distance is made
+            // again each frame and the nearest taken from its top
+            pendingMeshDistances.resize(pendingMeshes.size());
+            for (size_t k = 0; k < pendingMeshes.size(); ++k)
+            {
+                int i = pendingMeshes[k]->mesh;
+                glm::vec3 center = glm::vec3(sceneScale * assimp_objectToWorld[i] * glm::vec4(assimp_lods[i].center, 1.f));
+                pendingMeshDistances[k] = std::make_pair(glm::length(center - camera.eye), pendingMeshes[k]);
+            }
+            auto farther = [](const std::pair<float, StreamedMesh *> & a, const std::pair<float, StreamedMesh *> & b) {
+                return a.first != b.first ? a.first > b.first : a.second->mesh > b.second->mesh;
+            };
+            std::make_heap(pendingMeshDistances.begin(), pendingMeshDistances.end(), farther);
+            while (!pendingMeshDistances.empty() && streamUploadBytes < uploadBudget)
+            {
+                PROFILE_ZONE("mesh upload");
+                std::pop_heap(pendingMeshDistances.begin(), pendingMeshDistances.end(), farther);
+                StreamedMesh * streamed = pendingMeshDistances.back().second;
+                pendingMeshDistances.pop_back();
+
+                const unsigned int i = streamed->mesh;
+                const SceneMesh & m = sceneStream.data.meshes[i];
+                const unsigned int vertexCount = m.positions.size() / 3;
+                assimp_lods[i] = streamed->lod;
+                if (!streamed->lodIndices.empty())
+                {
+                    // Indices of all levels in one region, positions, normals and uvs in another
+                    const size_t indexBytes = streamed->lodIndices.size() * sizeof(GLuint);
+                    meshIndexRegions[i] = buffer_heap_alloc(bufferHeap, indexBytes, i, resources);
+                    meshVertexRegions[i] = buffer_heap_alloc(bufferHeap, vertexCount * 8 * sizeof(float), i, resources);
+                    meshVertexCounts[i] = vertexCount;
+                    buffer_heap_upload(bufferHeap, meshIndexRegions[i], 0, indexBytes, &streamed->lodIndices[0]);
+                    buffer_heap_upload(bufferHeap, meshVertexRegions[i], 0, vertexCount*3*sizeof(float), &m.positions[0]);
+                    buffer_heap_upload(bufferHeap, meshVertexRegions[i], vertexCount*3*sizeof(float), vertexCount*3*sizeof(float), &m.normals[0]);
+                    buffer_heap_upload(bufferHeap, meshVertexRegions[i], vertexCount*6*sizeof(float), vertexCount*2*sizeof(float), &m.uvs[0]);
+                    mesh_vertex_array_bind(assimp_vao[i], bufferHeap, meshIndexRegions[i], meshVertexRegions[i], vertexCount);
+                    // Level offsets count from the start of the shared index buffer
+                    const GLuint indexBase = buffer_heap_offset(bufferHeap, meshIndexRegions[i]) / sizeof(GLuint);
+                    for (int l = 0; l < assimp_lods[i].lodCount; ++l)
+                        assimp_lods[i].indexOffset[l] += indexBase;
+                    streamUploadBytes += indexBytes + vertexCount * 8 * sizeof(float);
+                }
+                assimp_diffuse_texture_ids[i] = materialResident[meshMaterials[i]] ? materialTextures[meshMaterials[i]] : 0;
+                meshResident[i] = !streamed->lodIndices.empty();
+                ++residentMeshCount;
+
+                // Copies get a vertex array on the buffers of their source
+                for (size_t k = 0; k < meshCopies[i].size(); ++k)
+                {
+                    unsigned int c = meshCopies[i][k];
+                    if (meshResident[i])
+                        mesh_vertex_array_bind(assimp_vao[c], bufferHeap, meshIndexRegions[i], meshVertexRegions[i], vertexCount);
+                    assimp_lods[c] = assimp_lods[i];
+                    assimp_diffuse_texture_ids[c] = assimp_diffuse_texture_ids[i];
+                    meshResident[c] = meshResident[i];
+                    ++residentMeshCount;
+                }
+                ++meshesArrived;
+                scene_stream_release_mesh(sceneStream, streamed);
+            }
+            pendingMeshes.resize(pendingMeshDistances.size());
+            for (size_t k = 0; k < pendingMeshDistances.size(); ++k)
+                pendingMeshes[k] = pendingMeshDistances[k].second;
 
+            // Textures in bands of rows, in the order they were prepared
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            while (!pendingTextures.empty() && streamUploadBytes < uploadBudget)
+            {
+                PROFILE_ZONE("texture upload");
+                StreamedTexture * streamed = pendingTextures.front();
+                GLuint & texture = materialTextures[streamed->material];
+                glActiveTexture(GL_TEXTURE0);
+                if (pendingTextureRows == 0)
+                {
+                    glGenTextures(1, &texture);
+                    glBindTexture(GL_TEXTURE_2D, texture);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, streamed->width, streamed->height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+                    resource_track(resources, GL_TEXTURE, texture, RESOURCE_MATERIAL_TEXTURES, texture_bytes(GL_RGB, streamed->width, streamed->height, 1, false));
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                }
+                else
+                    glBindTexture(GL_TEXTURE_2D, texture);
+                const size_t rowBytes = (size_t) streamed->width * 3;
+                int rows = (int) std::min<size_t>(std::max<size_t>((uploadBudget - streamUploadBytes) / rowBytes, 1), streamed->height - pendingTextureRows);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, pendingTextureRows, streamed->width, rows, GL_RGB, GL_UNSIGNED_BYTE, streamed->pixels + pendingTextureRows * rowBytes);
+                pendingTextureRows += rows;
+                streamUploadBytes += rows * rowBytes;
+                if (pendingTextureRows < streamed->height)
+                    continue;
+                // Complete, meshes of the material sample it from now on
+                materialResident[streamed->material] = 1;
+                for (unsigned int i = 0; i < sceneMeshCount; ++i)
+                    if (meshMaterials[i] == streamed->material)
+                        assimp_diffuse_texture_ids[i] = texture;
+                ++residentTextureCount;
+                pendingTextureRows = 0;
+                pendingTextures.erase(pendingTextures.begin());
+                scene_stream_release_texture(sceneStream, streamed);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
+            // Cached shadows are redrawn as casters arrive, not every frame
+            shadowsStale = shadowsStale || meshesArrived > 0;
+            if (streamState == SCENE_STREAM_PREPARED && pendingMeshes.empty() && pendingTextures.empty())
+            {
+                sceneStreamed = true;
+                sceneStreamedFrame = frameIndex;
+                printf("Scene streamed : %.1f ms after start, %d meshes, %d textures\n", glfwGetTime() * 1000.0, residentMeshCount, residentTextureCount);
+            }
+            if (shadowsStale && (sceneStreamed || frameIndex % 16 == 0))
+            {
+                shadow_cascades_invalidate(shadowCascades);
+                shadow_atlas_invalidate(shadowAtlas);
+                shadowsStale = false;
+            }
+        }
+        // Imported data and prepared items held on the CPU
+        size_t streamCpuBytes = scene_stream_cpu_bytes(sceneStream);
+        if (streamCpuBytes > sceneStreamCpuBytes)
+            cpu_heap_alloc(resources, CPU_IMPORT, streamCpuBytes - sceneStreamCpuBytes);
+        else
+            cpu_heap_free(resources, CPU_IMPORT, sceneStreamCpuBytes - streamCpuBytes);
+        sceneStreamCpuBytes = streamCpuBytes;
 
-        // Select textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textures[1]);
-
-
-        // Select shader
-        glUseProgram(gbufferProgramObject);
-
-        // Upload uniforms
-        glProgramUniformMatrix4fv(gbufferProgramObject, mvpLocation, 1, 0, glm::value_ptr(mvp));
-        glProgramUniformMatrix4fv(gbufferProgramObject, mvLocation, 1, 0, glm::value_ptr(mv));
-        glProgramUniform1i(gbufferProgramObject, instanceCountLocation, (int) instanceCount);
-        glProgramUniform1f(gbufferProgramObject, specularPowerLocation, 30.f);
-        glProgramUniform1f(gbufferProgramObject, timeLocation, t);
-        glProgramUniform1i(gbufferProgramObject, diffuseLocation, 0);
-        glProgramUniform1i(gbufferProgramObject, specLocation, 1);
-        glProgramUniformMatrix4fv(pointlightProgramObject, pointInverseProjectionLocation, 1, 0, glm::value_ptr(inverseProjection));
-        glProgramUniformMatrix4fv(directionallightProgramObject, directionalInverseProjectionLocation, 1, 0, glm::value_ptr(inverseProjection));
-        glProgramUniformMatrix4fv(spotlightProgramObject, spotInverseProjectionLocation, 1, 0, glm::value_ptr(inverseProjection));
-
-        // Render vaos
-        glBindVertexArray(vao[0]);
-        //glDrawElements(GL_TRIANGLES, cube_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        glProgramUniform1f(gbufferProgramObject, timeLocation, 0.f);
-        glBindVertexArray(vao[1]);
-        //glDrawElements(GL_TRIANGLES, plane_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, fxFbo);
-        // Attach first fx texture to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
-        // Only the color buffer is used
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        glDisable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE);
-
-        // Select textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gbufferTextures[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, gbufferTextures[1]);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, gbufferTextures[2]);
-
-        // Bind the same VAO for all lights
-        glBindVertexArray(vao[2]);
-
-        // Render point lights
-        glUseProgram(pointlightProgramObject);
-        struct PointLight
-        {
-            glm::vec3 position;
-            int padding;
-            glm::vec3 color;
-            float intensity;
-        };
-        for (int i = 0; i < pointLightCount; ++i)
-        {
-            glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            // PointLight p = { 
-            //     glm::vec3( worldToView * glm::vec4((pointLightCount*cosf(t)) * sinf(t*i), 1.0, fabsf(pointLightCount*sinf(t)) * cosf(t*i), 1.0)),
-            //     0,
-            //     glm::vec3(fabsf(cos(t+i*2.f)), 1.-fabsf(sinf(t+i)) , 0.5f + 0.5f-fabsf(cosf(t+i)) ),
-            //     0.5f + fabsf(cosf(t+i))
-            // };
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(X,Y,Z,1)),
-                0,
-                glm::vec3(R,G,B),
-                I
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+        // A few regions of the geometry heap move down each frame
+        buffer_heap_compact(bufferHeap, (size_t) compactBudgetKB * 1024, bufferMoves);
+        for (size_t k = 0; k < bufferMoves.size(); ++k)
+        {
+            const BufferMove & move = bufferMoves[k];
+            unsigned int i = bufferHeap.regions[move.region].owner;
+            if (move.region == meshIndexRegions[i])
+            {
+                // Same buffer, only the level offsets change
+                GLuint from = move.from / sizeof(GLuint), to = move.to / sizeof(GLuint);
+                for (int l = 0; l < assimp_lods[i].lodCount; ++l)
+                    assimp_lods[i].indexOffset[l] = assimp_lods[i].indexOffset[l] - from + to;
+                for (size_t c = 0; c < meshCopies[i].size(); ++c)
+                    for (int l = 0; l < assimp_lods[i].lodCount; ++l)
+                        assimp_lods[meshCopies[i][c]].indexOffset[l] = assimp_lods[i].indexOffset[l];
+            }
+            else
+            {
+                mesh_vertex_array_bind(assimp_vao[i], bufferHeap, meshIndexRegions[i], meshVertexRegions[i], meshVertexCounts[i]);
+                for (size_t c = 0; c < meshCopies[i].size(); ++c)
+                    mesh_vertex_array_bind(assimp_vao[meshCopies[i][c]], bufferHeap, meshIndexRegions[i], meshVertexRegions[i], meshVertexCounts[i]);
+            }
         }
-
-        // Point light 1
+        PROFILE_PHASE_END(streamingZone);
+
+        // Per mesh transforms, level of detail and view depth
+        PROFILE_PHASE_BEGIN(transformsZone, "transforms and culling");
+        glm::mat4 scale = sceneScale;
+        // Projected size in pixels of one world unit at unit distance
+        float pixelsPerUnit = projection[1][1] * renderHeight * 0.5f;
+        sceneTriangles = 0;
+        sceneTrianglesDrawn = 0;
+        int maxTrianglesDrawn = 0;
+        if (sceneMeshCount > 0)
+            mesh_transforms_soa(jitteredProjection, worldToView, scale, sceneTransforms, &meshMv[0], &meshMvp[0], (TransformPath) transformPath);
+        if (sceneFrustumCulling)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(1.5,0.5,-4.8,1)),
-                0,
-                glm::vec3(0,0,1),
-                1.5
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            // Meshes seen by any of the views
+            std::fill(meshVisible.begin(), meshVisible.end(), 0);
+            for (int view = 0; view < viewCount; ++view)
+            {
+                glm::vec4 planes[6];
+                frustum_planes(view == 0 ? jitteredProjection * worldToView : viewsProjection[view] * viewsWorldToView[view], planes);
+                sphere_bvh_cull(sceneBvh, planes, visibleMeshes);
+                for (size_t k = 0; k < visibleMeshes.size(); ++k)
+                    meshVisible[visibleMeshes[k]] = meshResident[visibleMeshes[k]];
+            }
+            sceneMeshesVisible = (int) std::count(meshVisible.begin(), meshVisible.end(), 1);
         }
-
-        // Point light 2
+        else
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(-10,2.681,-5.83,1)),
-                0,
-                glm::vec3(1,0.357,1),
-                10
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            meshVisible = meshResident;
+            sceneMeshesVisible = residentMeshCount;
         }
-
-        // Point light 3
+        for (unsigned int i =0; i < sceneMeshCount; ++i)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(-13.872,0.936,-3.319,1)),
-                0,
-                glm::vec3(1,0.46,0.009),
-                2.085
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            MeshLod & lod = assimp_lods[i];
+            const glm::mat4 & mvScaled = meshMv[i];
+            glm::mat3 linear = glm::mat3(scale * assimp_objectToWorld[i]);
+            float worldScale = std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+            glm::vec3 center = glm::vec3(mvScaled * glm::vec4(lod.center, 1.f));
+            int level = 0;
+            if (lodEnabled)
+            {
+                float distance = std::max(glm::length(center) - lod.radius * worldScale, 0.1f);
+                level = mesh_lod_select(lod, pixelsPerUnit * worldScale / distance, lodThreshold);
+            }
+            sceneTriangles += lod.indexCount[0] / 3;
+            sceneTrianglesDrawn += meshVisible[i] ? lod.indexCount[level] / 3 : 0;
+            if (meshVisible[i])
+                maxTrianglesDrawn = std::max(maxTrianglesDrawn, (int) lod.indexCount[level] / 3);
+            meshLevels[i] = level;
+            meshDepths[i] = -center.z;
         }
 
-        // Point light 4
+        // Front to back order, the order barely changes from one frame to the
+        // next so an insertion sort of the previous order is close to linear
+        if (sortFrontToBack)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(-10.818,0.085,-1.617,1)),
-                0,
-                glm::vec3(0,1,0.809),
-                0.183
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            for (unsigned int i = 1; i < sceneMeshCount; ++i)
+            {
+                unsigned int mesh = drawOrder[i];
+                unsigned int j = i;
+                for (; j > 0 && meshDepths[drawOrder[j-1]] > meshDepths[mesh]; --j)
+                    drawOrder[j] = drawOrder[j-1];
+                drawOrder[j] = mesh;
+            }
         }
 
-        // Point light 5
+        PROFILE_PHASE_END(transformsZone);
+
+        // Depth pre-pass, the scene pass then only shades visible fragments.
+        // The shadow program is depth only and computes the same positions
+        PROFILE_PHASE_BEGIN(scenePassZone, "scene pass");
+        // Visibility buffer when the frame fits in its ids, the G-buffer otherwise
+        const bool visibilityActive = visibilityEnabled && !multiViewActive && !msaaActive
+            && materialTextures.size() <= (size_t) VisibilityBuffer::MAX_MATERIALS
+            && visibility_buffer_begin(visibility, bufferHeap, sceneMeshesVisible, maxTrianglesDrawn);
+        if (visibilityActive && benchmark && sceneStreamed && frameIndex > sceneStreamedFrame + BENCHMARK_WARMUP_FRAMES)
+            ++benchmarkRecord.visibilityFrames;
+        if (depthPrepass && !multiViewActive && !visibilityActive)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(-6.043,-1.957,0.426,1)),
-                0,
-                glm::vec3(1,0,1),
-                2.213
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            glUseProgram(shadowProgramObject);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (unsigned int k = 0; k < sceneMeshCount; ++k)
+            {
+                unsigned int i = drawOrder[k];
+                if (!meshVisible[i])
+                    continue;
+                const MeshLod & lod = assimp_lods[i];
+                glProgramUniformMatrix4fv(shadowProgramObject, shadowMvpLocation, 1, 0, glm::value_ptr(meshMvp[i]));
+                glBindVertexArray(assimp_vao[i]);
+                glDrawElements(GL_TRIANGLES, lod.indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(lod.indexOffset[meshLevels[i]] * sizeof(GLuint)));
+            }
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+            glUseProgram(sceneProgramObject);
         }
 
-        // Point light 6
+        // Multi-view : each draw is instanced once per view, per view
+        // matrices are set once for the frame
+        glm::mat4 viewsViewProjection[MultiView::MAX_VIEWS];
+        if (multiViewActive)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(0.596,3.149,-6.553,1)),
-                0,
-                glm::vec3(1,0.272,0.489),
-                7.149
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            glUseProgram(multiViewProgramObject);
+            for (int view = 0; view < viewCount; ++view)
+            {
+                viewsViewProjection[view] = (view == 0 ? jitteredProjection : viewsProjection[view]) * viewsWorldToView[view];
+                glm::ivec2 size = multi_view_size(multiView, view, renderWidth, renderHeight);
+                glViewportIndexedf(view, 0.f, 0.f, (float) size.x, (float) size.y);
+            }
+            glProgramUniformMatrix4fv(multiViewProgramObject, multiViewViewProjectionsLocation, viewCount, 0, glm::value_ptr(viewsViewProjection[0]));
+            glProgramUniformMatrix4fv(multiViewProgramObject, multiViewPrevViewProjectionsLocation, viewCount, 0, glm::value_ptr(multiView.previousViewProjections[0]));
+            glProgramUniform2fv(multiViewProgramObject, multiViewJitterLocation, 1, glm::value_ptr(jitter));
         }
 
-        // Point light 7
+        // Ids of the visibility buffer, its depth is the one of the G-buffer
+        if (visibilityActive)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(11.149,7.234,-5.702,1)),
-                0,
-                glm::vec3(1,0,0),
-                10
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            const GLuint noDraw[4] = { 0xffffffffu, 0, 0, 0 };
+            glBindFramebuffer(GL_FRAMEBUFFER, visibility.fbo);
+            glClearBufferuiv(GL_COLOR, 0, noDraw);
+            glUseProgram(visibilityProgramObject);
+            glProgramUniform1ui(visibilityProgramObject, visibilityTriangleBitsLocation, visibility.triangleBits);
         }
 
-        // Point light 8
+        // Render vaos
+        glActiveTexture(GL_TEXTURE0);
+        overdraw_counter_begin(overdrawCounter, renderWidth * renderHeight * viewCount * (msaaActive ? msaa.samples : 1));
+        std::fill(meshInstanced.begin(), meshInstanced.end(), 0);
+        sceneInstancedDraws = 0;
+        sceneInstancedMeshes = 0;
+        for (unsigned int k = 0; k < sceneMeshCount; ++k)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(8.085,-2.979,-1.617,1)),
-                0,
-                glm::vec3(0.268,1,1),
-                3.957
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            unsigned int i = drawOrder[k];
+            if (!meshVisible[i] || meshInstanced[i])
+                continue;
+            GLuint subIndex = 1;
+            // Materials are sampled by the resolve in visibility buffer mode
+            VisibilityRecord record;
+            if (visibilityActive)
+            {
+                unsigned int source = meshSources[i];
+                visibility_record_geometry(record, bufferHeap, meshIndexRegions[source], meshVertexRegions[source], meshVertexCounts[source], assimp_lods[i].indexOffset[meshLevels[i]]);
+                record.diffuseColor = glm::make_vec3(assimp_diffuse_colors + 3*i);
+                record.material = assimp_diffuse_texture_ids[i] > 0 ? meshMaterials[i] + 1 : 0;
+            }
+            else
+            {
+                if (assimp_diffuse_texture_ids[i] > 0) {
+                    glBindTexture(GL_TEXTURE_2D, assimp_diffuse_texture_ids[i]);
+                    subIndex = 0;
+                }
+                glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subIndex);
+            }
+            if (multiViewActive)
+            {
+                glm::mat4 model = scale * assimp_objectToWorld[i];
+                glProgramUniformMatrix4fv(multiViewProgramObject, multiViewModelLocation, 1, 0, glm::value_ptr(model));
+                glProgramUniformMatrix3fv(multiViewProgramObject, multiViewNormalMatrixLocation, 1, 0, glm::value_ptr(meshNormalMatrices[i]));
+                glProgramUniform3fv(multiViewProgramObject, multiViewDiffuseColorLocation, 1, assimp_diffuse_colors + 3*i);
+                const MeshLod & lod = assimp_lods[i];
+                glBindVertexArray(assimp_vao[i]);
+                glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(lod.indexOffset[meshLevels[i]] * sizeof(GLuint)), viewCount);
+                continue;
+            }
+            // Repeated geometry : the mesh and the visible meshes sharing its
+            // streams and level, drawn together when the nearest comes first
+            unsigned int source = meshSources[i];
+            if (!meshCopies[source].empty())
+            {
+                glm::mat4 instanceMvps[MAX_SCENE_INSTANCES];
+                glm::mat4 instancePrevMvps[MAX_SCENE_INSTANCES];
+                glm::mat3 instanceNormalMatrices[MAX_SCENE_INSTANCES];
+                unsigned int instanceMeshes[MAX_SCENE_INSTANCES];
+                int instances = scene_instance_group(i, source, meshCopies[source], &meshVisible[0], &meshLevels[0], &meshInstanced[0], instanceMeshes, MAX_SCENE_INSTANCES);
+                for (int k = 0; k < instances; ++k)
+                {
+                    unsigned int j = instanceMeshes[k];
+                    instanceMvps[k] = meshMvp[j];
+                    instancePrevMvps[k] = previousViewProjection * scale * assimp_objectToWorld[j];
+                    instanceNormalMatrices[k] = meshNormalMatrices[j];
+                }
+                ++sceneInstancedDraws;
+                sceneInstancedMeshes += instances;
+                const MeshLod & lod = assimp_lods[i];
+                if (visibilityActive)
+                {
+                    visibility_buffer_add_instances(visibility, record, instanceMvps, instancePrevMvps, instanceNormalMatrices, instances, visibilityProgramObject, visibilityMvpsLocation, visibilityDrawBaseLocation);
+                    glBindVertexArray(assimp_vao[i]);
+                    glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(lod.indexOffset[meshLevels[i]] * sizeof(GLuint)), instances);
+                    continue;
+                }
+                glUseProgram(sceneInstancedProgramObject);
+                glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subIndex);
+                glProgramUniformMatrix4fv(sceneInstancedProgramObject, sceneInstancedMvpsLocation, instances, 0, glm::value_ptr(instanceMvps[0]));
+                glProgramUniformMatrix4fv(sceneInstancedProgramObject, sceneInstancedPrevMvpsLocation, instances, 0, glm::value_ptr(instancePrevMvps[0]));
+                glProgramUniformMatrix3fv(sceneInstancedProgramObject, sceneInstancedNormalMatricesLocation, instances, 0, glm::value_ptr(instanceNormalMatrices[0]));
+                glProgramUniform3fv(sceneInstancedProgramObject, sceneInstancedDiffuseColorLocation, 1, assimp_diffuse_colors + 3*i);
+                glBindVertexArray(assimp_vao[i]);
+                glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(lod.indexOffset[meshLevels[i]] * sizeof(GLuint)), instances);
+                glUseProgram(sceneProgramObject);
+                continue;
+            }
+            glm::mat4 prevMvpScaled = previousViewProjection * scale * assimp_objectToWorld[i];
+            if (visibilityActive)
+            {
+                const MeshLod & lod = assimp_lods[i];
+                visibility_buffer_add_instances(visibility, record, &meshMvp[i], &prevMvpScaled, &meshNormalMatrices[i], 1, visibilityProgramObject, visibilityMvpsLocation, visibilityDrawBaseLocation);
+                glBindVertexArray(assimp_vao[i]);
+                glDrawElements(GL_TRIANGLES, lod.indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(lod.indexOffset[meshLevels[i]] * sizeof(GLuint)));
+                continue;
+            }
+            glProgramUniformMatrix4fv(sceneProgramObject, mvpLocation2, 1, 0, glm::value_ptr(meshMvp[i]));
+            glProgramUniformMatrix4fv(sceneProgramObject, prevMvpLocation2, 1, 0, glm::value_ptr(prevMvpScaled));
+            glProgramUniformMatrix4fv(sceneProgramObject, mvLocation2, 1, 0, glm::value_ptr(meshMv[i]));
+            glProgramUniform3fv(sceneProgramObject, diffuseColorLocation, 1, assimp_diffuse_colors + 3*i);
+            const MeshLod & lod = assimp_lods[i];
+            glBindVertexArray(assimp_vao[i]);
+            glDrawElements(GL_TRIANGLES, lod.indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(lod.indexOffset[meshLevels[i]] * sizeof(GLuint)));
         }
-
-        // Point light 9
+        overdraw_counter_end(overdrawCounter);
+        if (depthPrepass && !multiViewActive && !visibilityActive)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(12.34,0.426,-4.34,1)),
-                0,
-                glm::vec3(0.889,0.396,0),
-                0.736
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
         }
 
-        // Point light 10
+        // Visibility buffer resolve : the material of each pixel as a depth,
+        // then the G-buffer of each material behind an equal depth test
+        if (visibilityActive)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(17.277,0.085,2.638,1)),
-                0,
-                glm::vec3(0.723,0.311,0.779),
-                0.723
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
+            visibility_buffer_upload(visibility, resources);
+            glBindFramebuffer(GL_FRAMEBUFFER, visibility.materialFbo);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glBindVertexArray(vao[2]);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, visibility.ids);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_BUFFER, visibility.recordTextures[0]);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_BUFFER, visibility.recordTextures[1]);
+            for (int a = 0; a < visibility.arenaCount; ++a)
+            {
+                glActiveTexture(GL_TEXTURE4 + a);
+                glBindTexture(GL_TEXTURE_BUFFER, visibility.arenaTextures[a]);
+            }
+            glDepthFunc(GL_ALWAYS);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glUseProgram(visibilityMaterialProgramObject);
+            glProgramUniform1ui(visibilityMaterialProgramObject, visibilityMaterialTriangleBitsLocation, visibility.triangleBits);
             glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+            glUseProgram(visibilityResolveProgramObject);
+            glProgramUniform1ui(visibilityResolveProgramObject, visibilityResolveTriangleBitsLocation, visibility.triangleBits);
+            glProgramUniform2f(visibilityResolveProgramObject, visibilityResolveRenderSizeLocation, (float) renderWidth, (float) renderHeight);
+            glProgramUniform2fv(visibilityResolveProgramObject, visibilityResolveJitterLocation, 1, glm::value_ptr(jitter));
+            glActiveTexture(GL_TEXTURE0);
+            for (size_t m = 0; m < visibility.frameMaterials.size(); ++m)
+            {
+                int key = visibility.frameMaterials[m];
+                glBindTexture(GL_TEXTURE_2D, key > 0 ? materialTextures[key - 1] : 0);
+                glProgramUniform1i(visibilityResolveProgramObject, visibilityResolveTexturedLocation, key > 0);
+                glProgramUniform1f(visibilityResolveProgramObject, visibilityResolveMaterialDepthLocation, (key + 1) / (float) VisibilityBuffer::MATERIAL_DEPTH_STEPS);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            }
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            glBindFramebuffer(GL_FRAMEBUFFER, gbufferFbo);
         }
 
-        // Point light 11
+
+
+        // Instanced field
+        if (instancingSupported && instanceCount > 0)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(17.277,3.489,-5.872,1)),
-                0,
-                glm::vec3(1,0.532,0.311),
-                5.234
-            };
+            // Grow instance buffers if needed
+            if (instanceCount > instanceCapacity)
+            {
+                instanceCapacity = instanceCount;
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffers[0]);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCapacity * sizeof(InstanceTransform), 0, GL_DYNAMIC_COPY);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffers[1]);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCapacity * sizeof(GLuint), 0, GL_DYNAMIC_COPY);
+                resource_track(resources, GL_BUFFER, instanceBuffers[0], RESOURCE_GEOMETRY, instanceCapacity * sizeof(InstanceTransform));
+                resource_track(resources, GL_BUFFER, instanceBuffers[1], RESOURCE_GEOMETRY, instanceCapacity * sizeof(GLuint));
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                instanceUpdateCount = -1;
+            }
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffers[0]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffers[1]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, instanceBuffers[2]);
+            int groupCount = (instanceCount + 255) / 256;
 
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            // Recompute transforms only when time or layout changed
+            if (t != instanceUpdateTime || instanceCount != instanceUpdateCount || instanceSpacing != instanceUpdateSpacing)
+            {
+                int side = (int) ceil(sqrt((double) instanceCount));
+                glUseProgram(instancesProgramObject);
+                glProgramUniform1f(instancesProgramObject, instancesTimeLocation, t);
+                glProgramUniform1i(instancesProgramObject, instancesCountLocation, instanceCount);
+                glProgramUniform1i(instancesProgramObject, instancesSideLocation, side);
+                glProgramUniform1f(instancesProgramObject, instancesSpacingLocation, instanceSpacing);
+                glDispatchCompute(groupCount, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                instanceUpdateTime = t;
+                instanceUpdateCount = instanceCount;
+                instanceUpdateSpacing = instanceSpacing;
+            }
+
+            // Frustum cull instances and compact the visible ones into the draw command
+            glm::vec4 planes[6];
+            frustum_planes(mvp, planes);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceBuffers[2]);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand), &instanceDrawCommand);
+            glUseProgram(instanceCullProgramObject);
+            glProgramUniform1i(instanceCullProgramObject, instanceCullCountLocation, instanceCount);
+            glProgramUniform1f(instanceCullProgramObject, instanceCullRadiusLocation, instanceRadius);
+            glProgramUniform4fv(instanceCullProgramObject, instanceCullPlanesLocation, 6, glm::value_ptr(planes[0]));
+            glDispatchCompute(groupCount, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+            // Select textures
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, textures[0]);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, textures[1]);
+
+            // Select shader
+            glUseProgram(gbufferProgramObject);
+
+            // Upload uniforms
+            glProgramUniformMatrix4fv(gbufferProgramObject, mvpLocation, 1, 0, glm::value_ptr(mvp));
+            glProgramUniformMatrix4fv(gbufferProgramObject, mvLocation, 1, 0, glm::value_ptr(mv));
+            glProgramUniformMatrix4fv(gbufferProgramObject, prevMvpLocation, 1, 0, glm::value_ptr(previousViewProjection));
+            glProgramUniform2fv(gbufferProgramObject, jitterLocation, 1, glm::value_ptr(jitter));
+            glProgramUniform1f(gbufferProgramObject, specularPowerLocation, 30.f);
+
+            // Render visible instances
+            glBindVertexArray(vao[0]);
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
         }
 
+        PROFILE_PHASE_END(scenePassZone);
 
-        // Point light 12
+        gpu_timers_mark(gpuTimers, GPU_PASS_SHADOW);
+        PROFILE_PHASE_BEGIN(shadowsZone, "shadows");
+
+        // Shadow maps, only what the caches miss is rendered
+        shadowCascadesRendered = 0;
+        shadowFacesRendered = 0;
+        bool dynamicShadows = shadows && instancingSupported && instanceCount > 0;
+        if (shadows)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(16.085,0.255,-7.915,1)),
-                0,
-                glm::vec3(0,0.532,0.604),
-                9.894
-            };
+            glBindFramebuffer(GL_FRAMEBUFFER, shadowFbo);
+            glEnable(GL_DEPTH_TEST);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.f, 4.f);
+
+            // Static casters into the cascades the cache misses
+            bool refresh[ShadowCascades::CASCADE_COUNT];
+            shadow_cascades_update(shadowCascades, projection, worldToView, directionalLightDirection, refresh);
+            glViewport(0, 0, ShadowCascades::SIZE, ShadowCascades::SIZE);
+            glUseProgram(shadowProgramObject);
+            for (int c = 0; c < ShadowCascades::CASCADE_COUNT; ++c)
+            {
+                if (!refresh[c])
+                    continue;
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowCascades.staticTexture, 0, c);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                for (unsigned int i = 0; i < sceneMeshCount; ++i)
+                {
+                    if (!meshResident[i])
+                        continue;
+                    glm::mat4 shadowMvp = shadowCascades.matrices[c] * scale * assimp_objectToWorld[i];
+                    glProgramUniformMatrix4fv(shadowProgramObject, shadowMvpLocation, 1, 0, glm::value_ptr(shadowMvp));
+                    glBindVertexArray(assimp_vao[i]);
+                    glDrawElements(GL_TRIANGLES, assimp_lods[i].indexCount[0], GL_UNSIGNED_INT, (void*)(assimp_lods[i].indexOffset[0] * sizeof(GLuint)));
+                }
+                ++shadowCascadesRendered;
+            }
 
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            // Dynamic casters are redrawn every frame in their own layers,
+            // culled against each cascade
+            if (dynamicShadows)
+            {
+                glUseProgram(shadowInstancedProgramObject);
+                glBindVertexArray(vao[0]);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceBuffers[2]);
+                int groupCount = (instanceCount + 255) / 256;
+                for (int c = 0; c < ShadowCascades::CASCADE_COUNT; ++c)
+                {
+                    glm::vec4 planes[6];
+                    frustum_planes(shadowCascades.matrices[c], planes);
+                    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand), &instanceDrawCommand);
+                    glUseProgram(instanceCullProgramObject);
+                    glProgramUniform4fv(instanceCullProgramObject, instanceCullPlanesLocation, 6, glm::value_ptr(planes[0]));
+                    glDispatchCompute(groupCount, 1, 1);
+                    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowCascades.dynamicTexture, 0, c);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    glUseProgram(shadowInstancedProgramObject);
+                    glProgramUniformMatrix4fv(shadowInstancedProgramObject, shadowInstancedMvpLocation, 1, 0, glm::value_ptr(shadowCascades.matrices[c]));
+                    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0);
+                }
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            }
+
+            // Static casters into the cube faces the cache misses, within a per frame budget
+            int faceBudget = ShadowAtlas::FACES_PER_FRAME;
+            glViewport(0, 0, ShadowAtlas::SIZE, ShadowAtlas::SIZE);
+            glUseProgram(shadowProgramObject);
+            for (int l = 0; l < shadowAtlas.lightCount && faceBudget > 0; ++l)
+            {
+                if (shadowAtlas.positions[l] != staticPointLights[l].position)
+                {
+                    shadowAtlas.positions[l] = staticPointLights[l].position;
+                    shadowAtlas.validFaces[l] = 0;
+                }
+                for (; shadowAtlas.validFaces[l] < 6 && faceBudget > 0; ++shadowAtlas.validFaces[l], --faceBudget)
+                {
+                    int face = shadowAtlas.validFaces[l];
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowAtlas.texture, 0, l * 6 + face);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    glm::mat4 faceMatrix = shadow_atlas_face_matrix(shadowAtlas, staticPointLights[l].position, face);
+                    for (unsigned int i = 0; i < sceneMeshCount; ++i)
+                    {
+                        if (!meshResident[i])
+                            continue;
+                        glm::mat4 shadowMvp = faceMatrix * scale * assimp_objectToWorld[i];
+                        glProgramUniformMatrix4fv(shadowProgramObject, shadowMvpLocation, 1, 0, glm::value_ptr(shadowMvp));
+                        glBindVertexArray(assimp_vao[i]);
+                        glDrawElements(GL_TRIANGLES, assimp_lods[i].indexCount[0], GL_UNSIGNED_INT, (void*)(assimp_lods[i].indexOffset[0] * sizeof(GLuint)));
+                    }
+                    ++shadowFacesRendered;
+                }
+            }
+
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glViewport(0, 0, renderWidth, renderHeight);
         }
 
+        PROFILE_PHASE_END(shadowsZone);
 
-        // Point light 13
+        // Light regions follow the light counts, the holes they leave are
+        // filled by compaction. Offsets are read at each bind, moved regions
+        // need nothing more
+        const int lightCounts[LIGHT_REGION_COUNT] = { pointLightCount, staticPointLightCount, directionalLightCount };
+        for (int k = 0; k < LIGHT_REGION_COUNT; ++k)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(-14.553,1.277,-0.426,1)),
-                0,
-                glm::vec3(1,0.196,0),
-                3.957
-            };
-
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            int slots = lightCounts[k] * viewCount;
+            if (slots == lightRegionSlots[k])
+                continue;
+            if (lightRegions[k] != -1)
+                buffer_heap_free(uniformHeap, lightRegions[k]);
+            lightRegions[k] = slots ? buffer_heap_alloc(uniformHeap, slots * lightSlotBytes, k, resources) : -1;
+            lightRegionSlots[k] = slots;
         }
+        buffer_heap_compact(uniformHeap, (size_t) compactBudgetKB * 1024, uniformMoves);
 
-
-        // Point light 14
+        // Per view camera, G-buffer layer and viewport. Temporal effects only
+        // keep a history for the first view
+        for (int view = 0; view < viewCount; ++view)
         {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(-7.064,1.957,-0.426,1)),
-                0,
-                glm::vec3(1,0.536,0.745),
-                4.213
-            };
+            const glm::mat4 & viewWorldToView = viewsWorldToView[view];
+            glm::mat4 viewInverseProjection = view == 0 ? inverseProjection : glm::inverse(viewsProjection[view]);
+            glm::mat4 viewViewToWorld = glm::inverse(viewWorldToView);
+            const GLuint * viewTextures = multiViewActive ? multiView.layers[view] : gbufferTextures;
+            bool viewTemporal = temporal && view == 0;
+            glm::ivec2 viewSize = multiViewActive ? multi_view_size(multiView, view, renderWidth, renderHeight) : glm::ivec2(renderWidth, renderHeight);
+            glViewport(0, 0, viewSize.x, viewSize.y);
+            if (multiViewActive)
+                for (int i = 0; i < SCALED_PROGRAM_COUNT; ++i)
+                    glProgramUniform2f(scaledPrograms[i], scaledProgramsViewportScaleLocations[i], viewSize.x / widthf, viewSize.y / heightf);
+
+            gpu_timers_mark(gpuTimers, GPU_PASS_LIGHTING);
+            PROFILE_PHASE_BEGIN(lightingZone, "lighting");
+
+            // Shadow uniforms of the lights
+            glm::mat4 viewToShadow[ShadowCascades::CASCADE_COUNT];
+            for (int c = 0; c < ShadowCascades::CASCADE_COUNT; ++c)
+                viewToShadow[c] = shadowCascades.matrices[c] * viewViewToWorld;
+            glProgramUniform1i(directionallightProgramObject, directionalShadowsLocation, shadows);
+            glProgramUniform1i(directionallightProgramObject, directionalDynamicShadowsLocation, dynamicShadows);
+            glProgramUniformMatrix4fv(directionallightProgramObject, directionalViewToShadowLocation, ShadowCascades::CASCADE_COUNT, 0, glm::value_ptr(viewToShadow[0]));
+            glProgramUniform1fv(directionallightProgramObject, directionalCascadeSplitsLocation, ShadowCascades::CASCADE_COUNT, shadowCascades.splits);
+            glProgramUniformMatrix4fv(pointlightProgramObject, pointViewToWorldLocation, 1, 0, glm::value_ptr(viewViewToWorld));
+            glProgramUniform1f(pointlightProgramObject, pointShadowNearLocation, shadowAtlas.nearPlane);
+            glProgramUniform1f(pointlightProgramObject, pointShadowFarLocation, shadowAtlas.farPlane);
+
+            glProgramUniformMatrix4fv(pointlightProgramObject, pointInverseProjectionLocation, 1, 0, glm::value_ptr(viewInverseProjection));
+            glProgramUniformMatrix4fv(directionallightProgramObject, directionalInverseProjectionLocation, 1, 0, glm::value_ptr(viewInverseProjection));
+            glProgramUniformMatrix4fv(spotlightProgramObject, spotInverseProjectionLocation, 1, 0, glm::value_ptr(viewInverseProjection));
+
+            glBindVertexArray(vao[2]);
+            if (msaaActive)
+            {
+                // Single sample G-buffer from the samples, for post processing
+                // and the lights of pixels that are not edges
+                glBindFramebuffer(GL_FRAMEBUFFER, gbufferFbo);
+                glEnable(GL_DEPTH_TEST);
+                glDepthFunc(GL_ALWAYS);
+                for (int k = 0; k < 4; ++k)
+                {
+                    glActiveTexture(GL_TEXTURE0 + k);
+                    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaa.textures[k]);
+                }
+                glUseProgram(msaaResolveProgramObject);
+                glProgramUniform1i(msaaResolveProgramObject, msaaResolveSamplesLocation, msaa.samples);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+                glDepthFunc(GL_LESS);
+            }
 
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        }
+            glBindFramebuffer(GL_FRAMEBUFFER, fxFbo);
+            // Attach first fx texture to framebuffer
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
+            // Only the color buffer is used
+            glClear(GL_COLOR_BUFFER_BIT);
 
+            glDisable(GL_DEPTH_TEST);
+            int lightSamples = 0;
+            if (msaaActive)
+            {
+                // Edge pixels get a stencil of 1, the edge shader discards the others
+                glClear(GL_STENCIL_BUFFER_BIT);
+                glEnable(GL_STENCIL_TEST);
+                glStencilFunc(GL_ALWAYS, 1, 1);
+                glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                glUseProgram(msaaEdgesProgramObject);
+                glProgramUniform1i(msaaEdgesProgramObject, msaaEdgesSamplesLocation, msaa.samples);
+                glProgramUniformMatrix4fv(msaaEdgesProgramObject, msaaEdgesInverseProjectionLocation, 1, 0, glm::value_ptr(viewInverseProjection));
+                glProgramUniform1f(msaaEdgesProgramObject, msaaEdgesDepthThresholdLocation, msaa.depthThreshold);
+                glProgramUniform1f(msaaEdgesProgramObject, msaaEdgesNormalThresholdLocation, msaa.normalThreshold);
+                msaa_gbuffer_edges_begin(msaa, renderWidth * renderHeight);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+                msaa_gbuffer_edges_end(msaa);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+                lightSamples = msaa.samples;
+            }
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
 
-        // Point light 15
-        {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(-3.489,-0.255,0.596,1)),
-                0,
-                glm::vec3(1,0.174,0),
-                10
-            };
+            // Select textures
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, viewTextures[0]);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, viewTextures[1]);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, viewTextures[2]);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, shadowAtlas.texture);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadowCascades.staticTexture);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadowCascades.dynamicTexture);
+            if (msaaActive)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    glActiveTexture(GL_TEXTURE5 + k);
+                    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaa.textures[k]);
+                }
+            }
 
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        }
+            // Render point lights
+            glUseProgram(pointlightProgramObject);
+            struct PointLight
+            {
+                glm::vec3 position;
+                int shadowIndex;
+                glm::vec3 color;
+                float intensity;
+            };
+            // One upload for the lights of the view, then a range per light
+            lightSlots.resize(pointLightCount * lightSlotBytes);
+            for (int i = 0; i < pointLightCount; ++i)
+            {
+                // PointLight p = { 
+                //     glm::vec3( viewWorldToView * glm::vec4((pointLightCount*cosf(t)) * sinf(t*i), 1.0, fabsf(pointLightCount*sinf(t)) * cosf(t*i), 1.0)),
+                //     0,
+                //     glm::vec3(fabsf(cos(t+i*2.f)), 1.-fabsf(sinf(t+i)) , 0.5f + 0.5f-fabsf(cosf(t+i)) ),
+                //     0.5f + fabsf(cosf(t+i))
+                // };
+                PointLight p = { 
+                    glm::vec3( viewWorldToView * glm::vec4(X,Y,Z,1)),
+                    -1,
+                    glm::vec3(R,G,B),
+                    I
+                };
+                memcpy(&lightSlots[i * lightSlotBytes], &p, sizeof(p));
+            }
+            if (pointLightCount > 0)
+            {
+                size_t first = light_slots_upload(uniformHeap, lightRegions[LIGHT_REGION_POINT], view, lightSlots);
+                for (int i = 0; i < pointLightCount; ++i)
+                {
+                    glBindBufferRange(GL_UNIFORM_BUFFER, pointlightLightLocation, buffer_heap_buffer(uniformHeap, lightRegions[LIGHT_REGION_POINT]), first + i * lightSlotBytes, pointLightBlockSize);
+                    msaa_light_draw(pointlightProgramObject, pointSamplesLocation, lightSamples, quad_triangleCount * 3);
+                }
+            }
 
+            // Static point lights, shadowed once their cube is complete
+            points_to_view(viewWorldToView, staticPointLightPositions, staticPointLightCount, staticPointLightViewPositions);
+            lightSlots.resize(staticPointLightCount * lightSlotBytes);
+            for (int i = 0; i < staticPointLightCount; ++i)
+            {
+                PointLight p = { 
+                    staticPointLightViewPositions[i],
+                    shadows && i < shadowAtlas.lightCount && shadowAtlas.validFaces[i] == 6 ? i : -1,
+                    staticPointLights[i].color,
+                    staticPointLights[i].intensity
+                };
+                memcpy(&lightSlots[i * lightSlotBytes], &p, sizeof(p));
+            }
+            if (staticPointLightCount > 0)
+            {
+                size_t first = light_slots_upload(uniformHeap, lightRegions[LIGHT_REGION_STATIC_POINT], view, lightSlots);
+                for (int i = 0; i < staticPointLightCount; ++i)
+                {
+                    glBindBufferRange(GL_UNIFORM_BUFFER, pointlightLightLocation, buffer_heap_buffer(uniformHeap, lightRegions[LIGHT_REGION_STATIC_POINT]), first + i * lightSlotBytes, pointLightBlockSize);
+                    msaa_light_draw(pointlightProgramObject, pointSamplesLocation, lightSamples, quad_triangleCount * 3);
+                }
+            }
 
-        // Point light 16
-        {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(4.34,4.851,0.596,1)),
-                0,
-                glm::vec3(1,1,1),
-                10
+            // Render directional lights
+            glUseProgram(directionallightProgramObject);
+            struct DirectionalLight
+            {
+                glm::vec3 direction;
+                int padding;
+                glm::vec3 color;
+                float intensity;
             };
+            lightSlots.resize(directionalLightCount * lightSlotBytes);
+            for (int i = 0; i < directionalLightCount; ++i)
+            {
+                 DirectionalLight d = { 
+                    glm::vec3( viewWorldToView * glm::vec4(directionalLightDirection, 0.0)),
+                    0,
+                    glm::vec3(0.3, 0.3, 1.0),
+                    0.5f
+                };
+                memcpy(&lightSlots[i * lightSlotBytes], &d, sizeof(d));
+            }
+            if (directionalLightCount > 0)
+            {
+                size_t first = light_slots_upload(uniformHeap, lightRegions[LIGHT_REGION_DIRECTIONAL], view, lightSlots);
+                for (int i = 0; i < directionalLightCount; ++i)
+                {
+                    glBindBufferRange(GL_UNIFORM_BUFFER, directionallightLightLocation, buffer_heap_buffer(uniformHeap, lightRegions[LIGHT_REGION_DIRECTIONAL]), first + i * lightSlotBytes, directionalLightBlockSize);
+                    msaa_light_draw(directionallightProgramObject, directionalSamplesLocation, lightSamples, quad_triangleCount * 3);
+                }
+            }
 
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
+            // Render spot lights
+            glUseProgram(spotlightProgramObject);
+            struct SpotLight
+            {
+                glm::vec3 position;
+                float angle;
+                glm::vec3 direction;
+                float penumbraAngle;
+                glm::vec3 color;
+                float intensity;
+            };
+            // for (int i = 0; i < spotLightCount; ++i)
+            // {
+            //     glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
+            //     SpotLight s = { 
+            //         glm::vec3( viewWorldToView * glm::vec4((spotLightCount*sinf(t)) * cosf(t*i), 1.f + sinf(t * i), fabsf(spotLightCount*cosf(t)) * sinf(t*i), 1.0)),
+            //         45.f + 20.f * cos(t + i),
+            //         glm::vec3( viewWorldToView * glm::vec4(sinf(t*10.0+i), -1.0, 0.0, 0.0)),
+            //         60.f + 20.f * cos(t + i),
+            //         glm::vec3(fabsf(cos(t+i*2.f)), 1.-fabsf(sinf(t+i)) , 0.5f + 0.5f-fabsf(cosf(t+i))),
+            //         1.0
+            //     };
+            //     SpotLight * spotLightBuffer = (SpotLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            //     *spotLightBuffer = s;
+            //     glUnmapBuffer(GL_UNIFORM_BUFFER);
+            //     glBindBufferBase(GL_UNIFORM_BUFFER, spotlightLightLocation, ubo[0]);
+            //     glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            // }        
+
+            // End additive blending
+            glDisable(GL_BLEND);
+            glDisable(GL_STENCIL_TEST);
+
+            PROFILE_PHASE_END(lightingZone);
+
+            gpu_timers_mark(gpuTimers, GPU_PASS_POST);
+            PROFILE_PHASE_BEGIN(postZone, "post");
+
+            // Attach fx texture #1 to framebuffer
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[1], 0);
+            // Only the color buffer is used
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // freichen
+            glUseProgram(freichenProgramObject);
+            glProgramUniform1f(freichenProgramObject, freichenFactorLocation, factor);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, fxTextures[0]);
             glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        }
 
+            GLuint blurTexture = fxTextures[0];
+            if (viewTemporal)
+            {
+                // Temporally accumulated blur into the current blur history
+                blurTexture = temporalTextures[temporalIndex];
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, blurTexture, 0);
+                glUseProgram(temporalBlurProgramObject);
+                glProgramUniform1i(temporalBlurProgramObject, temporalBlurSampleCountLocation, (int) sampleCount);
+                glProgramUniform1i(temporalBlurProgramObject, temporalBlurFrameLocation, frameIndex);
+                glProgramUniform1f(temporalBlurProgramObject, temporalBlurFeedbackLocation, temporalBlurFeedback);
+                glProgramUniform1i(temporalBlurProgramObject, temporalBlurHistoryValidLocation, historyValid);
+                glProgramUniformMatrix4fv(temporalBlurProgramObject, temporalBlurCurrentToPreviousLocation, 1, 0, glm::value_ptr(currentToPrevious));
+                glProgramUniform2fv(temporalBlurProgramObject, temporalBlurJitterLocation, 1, glm::value_ptr(jitter));
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, fxTextures[1]);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, temporalTextures[1 - temporalIndex]);
+                glActiveTexture(GL_TEXTURE2);
+                glBindTexture(GL_TEXTURE_2D, viewTextures[3]);
+                glActiveTexture(GL_TEXTURE3);
+                glBindTexture(GL_TEXTURE_2D, viewTextures[2]);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            }
+            else
+            {
+                // Attach fx texture #0 to framebuffer
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[2], 0);
+                // Only the color buffer is used
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                // vertical blur
+                glUseProgram(blurProgramObject);
+                glProgramUniform1i(blurProgramObject, blurSampleCountLocation, (int) sampleCount);
+                glProgramUniform2i(blurProgramObject, blurDirectionLocation, 0, 1);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, fxTextures[1]);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+
+                // Attach fx texture #1 to framebuffer
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
+                // Only the color buffer is used
+                glClear(GL_COLOR_BUFFER_BIT);
+                // horizontal blur
+                glProgramUniform2i(blurProgramObject, blurDirectionLocation, 1, 0);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, fxTextures[2]);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            }
 
-        // Point light 17
-        {
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-            PointLight p = { 
-                glm::vec3( worldToView * glm::vec4(16.085,5.362,1.106,1)),
-                0,
-                glm::vec3(1,0,1),
-                10
-            };
+            // Attach fx texture #1 to framebuffer
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[2], 0);
+            // Only the color buffer is used
+            glClear(GL_COLOR_BUFFER_BIT);
+            // CoC compute
+            glUseProgram(cocProgramObject);
+            glProgramUniform3f(cocProgramObject, cocFocusnLocation, focusPlane, nearPlane, farPlane);
+            glProgramUniformMatrix4fv(cocProgramObject, cocScreenToViewCountLocation, 1, 0, glm::value_ptr(viewInverseProjection));
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, viewTextures[2]);
+            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
 
-            PointLight * pointLightBuffer = (PointLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *pointLightBuffer = p;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, pointlightLightLocation, ubo[0]);
+            // Attach fx texture #1 to framebuffer
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[3], 0);
+            // Only the color buffer is used
+            glClear(GL_COLOR_BUFFER_BIT);
+            // dof compute
+            glUseProgram(dofProgramObject);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, fxTextures[1]); // Color
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, fxTextures[2]); // CoC
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, blurTexture); // Blur
             glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        }
 
+            GLuint sceneTexture = fxTextures[3];
+            if (viewTemporal)
+            {
+                // Temporal anti-aliasing into the current color history
+                sceneTexture = temporalTextures[2 + temporalIndex];
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, sceneTexture, 0);
+                glUseProgram(taaProgramObject);
+                glProgramUniform1f(taaProgramObject, taaFeedbackLocation, taaFeedback);
+                glProgramUniform1i(taaProgramObject, taaHistoryValidLocation, historyValid);
+                glProgramUniformMatrix4fv(taaProgramObject, taaCurrentToPreviousLocation, 1, 0, glm::value_ptr(currentToPrevious));
+                glProgramUniform2fv(taaProgramObject, taaJitterLocation, 1, glm::value_ptr(jitter));
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, fxTextures[3]);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, temporalTextures[2 + 1 - temporalIndex]);
+                glActiveTexture(GL_TEXTURE2);
+                glBindTexture(GL_TEXTURE_2D, viewTextures[3]);
+                glActiveTexture(GL_TEXTURE3);
+                glBindTexture(GL_TEXTURE_2D, viewTextures[2]);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+
+                // Next frame reads what was written this frame
+                temporalIndex = 1 - temporalIndex;
+            }
+            PROFILE_PHASE_END(postZone);
+
+            gpu_timers_mark(gpuTimers, GPU_PASS_UPSCALE);
+            PROFILE_PHASE_BEGIN(outputZone, "output");
 
+            // Output is rendered at full resolution
+            glViewport( 0, 0, width, height );
+            GLuint outputTexture = sceneTexture;
+            bool upscaled = viewSize.x != width || viewSize.y != height;
+            if (upscaled)
+            {
+                // Attach fx texture #0 to framebuffer
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
+                // Edge adaptive upscale
+                glUseProgram(upscaleProgramObject);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, sceneTexture);
+                glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+                outputTexture = fxTextures[0];
+            }
 
-        // Render directional lights
-        glUseProgram(directionallightProgramObject);
-        struct DirectionalLight
-        {
-            glm::vec3 direction;
-            int padding;
-            glm::vec3 color;
-            float intensity;
-        };
-        for (int i = 0; i < directionalLightCount; ++i)
-        {
-            glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-             DirectionalLight d = { 
-                glm::vec3( worldToView * glm::vec4(1.0, -1.0, -1.0, 0.0)),
-                0,
-                glm::vec3(0.3, 0.3, 1.0),
-                0.5f
-            };
-            DirectionalLight * directionalLightBuffer = (DirectionalLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *directionalLightBuffer = d;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, directionallightLightLocation, ubo[0]);
+            // Write to back buffer, each view in its own tile
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+            if (multiViewActive)
+            {
+                glm::ivec4 tile = multi_view_tile(view, viewCount, width, height);
+                glViewport(tile.x, tile.y, tile.z, tile.w);
+            }
+
+            // Tonemapping and gamma, sharpening the upscaled image
+            glUseProgram(gammaProgramObject);
+            glProgramUniform1f(gammaProgramObject, gammaGammaLocation, gamma);
+            glProgramUniform1f(gammaProgramObject, gammaExposureLocation, exposure);
+            glProgramUniform1i(gammaProgramObject, gammaTonemapLocation, tonemapOperator);
+            glProgramUniform1i(gammaProgramObject, gammaSharpenLocation, upscaled && !multiViewActive);
+            glProgramUniform1f(gammaProgramObject, gammaSharpnessLocation, sharpness);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, outputTexture);
             glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+
+            PROFILE_PHASE_END(outputZone);
         }
 
-        // Render spot lights
-        glUseProgram(spotlightProgramObject);
-        struct SpotLight
-        {
-            glm::vec3 position;
-            float angle;
-            glm::vec3 direction;
-            float penumbraAngle;
-            glm::vec3 color;
-            float intensity;
-        };
-        // for (int i = 0; i < spotLightCount; ++i)
-        // {
-        //     glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
-        //     SpotLight s = { 
-        //         glm::vec3( worldToView * glm::vec4((spotLightCount*sinf(t)) * cosf(t*i), 1.f + sinf(t * i), fabsf(spotLightCount*cosf(t)) * sinf(t*i), 1.0)),
-        //         45.f + 20.f * cos(t + i),
-        //         glm::vec3( worldToView * glm::vec4(sinf(t*10.0+i), -1.0, 0.0, 0.0)),
-        //         60.f + 20.f * cos(t + i),
-        //         glm::vec3(fabsf(cos(t+i*2.f)), 1.-fabsf(sinf(t+i)) , 0.5f + 0.5f-fabsf(cosf(t+i))),
-        //         1.0
-        //     };
-        //     SpotLight * spotLightBuffer = (SpotLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-        //     *spotLightBuffer = s;
-        //     glUnmapBuffer(GL_UNIFORM_BUFFER);
-        //     glBindBufferBase(GL_UNIFORM_BUFFER, spotlightLightLocation, ubo[0]);
-        //     glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        // }        
-
-        // End additive blending
-        glDisable(GL_BLEND);
-
-        // Attach fx texture #1 to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[1], 0);
-        // Only the color buffer is used
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // freichen
-        glUseProgram(freichenProgramObject);
-        glProgramUniform1f(freichenProgramObject, freichenFactorLocation, factor);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, fxTextures[0]);
-        glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-
-        // Attach fx texture #0 to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[2], 0);
-        // Only the color buffer is used
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // vertical blur
-        glUseProgram(blurProgramObject);
-        glProgramUniform1i(blurProgramObject, blurSampleCountLocation, (int) sampleCount);
-        glProgramUniform2i(blurProgramObject, blurDirectionLocation, 0, 1);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, fxTextures[1]);
-        glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-
-        // Attach fx texture #1 to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
-        // Only the color buffer is used
-        glClear(GL_COLOR_BUFFER_BIT);
-        // horizontal blur
-        glProgramUniform2i(blurProgramObject, blurDirectionLocation, 1, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, fxTextures[2]);
-        glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-
-        // Attach fx texture #1 to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[2], 0);
-        // Only the color buffer is used
-        glClear(GL_COLOR_BUFFER_BIT);
-        // CoC compute
-        glUseProgram(cocProgramObject);
-        glProgramUniform3f(cocProgramObject, cocFocusnLocation, focusPlane, nearPlane, farPlane);
-        glProgramUniformMatrix4fv(cocProgramObject, cocScreenToViewCountLocation, 1, 0, glm::value_ptr(inverseProjection));
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gbufferTextures[2]);
-        glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-
-        // Attach fx texture #1 to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[3], 0);
-        // Only the color buffer is used
-        glClear(GL_COLOR_BUFFER_BIT);
-        // dof compute
-        glUseProgram(dofProgramObject);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, fxTextures[1]); // Color
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, fxTextures[2]); // CoC
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, fxTextures[0]); // Blur
-        glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-
-        // Write to back buffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        // Gamma
-        glUseProgram(gammaProgramObject);
-        glProgramUniform1f(gammaProgramObject, gammaGammaLocation, gamma);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, fxTextures[3]);
-        glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+        historyValid = temporal;
+        previousViewProjection = viewProjection;
+        for (int view = 0; view < viewCount && multiViewActive; ++view)
+            multiView.previousViewProjections[view] = viewsProjection[view] * viewsWorldToView[view];
+        if (multiViewActive)
+        {
+            glViewport(0, 0, width, height);
+            for (int i = 0; i < SCALED_PROGRAM_COUNT; ++i)
+                glProgramUniform2f(scaledPrograms[i], scaledProgramsViewportScaleLocations[i], renderWidth / widthf, renderHeight / heightf);
+        }
+
+        PROFILE_PHASE_BEGIN(overlayZone, "overlays");
 
         // Bind blit shader
         glUseProgram(blitProgramObject);
@@ -1340,32 +3109,130 @@ int main( int argc, char **argv )
         // Bind VAO
         glBindVertexArray(vao[2]);
 
-        // // Viewport 
-        // glViewport( 0, 0, width/4, height/4  );
-        // // Bind texture
-        // glBindTexture(GL_TEXTURE_2D, gbufferTextures[0]);
-        // // Draw quad
-        // glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        // // Viewport 
-        // glViewport( width/4, 0, width/4, height/4  );
-        // // Bind texture
-        // glBindTexture(GL_TEXTURE_2D, gbufferTextures[1]);
-        // // Draw quad
-        // glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        // // Viewport 
-        // glViewport( width/4 * 2, 0, width/4, height/4  );
-        // // Bind texture
-        // glBindTexture(GL_TEXTURE_2D, gbufferTextures[2]);
-        // // Draw quad
-        // glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
-        // // Viewport 
-        // glViewport( width/4 * 3, 0, width/4, height/4  );
-        // // Bind texture
-        // glBindTexture(GL_TEXTURE_2D, fxTextures[(int)t%4]);
-        // // Draw quad
-        // glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+        // Debug heatmaps, computed in their own passes after the frame and
+        // drawn over it
+        if (debugView != DEBUG_VIEW_NONE)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, debugFbo);
+            glViewport(0, 0, renderWidth, renderHeight);
+
+            // Lights whose contribution is above the cutoff, per pixel
+            const int MAX_DEBUG_LIGHTS = 128;
+            glm::vec4 debugLights[MAX_DEBUG_LIGHTS];
+            int debugLightCount = 0;
+            for (int i = 0; i < staticPointLightCount && debugLightCount < MAX_DEBUG_LIGHTS; ++i)
+                debugLights[debugLightCount++] = glm::vec4(staticPointLightViewPositions[i], sqrtf(staticPointLights[i].intensity / debugLightCutoff));
+            for (int i = 0; i < pointLightCount && debugLightCount < MAX_DEBUG_LIGHTS; ++i)
+                debugLights[debugLightCount++] = glm::vec4(glm::vec3(worldToView * glm::vec4(X, Y, Z, 1.f)), sqrtf(I / debugLightCutoff));
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, debugTextures[0], 0);
+            glUseProgram(lightCountProgramObject);
+            glProgramUniformMatrix4fv(lightCountProgramObject, lightCountInverseProjectionLocation, 1, 0, glm::value_ptr(inverseProjection));
+            glProgramUniform4fv(lightCountProgramObject, lightCountLightsLocation, debugLightCount, glm::value_ptr(debugLights[0]));
+            glProgramUniform1i(lightCountProgramObject, lightCountLightCountLocation, debugLightCount);
+            glProgramUniform1i(lightCountProgramObject, lightCountDirectionalLightCountLocation, directionalLightCount);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, multiViewActive ? multiView.layers[0][2] : gbufferTextures[2]);
+            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+
+            // Scene pass fragments per pixel, with the same order, levels and pre-pass
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, debugTextures[1], 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, debugTextures[4], 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glEnable(GL_DEPTH_TEST);
+            if (depthPrepass)
+            {
+                glUseProgram(shadowProgramObject);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                for (unsigned int k = 0; k < sceneMeshCount; ++k)
+                {
+                    unsigned int i = drawOrder[k];
+                    if (!meshVisible[i])
+                        continue;
+                    glProgramUniformMatrix4fv(shadowProgramObject, shadowMvpLocation, 1, 0, glm::value_ptr(meshMvp[i]));
+                    glBindVertexArray(assimp_vao[i]);
+                    glDrawElements(GL_TRIANGLES, assimp_lods[i].indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(assimp_lods[i].indexOffset[meshLevels[i]] * sizeof(GLuint)));
+                }
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glUseProgram(overdrawProgramObject);
+            for (unsigned int k = 0; k < sceneMeshCount; ++k)
+            {
+                unsigned int i = drawOrder[k];
+                if (!meshVisible[i])
+                    continue;
+                glProgramUniformMatrix4fv(overdrawProgramObject, overdrawMvpLocation, 1, 0, glm::value_ptr(meshMvp[i]));
+                glBindVertexArray(assimp_vao[i]);
+                glDrawElements(GL_TRIANGLES, assimp_lods[i].indexCount[meshLevels[i]], GL_UNSIGNED_INT, (void*)(assimp_lods[i].indexOffset[meshLevels[i]] * sizeof(GLuint)));
+            }
+            glDisable(GL_BLEND);
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            glDisable(GL_DEPTH_TEST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+            glBindVertexArray(vao[2]);
+
+            // Per tile cost, one fragment per tile
+            int tilesX = (renderWidth + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE;
+            int tilesY = (renderHeight + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE;
+            glViewport(0, 0, tilesX, tilesY);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, debugTextures[2], 0);
+            glUseProgram(tileCostProgramObject);
+            glProgramUniform1i(tileCostProgramObject, tileCostTileSizeLocation, DEBUG_TILE_SIZE);
+            glProgramUniform2i(tileCostProgramObject, tileCostRenderSizeLocation, renderWidth, renderHeight);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, debugTextures[0]);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, debugTextures[1]);
+            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+
+            // Colour ramp of the selected view at full resolution
+            glViewport(0, 0, width, height);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, debugTextures[3], 0);
+            glUseProgram(heatmapProgramObject);
+            glProgramUniform1i(heatmapProgramObject, heatmapModeLocation, debugView);
+            glProgramUniform1f(heatmapProgramObject, heatmapMaxValueLocation, debugMaxValues[debugView]);
+            glProgramUniform1i(heatmapProgramObject, heatmapTileSizeLocation, DEBUG_TILE_SIZE);
+            glProgramUniform2i(heatmapProgramObject, heatmapRenderSizeLocation, renderWidth, renderHeight);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, debugTextures[2]);
+            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+
+            if (debugExport)
+            {
+                std::vector<unsigned char> pixels(width * height * 4);
+                glReadBuffer(GL_COLOR_ATTACHMENT0);
+                glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+                char path[256];
+                snprintf(path, sizeof(path), "heatmap_%s_%d.png", DEBUG_VIEW_NAMES[debugView], frameIndex);
+                if (write_png(path, width, height, &pixels[0]))
+                    fprintf(stdout, "Heatmap written to %s\n", path);
+                else
+                    fprintf(stderr, "Error writing %s\n", path);
+                debugExport = false;
+            }
+
+            // Draw over the back buffer
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+            glUseProgram(blitProgramObject);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, debugTextures[3]);
+            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+        }
+
+        if (batch && sceneStreamed)
+        {
+            if (batchFrame == 0)
+                batchStart = glfwGetTime();
+            batch_readback_push(batchReadback, batchFrame++, frameEncoder);
+        }
+        PROFILE_PHASE_END(overlayZone);
 
         // Draw UI
+        PROFILE_PHASE_BEGIN(uiZone, "ui");
 
         /*imguiSlider("Point Lights", &pointLightCount, 0.0, 100.0, 1);
         imguiSlider("Directional Lights", &directionalLightCount, 0.0, 100.0, 1);
@@ -1373,43 +3240,306 @@ int main( int argc, char **argv )
         imguiSlider("Blur Samples", &sampleCount, 3.0, 65.0, 2.0);
 */
 
-        // ImGui::SetNextWindowSize(ImVec2(200,100), ImGuiSetCond_FirstUseEver);
-        // ImGui::Begin("aogl");
-        // ImGui::SliderFloat("X", &X, -20.0f, 20.0f);
-        // ImGui::SliderFloat("Y", &Y, -20.0f, 20.0f);
-        // ImGui::SliderFloat("Z", &Z, -20.0f, 20.0f);
-        // ImGui::SliderFloat("R", &R, 0.0f, 1.0f);
-        // ImGui::SliderFloat("G", &G, 0.0f, 1.0f);
-        // ImGui::SliderFloat("B", &B, 0.0f, 1.0f);
-        // ImGui::SliderFloat("I", &I, 0.0f, 10.0f);
-        // ImGui::SliderFloat("Speed", &speed, 0.0f, 1.0f);
-        // ImGui::SliderFloat("Gamma", &gamma, 0.01f, 3.0f);
-        // ImGui::SliderFloat("Factor", &factor, 0.01f, 5.0f);
-        // ImGui::SliderFloat("Focus plane", &focusPlane, 1.f, 100.f);
-        // ImGui::SliderFloat("Near plane", &nearPlane, 1.f, 100.f);
-        // ImGui::SliderFloat("Far plane", &farPlane, 1.f, 100.f);
-        // ImGui::DragInt("Sample Count", &sampleCount, .1f, 0, 100);
-        // ImGui::DragInt("Point Lights", &pointLightCount, .1f, 0, 100);
-        // ImGui::DragInt("Directional Lights", &directionalLightCount, .1f, 0, 100);
+        ImGui::SetNextWindowSize(ImVec2(200,100), ImGuiSetCond_FirstUseEver);
+        ImGui::Begin("aogl");
+        ImGui::SliderFloat("X", &X, -20.0f, 20.0f);
+        ImGui::SliderFloat("Y", &Y, -20.0f, 20.0f);
+        ImGui::SliderFloat("Z", &Z, -20.0f, 20.0f);
+        ImGui::SliderFloat("R", &R, 0.0f, 1.0f);
+        ImGui::SliderFloat("G", &G, 0.0f, 1.0f);
+        ImGui::SliderFloat("B", &B, 0.0f, 1.0f);
+        ImGui::SliderFloat("I", &I, 0.0f, 10.0f);
+        ImGui::SliderFloat("Speed", &speed, 0.0f, 1.0f);
+        ImGui::SliderFloat("Gamma", &gamma, 0.01f, 3.0f);
+        ImGui::SliderFloat("Exposure", &exposure, 0.01f, 16.0f, "%.2f", 2.f);
+        ImGui::Combo("Tonemap", &tonemapOperator, TONEMAP_NAMES, 3);
+        ImGui::SliderFloat("Factor", &factor, 0.01f, 5.0f);
+        ImGui::SliderFloat("Focus plane", &focusPlane, 1.f, 100.f);
+        ImGui::SliderFloat("Near plane", &nearPlane, 1.f, 100.f);
+        ImGui::SliderFloat("Far plane", &farPlane, 1.f, 100.f);
+        ImGui::DragInt("Sample Count", &sampleCount, .1f, 0, 100);
+        ImGui::DragInt("Point Lights", &pointLightCount, .1f, 0, 100);
+        ImGui::DragInt("Directional Lights", &directionalLightCount, .1f, 0, 100);
         // ImGui::DragInt("Spot Lights", &spotLightCount, .1f, 0, 100);
-        // ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-        // ImGui::End();
-
-        // ImGui::Render();
+        if (instancingSupported)
+        {
+            ImGui::DragInt("Instance Count", &instanceCount, 100.f, 0, 500000);
+            ImGui::SliderFloat("Instance Spacing", &instanceSpacing, 1.f, 10.f);
+        }
+        if (ImGui::CollapsingHeader("Frame pacing", NULL, true, true))
+        {
+            if (framePacing.adaptiveSupported)
+                ImGui::Combo("Swap", &framePacing.swapMode, "Immediate\0Vsync\0Adaptive vsync\0\0");
+            else
+                ImGui::Combo("Swap", &framePacing.swapMode, "Immediate\0Vsync\0\0");
+            ImGui::SliderInt("Frames in flight", &framePacing.maxFramesInFlight, 1, FramePacing::MAX_FRAMES_IN_FLIGHT);
+            if (framePacing.swapMode == FramePacing::SWAP_IMMEDIATE)
+                ImGui::SliderFloat("Frame rate cap", &framePacing.frameRateCap, 0.f, 240.f, framePacing.frameRateCap > 0.f ? "%.0f FPS" : "Uncapped");
+            ImGui::Checkbox("Late camera latch", &framePacing.lateLatch);
+        }
+        if (ImGui::CollapsingHeader("Resolution", NULL, true, true))
+        {
+            ImGui::Checkbox("Dynamic resolution", &resolutionScaling.dynamic);
+            if (resolutionScaling.dynamic)
+                ImGui::SliderFloat("Target GPU time", &resolutionScaling.targetFrameTime, 4.f, 50.f, "%.1f ms");
+            else
+                ImGui::SliderFloat("Fixed scale", &resolutionScaling.fixedScale, resolutionScaling.minScale, 1.f);
+            ImGui::SliderFloat("Sharpness", &sharpness, 0.f, 2.f);
+        }
+        if (ImGui::CollapsingHeader("Temporal", NULL, true, true))
+        {
+            ImGui::Checkbox("Temporal DoF and AA", &temporal);
+            if (temporal)
+            {
+                ImGui::SliderFloat("Blur feedback", &temporalBlurFeedback, 0.f, 0.98f);
+                ImGui::SliderFloat("TAA feedback", &taaFeedback, 0.f, 0.98f);
+            }
+        }
+        if (ImGui::CollapsingHeader("Scene pass", NULL, true, true))
+        {
+            ImGui::Checkbox("Front to back sort", &sortFrontToBack);
+            ImGui::Checkbox("Depth pre-pass", &depthPrepass);
+            ImGui::Checkbox("Frustum culling", &sceneFrustumCulling);
+            ImGui::Combo("Transform path", &transformPath, TRANSFORM_PATH_NAMES, transform_path_best() + 1);
+            if (visibility.fbo)
+            {
+                ImGui::Checkbox("Visibility buffer", &visibilityEnabled);
+                if (visibilityActive)
+                    ImGui::Text("%d draws, %d material passes, %d triangle bits", (int) visibility.frameRecords.size(), (int) visibility.frameMaterials.size(), visibility.triangleBits);
+                else if (visibilityEnabled)
+                    ImGui::Text("Frame over the id bits or heap arenas, G-buffer pass");
+            }
+        }
+        if (msaa.samples > 1 && !multiViewActive && ImGui::CollapsingHeader("MSAA", NULL, true, true))
+        {
+            ImGui::Checkbox("Multisampled G-buffer", &msaaEnabled);
+            ImGui::SliderFloat("Edge depth threshold", &msaa.depthThreshold, 0.001f, 0.1f, "%.3f");
+            ImGui::SliderFloat("Edge normal threshold", &msaa.normalThreshold, 0.01f, 1.f);
+            ImGui::Text("%d samples, edge pixels %.1f %%", msaa.samples, msaa.edgeFraction * 100.f);
+        }
+        if (multiViewActive && ImGui::CollapsingHeader("Multi-view", NULL, true, true))
+        {
+            if (ImGui::Combo("Layout", &multiView.layout, MULTI_VIEW_LAYOUT_NAMES, MultiView::LAYOUT_COUNT))
+                historyValid = false;
+            if (multiView.layout == MultiView::LAYOUT_PANORAMA)
+                ImGui::SliderInt("Panorama views", &multiView.panoramaViews, 2, multiView.layerCount);
+            if (multiView.layout == MultiView::LAYOUT_STEREO)
+                ImGui::SliderFloat("Eye separation", &multiView.eyeSeparation, 0.f, 1.f);
+            ImGui::Text("Views %d of %d layers", viewCount, multiView.layerCount);
+        }
+        if (ImGui::CollapsingHeader("Streaming", NULL, true, true))
+        {
+            ImGui::SliderInt("Upload budget (KB)", &uploadBudgetKB, 64, 65536);
+        }
+        if (ImGui::CollapsingHeader("Buffer heap", NULL, true, true))
+        {
+            BufferHeapStats heapStats;
+            buffer_heap_stats(bufferHeap, heapStats);
+            ImGui::SliderInt("Compaction budget (KB)", &compactBudgetKB, 0, 16384);
+            ImGui::Text("%d arenas%s, %d regions", heapStats.arenas, bufferHeap.immutable ? " (immutable)" : "", heapStats.regions);
+            ImGui::Text("Used %.1f of %.1f MB", heapStats.used / (1024.f * 1024.f), heapStats.capacity / (1024.f * 1024.f));
+            ImGui::Text("Free blocks %d, largest %.1f MB", heapStats.freeBlocks, heapStats.largestFree / (1024.f * 1024.f));
+            ImGui::Text("Fragmentation %.1f %%", heapStats.fragmentation * 100.f);
+            ImGui::Text("Moved %.1f MB", bufferHeap.movedBytes / (1024.f * 1024.f));
+            BufferHeapStats uniformStats;
+            buffer_heap_stats(uniformHeap, uniformStats);
+            ImGui::Text("Light uniforms %d regions, %.1f of %.1f KB, moved %.1f KB", uniformStats.regions, uniformStats.used / 1024.f, uniformStats.capacity / 1024.f, uniformHeap.movedBytes / 1024.f);
+        }
+#ifdef AOGL_PROFILE
+        if (ImGui::CollapsingHeader("Profiler", NULL, true, true))
+        {
+            ImGui::DragInt("Trace frames", &traceUiFrameCount, .5f, 1, 1000);
+            if (profiler_capture_open() || traceCapture.frameCount > 0)
+                ImGui::Text("Capturing %s", traceCapture.frameCount > 0 ? traceCapture.framesOutput : traceCapture.output);
+            else if (ImGui::Button("Capture trace"))
+            {
+                char path[64];
+                snprintf(path, sizeof(path), "aogl_trace_%d.json", frameIndex + 1);
+                trace_capture_request(traceCapture, path, frameIndex + 1, traceUiFrameCount);
+            }
+        }
+#endif
+        if (ImGui::CollapsingHeader("Frame capture", NULL, true, true))
+        {
+            if (ImGui::Button("Capture next frame"))
+            {
+                char path[64];
+                snprintf(path, sizeof(path), "aogl_frame_%d.aoglcap", frameIndex + 1);
+                captureFrame = frameIndex + 1;
+                captureOutput = path;
+            }
+            if (captureFrame >= 0 && captureFrame <= frameIndex)
+                ImGui::Text("Last capture %s", captureOutput.c_str());
+        }
+        if (ImGui::CollapsingHeader("Level of detail", NULL, true, true))
+        {
+            ImGui::Checkbox("Mesh LOD", &lodEnabled);
+            ImGui::SliderFloat("LOD error", &lodThreshold, 0.25f, 8.f, "%.2f px");
+        }
+        if (ImGui::CollapsingHeader("Debug views", NULL, true, true))
+        {
+            ImGui::Combo("View", &debugView, "None\0Lights per pixel\0Scene overdraw\0Tile cost\0\0");
+            if (debugView != DEBUG_VIEW_NONE)
+            {
+                ImGui::SliderFloat("Ramp maximum", &debugMaxValues[debugView], 1.f, 64.f, "%.0f");
+                if (debugView != DEBUG_VIEW_OVERDRAW)
+                    ImGui::SliderFloat("Light cutoff", &debugLightCutoff, 0.001f, 0.1f, "%.3f");
+                if (ImGui::Button("Export heatmap"))
+                    debugExport = true;
+            }
+        }
+        if (ImGui::CollapsingHeader("Interface", NULL, true, true))
+        {
+            if (ImGui::Checkbox("Cache UI overlay", &uiOverlayCaching))
+                ImGui_ImplGlfwGL3Cached_SetOverlayCaching(uiOverlayCaching);
+        }
+        if (ImGui::CollapsingHeader("Shadows", NULL, true, true))
+        {
+            ImGui::Checkbox("Shadows", &shadows);
+            if (ImGui::SliderFloat3("Sun direction", glm::value_ptr(directionalLightDirection), -1.f, 1.f))
+            {
+                if (glm::length(directionalLightDirection) < 0.01f)
+                    directionalLightDirection = glm::vec3(0.f, -1.f, 0.f);
+            }
+            if (ImGui::SliderFloat("Shadow distance", &shadowCascades.distance, 5.f, 100.f))
+                shadow_cascades_invalidate(shadowCascades);
+            if (ImGui::Button("Invalidate shadow cache"))
+            {
+                shadow_cascades_invalidate(shadowCascades);
+                shadow_atlas_invalidate(shadowAtlas);
+            }
+        }
+        ImGui::End();
+
+        ImGui::Begin("Stats");
+        ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Text("Frame pacing wait %.3f ms", framePacing.waitTime);
+        ImGui::Text("Input to present latency %.2f ms", framePacing.latency);
+        ImGui::Text("Resolution scale %.2f (%dx%d)", resolutionScaling.scale, renderWidth, renderHeight);
+        ImGui::Text("Scene meshes visible %d / %d", sceneMeshesVisible, sceneMeshCount);
+        if (sceneMeshCount > 0)
+            ImGui::Text("Scene import (%s) %.1f ms", sceneStream.importPathName, sceneStream.importMs);
+        else
+            ImGui::Text("Scene import ...");
+        if (sceneMeshCount > 0 && sceneStream.batchStats.sourceMeshes > 0)
+            ImGui::Text("Static batching %d meshes, %d split, into %d, %d chunks", sceneStream.batchStats.sourceMeshes, sceneStream.batchStats.splitMeshes, sceneStream.batchStats.meshes, sceneStream.batchStats.chunks);
+        if (sceneMeshCount > 0 && sceneStream.instanceStats.copies > 0)
+        {
+            ImGui::Text("Repeated geometry %d meshes, %d copies, %.1f MB saved", sceneStream.instanceStats.geometries, sceneStream.instanceStats.copies, sceneStream.instanceStats.bytesSaved / (1024.0 * 1024.0));
+            ImGui::Text("Instanced draws %d for %d meshes, %d draws saved", sceneInstancedDraws, sceneInstancedMeshes, sceneInstancedMeshes - sceneInstancedDraws);
+        }
+        ImGui::Text("Streaming %d / %d meshes, %d textures, %.1f MB this frame", residentMeshCount, sceneMeshCount, residentTextureCount, streamUploadBytes / (1024.0 * 1024.0));
+        ImGui::Text("Scene triangles %d, drawn %d (%.0f%%)", sceneTriangles, sceneTrianglesDrawn, sceneTriangles > 0 ? 100.f * sceneTrianglesDrawn / sceneTriangles : 0.f);
+        ImGui::Text("Scene fragments per pixel %.2f", overdrawCounter.fragmentsPerPixel);
+        ImGui::Text("Shadow cascades rendered %d, cube faces %d", shadowCascadesRendered, shadowFacesRendered);
+        ImGui::Text("GPU frame %.3f ms", gpuTimers.frameTime);
+        for (int i = 0; i < GPU_PASS_COUNT; ++i)
+            ImGui::Text("  %-10s %.3f ms", GPU_PASS_NAMES[i], gpuTimers.passTimes[i]);
+        ImGui::Text("GPU memory %.1f MB (peak %.1f MB)", resources.gpuTotal / 1048576.0, resources.gpuPeakTotal / 1048576.0);
+        for (int i = 0; i < RESOURCE_CATEGORY_COUNT; ++i)
+            ImGui::Text("  %-18s %.1f MB (peak %.1f MB)", RESOURCE_CATEGORY_NAMES[i], resources.gpuBytes[i] / 1048576.0, resources.gpuPeak[i] / 1048576.0);
+        ImGui::Text("CPU heap %.1f MB (peak %.1f MB)", resources.cpuTotal / 1048576.0, resources.cpuPeakTotal / 1048576.0);
+        for (int i = 0; i < CPU_SUBSYSTEM_COUNT; ++i)
+            ImGui::Text("  %-18s %.1f MB (peak %.1f MB)", CPU_SUBSYSTEM_NAMES[i], resources.cpuBytes[i] / 1048576.0, resources.cpuPeak[i] / 1048576.0);
+        ImGui::Text("UI %s, %d draws, %d bytes uploaded (%s ring %d KB)", uiStats.overlayRendered ? "rendered" : "cached", uiStats.drawCalls, uiStats.uploadBytes, uiStats.persistentMapping ? "persistent" : "mapped", uiStats.ringBytes / 1024);
+        ImGui::Text("UI overlay %d lists cached, %d direct, hit rate %.0f%%", uiStats.overlayLists, uiStats.directLists, uiStats.overlayFrames > 0 ? 100.f * uiStats.overlayHits / uiStats.overlayFrames : 0.f);
+        ImGui::End();
+
+        gpu_timers_mark(gpuTimers, GPU_PASS_UI);
+        ImGui::Render();
+        ImGui_ImplGlfwGL3Cached_GetStats(&uiStats);
+        gpu_timers_end_frame(gpuTimers);
+        PROFILE_PHASE_END(uiZone);
         // Check for errors
         checkError("End loop");
+        if (gl_capture_active())
+        {
+            if (gl_capture_end())
+                printf("Frame %d captured to %s\n", frameIndex, captureOutput.c_str());
+            else
+                fprintf(stderr, "Error: impossible to write %s\n", captureOutput.c_str());
+        }
 
-        glfwSwapBuffers(window);
+        PROFILE_PHASE_BEGIN(swapZone, "swap");
+        frame_pacing_end(framePacing, window);
         glfwPollEvents();
-    } // Check if the ESC key was pressed
-    while( glfwGetKey( window, GLFW_KEY_ESCAPE ) != GLFW_PRESS );
-
-    // Close OpenGL window and terminate GLFW
-    ImGui_ImplGlfwGL3_Shutdown();
-    glfwTerminate();
+        PROFILE_PHASE_END(swapZone);
+        if (frameIndex == 0)
+            printf("First frame : %.1f ms after start\n", glfwGetTime() * 1000.0);
+        ++frameIndex;
+    } // Check if the ESC key was pressed or the benchmark is over
+    while( glfwGetKey( window, GLFW_KEY_ESCAPE ) != GLFW_PRESS
+           && (!benchmark || (int) benchmarkRecord.gpuFrameTimes.size() < benchmarkFrames)
+           && (!batch || batchFrame < batchFrames) );
+
+    if (batch)
+    {
+        batch_readback_flush(batchReadback, frameEncoder);
+        double renderTime = glfwGetTime() - batchStart;
+        int encoded = frame_encoder_finish(frameEncoder);
+        double totalTime = glfwGetTime() - batchStart;
+        printf("Batch : %d frames to %s in %.2f s, %.1f frames/s (rendering %.1f frames/s), %d readback stalls, %d encoder threads\n",
+               encoded, batchOutput, totalTime, totalTime > 0.0 ? encoded / totalTime : 0.0, renderTime > 0.0 ? batchFrame / renderTime : 0.0, batchReadback.stalls, batchThreads);
+        batch_readback_shutdown(batchReadback, resources);
+    }
+    if (benchmark && !write_benchmark_json(benchmarkOutput, benchmarkRecord, resources, width, height, resolutionScaling.scale))
+        fprintf(stderr, "Error: impossible to write %s\n", benchmarkOutput);
+#ifdef AOGL_PROFILE
+    trace_capture_shutdown(traceCapture);
+#endif
 
-    exit( EXIT_SUCCESS );
-}
+    overdraw_counter_shutdown(overdrawCounter);
+    shadow_atlas_shutdown(shadowAtlas, resources);
+    multi_view_shutdown(multiView, resources);
+    msaa_gbuffer_shutdown(msaa, resources);
+    visibility_buffer_shutdown(visibility, resources);
+    shadow_cascades_shutdown(shadowCascades, resources);
+
+    // Scene resources, along with what was still streaming
+    for (size_t k = 0; k < pendingMeshes.size(); ++k)
+        scene_stream_release_mesh(sceneStream, pendingMeshes[k]);
+    for (size_t k = 0; k < pendingTextures.size(); ++k)
+        scene_stream_release_texture(sceneStream, pendingTextures[k]);
+    scene_stream_stop(sceneStream);
+    cpu_heap_free(resources, CPU_IMPORT, sceneStreamCpuBytes);
+    for (unsigned int i = 0; i < sceneMeshCount; ++i)
+    {
+        if (meshIndexRegions[i] != -1)
+            buffer_heap_free(bufferHeap, meshIndexRegions[i]);
+        if (meshVertexRegions[i] != -1)
+            buffer_heap_free(bufferHeap, meshVertexRegions[i]);
+    }
+    buffer_heap_shutdown(bufferHeap, resources);
+    for (int k = 0; k < LIGHT_REGION_COUNT; ++k)
+        if (lightRegions[k] != -1)
+            buffer_heap_free(uniformHeap, lightRegions[k]);
+    buffer_heap_shutdown(uniformHeap, resources);
+    for (size_t i = 0; i < materialTextures.size(); ++i)
+    {
+        if (materialTextures[i])
+        {
+            resource_release(resources, GL_TEXTURE, materialTextures[i]);
+            glDeleteTextures(1, &materialTextures[i]);
+        }
+    }
+    if (sceneMeshCount > 0)
+        glDeleteVertexArrays(sceneMeshCount, assimp_vao);
+    delete[] assimp_vao;
+    delete[] assimp_objectToWorld;
+    delete[] assimp_lods;
+    delete[] assimp_diffuse_colors;
+    delete[] assimp_diffuse_texture_ids;
+    cpu_heap_free(resources, CPU_SCENE, sceneArraysBytes + sceneTransforms.elements.size() * sizeof(float));
+    gpu_timers_shutdown(gpuTimers);
+    frame_pacing_shutdown(framePacing);
+
+    // Close OpenGL window and terminate GLFW
+    ImGui_ImplGlfwGL3Cached_Shutdown();
+    ImGui_ImplGlfwGL3_Shutdown();
+    glfwTerminate();
+
+    exit( EXIT_SUCCESS );
+}
 
 // No windows implementation of strsep
 char * strsep_custom(char **stringp, const char *delim)
@@ -1466,6 +3596,7 @@ int check_compile_error(GLuint shader, const char ** sourceBuffer)
 
 int check_link_error(GLuint program)
 {
+    PROFILE_ZONE("link program");
     // Get link error log size and print it eventually
     int logLength;
     glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
@@ -1498,6 +3629,7 @@ GLuint compile_shader(GLenum shaderType, const char * sourceBuffer, int bufferSi
 
 GLuint compile_shader_from_file(GLenum shaderType, const char * path)
 {
+    PROFILE_ZONE_DETAIL("compile shader", path);
     FILE * shaderFileDesc = fopen( path, "rb" );
     if (!shaderFileDesc)
         return 0;
@@ -1513,6 +3645,20 @@ GLuint compile_shader_from_file(GLenum shaderType, const char * path)
 }
 
 
+// Radical inverse of index in the given base
+float halton(int index, int base)
+{
+    float f = 1.f;
+    float r = 0.f;
+    while (index > 0)
+    {
+        f /= base;
+        r += f * (index % base);
+        index /= base;
+    }
+    return r;
+}
+
 bool checkError(const char* title)
 {
     int error;
@@ -1598,6 +3744,1219 @@ void camera_pan(Camera & c, float x, float y)
     camera_compute(c);
 }
 
+void frame_pacing_calibrate(FramePacing & fp)
+{
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    fp.gpuClockOffset = gpuTime * 1e-9 - glfwGetTime();
+}
+
+void frame_pacing_init(FramePacing & fp)
+{
+    fp.maxFramesInFlight = 2;
+    fp.swapMode = FramePacing::SWAP_VSYNC;
+    fp.appliedSwapMode = FramePacing::SWAP_VSYNC;
+    fp.adaptiveSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+    fp.lateLatch = true;
+    fp.frameRateCap = 0.f;
+    fp.frame = 0;
+    fp.frameStart = glfwGetTime();
+    glGenQueries(FramePacing::MAX_FRAMES_IN_FLIGHT, fp.presentQueries);
+    for (int i = 0; i < FramePacing::MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        fp.fences[i] = 0;
+        fp.latchTimes[i] = 0.0;
+        fp.pending[i] = false;
+    }
+    fp.waitTime = 0.f;
+    fp.latency = 0.f;
+    frame_pacing_calibrate(fp);
+}
+
+// Retire a frame slot once its fence signaled and fold its present time into
+// the latency estimate
+static void frame_pacing_retire(FramePacing & fp, int slot)
+{
+    glDeleteSync(fp.fences[slot]);
+    fp.fences[slot] = 0;
+    if (!fp.pending[slot])
+        return;
+    fp.pending[slot] = false;
+    GLuint64 presentTime = 0;
+    glGetQueryObjectui64v(fp.presentQueries[slot], GL_QUERY_RESULT, &presentTime);
+    float latency = (float) ((presentTime * 1e-9 - fp.gpuClockOffset - fp.latchTimes[slot]) * 1000.0);
+    if (latency > 0.f)
+        fp.latency = fp.latency > 0.f ? fp.latency * 0.9f + latency * 0.1f : latency;
+}
+
+void frame_pacing_begin(FramePacing & fp)
+{
+    double waitStart = glfwGetTime();
+
+    // Block on the frame that is maxFramesInFlight frames old, and retire
+    // every older frame that already completed
+    for (int i = 0; i < FramePacing::MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        int slot = (fp.frame + i) % FramePacing::MAX_FRAMES_IN_FLIGHT;
+        if (!fp.fences[slot])
+            continue;
+        bool mustWait = i + fp.maxFramesInFlight <= FramePacing::MAX_FRAMES_IN_FLIGHT;
+        GLenum status = glClientWaitSync(fp.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, mustWait ? 1000000000 : 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            frame_pacing_retire(fp, slot);
+        else if (mustWait)
+            fprintf(stderr, "Frame pacing : fence wait timed out\n");
+    }
+
+    fp.waitTime = (float) ((glfwGetTime() - waitStart) * 1000.0);
+    fp.frameStart = waitStart;
+    if (fp.frame % 600 == 0)
+        frame_pacing_calibrate(fp);
+}
+
+void frame_pacing_latch(FramePacing & fp)
+{
+    fp.latchTimes[fp.frame % FramePacing::MAX_FRAMES_IN_FLIGHT] = glfwGetTime();
+}
+
+void frame_pacing_end(FramePacing & fp, GLFWwindow * window)
+{
+    if (fp.swapMode != fp.appliedSwapMode)
+    {
+        glfwSwapInterval(fp.swapMode == FramePacing::SWAP_ADAPTIVE ? -1 : fp.swapMode);
+        fp.appliedSwapMode = fp.swapMode;
+    }
+
+    // Frame rate cap : sleep most of the remaining time then spin for accuracy
+    if (fp.swapMode == FramePacing::SWAP_IMMEDIATE && fp.frameRateCap > 0.f)
+    {
+        double deadline = fp.frameStart + 1.0 / fp.frameRateCap;
+        double remaining = deadline - glfwGetTime();
+        if (remaining > 0.002)
+            std::this_thread::sleep_for(std::chrono::microseconds((long long) ((remaining - 0.001) * 1e6)));
+        while (glfwGetTime() < deadline)
+            std::this_thread::yield();
+    }
+
+    glfwSwapBuffers(window);
+
+    int slot = fp.frame % FramePacing::MAX_FRAMES_IN_FLIGHT;
+    glQueryCounter(fp.presentQueries[slot], GL_TIMESTAMP);
+    fp.pending[slot] = true;
+    fp.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++fp.frame;
+}
+
+void frame_pacing_shutdown(FramePacing & fp)
+{
+    for (int i = 0; i < FramePacing::MAX_FRAMES_IN_FLIGHT; ++i)
+        if (fp.fences[i])
+            glDeleteSync(fp.fences[i]);
+    glDeleteQueries(FramePacing::MAX_FRAMES_IN_FLIGHT, fp.presentQueries);
+}
+
+bool batch_readback_init(BatchReadback & br, int width, int height, ResourceRegistry & resources)
+{
+    glGenTextures(1, &br.color);
+    glBindTexture(GL_TEXTURE_2D, br.color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    resource_track(resources, GL_TEXTURE, br.color, RESOURCE_RENDER_TARGETS, texture_bytes(GL_RGBA8, width, height, 1, false));
+    glGenFramebuffers(1, &br.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, br.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, br.color, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    br.width = width;
+    br.height = height;
+    br.head = 0;
+    br.stalls = 0;
+    glGenBuffers(BatchReadback::RING_SIZE, br.buffers);
+    for (int i = 0; i < BatchReadback::RING_SIZE; ++i)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, br.buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) width * height * 4, 0, GL_STREAM_READ);
+        br.fences[i] = 0;
+        br.frames[i] = -1;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return complete;
+}
+
+static void batch_readback_retire(BatchReadback & br, int slot, FrameEncoder & encoder)
+{
+    PROFILE_ZONE("batch readback");
+    std::vector<unsigned char> pixels;
+    frame_encoder_buffer(encoder, pixels);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, br.buffers[slot]);
+    const void * mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels.size(), GL_MAP_READ_BIT);
+    if (mapped)
+        memcpy(&pixels[0], mapped, pixels.size());
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteSync(br.fences[slot]);
+    br.fences[slot] = 0;
+    frame_encoder_submit(encoder, br.frames[slot], pixels);
+    br.frames[slot] = -1;
+}
+
+void batch_readback_push(BatchReadback & br, int frame, FrameEncoder & encoder)
+{
+    // Ring full, the oldest readback has to be done before its slot is reused
+    if (br.frames[br.head] >= 0)
+    {
+        if (glClientWaitSync(br.fences[br.head], 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            ++br.stalls;
+            glClientWaitSync(br.fences[br.head], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        }
+        batch_readback_retire(br, br.head, encoder);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, br.fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, br.buffers[br.head]);
+    glReadPixels(0, 0, br.width, br.height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    br.fences[br.head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    br.frames[br.head] = frame;
+    br.head = (br.head + 1) % BatchReadback::RING_SIZE;
+
+    // Older frames first, stopping at the first one still in flight
+    for (int i = 0; i < BatchReadback::RING_SIZE; ++i)
+    {
+        int slot = (br.head + i) % BatchReadback::RING_SIZE;
+        if (br.frames[slot] < 0)
+            continue;
+        GLenum status = glClientWaitSync(br.fences[slot], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        batch_readback_retire(br, slot, encoder);
+    }
+}
+
+void batch_readback_flush(BatchReadback & br, FrameEncoder & encoder)
+{
+    for (int i = 0; i < BatchReadback::RING_SIZE; ++i)
+    {
+        int slot = (br.head + i) % BatchReadback::RING_SIZE;
+        if (br.frames[slot] < 0)
+            continue;
+        glClientWaitSync(br.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        batch_readback_retire(br, slot, encoder);
+    }
+}
+
+void batch_readback_shutdown(BatchReadback & br, ResourceRegistry & resources)
+{
+    for (int i = 0; i < BatchReadback::RING_SIZE; ++i)
+        if (br.fences[i])
+            glDeleteSync(br.fences[i]);
+    glDeleteBuffers(BatchReadback::RING_SIZE, br.buffers);
+    glDeleteFramebuffers(1, &br.fbo);
+    resource_release(resources, GL_TEXTURE, br.color);
+    glDeleteTextures(1, &br.color);
+}
+
+const char * const GPU_PASS_NAMES[GPU_PASS_COUNT] = { "scene", "shadow", "lighting", "post", "upscale", "ui" };
+
+void gpu_timers_init(GpuTimers & timers)
+{
+    for (int i = 0; i < GpuTimers::FRAME_LATENCY; ++i)
+    {
+        glGenQueries(GpuTimers::MAX_MARKS + 1, timers.queries[i]);
+        timers.markCount[i] = 0;
+    }
+    timers.frame = 0;
+    timers.resolved = false;
+    for (int i = 0; i < GPU_PASS_COUNT; ++i)
+        timers.passTimes[i] = 0.f;
+    timers.frameTime = 0.f;
+}
+
+void gpu_timers_begin_frame(GpuTimers & timers)
+{
+    // The slot about to be reused holds the oldest frame in flight
+    int slot = timers.frame % GpuTimers::FRAME_LATENCY;
+    timers.resolved = false;
+    int markCount = timers.markCount[slot];
+    if (markCount > 0)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(timers.queries[slot][markCount], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 timestamps[GpuTimers::MAX_MARKS + 1];
+            for (int i = 0; i <= markCount; ++i)
+                glGetQueryObjectui64v(timers.queries[slot][i], GL_QUERY_RESULT, timestamps + i);
+            for (int i = 0; i < GPU_PASS_COUNT; ++i)
+                timers.passTimes[i] = 0.f;
+            for (int i = 0; i < markCount; ++i)
+                timers.passTimes[timers.marks[slot][i]] += (float) ((timestamps[i + 1] - timestamps[i]) * 1e-6);
+            timers.frameTime = (float) ((timestamps[markCount] - timestamps[0]) * 1e-6);
+            timers.resolved = true;
+#ifdef AOGL_PROFILE
+            for (int i = 0; i < markCount; ++i)
+                profiler_gpu_zone(GPU_PASS_NAMES[timers.marks[slot][i]], (int64_t) timestamps[i], (int64_t) timestamps[i + 1]);
+#endif
+        }
+    }
+    timers.markCount[slot] = 0;
+}
+
+void gpu_timers_mark(GpuTimers & timers, GpuPass pass)
+{
+    int slot = timers.frame % GpuTimers::FRAME_LATENCY;
+    int & markCount = timers.markCount[slot];
+    if (markCount >= GpuTimers::MAX_MARKS)
+        return;
+    timers.marks[slot][markCount] = pass;
+    glQueryCounter(timers.queries[slot][markCount], GL_TIMESTAMP);
+    ++markCount;
+}
+
+void gpu_timers_end_frame(GpuTimers & timers)
+{
+    int slot = timers.frame % GpuTimers::FRAME_LATENCY;
+    if (timers.markCount[slot] > 0)
+        glQueryCounter(timers.queries[slot][timers.markCount[slot]], GL_TIMESTAMP);
+    ++timers.frame;
+}
+
+void gpu_timers_shutdown(GpuTimers & timers)
+{
+    for (int i = 0; i < GpuTimers::FRAME_LATENCY; ++i)
+        glDeleteQueries(GpuTimers::MAX_MARKS + 1, timers.queries[i]);
+}
+
+#ifdef AOGL_PROFILE
+void trace_capture_init(TraceCapture & tc, const char * startupOutput)
+{
+    tc.output = startupOutput;
+    tc.framesOutput[0] = '\0';
+    tc.firstFrame = 0;
+    tc.frameCount = 0;
+    tc.endFrame = -1;
+    tc.writeFrame = -1;
+    if (startupOutput)
+        profiler_capture_begin();
+}
+
+void trace_capture_request(TraceCapture & tc, const char * output, int firstFrame, int frameCount)
+{
+    snprintf(tc.framesOutput, sizeof(tc.framesOutput), "%s", output);
+    tc.firstFrame = firstFrame;
+    tc.frameCount = frameCount;
+}
+
+void trace_capture_frame(TraceCapture & tc, int frameIndex, bool startupDone)
+{
+    if (tc.writeFrame >= 0 && frameIndex >= tc.writeFrame)
+    {
+        if (profiler_write_trace(tc.output))
+            printf("Trace written to %s\n", tc.output);
+        else
+            fprintf(stderr, "Error: impossible to write %s\n", tc.output);
+        tc.writeFrame = -1;
+    }
+    if (profiler_capture_open() && tc.writeFrame < 0 && (tc.endFrame < 0 ? startupDone : frameIndex >= tc.endFrame))
+    {
+        profiler_capture_end();
+        tc.writeFrame = frameIndex + GpuTimers::FRAME_LATENCY;
+    }
+    // A window requested during another capture starts after it
+    if (!profiler_capture_open() && tc.frameCount > 0 && frameIndex >= tc.firstFrame)
+    {
+        profiler_gpu_sync();
+        profiler_capture_begin();
+        tc.output = tc.framesOutput;
+        tc.endFrame = frameIndex + tc.frameCount;
+        tc.frameCount = 0;
+    }
+}
+
+void trace_capture_shutdown(TraceCapture & tc)
+{
+    if (profiler_capture_open() && profiler_write_trace(tc.output))
+        printf("Trace written to %s\n", tc.output);
+}
+
+void profiler_gpu_sync()
+{
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    profiler_gpu_calibrate(gpuTime);
+}
+#endif
+
+void shadow_cascades_init(ShadowCascades & sc, ResourceRegistry & resources)
+{
+    GLuint textures[2];
+    glGenTextures(2, textures);
+    for (int i = 0; i < 2; ++i)
+    {
+        const float border[] = { 1.f, 1.f, 1.f, 1.f };
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, ShadowCascades::SIZE, ShadowCascades::SIZE, ShadowCascades::CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+        resource_track(resources, GL_TEXTURE, textures[i], RESOURCE_RENDER_TARGETS, texture_bytes(GL_DEPTH_COMPONENT24, ShadowCascades::SIZE, ShadowCascades::SIZE, ShadowCascades::CASCADE_COUNT, false));
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    sc.staticTexture = textures[0];
+    sc.dynamicTexture = textures[1];
+    sc.distance = 40.f;
+    sc.margin = 1.25f;
+    sc.extrusion = 50.f;
+    sc.direction = glm::vec3(0.f);
+    sc.nextFarCascade = 0;
+    for (int i = 0; i < ShadowCascades::CASCADE_COUNT; ++i)
+        sc.splits[i] = 0.f;
+    shadow_cascades_invalidate(sc);
+}
+
+void shadow_cascades_invalidate(ShadowCascades & sc)
+{
+    for (int i = 0; i < ShadowCascades::CASCADE_COUNT; ++i)
+        sc.valid[i] = false;
+}
+
+void shadow_cascades_update(ShadowCascades & sc, const glm::mat4 & projection, const glm::mat4 & worldToView, const glm::vec3 & direction, bool refresh[])
+{
+    const int count = ShadowCascades::CASCADE_COUNT;
+    glm::vec3 lightDirection = glm::normalize(direction);
+    if (lightDirection != sc.direction)
+    {
+        sc.direction = lightDirection;
+        shadow_cascades_invalidate(sc);
+    }
+
+    // View space rays through the frustum corners, at unit depth
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    glm::mat4 viewToWorld = glm::inverse(worldToView);
+    glm::vec4 nearCenter = inverseProjection * glm::vec4(0.f, 0.f, -1.f, 1.f);
+    float nearDistance = -nearCenter.z / nearCenter.w;
+    glm::vec3 rays[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        glm::vec4 c = inverseProjection * glm::vec4(i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, -1.f, 1.f);
+        glm::vec3 v = glm::vec3(c) / c.w;
+        rays[i] = v / -v.z;
+    }
+
+    // Practical split scheme, blend of logarithmic and uniform splits
+    const float lambda = 0.75f;
+    for (int i = 0; i < count; ++i)
+    {
+        float f = (i + 1) / (float) count;
+        float logSplit = nearDistance * powf(sc.distance / nearDistance, f);
+        float uniformSplit = nearDistance + (sc.distance - nearDistance) * f;
+        sc.splits[i] = lambda * logSplit + (1.f - lambda) * uniformSplit;
+    }
+
+    bool uncovered[count];
+    glm::vec3 centers[count];
+    float radii[count];
+    for (int i = 0; i < count; ++i)
+    {
+        // Bounding sphere of the camera slice
+        float sliceNear = i == 0 ? nearDistance : sc.splits[i-1];
+        float sliceFar = sc.splits[i];
+        glm::vec3 corners[8];
+        glm::vec3 center(0.f);
+        for (int j = 0; j < 4; ++j)
+        {
+            corners[j] = glm::vec3(viewToWorld * glm::vec4(rays[j] * sliceNear, 1.f));
+            corners[j+4] = glm::vec3(viewToWorld * glm::vec4(rays[j] * sliceFar, 1.f));
+            center += corners[j] + corners[j+4];
+        }
+        center /= 8.f;
+        float radius = 0.f;
+        for (int j = 0; j < 8; ++j)
+            radius = std::max(radius, glm::length(corners[j] - center));
+        centers[i] = center;
+        radii[i] = radius;
+        // The cached cascade stays usable as long as it contains the slice
+        uncovered[i] = !sc.valid[i] || glm::length(center - sc.centers[i]) + radius > sc.radii[i];
+        refresh[i] = uncovered[i] && (i == 0 || !sc.valid[i]);
+    }
+
+    // Far cascades the camera moved out of are refreshed one per frame
+    for (int k = 0; k < count - 1; ++k)
+    {
+        int i = 1 + (sc.nextFarCascade + k) % (count - 1);
+        if (uncovered[i] && !refresh[i])
+        {
+            refresh[i] = true;
+            sc.nextFarCascade = i % (count - 1);
+            break;
+        }
+    }
+
+    glm::vec3 up = fabsf(lightDirection.y) > 0.99f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    for (int i = 0; i < count; ++i)
+    {
+        if (!refresh[i])
+            continue;
+        // Grow the cascade so small camera moves stay covered
+        float r = radii[i] * sc.margin;
+        glm::mat4 lightView = glm::lookAt(centers[i] - lightDirection * (r + sc.extrusion), centers[i], up);
+        glm::mat4 lightProjection = glm::ortho(-r, r, -r, r, 0.f, 2.f * r + sc.extrusion);
+        sc.matrices[i] = lightProjection * lightView;
+        sc.centers[i] = centers[i];
+        sc.radii[i] = r;
+        sc.valid[i] = true;
+    }
+}
+
+void shadow_cascades_shutdown(ShadowCascades & sc, ResourceRegistry & resources)
+{
+    resource_release(resources, GL_TEXTURE, sc.staticTexture);
+    resource_release(resources, GL_TEXTURE, sc.dynamicTexture);
+    glDeleteTextures(1, &sc.staticTexture);
+    glDeleteTextures(1, &sc.dynamicTexture);
+}
+
+void shadow_atlas_init(ShadowAtlas & sa, int lightCount, ResourceRegistry & resources)
+{
+    sa.lightCount = std::min(lightCount, (int) ShadowAtlas::MAX_LIGHTS);
+    sa.nearPlane = 0.05f;
+    sa.farPlane = 50.f;
+    glGenTextures(1, &sa.texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, sa.texture);
+    glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT24, ShadowAtlas::SIZE, ShadowAtlas::SIZE, 6 * std::max(sa.lightCount, 1), 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    resource_track(resources, GL_TEXTURE, sa.texture, RESOURCE_RENDER_TARGETS, texture_bytes(GL_DEPTH_COMPONENT24, ShadowAtlas::SIZE, ShadowAtlas::SIZE, 6 * std::max(sa.lightCount, 1), false));
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+    for (int i = 0; i < ShadowAtlas::MAX_LIGHTS; ++i)
+        sa.positions[i] = glm::vec3(0.f);
+    shadow_atlas_invalidate(sa);
+}
+
+void shadow_atlas_invalidate(ShadowAtlas & sa)
+{
+    for (int i = 0; i < ShadowAtlas::MAX_LIGHTS; ++i)
+        sa.validFaces[i] = 0;
+}
+
+glm::mat4 shadow_atlas_face_matrix(const ShadowAtlas & sa, const glm::vec3 & position, int face)
+{
+    // Cube map face orientations : +X, -X, +Y, -Y, +Z, -Z
+    static const glm::vec3 directions[6] = {
+        glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f),
+        glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f)
+    };
+    static const glm::vec3 ups[6] = {
+        glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f),
+        glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f)
+    };
+    glm::mat4 projection = glm::perspective(glm::radians(90.f), 1.f, sa.nearPlane, sa.farPlane);
+    return projection * glm::lookAt(position, position + directions[face], ups[face]);
+}
+
+void shadow_atlas_shutdown(ShadowAtlas & sa, ResourceRegistry & resources)
+{
+    resource_release(resources, GL_TEXTURE, sa.texture);
+    glDeleteTextures(1, &sa.texture);
+}
+
+const char * MULTI_VIEW_LAYOUT_NAMES[MultiView::LAYOUT_COUNT] = { "Stereo", "Panorama", "Camera and cube" };
+
+bool multi_view_init(MultiView & mv, int layerCount, int width, int height, ResourceRegistry & resources)
+{
+    // Views of the layers need immutable storage
+    static const GLenum formats[4] = { GL_RGBA8, GL_RGBA32F, GL_DEPTH_COMPONENT24, GL_RG16F };
+    mv.layerCount = glm::clamp(layerCount, 2, (int) MultiView::MAX_VIEWS);
+    mv.layout = mv.layerCount >= 7 ? MultiView::LAYOUT_CUBE : mv.layerCount == 2 ? MultiView::LAYOUT_STEREO : MultiView::LAYOUT_PANORAMA;
+    mv.panoramaViews = mv.layerCount;
+    mv.eyeSeparation = 0.065f;
+    glGenTextures(4, mv.arrays);
+    for (int k = 0; k < 4; ++k)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, mv.arrays[k]);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, formats[k], width, height, mv.layerCount);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        resource_track(resources, GL_TEXTURE, mv.arrays[k], RESOURCE_RENDER_TARGETS, texture_bytes(formats[k], width, height, mv.layerCount, false));
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    // Views share the storage and start with the sampling state of the arrays
+    for (int l = 0; l < mv.layerCount; ++l)
+    {
+        glGenTextures(4, mv.layers[l]);
+        for (int k = 0; k < 4; ++k)
+            glTextureView(mv.layers[l][k], GL_TEXTURE_2D, mv.arrays[k], formats[k], 0, 1, l, 1);
+    }
+
+    GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glGenFramebuffers(1, &mv.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, mv.fbo);
+    glDrawBuffers(3, drawBuffers);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mv.arrays[0], 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, mv.arrays[1], 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, mv.arrays[3], 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mv.arrays[2], 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (int v = 0; v < MultiView::MAX_VIEWS; ++v)
+        mv.previousViewProjections[v] = glm::mat4();
+    return complete;
+}
+
+int multi_view_count(const MultiView & mv)
+{
+    int count = mv.layout == MultiView::LAYOUT_STEREO ? 2 : mv.layout == MultiView::LAYOUT_CUBE ? 7 : mv.panoramaViews;
+    return glm::clamp(count, 1, mv.layerCount);
+}
+
+void multi_view_cameras(const MultiView & mv, const Camera & camera, const glm::mat4 & projection, glm::mat4 worldToView[], glm::mat4 projections[])
+{
+    glm::vec3 forward = glm::normalize(camera.o - camera.eye);
+    int count = multi_view_count(mv);
+    worldToView[0] = glm::lookAt(camera.eye, camera.o, camera.up);
+    projections[0] = projection;
+    for (int v = 1; v < count; ++v)
+    {
+        projections[v] = projection;
+        if (mv.layout == MultiView::LAYOUT_STEREO)
+        {
+            // Parallel axes, shifted along the camera right
+            glm::vec3 offset = glm::normalize(glm::cross(forward, camera.up)) * mv.eyeSeparation;
+            worldToView[v] = glm::lookAt(camera.eye + offset, camera.o + offset, camera.up);
+        }
+        else if (mv.layout == MultiView::LAYOUT_PANORAMA)
+        {
+            glm::mat4 turn = glm::rotate(glm::mat4(), glm::radians(360.f * v / count), camera.up);
+            worldToView[v] = glm::lookAt(camera.eye, camera.eye + glm::vec3(turn * glm::vec4(forward, 0.f)), camera.up);
+        }
+        else
+        {
+            // Cube map face orientations : +X, -X, +Y, -Y, +Z, -Z
+            static const glm::vec3 directions[6] = {
+                glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f),
+                glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f)
+            };
+            static const glm::vec3 ups[6] = {
+                glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f),
+                glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f)
+            };
+            worldToView[v] = glm::lookAt(camera.eye, camera.eye + directions[v - 1], ups[v - 1]);
+            projections[v] = glm::perspective(glm::radians(90.f), 1.f, 0.1f, 100.f);
+        }
+    }
+}
+
+glm::ivec2 multi_view_size(const MultiView & mv, int view, int renderWidth, int renderHeight)
+{
+    if (mv.layout == MultiView::LAYOUT_CUBE && view > 0)
+        return glm::ivec2(std::min(renderWidth, renderHeight));
+    return glm::ivec2(renderWidth, renderHeight);
+}
+
+glm::ivec4 multi_view_tile(int view, int viewCount, int width, int height)
+{
+    int columns = (int) ceil(sqrt((double) viewCount));
+    int rows = (viewCount + columns - 1) / columns;
+    int tileWidth = width / columns, tileHeight = height / rows;
+    // First row at the top
+    return glm::ivec4(view % columns * tileWidth, (rows - 1 - view / columns) * tileHeight, tileWidth, tileHeight);
+}
+
+void multi_view_shutdown(MultiView & mv, ResourceRegistry & resources)
+{
+    if (mv.layerCount == 0)
+        return;
+    for (int l = 0; l < mv.layerCount; ++l)
+        glDeleteTextures(4, mv.layers[l]);
+    for (int k = 0; k < 4; ++k)
+        resource_release(resources, GL_TEXTURE, mv.arrays[k]);
+    glDeleteTextures(4, mv.arrays);
+    glDeleteFramebuffers(1, &mv.fbo);
+}
+
+bool msaa_gbuffer_init(MsaaGbuffer & mg, int samples, int width, int height, GLuint lightingFbo, ResourceRegistry & resources)
+{
+    static const GLenum formats[4] = { GL_RGBA8, GL_RGBA32F, GL_DEPTH_COMPONENT24, GL_RG16F };
+    GLint maxColorSamples, maxDepthSamples;
+    glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &maxColorSamples);
+    glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &maxDepthSamples);
+    mg.samples = std::min(samples, std::min((int) maxColorSamples, (int) maxDepthSamples));
+    mg.depthThreshold = 0.01f;
+    mg.normalThreshold = 0.1f;
+    glGenTextures(4, mg.textures);
+    for (int k = 0; k < 4; ++k)
+    {
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, mg.textures[k]);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, mg.samples, formats[k], width, height, GL_TRUE);
+        resource_track(resources, GL_TEXTURE, mg.textures[k], RESOURCE_RENDER_TARGETS, texture_bytes(formats[k], width, height, 1, false) * mg.samples);
+    }
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+
+    GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glGenFramebuffers(1, &mg.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, mg.fbo);
+    glDrawBuffers(3, drawBuffers);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, mg.textures[0], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D_MULTISAMPLE, mg.textures[1], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D_MULTISAMPLE, mg.textures[3], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, mg.textures[2], 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    // Lights only test the stencil, the depth is unused
+    glGenRenderbuffers(1, &mg.stencil);
+    glBindRenderbuffer(GL_RENDERBUFFER, mg.stencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    resource_track(resources, GL_RENDERBUFFER, mg.stencil, RESOURCE_RENDER_TARGETS, texture_bytes(GL_DEPTH24_STENCIL8, width, height, 1, false));
+    glBindFramebuffer(GL_FRAMEBUFFER, lightingFbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mg.stencil);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenQueries(MsaaGbuffer::FRAME_LATENCY, mg.queries);
+    for (int i = 0; i < MsaaGbuffer::FRAME_LATENCY; ++i)
+    {
+        mg.pending[i] = false;
+        mg.pixelCounts[i] = 0;
+    }
+    mg.frame = 0;
+    mg.edgeFraction = 0.f;
+    return complete;
+}
+
+void msaa_gbuffer_edges_begin(MsaaGbuffer & mg, int pixelCount)
+{
+    int slot = mg.frame % MsaaGbuffer::FRAME_LATENCY;
+    if (mg.pending[slot])
+    {
+        GLuint64 edgePixels = 0;
+        glGetQueryObjectui64v(mg.queries[slot], GL_QUERY_RESULT, &edgePixels);
+        mg.edgeFraction = mg.pixelCounts[slot] > 0 ? (float) ((double) edgePixels / mg.pixelCounts[slot]) : 0.f;
+    }
+    mg.pixelCounts[slot] = pixelCount;
+    glBeginQuery(GL_SAMPLES_PASSED, mg.queries[slot]);
+}
+
+void msaa_gbuffer_edges_end(MsaaGbuffer & mg)
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+    mg.pending[mg.frame % MsaaGbuffer::FRAME_LATENCY] = true;
+    ++mg.frame;
+}
+
+void msaa_light_draw(GLuint program, GLint samplesLocation, int samples, GLsizei indexCount)
+{
+    glProgramUniform1i(program, samplesLocation, 0);
+    if (samples == 0)
+    {
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0);
+        return;
+    }
+    glStencilFunc(GL_EQUAL, 0, 1);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0);
+    glStencilFunc(GL_EQUAL, 1, 1);
+    glProgramUniform1i(program, samplesLocation, samples);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0);
+}
+
+void msaa_gbuffer_shutdown(MsaaGbuffer & mg, ResourceRegistry & resources)
+{
+    if (mg.samples == 0)
+        return;
+    for (int k = 0; k < 4; ++k)
+        resource_release(resources, GL_TEXTURE, mg.textures[k]);
+    glDeleteTextures(4, mg.textures);
+    resource_release(resources, GL_RENDERBUFFER, mg.stencil);
+    glDeleteRenderbuffers(1, &mg.stencil);
+    glDeleteFramebuffers(1, &mg.fbo);
+    glDeleteQueries(MsaaGbuffer::FRAME_LATENCY, mg.queries);
+}
+
+void buffer_heap_init(BufferHeap & heap, size_t arenaBytes, size_t alignment, ResourceCategory category)
+{
+    heap.arenaBytes = arenaBytes;
+    heap.alignment = alignment;
+    heap.category = category;
+    heap.immutable = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    heap.movedBytes = 0;
+}
+
+int buffer_heap_alloc(BufferHeap & heap, size_t bytes, int owner, ResourceRegistry & resources)
+{
+    int arena = 0, block = -1;
+    for (; arena < (int) heap.arenas.size(); ++arena)
+    {
+        block = tlsf_alloc(heap.arenas[arena], bytes);
+        if (block != -1)
+            break;
+    }
+    if (block == -1)
+    {
+        // Larger than an arena, the region gets one of its own
+        size_t capacity = std::max(heap.arenaBytes, (bytes + heap.alignment - 1) / heap.alignment * heap.alignment);
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (heap.immutable)
+            glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+        else
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        resource_track(resources, GL_BUFFER, buffer, heap.category, capacity);
+        heap.buffers.push_back(buffer);
+        heap.arenas.push_back(Tlsf());
+        heap.blockRegions.push_back(std::vector<int>());
+        tlsf_init(heap.arenas.back(), capacity, heap.alignment);
+        block = tlsf_alloc(heap.arenas.back(), bytes);
+    }
+    int region;
+    if (!heap.freeRegions.empty())
+    {
+        region = heap.freeRegions.back();
+        heap.freeRegions.pop_back();
+    }
+    else
+    {
+        region = (int) heap.regions.size();
+        heap.regions.push_back(BufferRegion());
+    }
+    BufferRegion & r = heap.regions[region];
+    r.arena = arena;
+    r.block = block;
+    r.owner = owner;
+    std::vector<int> & blockRegions = heap.blockRegions[arena];
+    if ((int) blockRegions.size() <= block)
+        blockRegions.resize(block + 1, -1);
+    blockRegions[block] = region;
+    return region;
+}
+
+void buffer_heap_upload(const BufferHeap & heap, int region, size_t offset, size_t bytes, const void * data)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_heap_buffer(heap, region));
+    glBufferSubData(GL_COPY_WRITE_BUFFER, buffer_heap_offset(heap, region) + offset, bytes, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void buffer_heap_free(BufferHeap & heap, int region)
+{
+    BufferRegion & r = heap.regions[region];
+    tlsf_free(heap.arenas[r.arena], r.block);
+    heap.blockRegions[r.arena][r.block] = -1;
+    r.block = -1;
+    heap.freeRegions.push_back(region);
+}
+
+void buffer_heap_compact(BufferHeap & heap, size_t maxBytes, std::vector<BufferMove> & moves)
+{
+    moves.clear();
+    size_t copied = 0;
+    for (size_t a = 0; a < heap.arenas.size(); ++a)
+    {
+        Tlsf & arena = heap.arenas[a];
+        bool copying = false;
+        while (copied < maxBytes)
+        {
+            int last;
+            int block = tlsf_compact_step(arena, last);
+            if (block == -1)
+                break;
+            size_t size = tlsf_size(arena, last);
+            if (!copying)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, heap.buffers[a]);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, heap.buffers[a]);
+                copying = true;
+            }
+            // The new block was free, the ranges do not overlap
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, tlsf_offset(arena, last), tlsf_offset(arena, block), size);
+            int region = heap.blockRegions[a][last];
+            BufferMove move = { region, tlsf_offset(arena, last), tlsf_offset(arena, block) };
+            moves.push_back(move);
+            tlsf_free(arena, last);
+            heap.blockRegions[a][last] = -1;
+            if ((int) heap.blockRegions[a].size() <= block)
+                heap.blockRegions[a].resize(block + 1, -1);
+            heap.blockRegions[a][block] = region;
+            heap.regions[region].block = block;
+            copied += size;
+        }
+        if (copying)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+    }
+    heap.movedBytes += copied;
+}
+
+void buffer_heap_stats(const BufferHeap & heap, BufferHeapStats & stats)
+{
+    stats.arenas = (int) heap.arenas.size();
+    stats.regions = (int) (heap.regions.size() - heap.freeRegions.size());
+    stats.capacity = 0;
+    stats.used = 0;
+    stats.largestFree = 0;
+    stats.freeBlocks = 0;
+    for (size_t a = 0; a < heap.arenas.size(); ++a)
+    {
+        TlsfStats arena;
+        tlsf_stats(heap.arenas[a], arena);
+        stats.capacity += arena.capacity;
+        stats.used += arena.used;
+        stats.largestFree = std::max(stats.largestFree, arena.largestFree);
+        stats.freeBlocks += arena.freeBlocks;
+    }
+    size_t freeBytes = stats.capacity - stats.used;
+    stats.fragmentation = freeBytes ? 1.f - (float) stats.largestFree / freeBytes : 0.f;
+}
+
+void buffer_heap_shutdown(BufferHeap & heap, ResourceRegistry & resources)
+{
+    for (size_t a = 0; a < heap.buffers.size(); ++a)
+        resource_release(resources, GL_BUFFER, heap.buffers[a]);
+    if (!heap.buffers.empty())
+        glDeleteBuffers((GLsizei) heap.buffers.size(), &heap.buffers[0]);
+    heap.buffers.clear();
+    heap.arenas.clear();
+    heap.blockRegions.clear();
+    heap.regions.clear();
+    heap.freeRegions.clear();
+}
+
+size_t light_slots_upload(const BufferHeap & heap, int region, int view, const std::vector<unsigned char> & slots)
+{
+    size_t offset = view * slots.size();
+    buffer_heap_upload(heap, region, offset, slots.size(), &slots[0]);
+    return buffer_heap_offset(heap, region) + offset;
+}
+
+void mesh_vertex_array_bind(GLuint vao, const BufferHeap & heap, int indexRegion, int vertexRegion, unsigned int vertexCount)
+{
+    size_t base = buffer_heap_offset(heap, vertexRegion);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer_heap_buffer(heap, indexRegion));
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_heap_buffer(heap, vertexRegion));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)base);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)(base + vertexCount*3*sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*2, (void*)(base + vertexCount*6*sizeof(float)));
+    glBindVertexArray(0);
+}
+
+bool visibility_buffer_init(VisibilityBuffer & vb, int width, int height, const GLuint * gbufferTextures, ResourceRegistry & resources)
+{
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &vb.maxTexels);
+    GLuint textures[2];
+    glGenTextures(2, textures);
+    vb.ids = textures[0];
+    vb.materialDepth = textures[1];
+    glBindTexture(GL_TEXTURE_2D, vb.ids);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    resource_track(resources, GL_TEXTURE, vb.ids, RESOURCE_RENDER_TARGETS, texture_bytes(GL_R32UI, width, height, 1, false));
+    // Material keys are exact in a float depth
+    glBindTexture(GL_TEXTURE_2D, vb.materialDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    resource_track(resources, GL_TEXTURE, vb.materialDepth, RESOURCE_RENDER_TARGETS, texture_bytes(GL_DEPTH_COMPONENT32F, width, height, 1, false));
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The scene pass writes the depth of the G-buffer, the resolve its colors
+    GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glGenFramebuffers(1, &vb.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, vb.fbo);
+    glDrawBuffers(1, drawBuffers);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, vb.ids, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbufferTextures[2], 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glGenFramebuffers(1, &vb.materialFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, vb.materialFbo);
+    glDrawBuffers(3, drawBuffers);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gbufferTextures[0], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gbufferTextures[1], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gbufferTextures[3], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, vb.materialDepth, 0);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    vb.recordCapacity = 256;
+    glGenBuffers(1, &vb.records);
+    glBindBuffer(GL_TEXTURE_BUFFER, vb.records);
+    glBufferData(GL_TEXTURE_BUFFER, vb.recordCapacity * sizeof(VisibilityRecord), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    resource_track(resources, GL_BUFFER, vb.records, RESOURCE_UNIFORMS, vb.recordCapacity * sizeof(VisibilityRecord));
+    glGenTextures(2, vb.recordTextures);
+    glBindTexture(GL_TEXTURE_BUFFER, vb.recordTextures[0]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, vb.records);
+    glBindTexture(GL_TEXTURE_BUFFER, vb.recordTextures[1]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, vb.records);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    vb.arenaCount = 0;
+    vb.frame = 0;
+    vb.triangleBits = 0;
+    return complete;
+}
+
+bool visibility_buffer_begin(VisibilityBuffer & vb, const BufferHeap & heap, int draws, int maxTriangles)
+{
+    vb.frameRecords.clear();
+    vb.frameMaterials.clear();
+    ++vb.frame;
+    if ((int) heap.buffers.size() > VisibilityBuffer::MAX_ARENAS)
+        return false;
+    // One record per draw and instance, read through GL_MAX_TEXTURE_BUFFER_SIZE texels
+    if ((size_t) draws * VisibilityBuffer::RECORD_TEXELS > (size_t) vb.maxTexels)
+        return false;
+    // Views of the arenas created since the last frame
+    for (; vb.arenaCount < (int) heap.buffers.size(); ++vb.arenaCount)
+    {
+        if (heap.arenas[vb.arenaCount].capacity / sizeof(GLuint) > (size_t) vb.maxTexels)
+            return false;
+        GLuint & texture = vb.arenaTextures[vb.arenaCount];
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, heap.buffers[vb.arenaCount]);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    // Triangle ids up to maxTriangles - 1, the all ones id marks empty pixels
+    int triangleBits = 1;
+    while (triangleBits < 32 && ((GLuint) 1 << triangleBits) < (GLuint) maxTriangles)
+        ++triangleBits;
+    if (triangleBits >= 32 || (GLuint) draws >= ((GLuint) 1 << (32 - triangleBits)) - 1)
+        return false;
+    vb.triangleBits = triangleBits;
+    return true;
+}
+
+void visibility_record_geometry(VisibilityRecord & record, const BufferHeap & heap, int indexRegion, int vertexRegion, unsigned int vertexCount, GLuint indexOffset)
+{
+    record.vertexBase = buffer_heap_offset(heap, vertexRegion) / sizeof(GLuint);
+    record.vertexCount = vertexCount;
+    record.indexBase = indexOffset;
+    record.arenas = heap.regions[indexRegion].arena | heap.regions[vertexRegion].arena << 16;
+}
+
+int visibility_buffer_add(VisibilityBuffer & vb, const VisibilityRecord & record)
+{
+    if (record.material >= vb.materialFrames.size())
+        vb.materialFrames.resize(record.material + 1, 0);
+    if (vb.materialFrames[record.material] != vb.frame)
+    {
+        vb.materialFrames[record.material] = vb.frame;
+        vb.frameMaterials.push_back(record.material);
+    }
+    vb.frameRecords.push_back(record);
+    return (int) vb.frameRecords.size() - 1;
+}
+
+void visibility_buffer_add_instances(VisibilityBuffer & vb, VisibilityRecord & record, const glm::mat4 * mvps, const glm::mat4 * prevMvps, const glm::mat3 * normalMatrices, int instances,
+                                     GLuint program, GLint mvpsLocation, GLint drawBaseLocation)
+{
+    int drawBase = (int) vb.frameRecords.size();
+    for (int k = 0; k < instances; ++k)
+    {
+        record.mvp = mvps[k];
+        record.prevMvp = prevMvps[k];
+        for (int c = 0; c < 3; ++c)
+            record.normalMatrix[c] = glm::vec4(normalMatrices[k][c], 0.f);
+        visibility_buffer_add(vb, record);
+    }
+    glProgramUniformMatrix4fv(program, mvpsLocation, instances, 0, glm::value_ptr(mvps[0]));
+    glProgramUniform1i(program, drawBaseLocation, drawBase);
+}
+
+void visibility_buffer_upload(VisibilityBuffer & vb, ResourceRegistry & resources)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, vb.records);
+    if (vb.frameRecords.size() > vb.recordCapacity)
+    {
+        // visibility_buffer_begin keeps the records of a frame under the limit
+        const size_t maxRecords = (size_t) vb.maxTexels / VisibilityBuffer::RECORD_TEXELS;
+        vb.recordCapacity = std::max(vb.frameRecords.size(), std::min(2 * vb.recordCapacity, maxRecords));
+        resource_track(resources, GL_BUFFER, vb.records, RESOURCE_UNIFORMS, vb.recordCapacity * sizeof(VisibilityRecord));
+    }
+    // Orphaned each frame, the resolve of the previous frame may still read it
+    glBufferData(GL_TEXTURE_BUFFER, vb.recordCapacity * sizeof(VisibilityRecord), NULL, GL_STREAM_DRAW);
+    if (!vb.frameRecords.empty())
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, vb.frameRecords.size() * sizeof(VisibilityRecord), &vb.frameRecords[0]);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void visibility_buffer_shutdown(VisibilityBuffer & vb, ResourceRegistry & resources)
+{
+    if (vb.fbo == 0)
+        return;
+    resource_release(resources, GL_TEXTURE, vb.ids);
+    resource_release(resources, GL_TEXTURE, vb.materialDepth);
+    resource_release(resources, GL_BUFFER, vb.records);
+    glDeleteTextures(1, &vb.ids);
+    glDeleteTextures(1, &vb.materialDepth);
+    glDeleteTextures(2, vb.recordTextures);
+    glDeleteTextures(vb.arenaCount, vb.arenaTextures);
+    glDeleteBuffers(1, &vb.records);
+    glDeleteFramebuffers(1, &vb.fbo);
+    glDeleteFramebuffers(1, &vb.materialFbo);
+}
+
+void overdraw_counter_init(OverdrawCounter & oc)
+{
+    glGenQueries(OverdrawCounter::FRAME_LATENCY, oc.queries);
+    for (int i = 0; i < OverdrawCounter::FRAME_LATENCY; ++i)
+    {
+        oc.pending[i] = false;
+        oc.pixelCounts[i] = 0;
+    }
+    oc.frame = 0;
+    oc.fragmentsPerPixel = 0.f;
+}
+
+void overdraw_counter_begin(OverdrawCounter & oc, int pixelCount)
+{
+    int slot = oc.frame % OverdrawCounter::FRAME_LATENCY;
+    // The query of this slot was issued FRAME_LATENCY frames ago
+    if (oc.pending[slot])
+    {
+        GLuint64 samples = 0;
+        glGetQueryObjectui64v(oc.queries[slot], GL_QUERY_RESULT, &samples);
+        oc.fragmentsPerPixel = oc.pixelCounts[slot] > 0 ? (float) ((double) samples / oc.pixelCounts[slot]) : 0.f;
+    }
+    oc.pixelCounts[slot] = pixelCount;
+    glBeginQuery(GL_SAMPLES_PASSED, oc.queries[slot]);
+}
+
+void overdraw_counter_end(OverdrawCounter & oc)
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+    oc.pending[oc.frame % OverdrawCounter::FRAME_LATENCY] = true;
+    ++oc.frame;
+}
+
+void overdraw_counter_shutdown(OverdrawCounter & oc)
+{
+    glDeleteQueries(OverdrawCounter::FRAME_LATENCY, oc.queries);
+}
+
+void resolution_scaling_init(ResolutionScaling & rs)
+{
+    rs.dynamic = true;
+    rs.scale = 1.f;
+    rs.fixedScale = 1.f;
+    rs.minScale = 0.5f;
+    rs.targetFrameTime = 16.f;
+    rs.overBudgetFrames = 0;
+    rs.underBudgetFrames = 0;
+}
+
+void resolution_scaling_update(ResolutionScaling & rs, float gpuFrameTime)
+{
+    if (!rs.dynamic)
+    {
+        rs.scale = rs.fixedScale;
+        return;
+    }
+
+    // Hysteresis : drop quickly when over budget, only grow back after a long
+    // run of frames comfortably under budget
+    if (gpuFrameTime > rs.targetFrameTime)
+    {
+        ++rs.overBudgetFrames;
+        rs.underBudgetFrames = 0;
+    }
+    else if (gpuFrameTime < rs.targetFrameTime * 0.8f)
+    {
+        ++rs.underBudgetFrames;
+        rs.overBudgetFrames = 0;
+    }
+    else
+    {
+        rs.overBudgetFrames = 0;
+        rs.underBudgetFrames = 0;
+    }
+
+    if (rs.overBudgetFrames >= 4)
+    {
+        // Cost is roughly proportional to the pixel count
+        float ratio = sqrtf(rs.targetFrameTime * 0.9f / gpuFrameTime);
+        rs.scale = glm::clamp(rs.scale * glm::max(ratio, 0.85f), rs.minScale, 1.f);
+        rs.overBudgetFrames = 0;
+    }
+    else if (rs.underBudgetFrames >= 60)
+    {
+        rs.scale = glm::clamp(rs.scale + 0.05f, rs.minScale, 1.f);
+        rs.underBudgetFrames = 0;
+    }
+}
+
+static void write_json_array(FILE * file, const std::vector<float> & values)
+{
+    fprintf(file, "[");
+    for (size_t i = 0; i < values.size(); ++i)
+        fprintf(file, i ? ", %.4f" : "%.4f", values[i]);
+    fprintf(file, "]");
+}
+
+static void write_json_memory(FILE * file, const char * const * names, const size_t * bytes, const size_t * peaks, int count, size_t total, size_t peakTotal)
+{
+    fprintf(file, "{\n");
+    for (int i = 0; i < count; ++i)
+        fprintf(file, "      \"%s\": { \"bytes\": %zu, \"peak\": %zu },\n", names[i], bytes[i], peaks[i]);
+    fprintf(file, "      \"total\": %zu,\n      \"peak\": %zu\n    }", total, peakTotal);
+}
+
+bool write_benchmark_json(const char * path, const BenchmarkRecord & record, const ResourceRegistry & resources, int width, int height, float scale)
+{
+    FILE * file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\n");
+    fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n  \"scale\": %.3f,\n", width, height, scale);
+    fprintf(file, "  \"frames\": %d,\n", (int) record.gpuFrameTimes.size());
+    fprintf(file, "  \"cpu_frame_ms\": ");
+    write_json_array(file, record.cpuFrameTimes);
+    fprintf(file, ",\n  \"gpu_frame_ms\": ");
+    write_json_array(file, record.gpuFrameTimes);
+    fprintf(file, ",\n  \"fragments_per_pixel\": ");
+    write_json_array(file, record.fragmentsPerPixel);
+    fprintf(file, ",\n  \"visibility_frames\": %d", record.visibilityFrames);
+    fprintf(file, ",\n  \"memory\": {\n    \"gpu\": ");
+    write_json_memory(file, RESOURCE_CATEGORY_NAMES, resources.gpuBytes, resources.gpuPeak, RESOURCE_CATEGORY_COUNT, resources.gpuTotal, resources.gpuPeakTotal);
+    fprintf(file, ",\n    \"cpu\": ");
+    write_json_memory(file, CPU_SUBSYSTEM_NAMES, resources.cpuBytes, resources.cpuPeak, CPU_SUBSYSTEM_COUNT, resources.cpuTotal, resources.cpuPeakTotal);
+    fprintf(file, "\n  }");
+    fprintf(file, ",\n  \"passes\": {\n");
+    for (int i = 0; i < GPU_PASS_COUNT; ++i)
+    {
+        fprintf(file, "    \"%s\": ", GPU_PASS_NAMES[i]);
+        write_json_array(file, record.passTimes[i]);
+        fprintf(file, i + 1 < GPU_PASS_COUNT ? ",\n" : "\n");
+    }
+    fprintf(file, "  }\n}\n");
+    fclose(file);
+    return true;
+}
+
+const char * const DEBUG_VIEW_NAMES[DEBUG_VIEW_COUNT] = { "none", "lights", "overdraw", "tiles" };
+
 void init_gui_states(GUIStates & guiStates)
 {
     guiStates.panLock = false;
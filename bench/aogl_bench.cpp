@@ -0,0 +1,559 @@
+// Microbenchmarks of the renderer CPU hot paths. Nothing here needs an OpenGL
+// context, every case runs on the code shared with aogl through aoglcore.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cmath>
+
+#include "stb/stb_image.h"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "culling.h"
+#include "mesh_lod.h"
+#include "obj_import.h"
+#include "profiler.h"
+#include "scene.h"
+#include "scene_batch.h"
+#include "scene_instances.h"
+#include "tlsf.h"
+#include "transforms.h"
+
+// Inputs shared by the cases, generated from a fixed seed so runs are repeatable
+struct BenchData
+{
+    std::string scenePath;
+    std::string texturePath;
+    std::vector<glm::mat4> objectToWorld;
+    TransformSoa objectToWorldSoa;
+    std::vector<glm::mat4> mv;
+    std::vector<glm::mat4> mvp;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> viewPositions;
+    std::vector<glm::vec4> spheres;
+    SphereBvh bvh;
+    std::vector<unsigned int> visible;
+    glm::vec4 planes[6];
+    const aiScene * scene;
+    std::vector<GLuint> indices;
+    std::vector<GLuint> lodIndices;
+    std::vector<unsigned char> textureFile;
+    SceneData sceneData;
+    SceneData importedScene;
+    std::vector<size_t> allocationSizes;
+    Tlsf tlsf;
+    std::vector<int> blocks;
+    // Results are folded in here so the work cannot be optimized out
+    double sink;
+};
+
+struct BenchCase
+{
+    const char * name;
+    // Returns false when the inputs are not available, the case is skipped
+    bool (*setup)(BenchData & data);
+    // One iteration, returns the number of items processed
+    int (*run)(BenchData & data);
+};
+
+// Per iteration statistics of a case, in microseconds
+struct BenchResult
+{
+    const char * name;
+    int iterations;
+    int items;
+    std::vector<double> samples;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double p90;
+};
+
+static const int TRANSFORM_COUNT = 10000;
+static const int SPHERE_COUNT = 16384;
+
+static bool setup_transforms(BenchData & data)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(-100.f, 100.f);
+    std::uniform_real_distribution<float> angle(0.f, 6.2831853f);
+    data.objectToWorld.resize(TRANSFORM_COUNT);
+    data.mv.resize(TRANSFORM_COUNT);
+    data.mvp.resize(TRANSFORM_COUNT);
+    data.positions.resize(TRANSFORM_COUNT);
+    data.viewPositions.resize(TRANSFORM_COUNT);
+    for (int i = 0; i < TRANSFORM_COUNT; ++i)
+    {
+        glm::vec3 p(position(rng), position(rng), position(rng));
+        data.objectToWorld[i] = glm::rotate(glm::translate(glm::mat4(), p), angle(rng), glm::vec3(0.f, 1.f, 0.f));
+        data.positions[i] = glm::vec3(position(rng), position(rng), position(rng));
+    }
+    transform_soa_assign(data.objectToWorldSoa, &data.objectToWorld[0], TRANSFORM_COUNT);
+    return true;
+}
+
+static bool setup_transforms_sse(BenchData & data)
+{
+    return transform_path_best() >= TRANSFORM_PATH_SSE && setup_transforms(data);
+}
+
+static bool setup_transforms_avx(BenchData & data)
+{
+    return transform_path_best() >= TRANSFORM_PATH_AVX && setup_transforms(data);
+}
+
+static glm::mat4 bench_world_to_view()
+{
+    return glm::lookAt(glm::vec3(0.f, 2.f, 10.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+}
+
+static int run_matrix_chain(BenchData & data)
+{
+    glm::mat4 projection = glm::perspective(0.8f, 16.f / 9.f, 0.1f, 1000.f);
+    glm::mat4 scale = glm::scale(glm::mat4(), glm::vec3(0.01f));
+    mesh_transforms(projection, bench_world_to_view(), scale, &data.objectToWorld[0], TRANSFORM_COUNT, &data.mv[0], &data.mvp[0]);
+    data.sink += data.mvp[TRANSFORM_COUNT - 1][3][3];
+    return TRANSFORM_COUNT;
+}
+
+static int run_matrix_chain_soa(BenchData & data, TransformPath path)
+{
+    glm::mat4 projection = glm::perspective(0.8f, 16.f / 9.f, 0.1f, 1000.f);
+    glm::mat4 scale = glm::scale(glm::mat4(), glm::vec3(0.01f));
+    mesh_transforms_soa(projection, bench_world_to_view(), scale, data.objectToWorldSoa, &data.mv[0], &data.mvp[0], path);
+    data.sink += data.mvp[TRANSFORM_COUNT - 1][3][3];
+    return TRANSFORM_COUNT;
+}
+
+static int run_matrix_chain_soa_scalar(BenchData & data)
+{
+    return run_matrix_chain_soa(data, TRANSFORM_PATH_SCALAR);
+}
+
+static int run_matrix_chain_soa_sse(BenchData & data)
+{
+    return run_matrix_chain_soa(data, TRANSFORM_PATH_SSE);
+}
+
+static int run_matrix_chain_soa_avx(BenchData & data)
+{
+    return run_matrix_chain_soa(data, TRANSFORM_PATH_AVX);
+}
+
+static int run_light_transform(BenchData & data)
+{
+    points_to_view(bench_world_to_view(), &data.positions[0], TRANSFORM_COUNT, &data.viewPositions[0]);
+    data.sink += data.viewPositions[TRANSFORM_COUNT - 1].z;
+    return TRANSFORM_COUNT;
+}
+
+static bool setup_spheres(BenchData & data)
+{
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> position(-200.f, 200.f);
+    std::uniform_real_distribution<float> radius(0.1f, 4.f);
+    data.spheres.resize(SPHERE_COUNT);
+    for (int i = 0; i < SPHERE_COUNT; ++i)
+        data.spheres[i] = glm::vec4(position(rng), position(rng), position(rng), radius(rng));
+    sphere_bvh_build(data.bvh, &data.spheres[0], SPHERE_COUNT);
+    glm::mat4 projection = glm::perspective(0.8f, 16.f / 9.f, 0.1f, 300.f);
+    frustum_planes(projection * bench_world_to_view(), data.planes);
+    data.visible.reserve(SPHERE_COUNT);
+    return true;
+}
+
+static int run_cull_linear(BenchData & data)
+{
+    sphere_cull(data.planes, &data.spheres[0], SPHERE_COUNT, data.visible);
+    data.sink += data.visible.size();
+    return SPHERE_COUNT;
+}
+
+static int run_cull_bvh(BenchData & data)
+{
+    sphere_bvh_cull(data.bvh, data.planes, data.visible);
+    data.sink += data.visible.size();
+    return SPHERE_COUNT;
+}
+
+static int run_bvh_build(BenchData & data)
+{
+    sphere_bvh_build(data.bvh, &data.spheres[0], SPHERE_COUNT);
+    data.sink += data.bvh.nodes.size();
+    return SPHERE_COUNT;
+}
+
+static bool setup_scene_file(BenchData & data)
+{
+    FILE * file = fopen(data.scenePath.c_str(), "r");
+    if (!file)
+        return false;
+    fclose(file);
+    return true;
+}
+
+static int run_scene_import(BenchData & data)
+{
+    const aiScene * scene = aiImportFile(data.scenePath.c_str(), aiProcessPreset_TargetRealtime_MaxQuality);
+    if (!scene)
+        return 0;
+    data.sink += scene->mNumMeshes;
+    aiReleaseImport(scene);
+    return 1;
+}
+
+static bool setup_obj_file(BenchData & data)
+{
+    return obj_is_obj_path(data.scenePath.c_str()) && setup_scene_file(data);
+}
+
+static int run_scene_import_obj(BenchData & data)
+{
+    if (!obj_import(data.scenePath.c_str(), data.sceneData, NULL))
+        return 0;
+    data.sink += data.sceneData.meshes.size();
+    return 1;
+}
+
+static bool setup_scene(BenchData & data)
+{
+    if (!data.scene && setup_scene_file(data))
+        data.scene = aiImportFile(data.scenePath.c_str(), aiProcessPreset_TargetRealtime_MaxQuality);
+    return data.scene != NULL;
+}
+
+// Same conversion as aogl at load time, up to the buffer uploads
+static int run_scene_convert(BenchData & data)
+{
+    int triangles = 0;
+    scene_from_ai(data.scene, data.sceneData);
+    for (size_t i = 0; i < data.sceneData.meshes.size(); ++i)
+        triangles += data.sceneData.meshes[i].indices.size() / 3;
+    data.sink += ai_scene_bytes(data.scene);
+    return triangles;
+}
+
+static int run_mesh_lod_build(BenchData & data)
+{
+    int triangles = 0;
+    for (unsigned int i = 0; i < data.scene->mNumMeshes; ++i)
+    {
+        const aiMesh * m = data.scene->mMeshes[i];
+        if (m->mNumFaces == 0)
+            continue;
+        data.indices.resize(m->mNumFaces * 3);
+        scene_mesh_indices(m, &data.indices[0]);
+        MeshLod lod;
+        mesh_lod_build(lod, (const float *) m->mVertices, m->mNumVertices, &data.indices[0], m->mNumFaces * 3, data.lodIndices);
+        data.sink += lod.lodCount;
+        triangles += m->mNumFaces;
+    }
+    return triangles;
+}
+
+static bool setup_imported_scene(BenchData & data)
+{
+    if (!setup_scene(data))
+        return false;
+    scene_from_ai(data.scene, data.importedScene);
+    return true;
+}
+
+// Static batching of the converted scene, the copy of its streams is included
+static int run_scene_batch(BenchData & data)
+{
+    data.sceneData = data.importedScene;
+    SceneBatchStats stats;
+    scene_batch(data.sceneData, 16, &stats);
+    data.sink += stats.meshes;
+    return stats.sourceMeshes;
+}
+
+// Repeated geometry search on the converted scene, the copy of its streams is included
+static int run_scene_instances(BenchData & data)
+{
+    data.sceneData = data.importedScene;
+    SceneInstanceStats stats;
+    scene_find_instances(data.sceneData, 16, &stats);
+    data.sink += stats.copies;
+    return (int) data.importedScene.meshes.size();
+}
+
+static bool setup_texture(BenchData & data)
+{
+    FILE * file = fopen(data.texturePath.c_str(), "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data.textureFile.resize(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(&data.textureFile[0], 1, size, file) == (size_t) size;
+    fclose(file);
+    return ok;
+}
+
+static int run_texture_decode(BenchData & data)
+{
+    int x, y, comp;
+    if (data.textureFile.empty())
+        return 0;
+    unsigned char * pixels = stbi_load_from_memory(&data.textureFile[0], (int) data.textureFile.size(), &x, &y, &comp, 3);
+    if (!pixels)
+        return 0;
+    data.sink += pixels[0];
+    stbi_image_free(pixels);
+    return x * y;
+}
+
+// Buffer heap sub-allocation, mesh sized regions in a 64 MB arena. Every
+// other region is freed then allocated again, so the free lists get mixed sizes
+static const int ALLOCATION_COUNT = 4096;
+
+static bool setup_tlsf(BenchData & data)
+{
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> log2Size(8, 16);
+    data.allocationSizes.resize(ALLOCATION_COUNT);
+    for (int i = 0; i < ALLOCATION_COUNT; ++i)
+        data.allocationSizes[i] = (size_t) 1 << log2Size(rng) | (rng() & 255);
+    data.blocks.resize(ALLOCATION_COUNT);
+    return true;
+}
+
+static int run_tlsf_alloc_free(BenchData & data)
+{
+    tlsf_init(data.tlsf, 64 << 20, 256);
+    for (int i = 0; i < ALLOCATION_COUNT; ++i)
+        data.blocks[i] = tlsf_alloc(data.tlsf, data.allocationSizes[i]);
+    for (int i = 0; i < ALLOCATION_COUNT; i += 2)
+        if (data.blocks[i] != -1)
+            tlsf_free(data.tlsf, data.blocks[i]);
+    for (int i = 0; i < ALLOCATION_COUNT; i += 2)
+        data.blocks[i] = tlsf_alloc(data.tlsf, data.allocationSizes[ALLOCATION_COUNT - 1 - i]);
+    data.sink += data.tlsf.used;
+    for (int i = 0; i < ALLOCATION_COUNT; ++i)
+        if (data.blocks[i] != -1)
+            tlsf_free(data.tlsf, data.blocks[i]);
+    return 3 * ALLOCATION_COUNT;
+}
+
+// Cost of a profiler zone while recording, skipped without AOGL_PROFILE
+static const int PROFILE_ZONE_COUNT = 10000;
+
+static bool setup_profiler(BenchData &)
+{
+#ifdef AOGL_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+static int run_profile_zone(BenchData & data)
+{
+#ifdef AOGL_PROFILE
+    // A capture per iteration keeps the thread buffer from filling up
+    profiler_capture_begin();
+#endif
+    for (int i = 0; i < PROFILE_ZONE_COUNT; ++i)
+    {
+        PROFILE_ZONE("bench zone");
+        data.sink += i;
+    }
+#ifdef AOGL_PROFILE
+    profiler_capture_end();
+#endif
+    return PROFILE_ZONE_COUNT;
+}
+
+static const BenchCase BENCH_CASES[] = {
+    { "matrix_chain", setup_transforms, run_matrix_chain },
+    { "matrix_chain_soa_scalar", setup_transforms, run_matrix_chain_soa_scalar },
+    { "matrix_chain_soa_sse", setup_transforms_sse, run_matrix_chain_soa_sse },
+    { "matrix_chain_soa_avx", setup_transforms_avx, run_matrix_chain_soa_avx },
+    { "light_transform", setup_transforms, run_light_transform },
+    { "scene_import", setup_scene_file, run_scene_import },
+    { "scene_import_obj", setup_obj_file, run_scene_import_obj },
+    { "scene_convert", setup_scene, run_scene_convert },
+    { "mesh_lod_build", setup_scene, run_mesh_lod_build },
+    { "scene_batch", setup_imported_scene, run_scene_batch },
+    { "scene_instances", setup_imported_scene, run_scene_instances },
+    { "texture_decode", setup_texture, run_texture_decode },
+    { "frustum_cull_linear", setup_spheres, run_cull_linear },
+    { "frustum_cull_bvh", setup_spheres, run_cull_bvh },
+    { "bvh_build", setup_spheres, run_bvh_build },
+    { "tlsf_alloc_free", setup_tlsf, run_tlsf_alloc_free },
+    { "profile_zone", setup_profiler, run_profile_zone },
+};
+static const int BENCH_CASE_COUNT = sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]);
+
+static double elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Time repetitions of enough iterations to last at least minTime each
+static BenchResult bench_run(const BenchCase & c, BenchData & data, int repetitions, double minTime)
+{
+    BenchResult r;
+    r.name = c.name;
+    r.iterations = 1;
+    r.items = 0;
+    for (;;)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < r.iterations; ++i)
+            r.items = c.run(data);
+        double time = elapsed_us(start);
+        if (time >= minTime || r.iterations >= (1 << 24))
+            break;
+        r.iterations *= time > 0.0 ? std::min(std::max((int) (minTime / time) + 1, 2), 16) : 16;
+    }
+    for (int k = 0; k < repetitions; ++k)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < r.iterations; ++i)
+            c.run(data);
+        r.samples.push_back(elapsed_us(start) / r.iterations);
+    }
+
+    std::vector<double> sorted = r.samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    r.min = sorted[0];
+    r.median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    r.p90 = sorted[std::min(n - 1, (size_t) std::ceil(0.9 * n) - 1)];
+    r.mean = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        r.mean += sorted[i];
+    r.mean /= n;
+    r.stddev = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        r.stddev += (sorted[i] - r.mean) * (sorted[i] - r.mean);
+    r.stddev = n > 1 ? sqrt(r.stddev / (n - 1)) : 0.0;
+    return r;
+}
+
+static bool write_bench_json(const char * path, const std::vector<BenchResult> & results, int repetitions)
+{
+    FILE * file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\n  \"repetitions\": %d,\n  \"cases\": [\n", repetitions);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult & r = results[i];
+        fprintf(file, "    {\n      \"name\": \"%s\",\n      \"iterations\": %d,\n      \"items\": %d,\n", r.name, r.iterations, r.items);
+        fprintf(file, "      \"min_us\": %.4f,\n      \"median_us\": %.4f,\n      \"mean_us\": %.4f,\n      \"stddev_us\": %.4f,\n      \"p90_us\": %.4f,\n", r.min, r.median, r.mean, r.stddev, r.p90);
+        fprintf(file, "      \"samples_us\": [");
+        for (size_t k = 0; k < r.samples.size(); ++k)
+            fprintf(file, k ? ", %.4f" : "%.4f", r.samples[k]);
+        fprintf(file, "]\n    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+// Comma separated substrings, a case runs when its name contains one of them
+static bool bench_filter_match(const char * filter, const char * name)
+{
+    if (!filter)
+        return true;
+    std::string list = filter;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string pattern = list.substr(start, end - start);
+        if (!pattern.empty() && strstr(name, pattern.c_str()))
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+int main( int argc, char **argv )
+{
+    const char * filter = NULL;
+    const char * output = NULL;
+    int repetitions = 10;
+    double minTime = 20000.0;
+    bool list = false;
+    BenchData data;
+    data.scenePath = "./scene_v4/scene_v4.obj";
+    data.texturePath = "textures/spnza_bricks_a_diff.bmp";
+    data.scene = NULL;
+    data.sink = 0.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+            filter = argv[++i];
+        else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc)
+            repetitions = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--min-time") && i + 1 < argc)
+            minTime = std::max(0.0, atof(argv[++i]) * 1000.0);
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if (!strcmp(argv[i], "--scene") && i + 1 < argc)
+            data.scenePath = argv[++i];
+        else if (!strcmp(argv[i], "--texture") && i + 1 < argc)
+            data.texturePath = argv[++i];
+        else if (!strcmp(argv[i], "--list"))
+            list = true;
+        else
+        {
+            fprintf(stderr, "Usage : %s [--filter <name,...>] [--repetitions <count>] [--min-time <ms>] [--output <file.json>] [--scene <file>] [--texture <file>] [--list]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (int i = 0; i < BENCH_CASE_COUNT; ++i)
+    {
+        const BenchCase & c = BENCH_CASES[i];
+        if (!bench_filter_match(filter, c.name))
+            continue;
+        if (list)
+        {
+            printf("%s\n", c.name);
+            continue;
+        }
+        if (!c.setup(data))
+        {
+            fprintf(stderr, "%-24s skipped, inputs not found\n", c.name);
+            continue;
+        }
+        BenchResult r = bench_run(c, data, repetitions, minTime);
+        printf("%-24s median %10.3f us  min %10.3f us  mean %10.3f us  stddev %8.3f us  p90 %10.3f us  %8.1f Mitems/s\n",
+               r.name, r.median, r.min, r.mean, r.stddev, r.p90, r.median > 0.0 ? r.items / r.median : 0.0);
+        results.push_back(r);
+    }
+    if (data.scene)
+        aiReleaseImport(data.scene);
+
+    if (output && !write_bench_json(output, results, repetitions))
+    {
+        fprintf(stderr, "Error: impossible to write %s\n", output);
+        return EXIT_FAILURE;
+    }
+    // Printed so the sink is observable
+    if (data.sink == 0.0)
+        printf("\n");
+    return EXIT_SUCCESS;
+}
@@ -4,6 +4,9 @@
 
 layout(location = POSITION) in vec2 Position;
 
+// Fraction of the render targets covered by the (scaled) viewport
+uniform vec2 ViewportScale = vec2(1.0);
+
 out block
 {
 	vec2 Texcoord;
@@ -11,6 +14,6 @@ out block
 
 void main()
 {	
-	Out.Texcoord = Position * 0.5 + 0.5;
+	Out.Texcoord = (Position * 0.5 + 0.5) * ViewportScale;
 	gl_Position = vec4(Position.xy, 0.0, 1.0);
 }
\ No newline at end of file
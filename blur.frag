@@ -8,6 +8,7 @@ in block
 uniform sampler2D Texture;
 uniform int SampleCount;
 uniform ivec2 Direction;
+uniform vec2 ViewportScale = vec2(1.0);
 
 layout(location = 0, index = 0) out vec4 Color;
 
@@ -15,9 +16,10 @@ void main(void)
 {
     float weight = 1.0 / (SampleCount * 2.0);
     vec3 color = vec3(0.0, 0.0, 0.0);
+    ivec2 maxCoord = ivec2(vec2(textureSize(Texture, 0)) * ViewportScale) - 1;
     for(int i=-SampleCount;i<=SampleCount;++i)
     {
-        ivec2 coord = ivec2(gl_FragCoord.xy) + i*Direction;
+        ivec2 coord = clamp(ivec2(gl_FragCoord.xy) + i*Direction, ivec2(0), maxCoord);
         color += texelFetch(Texture, coord, 0).xyz * weight;
     }
     Color = vec4(color, 1.0);
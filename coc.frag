@@ -8,13 +8,14 @@ in block
 uniform sampler2D Texture;
 uniform mat4 ScreenToView;
 uniform vec3 Focus;
+uniform vec2 ViewportScale = vec2(1.0);
 
 layout(location = 0, index = 0) out vec4 Color;
 
 void main(void)
 {
     float depth = texture(Texture, In.Texcoord).r;
-    vec2  xy = In.Texcoord * 2.0 -1.0;
+    vec2  xy = In.Texcoord / ViewportScale * 2.0 -1.0;
     vec4  wViewPos =  ScreenToView * vec4(xy, depth * 2.0 -1.0, 1.0);
     vec3  viewPos = vec3(wViewPos/wViewPos.w);
     float viewDepth = -viewPos.z;
@@ -0,0 +1,416 @@
+// Compares benchmark runs with robust statistics, for regression gates on
+// noisy machines. Reads the JSON of aogl --benchmark (frame and pass times),
+// or the bench layout of aogl_bench and aogl_replay (case samples).
+// A measure regresses when a Mann-Whitney U test tells the runs apart, the
+// median slows down by more than the threshold, and the bootstrap confidence
+// interval of that slowdown is above zero. Exits with 1 on any regression.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+struct JsonValue
+{
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+    Type type;
+    double number;
+    std::string string;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue> > members;
+    JsonValue() : type(JSON_NULL), number(0.0) {}
+};
+
+struct JsonReader
+{
+    const char * p;
+    const char * end;
+    bool failed;
+};
+
+static void json_skip_spaces(JsonReader & in)
+{
+    while (in.p < in.end && (*in.p == ' ' || *in.p == '\t' || *in.p == '\n' || *in.p == '\r'))
+        ++in.p;
+}
+
+static bool json_expect(JsonReader & in, char c)
+{
+    json_skip_spaces(in);
+    if (in.p < in.end && *in.p == c)
+    {
+        ++in.p;
+        return true;
+    }
+    in.failed = true;
+    return false;
+}
+
+// Escapes other than \" and \\ are kept as they are, names do not use them
+static std::string json_read_string(JsonReader & in)
+{
+    std::string s;
+    if (!json_expect(in, '"'))
+        return s;
+    while (in.p < in.end && *in.p != '"')
+    {
+        if (*in.p == '\\' && in.p + 1 < in.end)
+            ++in.p;
+        s += *in.p++;
+    }
+    if (in.p >= in.end)
+        in.failed = true;
+    else
+        ++in.p;
+    return s;
+}
+
+static bool json_literal(JsonReader & in, const char * literal)
+{
+    size_t length = strlen(literal);
+    if ((size_t) (in.end - in.p) < length || strncmp(in.p, literal, length))
+        return false;
+    in.p += length;
+    return true;
+}
+
+static void json_read_value(JsonReader & in, JsonValue & v, int depth)
+{
+    json_skip_spaces(in);
+    if (in.p >= in.end || depth > 32)
+    {
+        in.failed = true;
+        return;
+    }
+    char c = *in.p;
+    if (c == '{')
+    {
+        v.type = JsonValue::JSON_OBJECT;
+        ++in.p;
+        json_skip_spaces(in);
+        if (in.p < in.end && *in.p == '}')
+        {
+            ++in.p;
+            return;
+        }
+        while (!in.failed)
+        {
+            v.members.push_back(std::make_pair(json_read_string(in), JsonValue()));
+            json_expect(in, ':');
+            json_read_value(in, v.members.back().second, depth + 1);
+            json_skip_spaces(in);
+            if (in.p < in.end && *in.p == ',')
+                ++in.p;
+            else
+            {
+                json_expect(in, '}');
+                break;
+            }
+        }
+    }
+    else if (c == '[')
+    {
+        v.type = JsonValue::JSON_ARRAY;
+        ++in.p;
+        json_skip_spaces(in);
+        if (in.p < in.end && *in.p == ']')
+        {
+            ++in.p;
+            return;
+        }
+        while (!in.failed)
+        {
+            v.items.push_back(JsonValue());
+            json_read_value(in, v.items.back(), depth + 1);
+            json_skip_spaces(in);
+            if (in.p < in.end && *in.p == ',')
+                ++in.p;
+            else
+            {
+                json_expect(in, ']');
+                break;
+            }
+        }
+    }
+    else if (c == '"')
+    {
+        v.type = JsonValue::JSON_STRING;
+        v.string = json_read_string(in);
+    }
+    else if (json_literal(in, "true") || json_literal(in, "false"))
+    {
+        v.type = JsonValue::JSON_BOOL;
+        v.number = c == 't' ? 1.0 : 0.0;
+    }
+    else if (json_literal(in, "null"))
+        return;
+    else
+    {
+        char * numberEnd = NULL;
+        v.type = JsonValue::JSON_NUMBER;
+        v.number = strtod(in.p, &numberEnd);
+        if (numberEnd == in.p)
+            in.failed = true;
+        in.p = numberEnd;
+    }
+}
+
+static const JsonValue * json_member(const JsonValue & v, const char * name)
+{
+    for (size_t i = 0; i < v.members.size(); ++i)
+        if (v.members[i].first == name)
+            return &v.members[i].second;
+    return NULL;
+}
+
+// Samples of one measure, in milliseconds
+struct Measure
+{
+    std::string name;
+    std::vector<double> samples;
+};
+
+// Returns the number of samples added
+static size_t add_samples(std::vector<Measure> & measures, const std::string & name, const JsonValue * array, double scale)
+{
+    if (!array || array->type != JsonValue::JSON_ARRAY)
+        return 0;
+    Measure * m = NULL;
+    for (size_t i = 0; i < measures.size() && !m; ++i)
+        if (measures[i].name == name)
+            m = &measures[i];
+    if (!m)
+    {
+        measures.push_back(Measure());
+        m = &measures.back();
+        m->name = name;
+    }
+    size_t before = m->samples.size();
+    for (size_t i = 0; i < array->items.size(); ++i)
+        if (array->items[i].type == JsonValue::JSON_NUMBER)
+            m->samples.push_back(array->items[i].number * scale);
+    return m->samples.size() - before;
+}
+
+// Runs of the same kind given together are pooled, measure by measure
+static bool read_run(const char * path, std::vector<Measure> & measures)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening %s\n", path);
+        return false;
+    }
+    std::string text;
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        text.append(chunk, n);
+    fclose(file);
+
+    JsonValue root;
+    JsonReader in = { text.c_str(), text.c_str() + text.size(), false };
+    json_read_value(in, root, 0);
+    if (in.failed || root.type != JsonValue::JSON_OBJECT)
+    {
+        fprintf(stderr, "Error : %s is not valid JSON\n", path);
+        return false;
+    }
+    size_t samples = 0;
+    samples += add_samples(measures, "cpu frame", json_member(root, "cpu_frame_ms"), 1.0);
+    samples += add_samples(measures, "gpu frame", json_member(root, "gpu_frame_ms"), 1.0);
+    const JsonValue * passes = json_member(root, "passes");
+    if (passes)
+        for (size_t i = 0; i < passes->members.size(); ++i)
+            samples += add_samples(measures, passes->members[i].first, &passes->members[i].second, 1.0);
+    const JsonValue * cases = json_member(root, "cases");
+    if (cases)
+        for (size_t i = 0; i < cases->items.size(); ++i)
+        {
+            const JsonValue * name = json_member(cases->items[i], "name");
+            if (name && name->type == JsonValue::JSON_STRING)
+                samples += add_samples(measures, name->string, json_member(cases->items[i], "samples_us"), 1e-3);
+        }
+    if (samples == 0)
+    {
+        fprintf(stderr, "Error : no timings in %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static double median(std::vector<double> v)
+{
+    size_t n = v.size();
+    std::nth_element(v.begin(), v.begin() + n / 2, v.end());
+    double upper = v[n / 2];
+    if (n % 2)
+        return upper;
+    return 0.5 * (upper + *std::max_element(v.begin(), v.begin() + n / 2));
+}
+
+// Two sided p value of the Mann-Whitney U test, normal approximation with
+// the tie correction, good from about 8 samples per side
+static double mann_whitney_p(const std::vector<double> & a, const std::vector<double> & b)
+{
+    std::vector<std::pair<double, int> > all;
+    for (size_t i = 0; i < a.size(); ++i)
+        all.push_back(std::make_pair(a[i], 0));
+    for (size_t i = 0; i < b.size(); ++i)
+        all.push_back(std::make_pair(b[i], 1));
+    std::sort(all.begin(), all.end());
+    double n1 = (double) a.size(), n2 = (double) b.size(), n = n1 + n2;
+    double rankSumA = 0.0, ties = 0.0;
+    for (size_t i = 0; i < all.size();)
+    {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first)
+            ++j;
+        double rank = 0.5 * (i + 1 + j);
+        double t = (double) (j - i);
+        ties += t * t * t - t;
+        for (size_t k = i; k < j; ++k)
+            if (all[k].second == 0)
+                rankSumA += rank;
+        i = j;
+    }
+    double u = rankSumA - n1 * (n1 + 1.0) * 0.5;
+    double mean = n1 * n2 * 0.5;
+    double variance = n1 * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+    if (variance <= 0.0)
+        return 1.0;
+    double z = (fabs(u - mean) - 0.5) / sqrt(variance);
+    return std::min(1.0, erfc(std::max(z, 0.0) / sqrt(2.0)));
+}
+
+// Percentile bootstrap of the relative change of the median, fixed seed so
+// the gate gives the same answer on the same files
+static void bootstrap_median_change(const std::vector<double> & a, const std::vector<double> & b, int resamples, double confidence, double & low, double & high)
+{
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<size_t> pickA(0, a.size() - 1), pickB(0, b.size() - 1);
+    std::vector<double> changes, ra(a.size()), rb(b.size());
+    changes.reserve(resamples);
+    for (int r = 0; r < resamples; ++r)
+    {
+        for (size_t i = 0; i < ra.size(); ++i)
+            ra[i] = a[pickA(rng)];
+        for (size_t i = 0; i < rb.size(); ++i)
+            rb[i] = b[pickB(rng)];
+        double ma = median(ra);
+        if (ma > 0.0)
+            changes.push_back(median(rb) / ma - 1.0);
+    }
+    if (changes.empty())
+    {
+        low = high = 0.0;
+        return;
+    }
+    std::sort(changes.begin(), changes.end());
+    double tail = 0.5 * (1.0 - confidence);
+    low = changes[(size_t) (tail * (changes.size() - 1))];
+    high = changes[(size_t) ((1.0 - tail) * (changes.size() - 1))];
+}
+
+int main( int argc, char **argv )
+{
+    double threshold = 5.0;
+    double alpha = 0.01;
+    double minMs = 0.05;
+    int resamples = 2000;
+    std::vector<const char *> baselinePaths, candidatePaths;
+    bool candidates = false;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; ++i)
+    {
+        if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--alpha") && i + 1 < argc)
+            alpha = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--min-ms") && i + 1 < argc)
+            minMs = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--resamples") && i + 1 < argc)
+            resamples = std::max(100, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--"))
+            candidates = true;
+        else if (argv[i][0] != '-')
+            (candidates ? candidatePaths : baselinePaths).push_back(argv[i]);
+        else
+            usage = true;
+    }
+    // Without --, the last file is the candidate
+    if (!candidates && baselinePaths.size() >= 2)
+    {
+        candidatePaths.push_back(baselinePaths.back());
+        baselinePaths.pop_back();
+    }
+    if (usage || baselinePaths.empty() || candidatePaths.empty())
+    {
+        fprintf(stderr, "Usage : %s [--threshold <percent>] [--alpha <p>] [--min-ms <ms>] [--resamples <count>] <baseline.json> [<baseline.json> ...] [--] <candidate.json> [...]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Measure> baseline, candidate;
+    for (size_t i = 0; i < baselinePaths.size(); ++i)
+        if (!read_run(baselinePaths[i], baseline))
+            return 2;
+    for (size_t i = 0; i < candidatePaths.size(); ++i)
+        if (!read_run(candidatePaths[i], candidate))
+            return 2;
+
+    printf("Baseline %d run(s), candidate %d run(s), regression past %+.1f%% at p < %g\n\n", (int) baselinePaths.size(), (int) candidatePaths.size(), threshold, alpha);
+    printf("%-16s %6s %6s %11s %11s %9s %21s %9s  %s\n", "measure", "n base", "n cand", "base ms", "cand ms", "change", "95% CI", "p", "verdict");
+    int regressions = 0;
+    for (size_t i = 0; i < baseline.size(); ++i)
+    {
+        const Measure & a = baseline[i];
+        const Measure * b = NULL;
+        for (size_t j = 0; j < candidate.size() && !b; ++j)
+            if (candidate[j].name == a.name)
+                b = &candidate[j];
+        if (!b || a.samples.size() < 2 || b->samples.size() < 2)
+        {
+            printf("%-16s %6d %6d %11s %11s %9s %21s %9s  %s\n", a.name.c_str(), (int) a.samples.size(), b ? (int) b->samples.size() : 0, "", "", "", "", "", "missing");
+            continue;
+        }
+        double ma = median(a.samples), mb = median(b->samples);
+        // Passes turned off in both runs
+        if (ma <= 0.0 && mb <= 0.0)
+        {
+            printf("%-16s %6d %6d %11.4f %11.4f %9s %21s %9s  %s\n", a.name.c_str(), (int) a.samples.size(), (int) b->samples.size(), ma, mb, "", "", "", "idle");
+            continue;
+        }
+        double change = ma > 0.0 ? mb / ma - 1.0 : 1.0;
+        double p = mann_whitney_p(a.samples, b->samples);
+        double low, high;
+        bootstrap_median_change(a.samples, b->samples, resamples, 0.95, low, high);
+        bool significant = p < alpha && fabs(mb - ma) >= minMs;
+        const char * verdict = "same";
+        if (significant && change * 100.0 > threshold && low > 0.0)
+        {
+            verdict = "REGRESSION";
+            ++regressions;
+        }
+        else if (significant && change * 100.0 < -threshold && high < 0.0)
+            verdict = "faster";
+        else if (significant)
+            verdict = change > 0.0 ? "slower, within threshold" : "faster, within threshold";
+        char ci[32];
+        snprintf(ci, sizeof(ci), "[%+.1f%%, %+.1f%%]", low * 100.0, high * 100.0);
+        printf("%-16s %6d %6d %11.4f %11.4f %+8.1f%% %21s %9.2g  %s\n", a.name.c_str(), (int) a.samples.size(), (int) b->samples.size(), ma, mb, change * 100.0, ci, p, verdict);
+    }
+    for (size_t j = 0; j < candidate.size(); ++j)
+    {
+        bool known = false;
+        for (size_t i = 0; i < baseline.size() && !known; ++i)
+            known = baseline[i].name == candidate[j].name;
+        if (!known)
+            printf("%-16s %6d %6d %11s %11s %9s %21s %9s  %s\n", candidate[j].name.c_str(), 0, (int) candidate[j].samples.size(), "", "", "", "", "", "new");
+    }
+    printf("\n%d regression(s)\n", regressions);
+    return regressions ? 1 : 0;
+}
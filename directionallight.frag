@@ -1,5 +1,7 @@
 #version 410 core
 
+#define CASCADE_COUNT 4
+
 in block
 {
 	vec2 Texcoord;
@@ -8,10 +10,26 @@ in block
 uniform sampler2D ColorBuffer;
 uniform sampler2D NormalBuffer;
 uniform sampler2D DepthBuffer;
+// Multisampled G-buffer, read on edge pixels to light each sample when
+// Samples is not zero
+uniform sampler2DMS ColorSamples;
+uniform sampler2DMS NormalSamples;
+uniform sampler2DMS DepthSamples;
+uniform int Samples = 0;
+// Cached static casters and per frame dynamic casters, one layer per cascade
+uniform sampler2DArrayShadow ShadowMap;
+uniform sampler2DArrayShadow DynamicShadowMap;
 
 layout(location = 0, index = 0) out vec4 Color;
 
 uniform mat4 InverseProjection;
+uniform vec2 ViewportScale = vec2(1.0);
+uniform bool Shadows = false;
+uniform bool DynamicShadows = false;
+// View space to shadow clip space of each cascade and their far distance
+uniform mat4 ViewToShadow[CASCADE_COUNT];
+uniform float CascadeSplits[CASCADE_COUNT];
+uniform float ShadowBias = 0.001;
 
 uniform light
 {
@@ -29,21 +47,47 @@ vec3 directionalLight(in vec3 n, in vec3 v, in vec3 diffuseColor, in vec3 specul
 	return DirectionalLight.Color * DirectionalLight.Intensity * (diffuseColor * ndotl + specularColor * pow(ndoth, specularPower));;
 }
 
-void main(void)
+float directionalShadow(in vec3 p, in vec3 n)
 {
-	vec4 colorBuffer = texture(ColorBuffer, In.Texcoord).rgba;
-	vec4 normalBuffer = texture(NormalBuffer, In.Texcoord).rgba;
-	float depth = texture(DepthBuffer, In.Texcoord).r;
+	if (!Shadows || -p.z > CascadeSplits[CASCADE_COUNT-1])
+		return 1.0;
+	int cascade = 0;
+	while (cascade < CASCADE_COUNT-1 && -p.z > CascadeSplits[cascade])
+		++cascade;
+	// Offset along the normal, cascades further away have bigger texels
+	vec4 s = ViewToShadow[cascade] * vec4(p + n * 0.02 * (cascade + 1), 1.0);
+	s.xyz = s.xyz / s.w * 0.5 + 0.5;
+	vec4 coord = vec4(s.xy, cascade, s.z - ShadowBias);
+	float shadow = texture(ShadowMap, coord);
+	if (DynamicShadows)
+		shadow = min(shadow, texture(DynamicShadowMap, coord));
+	return shadow;
+}
 
+vec3 shade(in vec4 colorBuffer, in vec4 normalBuffer, in float depth)
+{
 	vec3 n = normalBuffer.rgb;
 	vec3 diffuseColor = colorBuffer.rgb;
 	vec3 specularColor = colorBuffer.aaa;
 	float specularPower = normalBuffer.a;
 
-	vec2 xy = In.Texcoord * 2.0 -1.0;
+	vec2 xy = In.Texcoord / ViewportScale * 2.0 -1.0;
 	vec4 wP = InverseProjection * vec4(xy, depth * 2.0 -1.0, 1.0);
 	vec3 p = vec3(wP.xyz / wP.w);
 	vec3 v = normalize(-p);
-	Color = vec4(directionalLight(n, v, diffuseColor, specularColor, specularPower), 1.0);
-	//Color = vec4(1.0, 1.0, 1.0, 1.0);
+	return directionalShadow(p, n) * directionalLight(n, v, diffuseColor, specularColor, specularPower);
+}
+
+void main(void)
+{
+	if (Samples == 0)
+	{
+		Color = vec4(shade(texture(ColorBuffer, In.Texcoord), texture(NormalBuffer, In.Texcoord), texture(DepthBuffer, In.Texcoord).r), 1.0);
+		return;
+	}
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	vec3 color = vec3(0.0);
+	for (int s = 0; s < Samples; ++s)
+		color += shade(texelFetch(ColorSamples, coord, s), texelFetch(NormalSamples, coord, s), texelFetch(DepthSamples, coord, s).r);
+	Color = vec4(color / Samples, 1.0);
 }
\ No newline at end of file
@@ -6,6 +6,7 @@ in block
 } In; 
 
 uniform sampler2D Texture;
+uniform vec2 ViewportScale = vec2(1.0);
 uniform float Factor = 1.0;
 
 uniform mat3 G[9] = mat3[](
@@ -30,9 +31,10 @@ void main(void)
 	vec3 s;
 	
 	/* fetch the 3x3 neighbourhood and use the RGB vector's length as intensity value */
+	ivec2 maxCoord = ivec2(vec2(textureSize(Texture, 0)) * ViewportScale) - 1;
 	for (int i=0; i<3; i++)
 	for (int j=0; j<3; j++) {
-		s = texelFetch( Texture, ivec2(gl_FragCoord) + ivec2(i-1,j-1), 0 ).rgb;
+		s = texelFetch( Texture, clamp(ivec2(gl_FragCoord) + ivec2(i-1,j-1), ivec2(0), maxCoord), 0 ).rgb;
 		I[i][j] = length(s); 
 	}
 	
@@ -44,5 +46,6 @@ void main(void)
 
     float M = (cnv[4] + cnv[5]) + (cnv[6] + cnv[7]); // Line detector
     float S = (cnv[0] + cnv[1]) + (cnv[2] + cnv[3]) + M + cnv[8]; 
-	Color = vec4(texelFetch( Texture, ivec2(gl_FragCoord), 0 ).rgb - Factor * vec3(sqrt(M/S)), 1.0);
+	// The target is an unsigned float format
+	Color = vec4(max(texelFetch( Texture, ivec2(gl_FragCoord), 0 ).rgb - Factor * vec3(sqrt(M/S)), 0.0), 1.0);
 }
\ No newline at end of file
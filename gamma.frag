@@ -7,11 +7,53 @@ in block
 
 uniform sampler2D Texture;
 uniform float Gamma = 1.0;
+// HDR input scaled by Exposure then mapped to [0, 1],
+// 0 clamps, 1 is Reinhard on luminance, 2 is the ACES filmic fit
+uniform float Exposure = 1.0;
+uniform int Tonemap = 2;
+// Robust contrast adaptive sharpening (RCAS-like) after upscaling,
+// 0 is the strongest sharpening, each unit halves it
+uniform bool Sharpen = false;
+uniform float Sharpness = 0.2;
 
 layout(location = 0, index = 0) out vec4  Color;
 
+vec3 tonemap(vec3 c)
+{
+	c *= Exposure;
+	if (Tonemap == 1)
+	{
+		float l = dot(c, vec3(0.2126, 0.7152, 0.0722));
+		return clamp(c / (1.0 + l), 0.0, 1.0);
+	}
+	if (Tonemap == 2)
+		return clamp((c * (2.51 * c + 0.03)) / (c * (2.43 * c + 0.59) + 0.14), 0.0, 1.0);
+	return clamp(c, 0.0, 1.0);
+}
+
+// Works on tonemapped values, the lobe limits assume a [0, 1] range
+vec3 sharpen(vec3 e)
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	ivec2 maxCoord = textureSize(Texture, 0) - 1;
+	vec3 b = tonemap(texelFetch(Texture, clamp(coord + ivec2(0, -1), ivec2(0), maxCoord), 0).rgb);
+	vec3 d = tonemap(texelFetch(Texture, clamp(coord + ivec2(-1, 0), ivec2(0), maxCoord), 0).rgb);
+	vec3 f = tonemap(texelFetch(Texture, clamp(coord + ivec2(1, 0), ivec2(0), maxCoord), 0).rgb);
+	vec3 h = tonemap(texelFetch(Texture, clamp(coord + ivec2(0, 1), ivec2(0), maxCoord), 0).rgb);
+	vec3 mn4 = min(min(b, d), min(f, h));
+	vec3 mx4 = max(max(b, d), max(f, h));
+	// Largest negative lobe that keeps the result within [0, 1]
+	vec3 hitMin = mn4 / (4.0 * mx4 + 1e-5);
+	vec3 hitMax = (1.0 - mx4) / (4.0 * mn4 - 4.0 - 1e-5);
+	vec3 lobeRGB = max(-hitMin, hitMax);
+	float lobe = max(-0.1875, min(max(lobeRGB.r, max(lobeRGB.g, lobeRGB.b)), 0.0)) * exp2(-Sharpness);
+	return (lobe * (b + d + f + h) + e) / (4.0 * lobe + 1.0);
+}
+
 void main(void)
 {
-	vec3 color = texture(Texture, In.Texcoord).rgb;
+	vec3 color = tonemap(texture(Texture, In.Texcoord).rgb);
+	if (Sharpen)
+		color = sharpen(color);
 	Color = vec4(pow(color, vec3(1.0/Gamma)), 1.0);
-}
\ No newline at end of file
+}
@@ -4,6 +4,7 @@
 #define NORMAL		1
 #define TEXCOORD	2
 #define COLOR	    0
+#define VELOCITY	2
 
 const float PI = 3.14159265359;
 const float TWOPI = 6.28318530718;
@@ -16,15 +17,20 @@ uniform float Time;
 uniform sampler2D Diffuse;
 uniform sampler2D Specular;
 uniform float SpecularPower;
+// Sub-pixel offset of the projection, excluded from the velocity
+uniform vec2 Jitter;
 
 layout(location = COLOR ) out vec4 Color;
 layout(location = NORMAL) out vec4 Normal;
+layout(location = VELOCITY) out vec2 Velocity;
 
 in block
 {
 	vec2 Texcoord;
 	vec3 CameraSpacePosition;
 	vec3 CameraSpaceNormal;
+	vec4 Position;
+	vec4 PreviousPosition;
 } In; 
 
 void main()
@@ -42,4 +48,5 @@ void main()
 	float specularColor = texture(Specular, In.Texcoord).r;
 	Color = vec4(diffuseColor, specularColor);
 	Normal = vec4(n, SpecularPower);
+	Velocity = (In.Position.xy / In.Position.w - Jitter - In.PreviousPosition.xy / In.PreviousPosition.w) * 0.5;
 }
@@ -0,0 +1,49 @@
+#version 410 core
+
+#define MODE_LIGHT_COUNT 1
+#define MODE_OVERDRAW 2
+#define MODE_TILE_COST 3
+
+in block
+{
+	vec2 Texcoord;
+} In; 
+
+uniform sampler2D LightCount;
+uniform sampler2D Overdraw;
+uniform sampler2D Tiles;
+uniform int Mode;
+uniform float MaxValue = 16.0;
+uniform int TileSize = 16;
+uniform ivec2 RenderSize;
+uniform vec2 ViewportScale = vec2(1.0);
+
+layout(location = 0, index = 0) out vec4 Color;
+
+// Black, blue, cyan, green, yellow, red, white above the range
+vec3 ramp(float t)
+{
+	const vec3 stops[6] = vec3[6](vec3(0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 1.0),
+	                              vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0));
+	if (t > 1.0)
+		return vec3(1.0);
+	float s = clamp(t, 0.0, 1.0) * 5.0;
+	int i = min(int(s), 4);
+	return mix(stops[i], stops[i+1], s - float(i));
+}
+
+void main(void)
+{
+	ivec2 pixel = min(ivec2(In.Texcoord / ViewportScale * vec2(RenderSize)), RenderSize - 1);
+	float value = 0.0;
+	if (Mode == MODE_LIGHT_COUNT)
+		value = texelFetch(LightCount, pixel, 0).r;
+	else if (Mode == MODE_OVERDRAW)
+		value = texelFetch(Overdraw, pixel, 0).r;
+	else if (Mode == MODE_TILE_COST)
+	{
+		vec2 tile = texelFetch(Tiles, pixel / TileSize, 0).rg;
+		value = tile.r + tile.g;
+	}
+	Color = vec4(ramp(value / MaxValue), 1.0);
+}
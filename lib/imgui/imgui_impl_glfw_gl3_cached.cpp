@@ -0,0 +1,479 @@
+// ImGui OpenGL3 renderer variant for hosts that track their own GL state
+// See imgui_impl_glfw_gl3_cached.h. Inputs and the font texture still come from imgui_impl_glfw_gl3.cpp.
+
+#include "imgui.h"
+#include "imgui_impl_glfw_gl3_cached.h"
+
+#include <string.h>
+#include <stdint.h>
+
+// GL3W/GLFW
+#include "glew/glew.h"
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/gl.h>
+#endif
+
+// Frames in flight: a ring segment is only rewritten once its fence has been reached
+#define RING_SEGMENTS 3
+#define RING_INITIAL_SEGMENT_SIZE (256 * 1024)
+
+// Data
+static ImGui_ImplGlfwGL3Cached_HostState g_HostState = { 0, false, false, false };
+static ImGui_ImplGlfwGL3Cached_Stats     g_Stats = { false, false, 0, 0, 0, 0, 0, 0, 0 };
+static GLuint       g_ShaderHandle = 0, g_VertHandle = 0, g_FragHandle = 0;
+static GLint        g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;
+static GLint        g_AttribLocationPosition = 0, g_AttribLocationUV = 0, g_AttribLocationColor = 0;
+static GLuint       g_CompositeShaderHandle = 0, g_CompositeVertHandle = 0, g_CompositeFragHandle = 0;
+static GLint        g_CompositeLocationTex = 0;
+static GLuint       g_VaoHandle = 0;
+static bool         g_Persistent = false;
+static GLuint       g_RingHandle = 0;
+static char*        g_RingPointer = NULL;
+static size_t       g_RingSegmentSize = 0;
+static GLsync       g_RingFences[RING_SEGMENTS] = {};
+static int          g_RingSegment = 0;
+static bool         g_OverlayCaching = true;
+static GLuint       g_OverlayTexture = 0, g_OverlayFbo = 0;
+static int          g_OverlayWidth = 0, g_OverlayHeight = 0;
+static bool         g_OverlayValid = false;
+static ImVec4       g_OverlayRect;          // union of the clip rectangles drawn into the overlay
+// Hash of every command list of the last frame, and of the lists held by the overlay
+static ImVector<uint64_t> g_ListHashes, g_PreviousListHashes, g_OverlayListHashes;
+
+static void ImGui_ImplGlfwGL3Cached_WaitFence(int segment)
+{
+    if (!g_RingFences[segment])
+        return;
+    // Flush on the first wait only, the fence is normally reached long before
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(g_RingFences[segment], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+        flags = 0;
+    glDeleteSync(g_RingFences[segment]);
+    g_RingFences[segment] = 0;
+}
+
+static void ImGui_ImplGlfwGL3Cached_DestroyRing()
+{
+    for (int i = 0; i < RING_SEGMENTS; ++i)
+        ImGui_ImplGlfwGL3Cached_WaitFence(i);
+    if (g_RingHandle)
+    {
+        if (g_Persistent)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, g_RingHandle);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        glDeleteBuffers(1, &g_RingHandle);
+    }
+    g_RingHandle = 0;
+    g_RingPointer = NULL;
+    g_RingSegmentSize = 0;
+}
+
+static void ImGui_ImplGlfwGL3Cached_CreateRing(size_t segment_size)
+{
+    g_RingSegmentSize = segment_size;
+    GLsizeiptr size = (GLsizeiptr)(segment_size * RING_SEGMENTS);
+    glGenBuffers(1, &g_RingHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, g_RingHandle);
+    if (g_Persistent)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        g_RingPointer = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+    g_Stats.persistentMapping = g_Persistent;
+    g_Stats.ringBytes = (int)size;
+}
+
+static void ImGui_ImplGlfwGL3Cached_CreateOverlay(int width, int height)
+{
+    if (!g_OverlayTexture)
+    {
+        glGenTextures(1, &g_OverlayTexture);
+        glGenFramebuffers(1, &g_OverlayFbo);
+    }
+    glBindTexture(GL_TEXTURE_2D, g_OverlayTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_OverlayFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_OverlayTexture, 0);
+    g_OverlayWidth = width;
+    g_OverlayHeight = height;
+    g_OverlayValid = false;
+}
+
+// FNV-1a over everything that ends up on screen
+static uint64_t ImGui_ImplGlfwGL3Cached_Hash(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return hash;
+}
+
+static uint64_t ImGui_ImplGlfwGL3Cached_HashDrawList(const ImDrawList* cmd_list)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    hash = ImGui_ImplGlfwGL3Cached_Hash(hash, &cmd_list->VtxBuffer.front(), cmd_list->VtxBuffer.size() * sizeof(ImDrawVert));
+    hash = ImGui_ImplGlfwGL3Cached_Hash(hash, &cmd_list->IdxBuffer.front(), cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx));
+    for (const ImDrawCmd* pcmd = cmd_list->CmdBuffer.begin(); pcmd != cmd_list->CmdBuffer.end(); pcmd++)
+    {
+        hash = ImGui_ImplGlfwGL3Cached_Hash(hash, &pcmd->ElemCount, sizeof(pcmd->ElemCount));
+        hash = ImGui_ImplGlfwGL3Cached_Hash(hash, &pcmd->ClipRect, sizeof(pcmd->ClipRect));
+        hash = ImGui_ImplGlfwGL3Cached_Hash(hash, &pcmd->TextureId, sizeof(pcmd->TextureId));
+    }
+    return hash;
+}
+
+// Copy the command lists [first_list, last_list) into the next ring segment and draw them, one upload per call
+static void ImGui_ImplGlfwGL3Cached_DrawLists(ImDrawData* draw_data, int first_list, int last_list, int fb_width, int fb_height)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    size_t vtx_count = 0, idx_count = 0;
+    for (int n = first_list; n < last_list; n++)
+    {
+        vtx_count += draw_data->CmdLists[n]->VtxBuffer.size();
+        idx_count += draw_data->CmdLists[n]->IdxBuffer.size();
+    }
+    if (idx_count == 0)
+        return;
+    const size_t vtx_bytes = vtx_count * sizeof(ImDrawVert);
+    const size_t idx_offset = (vtx_bytes + 15) & ~(size_t)15;
+    const size_t total_bytes = idx_offset + idx_count * sizeof(ImDrawIdx);
+
+    if (total_bytes > g_RingSegmentSize)
+    {
+        size_t segment_size = g_RingSegmentSize ? g_RingSegmentSize : RING_INITIAL_SEGMENT_SIZE;
+        while (segment_size < total_bytes)
+            segment_size *= 2;
+        ImGui_ImplGlfwGL3Cached_DestroyRing();
+        ImGui_ImplGlfwGL3Cached_CreateRing(segment_size);
+    }
+
+    const int segment = g_RingSegment;
+    g_RingSegment = (g_RingSegment + 1) % RING_SEGMENTS;
+    const size_t base = (size_t)segment * g_RingSegmentSize;
+    ImGui_ImplGlfwGL3Cached_WaitFence(segment);
+
+    glBindVertexArray(g_VaoHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, g_RingHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_RingHandle);
+    char* dst = g_Persistent
+        ? g_RingPointer + base
+        : (char*)glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)base, (GLsizeiptr)total_bytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    char* vtx_dst = dst;
+    char* idx_dst = dst + idx_offset;
+    for (int n = first_list; n < last_list; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        const size_t vtx_size = cmd_list->VtxBuffer.size() * sizeof(ImDrawVert);
+        const size_t idx_size = cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx);
+        memcpy(vtx_dst, &cmd_list->VtxBuffer.front(), vtx_size);
+        memcpy(idx_dst, &cmd_list->IdxBuffer.front(), idx_size);
+        vtx_dst += vtx_size;
+        idx_dst += idx_size;
+    }
+    if (!g_Persistent)
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    g_Stats.uploadBytes += (int)total_bytes;
+
+#define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
+    glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(base + OFFSETOF(ImDrawVert, pos)));
+    glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(base + OFFSETOF(ImDrawVert, uv)));
+    glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)(base + OFFSETOF(ImDrawVert, col)));
+#undef OFFSETOF
+
+    const float ortho_projection[4][4] =
+    {
+        { 2.0f/io.DisplaySize.x, 0.0f,                   0.0f, 0.0f },
+        { 0.0f,                  2.0f/-io.DisplaySize.y, 0.0f, 0.0f },
+        { 0.0f,                  0.0f,                  -1.0f, 0.0f },
+        {-1.0f,                  1.0f,                   0.0f, 1.0f },
+    };
+    glViewport(0, 0, (GLsizei)fb_width, (GLsizei)fb_height);
+    glUseProgram(g_ShaderHandle);
+    glUniform1i(g_AttribLocationTex, 0);
+    glUniformMatrix4fv(g_AttribLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    // Alpha accumulates too so the overlay texture ends up premultiplied
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_SCISSOR_TEST);
+
+    int draw_calls = 0;
+    GLint vtx_base = 0;
+    size_t idx_base = base + idx_offset;
+    for (int n = first_list; n < last_list; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        for (const ImDrawCmd* pcmd = cmd_list->CmdBuffer.begin(); pcmd != cmd_list->CmdBuffer.end(); pcmd++)
+        {
+            if (pcmd->UserCallback)
+            {
+                pcmd->UserCallback(cmd_list, pcmd);
+            }
+            else
+            {
+                glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
+                glScissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
+                glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (GLvoid*)idx_base, vtx_base);
+                ++draw_calls;
+            }
+            idx_base += pcmd->ElemCount * sizeof(ImDrawIdx);
+        }
+        vtx_base += cmd_list->VtxBuffer.size();
+    }
+    g_RingFences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glDisable(GL_SCISSOR_TEST);
+    g_Stats.drawCalls += draw_calls;
+}
+
+void ImGui_ImplGlfwGL3Cached_RenderDrawLists(ImDrawData* draw_data)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    int fb_width = (int)(io.DisplaySize.x * io.DisplayFramebufferScale.x);
+    int fb_height = (int)(io.DisplaySize.y * io.DisplayFramebufferScale.y);
+    if (fb_width <= 0 || fb_height <= 0)
+        return;
+    draw_data->ScaleClipRects(io.DisplayFramebufferScale);
+
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    g_Stats.uploadBytes = 0;
+    g_Stats.drawCalls = 0;
+    g_Stats.overlayRendered = true;
+    g_Stats.overlayLists = 0;
+    g_Stats.directLists = draw_data->CmdListsCount;
+
+    // User callbacks may draw anything, only plain draw data is cached
+    bool cacheable = g_OverlayCaching;
+    for (int n = 0; n < draw_data->CmdListsCount && cacheable; n++)
+        for (const ImDrawCmd* pcmd = draw_data->CmdLists[n]->CmdBuffer.begin(); pcmd != draw_data->CmdLists[n]->CmdBuffer.end(); pcmd++)
+            if (pcmd->UserCallback)
+                cacheable = false;
+
+    if (!cacheable)
+    {
+        g_OverlayValid = false;
+        g_PreviousListHashes.resize(0);
+        ImGui_ImplGlfwGL3Cached_DrawLists(draw_data, 0, draw_data->CmdListsCount, fb_width, fb_height);
+    }
+    else
+    {
+        if (fb_width != g_OverlayWidth || fb_height != g_OverlayHeight)
+            ImGui_ImplGlfwGL3Cached_CreateOverlay(fb_width, fb_height);
+
+        // Lists come back to front: the overlay holds the run of lists at the back which did not change since the
+        // last frame, a window whose text changes every frame is drawn directly along with the windows above it
+        g_ListHashes.resize(draw_data->CmdListsCount);
+        int static_lists = 0;
+        for (int n = 0; n < draw_data->CmdListsCount; n++)
+        {
+            g_ListHashes[n] = ImGui_ImplGlfwGL3Cached_HashDrawList(draw_data->CmdLists[n]);
+            if (static_lists == n && n < g_PreviousListHashes.Size && g_ListHashes[n] == g_PreviousListHashes[n])
+                static_lists = n + 1;
+        }
+        g_PreviousListHashes.swap(g_ListHashes);
+
+        bool hit = g_OverlayValid && g_OverlayListHashes.Size == static_lists;
+        for (int n = 0; n < g_OverlayListHashes.Size && hit; n++)
+            hit = g_OverlayListHashes[n] == g_PreviousListHashes[n];
+        ++g_Stats.overlayFrames;
+        if (hit)
+        {
+            g_Stats.overlayRendered = false;
+            ++g_Stats.overlayHits;
+        }
+        else if (static_lists > 0)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, g_OverlayFbo);
+            glViewport(0, 0, fb_width, fb_height);
+            glClearColor(0.f, 0.f, 0.f, 0.f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            ImGui_ImplGlfwGL3Cached_DrawLists(draw_data, 0, static_lists, fb_width, fb_height);
+            g_OverlayRect = ImVec4((float)fb_width, (float)fb_height, 0.f, 0.f);
+            for (int n = 0; n < static_lists; n++)
+                for (const ImDrawCmd* pcmd = draw_data->CmdLists[n]->CmdBuffer.begin(); pcmd != draw_data->CmdLists[n]->CmdBuffer.end(); pcmd++)
+                {
+                    if (pcmd->ClipRect.x < g_OverlayRect.x) g_OverlayRect.x = pcmd->ClipRect.x;
+                    if (pcmd->ClipRect.y < g_OverlayRect.y) g_OverlayRect.y = pcmd->ClipRect.y;
+                    if (pcmd->ClipRect.z > g_OverlayRect.z) g_OverlayRect.z = pcmd->ClipRect.z;
+                    if (pcmd->ClipRect.w > g_OverlayRect.w) g_OverlayRect.w = pcmd->ClipRect.w;
+                }
+            g_OverlayListHashes.resize(static_lists);
+            memcpy(g_OverlayListHashes.Data, g_PreviousListHashes.Data, static_lists * sizeof(uint64_t));
+            g_OverlayValid = true;
+        }
+        else
+        {
+            g_OverlayListHashes.resize(0);
+            g_OverlayValid = false;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, g_HostState.framebuffer);
+        if (g_OverlayValid && g_OverlayRect.z > g_OverlayRect.x && g_OverlayRect.w > g_OverlayRect.y)
+        {
+            // Only the part of the screen covered by the cached windows is composited
+            glEnable(GL_SCISSOR_TEST);
+            glScissor((int)g_OverlayRect.x, (int)(fb_height - g_OverlayRect.w), (int)(g_OverlayRect.z - g_OverlayRect.x), (int)(g_OverlayRect.w - g_OverlayRect.y));
+            glViewport(0, 0, fb_width, fb_height);
+            glEnable(GL_BLEND);
+            glBlendEquation(GL_FUNC_ADD);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            glUseProgram(g_CompositeShaderHandle);
+            glUniform1i(g_CompositeLocationTex, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, g_OverlayTexture);
+            glBindVertexArray(g_VaoHandle);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glDisable(GL_SCISSOR_TEST);
+        }
+        g_Stats.overlayLists = g_OverlayListHashes.Size;
+        g_Stats.directLists = draw_data->CmdListsCount - g_OverlayListHashes.Size;
+        ImGui_ImplGlfwGL3Cached_DrawLists(draw_data, g_OverlayListHashes.Size, draw_data->CmdListsCount, fb_width, fb_height);
+    }
+
+    // Back to the state the host described, no query needed
+    glBindFramebuffer(GL_FRAMEBUFFER, g_HostState.framebuffer);
+    if (g_HostState.blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
+    if (g_HostState.depthTest) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
+    if (g_HostState.cullFace) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
+}
+
+static GLuint ImGui_ImplGlfwGL3Cached_CreateProgram(const GLchar* vertex_shader, const GLchar* fragment_shader, GLuint* vert_handle, GLuint* frag_handle)
+{
+    GLuint program = glCreateProgram();
+    *vert_handle = glCreateShader(GL_VERTEX_SHADER);
+    *frag_handle = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(*vert_handle, 1, &vertex_shader, 0);
+    glShaderSource(*frag_handle, 1, &fragment_shader, 0);
+    glCompileShader(*vert_handle);
+    glCompileShader(*frag_handle);
+    glAttachShader(program, *vert_handle);
+    glAttachShader(program, *frag_handle);
+    glLinkProgram(program);
+    return program;
+}
+
+static void ImGui_ImplGlfwGL3Cached_DeleteProgram(GLuint* program, GLuint* vert_handle, GLuint* frag_handle)
+{
+    glDetachShader(*program, *vert_handle);
+    glDeleteShader(*vert_handle);
+    glDetachShader(*program, *frag_handle);
+    glDeleteShader(*frag_handle);
+    glDeleteProgram(*program);
+    *program = *vert_handle = *frag_handle = 0;
+}
+
+bool    ImGui_ImplGlfwGL3Cached_Init()
+{
+    const GLchar *vertex_shader =
+        "#version 330\n"
+        "uniform mat4 ProjMtx;\n"
+        "in vec2 Position;\n"
+        "in vec2 UV;\n"
+        "in vec4 Color;\n"
+        "out vec2 Frag_UV;\n"
+        "out vec4 Frag_Color;\n"
+        "void main()\n"
+        "{\n"
+        "	Frag_UV = UV;\n"
+        "	Frag_Color = Color;\n"
+        "	gl_Position = ProjMtx * vec4(Position.xy,0,1);\n"
+        "}\n";
+
+    const GLchar* fragment_shader =
+        "#version 330\n"
+        "uniform sampler2D Texture;\n"
+        "in vec2 Frag_UV;\n"
+        "in vec4 Frag_Color;\n"
+        "out vec4 Out_Color;\n"
+        "void main()\n"
+        "{\n"
+        "	Out_Color = Frag_Color * texture( Texture, Frag_UV.st);\n"
+        "}\n";
+
+    // Full screen triangle, the overlay holds premultiplied colors
+    const GLchar *composite_vertex_shader =
+        "#version 330\n"
+        "void main()\n"
+        "{\n"
+        "	vec2 p = vec2(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0);\n"
+        "	gl_Position = vec4(p,0,1);\n"
+        "}\n";
+
+    const GLchar* composite_fragment_shader =
+        "#version 330\n"
+        "uniform sampler2D Texture;\n"
+        "out vec4 Out_Color;\n"
+        "void main()\n"
+        "{\n"
+        "	Out_Color = texelFetch( Texture, ivec2(gl_FragCoord.xy), 0);\n"
+        "}\n";
+
+    g_ShaderHandle = ImGui_ImplGlfwGL3Cached_CreateProgram(vertex_shader, fragment_shader, &g_VertHandle, &g_FragHandle);
+    g_AttribLocationTex = glGetUniformLocation(g_ShaderHandle, "Texture");
+    g_AttribLocationProjMtx = glGetUniformLocation(g_ShaderHandle, "ProjMtx");
+    g_AttribLocationPosition = glGetAttribLocation(g_ShaderHandle, "Position");
+    g_AttribLocationUV = glGetAttribLocation(g_ShaderHandle, "UV");
+    g_AttribLocationColor = glGetAttribLocation(g_ShaderHandle, "Color");
+
+    g_CompositeShaderHandle = ImGui_ImplGlfwGL3Cached_CreateProgram(composite_vertex_shader, composite_fragment_shader, &g_CompositeVertHandle, &g_CompositeFragHandle);
+    g_CompositeLocationTex = glGetUniformLocation(g_CompositeShaderHandle, "Texture");
+
+    glGenVertexArrays(1, &g_VaoHandle);
+    glBindVertexArray(g_VaoHandle);
+    glEnableVertexAttribArray(g_AttribLocationPosition);
+    glEnableVertexAttribArray(g_AttribLocationUV);
+    glEnableVertexAttribArray(g_AttribLocationColor);
+
+    // GL 4.1 contexts fall back to unsynchronized maps of the same fenced ring
+    g_Persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    ImGui_ImplGlfwGL3Cached_CreateRing(RING_INITIAL_SEGMENT_SIZE);
+
+    ImGui::GetIO().RenderDrawListsFn = ImGui_ImplGlfwGL3Cached_RenderDrawLists;
+    return true;
+}
+
+void    ImGui_ImplGlfwGL3Cached_Shutdown()
+{
+    ImGui_ImplGlfwGL3Cached_DestroyRing();
+    if (g_VaoHandle) glDeleteVertexArrays(1, &g_VaoHandle);
+    g_VaoHandle = 0;
+    if (g_OverlayFbo) glDeleteFramebuffers(1, &g_OverlayFbo);
+    if (g_OverlayTexture) glDeleteTextures(1, &g_OverlayTexture);
+    g_OverlayFbo = g_OverlayTexture = 0;
+    g_OverlayWidth = g_OverlayHeight = 0;
+    g_OverlayValid = false;
+    g_ListHashes.clear();
+    g_PreviousListHashes.clear();
+    g_OverlayListHashes.clear();
+    ImGui_ImplGlfwGL3Cached_DeleteProgram(&g_ShaderHandle, &g_VertHandle, &g_FragHandle);
+    ImGui_ImplGlfwGL3Cached_DeleteProgram(&g_CompositeShaderHandle, &g_CompositeVertHandle, &g_CompositeFragHandle);
+}
+
+void    ImGui_ImplGlfwGL3Cached_SetHostState(const ImGui_ImplGlfwGL3Cached_HostState& state)
+{
+    g_HostState = state;
+}
+
+void    ImGui_ImplGlfwGL3Cached_SetOverlayCaching(bool enabled)
+{
+    if (!enabled)
+        g_OverlayValid = false;
+    g_OverlayCaching = enabled;
+}
+
+void    ImGui_ImplGlfwGL3Cached_GetStats(ImGui_ImplGlfwGL3Cached_Stats* stats)
+{
+    *stats = g_Stats;
+}
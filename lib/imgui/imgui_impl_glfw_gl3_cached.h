@@ -0,0 +1,36 @@
+// ImGui OpenGL3 renderer variant for hosts that track their own GL state
+// Only replaces rendering: call ImGui_ImplGlfwGL3_Init() first (inputs, font texture), then ImGui_ImplGlfwGL3Cached_Init().
+// - no glGet: the host describes the state it is in when ImGui::Render() is called and gets exactly that state back
+// - all command lists are copied in a single upload into a ring buffer, persistently mapped when GL 4.4 / ARB_buffer_storage is available
+// - the UI can be kept in an overlay texture: windows whose draw data did not change since the last frame are composited
+//   from it, the windows above the first changing one are drawn directly
+
+// Render state the host is in when ImGui::Render() is called, restored on exit.
+// Bindings (program, vertex array, buffers, texture unit 0), blend function, viewport and scissor box are not restored.
+struct ImGui_ImplGlfwGL3Cached_HostState
+{
+    unsigned int framebuffer;
+    bool         blend;
+    bool         depthTest;
+    bool         cullFace;
+};
+
+struct ImGui_ImplGlfwGL3Cached_Stats
+{
+    bool         persistentMapping;
+    bool         overlayRendered;    // false when the cached overlay was composited as is
+    int          overlayLists;       // command lists composited from the overlay
+    int          directLists;        // command lists drawn directly
+    int          overlayHits;        // frames which reused the overlay, since Init()
+    int          overlayFrames;      // frames rendered with caching on, since Init()
+    int          uploadBytes;
+    int          drawCalls;
+    int          ringBytes;
+};
+
+IMGUI_API bool        ImGui_ImplGlfwGL3Cached_Init();
+IMGUI_API void        ImGui_ImplGlfwGL3Cached_Shutdown();
+IMGUI_API void        ImGui_ImplGlfwGL3Cached_SetHostState(const ImGui_ImplGlfwGL3Cached_HostState& state);
+IMGUI_API void        ImGui_ImplGlfwGL3Cached_SetOverlayCaching(bool enabled);
+IMGUI_API void        ImGui_ImplGlfwGL3Cached_GetStats(ImGui_ImplGlfwGL3Cached_Stats* stats);
+IMGUI_API void        ImGui_ImplGlfwGL3Cached_RenderDrawLists(ImDrawData* draw_data);
@@ -0,0 +1,43 @@
+#version 410 core
+
+#define MAX_LIGHTS 128
+
+in block
+{
+	vec2 Texcoord;
+} In; 
+
+uniform sampler2D DepthBuffer;
+uniform mat4 InverseProjection;
+uniform vec2 ViewportScale = vec2(1.0);
+
+// View space position and range of the point lights
+uniform vec4 Lights[MAX_LIGHTS];
+uniform int LightCount;
+uniform int DirectionalLightCount;
+
+layout(location = 0, index = 0) out vec4 Color;
+
+void main(void)
+{
+	float depth = texture(DepthBuffer, In.Texcoord).r;
+	if (depth >= 1.0)
+	{
+		Color = vec4(0.0);
+		return;
+	}
+
+	vec2 xy = In.Texcoord / ViewportScale * 2.0 -1.0;
+	vec4 wP = InverseProjection * vec4(xy, depth * 2.0 -1.0, 1.0);
+	vec3 p = vec3(wP.xyz / wP.w);
+
+	// Lights whose contribution is above the cutoff at this pixel
+	int count = DirectionalLightCount;
+	for (int i = 0; i < LightCount; ++i)
+	{
+		vec3 d = Lights[i].xyz - p;
+		if (dot(d, d) < Lights[i].w * Lights[i].w)
+			++count;
+	}
+	Color = vec4(float(count), 0.0, 0.0, 1.0);
+}
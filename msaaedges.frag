@@ -0,0 +1,38 @@
+#version 410 core
+
+// Edge pixels of the multisampled G-buffer, those whose samples do not all
+// see the same surface. Other pixels are discarded and keep a zero stencil
+
+uniform sampler2DMS NormalSamples;
+uniform sampler2DMS DepthSamples;
+uniform int Samples = 4;
+uniform mat4 InverseProjection;
+// View depth difference relative to the depth, and squared distance between
+// normals, above which two samples are on different surfaces
+uniform float DepthThreshold = 0.01;
+uniform float NormalThreshold = 0.1;
+
+layout(location = 0, index = 0) out vec4 Color;
+
+float viewDepth(float depth)
+{
+	vec4 p = InverseProjection * vec4(0.0, 0.0, depth * 2.0 - 1.0, 1.0);
+	return p.z / p.w;
+}
+
+void main(void)
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	vec3 n0 = texelFetch(NormalSamples, coord, 0).rgb;
+	float z0 = viewDepth(texelFetch(DepthSamples, coord, 0).r);
+	bool edge = false;
+	for (int s = 1; s < Samples && !edge; ++s)
+	{
+		vec3 d = texelFetch(NormalSamples, coord, s).rgb - n0;
+		float z = viewDepth(texelFetch(DepthSamples, coord, s).r);
+		edge = dot(d, d) > NormalThreshold || abs(z - z0) > DepthThreshold * abs(z0);
+	}
+	if (!edge)
+		discard;
+	Color = vec4(1.0);
+}
@@ -0,0 +1,43 @@
+#version 410 core
+
+#define COLOR	    0
+#define NORMAL		1
+#define VELOCITY	2
+
+// Single sample G-buffer from the multisampled one, for the lights of the
+// pixels that are not edges and for post processing. Color and normal are
+// averaged, depth and velocity are those of the nearest sample
+
+uniform sampler2DMS ColorSamples;
+uniform sampler2DMS NormalSamples;
+uniform sampler2DMS DepthSamples;
+uniform sampler2DMS VelocitySamples;
+uniform int Samples = 4;
+
+layout(location = COLOR ) out vec4 Color;
+layout(location = NORMAL) out vec4 Normal;
+layout(location = VELOCITY) out vec2 Velocity;
+
+void main(void)
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	vec4 color = vec4(0.0);
+	vec4 normal = vec4(0.0);
+	int nearest = 0;
+	float nearestDepth = 1.0;
+	for (int s = 0; s < Samples; ++s)
+	{
+		color += texelFetch(ColorSamples, coord, s);
+		normal += texelFetch(NormalSamples, coord, s);
+		float depth = texelFetch(DepthSamples, coord, s).r;
+		if (depth < nearestDepth)
+		{
+			nearest = s;
+			nearestDepth = depth;
+		}
+	}
+	Color = color / Samples;
+	Normal = vec4(dot(normal.xyz, normal.xyz) > 0.0 ? normalize(normal.xyz) : vec3(0.0), normal.a / Samples);
+	Velocity = texelFetch(VelocitySamples, coord, nearest).rg;
+	gl_FragDepth = nearestDepth;
+}
@@ -0,0 +1,9 @@
+#version 410 core
+
+layout(location = 0, index = 0) out vec4 Color;
+
+// One per fragment, accumulated with additive blending
+void main(void)
+{
+	Color = vec4(1.0, 0.0, 0.0, 1.0);
+}
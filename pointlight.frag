@@ -8,14 +8,27 @@ in block
 uniform sampler2D ColorBuffer;
 uniform sampler2D NormalBuffer;
 uniform sampler2D DepthBuffer;
+// Multisampled G-buffer, read on edge pixels to light each sample when
+// Samples is not zero
+uniform sampler2DMS ColorSamples;
+uniform sampler2DMS NormalSamples;
+uniform sampler2DMS DepthSamples;
+uniform int Samples = 0;
+uniform samplerCubeArrayShadow ShadowMap;
 
 layout(location = 0, index = 0) out vec4 Color;
 
 uniform mat4 InverseProjection;
+uniform vec2 ViewportScale = vec2(1.0);
+uniform mat4 ViewToWorld;
+// Depth range of the cube shadow faces
+uniform float ShadowNear = 0.05;
+uniform float ShadowFar = 50.0;
 
 uniform light
 {
 	vec3 Position;
+	int ShadowIndex;
 	vec3 Color;
 	float Intensity;
 } PointLight;
@@ -31,21 +44,42 @@ vec3 pointLight( in vec3 p, in vec3 n, in vec3 v, in vec3 diffuseColor, in vec3
 	return att * PointLight.Color * PointLight.Intensity * (diffuseColor * ndotl + specularColor * pow(ndoth, specularPower));
 }
 
-void main(void)
+float pointShadow(in vec3 p, in vec3 n)
 {
-	vec4 colorBuffer = texture(ColorBuffer, In.Texcoord).rgba;
-	vec4 normalBuffer = texture(NormalBuffer, In.Texcoord).rgba;
-	float depth = texture(DepthBuffer, In.Texcoord).r;
+	if (PointLight.ShadowIndex < 0)
+		return 1.0;
+	// Cube faces are rendered in world space
+	vec3 d = mat3(ViewToWorld) * (p + n * 0.02 - PointLight.Position);
+	float z = max(abs(d.x), max(abs(d.y), abs(d.z)));
+	float depth = (ShadowFar + ShadowNear) / (ShadowFar - ShadowNear) - 2.0 * ShadowFar * ShadowNear / ((ShadowFar - ShadowNear) * z);
+	return texture(ShadowMap, vec4(d, PointLight.ShadowIndex), depth * 0.5 + 0.5 - 0.0005);
+}
 
+vec3 shade(in vec4 colorBuffer, in vec4 normalBuffer, in float depth)
+{
 	vec3 n = normalBuffer.rgb;
 	vec3 diffuseColor = colorBuffer.rgb;
 	vec3 specularColor = colorBuffer.aaa;
 	float specularPower = normalBuffer.a;
 
-	vec2 xy = In.Texcoord * 2.0 -1.0;
+	vec2 xy = In.Texcoord / ViewportScale * 2.0 -1.0;
 	vec4 wP = InverseProjection * vec4(xy, depth * 2.0 -1.0, 1.0);
 	vec3 p = vec3(wP.xyz / wP.w);
 	vec3 v = normalize(-p);
 
-	Color = vec4(pointLight(p, n, v, diffuseColor, specularColor, specularPower), 1.0);
+	return pointShadow(p, n) * pointLight(p, n, v, diffuseColor, specularColor, specularPower);
+}
+
+void main(void)
+{
+	if (Samples == 0)
+	{
+		Color = vec4(shade(texture(ColorBuffer, In.Texcoord), texture(NormalBuffer, In.Texcoord), texture(DepthBuffer, In.Texcoord).r), 1.0);
+		return;
+	}
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	vec3 color = vec3(0.0);
+	for (int s = 0; s < Samples; ++s)
+		color += shade(texelFetch(ColorSamples, coord, s), texelFetch(NormalSamples, coord, s), texelFetch(DepthSamples, coord, s).r);
+	Color = vec4(color / Samples, 1.0);
 }
\ No newline at end of file
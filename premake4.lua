@@ -1,23 +1,34 @@
+newoption {
+   trigger = "profile",
+   description = "Build with the timeline profiler, zones compile out otherwise"
+}
+
 solution "aogl"
    configurations { "Debug", "Release" }
    platforms {"native", "x64", "x32"}
 
+   if _OPTIONS["profile"] then
+      defines { "AOGL_PROFILE" }
+   end
+
    project "aogl"
       kind "ConsoleApp"
       language "C++"
       files { "aogl.cpp"}
       includedirs { "lib/glfw/include", "src", "common", "lib/" }
-      links {"imgui", "glfw", "glew", "stb",  "assimp"}
+      links {"aoglcore", "imgui", "glfw", "glew", "stb",  "assimp"}
       defines { "GLEW_STATIC" }
      
       configuration { "linux" }
          links {"X11","Xrandr", "Xi", "Xxf86vm", "rt", "GL", "GLU", "pthread"}
+         buildoptions { "-std=c++11", "-pthread" }
        
       configuration { "windows" }
          links {"glu32","opengl32", "gdi32", "winmm", "user32"}
 
       configuration { "macosx" }
          linkoptions { "-framework OpenGL", "-framework CoreVideo" , "-framework Cocoa", "-framework IOKit"}
+         buildoptions { "-std=c++11" }
          
        
       configuration "Debug"
@@ -29,6 +40,130 @@ solution "aogl"
          defines { "NDEBUG" }
          flags { "Optimize"}    
 
+   -- CPU microbenchmarks, no OpenGL context needed
+   project "aogl_bench"
+      kind "ConsoleApp"
+      language "C++"
+      files { "bench/*.cpp" }
+      includedirs { "src", "lib/" }
+      links {"aoglcore", "stb", "assimp"}
+      defines { "GLEW_STATIC" }
+
+      configuration { "linux" }
+         links { "pthread" }
+         buildoptions { "-std=c++11", "-pthread" }
+
+      configuration { "macosx" }
+         buildoptions { "-std=c++11" }
+
+      configuration "Debug"
+         defines { "DEBUG" }
+         flags {"ExtraWarnings", "Symbols" }
+         targetsuffix "_d"
+
+      configuration "Release"
+         defines { "NDEBUG" }
+         flags { "Optimize"}
+
+   -- CPU consistency checks, no OpenGL context needed
+   project "aogl_tests"
+      kind "ConsoleApp"
+      language "C++"
+      files { "tests/*.cpp" }
+      includedirs { "src", "lib/" }
+      links {"aoglcore"}
+      defines { "GLEW_STATIC" }
+
+      configuration { "linux" }
+         links { "pthread" }
+         buildoptions { "-std=c++11", "-pthread" }
+
+      configuration { "macosx" }
+         buildoptions { "-std=c++11" }
+
+      configuration "Debug"
+         defines { "DEBUG" }
+         flags {"ExtraWarnings", "Symbols" }
+         targetsuffix "_d"
+
+      configuration "Release"
+         defines { "NDEBUG" }
+         flags { "Optimize"}
+
+   -- Headless replay of a frame captured with aogl --capture
+   project "aogl_replay"
+      kind "ConsoleApp"
+      language "C++"
+      files { "replay/*.cpp" }
+      includedirs { "lib/glfw/include", "src", "lib/" }
+      links {"aoglcore", "glfw", "glew"}
+      defines { "GLEW_STATIC" }
+
+      configuration { "linux" }
+         links {"X11","Xrandr", "Xi", "Xxf86vm", "rt", "GL", "GLU", "pthread"}
+         buildoptions { "-std=c++11", "-pthread" }
+
+      configuration { "windows" }
+         links {"glu32","opengl32", "gdi32", "winmm", "user32"}
+
+      configuration { "macosx" }
+         linkoptions { "-framework OpenGL", "-framework CoreVideo" , "-framework Cocoa", "-framework IOKit"}
+         buildoptions { "-std=c++11" }
+
+      configuration "Debug"
+         defines { "DEBUG" }
+         flags {"ExtraWarnings", "Symbols" }
+         targetsuffix "_d"
+
+      configuration "Release"
+         defines { "NDEBUG" }
+         flags { "Optimize"}
+
+   -- Statistical comparison of benchmark results, a regression gate
+   project "aogl_compare"
+      kind "ConsoleApp"
+      language "C++"
+      files { "compare/*.cpp" }
+
+      configuration { "linux" }
+         buildoptions { "-std=c++11" }
+
+      configuration { "macosx" }
+         buildoptions { "-std=c++11" }
+
+      configuration "Debug"
+         defines { "DEBUG" }
+         flags {"ExtraWarnings", "Symbols" }
+         targetsuffix "_d"
+
+      configuration "Release"
+         defines { "NDEBUG" }
+         flags { "Optimize"}
+
+   -- Renderer code shared by aogl, aogl_bench and aogl_replay
+   project "aoglcore"
+      kind "StaticLib"
+      language "C++"
+      files { "src/*.cpp", "src/*.h" }
+      includedirs { "src", "lib/" }
+      defines { "GLEW_STATIC" }
+
+      configuration { "linux" }
+         buildoptions { "-std=c++11", "-pthread" }
+
+      configuration { "macosx" }
+         buildoptions { "-std=c++11" }
+
+      configuration "Debug"
+         defines { "DEBUG" }
+         flags {"ExtraWarnings", "Symbols" }
+         targetdir "bin/debug"
+
+      configuration "Release"
+         defines { "NDEBUG" }
+         flags { "Optimize" }
+         targetdir "bin/release"
+
    -- GLFW Library
    project "glfw"
       kind "StaticLib"
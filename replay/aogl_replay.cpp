@@ -0,0 +1,199 @@
+// Headless replay of a frame captured by aogl --capture. The captured
+// resources are created once, then the frame is replayed from its initial
+// state and timed. No scene asset is needed, the capture holds everything.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "glew/glew.h"
+#include "GLFW/glfw3.h"
+
+#include "gl_replay.h"
+
+// Per iteration statistics of one measure, in microseconds
+struct ReplayResult
+{
+    const char * name;
+    std::vector<double> samples;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double p90;
+};
+
+static void replay_result_stats(ReplayResult & r)
+{
+    std::vector<double> sorted = r.samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    r.min = sorted[0];
+    r.median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    r.p90 = sorted[std::min(n - 1, (size_t) std::ceil(0.9 * n) - 1)];
+    r.mean = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        r.mean += sorted[i];
+    r.mean /= n;
+    r.stddev = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        r.stddev += (sorted[i] - r.mean) * (sorted[i] - r.mean);
+    r.stddev = n > 1 ? sqrt(r.stddev / (n - 1)) : 0.0;
+}
+
+// Same layout as aogl_bench results, one case per measure
+static bool write_replay_json(const char * path, const char * capture, const char * renderer, const ReplayResult * results, int resultCount, int iterations, int drawCalls)
+{
+    FILE * file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\n  \"capture\": \"%s\",\n  \"renderer\": \"%s\",\n  \"repetitions\": %d,\n  \"cases\": [\n", capture, renderer, iterations);
+    for (int i = 0; i < resultCount; ++i)
+    {
+        const ReplayResult & r = results[i];
+        fprintf(file, "    {\n      \"name\": \"%s\",\n      \"iterations\": 1,\n      \"items\": %d,\n", r.name, drawCalls);
+        fprintf(file, "      \"min_us\": %.4f,\n      \"median_us\": %.4f,\n      \"mean_us\": %.4f,\n      \"stddev_us\": %.4f,\n      \"p90_us\": %.4f,\n", r.min, r.median, r.mean, r.stddev, r.p90);
+        fprintf(file, "      \"samples_us\": [");
+        for (size_t k = 0; k < r.samples.size(); ++k)
+            fprintf(file, k ? ", %.4f" : "%.4f", r.samples[k]);
+        fprintf(file, "]\n    }%s\n", i + 1 < resultCount ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+static double elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main( int argc, char **argv )
+{
+    const char * capture = NULL;
+    const char * output = NULL;
+    int iterations = 100;
+    int warmup = 5;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--warmup") && i + 1 < argc)
+            warmup = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if (argv[i][0] != '-' && !capture)
+            capture = argv[i];
+        else
+        {
+            capture = NULL;
+            break;
+        }
+    }
+    if (!capture)
+    {
+        fprintf(stderr, "Usage : %s <file.aoglcap> [--iterations <count>] [--warmup <count>] [--output <file.json>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    GlReplay replay;
+    if (!gl_replay_load(replay, capture))
+        return EXIT_FAILURE;
+
+    // An invisible window, offscreen rendering is all the replay needs
+    if( !glfwInit() )
+    {
+        fprintf( stderr, "Failed to initialize GLFW\n" );
+        return EXIT_FAILURE;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, replay.header.glMajor);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, replay.header.glMinor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#if defined(__APPLE__)
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow * window = glfwCreateWindow(64, 64, "aogl_replay", 0, 0);
+    if( ! window )
+    {
+        fprintf( stderr, "Failed to create an OpenGL %u.%u context\n", replay.header.glMajor, replay.header.glMinor );
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+    if (GLEW_OK != err)
+    {
+        fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    // glewInit leaves an error behind on core contexts
+    glGetError();
+    const char * renderer = (const char *) glGetString(GL_RENDERER);
+    printf("Replaying %s, %ux%u, on %s\n", capture, replay.header.width, replay.header.height, renderer);
+
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    bool replayed = gl_replay_init(replay);
+    glFinish();
+    printf("Resources : %.1f MB created in %.1f ms, %d commands\n", replay.resources.size() / (1024.0 * 1024.0), elapsed_us(loadStart) * 1e-3, replay.commands);
+
+    // Submission on the CPU, until glFinish returns, and between GPU timestamps
+    ReplayResult results[3];
+    results[0].name = "submit";
+    results[1].name = "wall";
+    results[2].name = "gpu";
+    GLuint timestamps[2];
+    glGenQueries(2, timestamps);
+    for (int i = 0; i < warmup + iterations && replayed; ++i)
+    {
+        replayed = gl_replay_state(replay);
+        glFinish();
+        glQueryCounter(timestamps[0], GL_TIMESTAMP);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        replayed = replayed && gl_replay_frame(replay);
+        double submit = elapsed_us(start);
+        glQueryCounter(timestamps[1], GL_TIMESTAMP);
+        glFinish();
+        double wall = elapsed_us(start);
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(timestamps[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(timestamps[1], GL_QUERY_RESULT, &end);
+        if (i < warmup)
+            continue;
+        results[0].samples.push_back(submit);
+        results[1].samples.push_back(wall);
+        results[2].samples.push_back((end - begin) * 1e-3);
+    }
+    GLenum glerr = glGetError();
+    if (glerr != GL_NO_ERROR)
+        fprintf(stderr, "OpenGL error %04x during the replay\n", glerr);
+    int drawCalls = replay.drawCalls;
+    printf("Frame : %d commands, %d draw calls, %d dispatches\n", replay.commands, drawCalls, replay.dispatches);
+
+    if (replayed)
+    {
+        for (int r = 0; r < 3; ++r)
+        {
+            replay_result_stats(results[r]);
+            printf("%-8s median %10.3f ms  min %10.3f ms  mean %10.3f ms  stddev %8.3f ms  p90 %10.3f ms\n",
+                   results[r].name, results[r].median * 1e-3, results[r].min * 1e-3, results[r].mean * 1e-3, results[r].stddev * 1e-3, results[r].p90 * 1e-3);
+        }
+        if (output && !write_replay_json(output, capture, renderer, results, 3, iterations, drawCalls))
+        {
+            fprintf(stderr, "Error writing %s\n", output);
+            replayed = false;
+        }
+    }
+
+    glDeleteQueries(2, timestamps);
+    gl_replay_shutdown(replay);
+    glfwTerminate();
+    return replayed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
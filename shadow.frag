@@ -0,0 +1,6 @@
+#version 410 core
+
+// Depth only, nothing to write
+void main(void)
+{
+}
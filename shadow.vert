@@ -0,0 +1,15 @@
+#version 410 core
+
+#define POSITION	0
+
+layout(location = POSITION) in vec3 Position;
+
+uniform mat4 MVP;
+
+// Also used by the depth pre-pass, positions must match the scene pass
+invariant gl_Position;
+
+void main()
+{	
+	gl_Position = MVP * vec4(Position, 1.0);
+}
@@ -0,0 +1,37 @@
+#version 430 core
+
+#define POSITION	0
+
+layout(location = POSITION) in vec3 Position;
+
+uniform mat4 MVP;
+
+struct Instance
+{
+	vec4 Position;
+	vec4 Rotation;
+};
+
+layout(std430, binding = 0) readonly buffer InstanceBuffer
+{
+	Instance Instances[];
+};
+
+layout(std430, binding = 1) readonly buffer VisibleBuffer
+{
+	uint Visible[];
+};
+
+void main()
+{	
+	Instance instance = Instances[Visible[gl_InstanceID]];
+	float ct = instance.Rotation.x;
+	float st = instance.Rotation.y;
+
+	vec3 p = Position;
+	p.x = Position.x * ct + Position.z * st;
+	p.z = -Position.x * st + Position.z * ct;
+	p += instance.Position.xyz;
+
+	gl_Position = MVP * vec4(p, 1.0);
+}
@@ -6,6 +6,7 @@ in block
 } In; 
 
 uniform sampler2D Texture;
+uniform vec2 ViewportScale = vec2(1.0);
 uniform float Factor = 2.0;
 
 uniform mat3 G[2] = mat3[](
@@ -19,9 +20,10 @@ void main(void)
 {
 	mat3 I;
 	vec3 s;
+	ivec2 maxCoord = ivec2(vec2(textureSize(Texture, 0)) * ViewportScale) - 1;
 	for (int i=0; i<3; i++) {
 	for (int j=0; j<3; j++) {
-			s = texelFetch( Texture, ivec2(gl_FragCoord) + ivec2(i-1,j-1), 0 ).rgb;
+			s = texelFetch( Texture, clamp(ivec2(gl_FragCoord) + ivec2(i-1,j-1), ivec2(0), maxCoord), 0 ).rgb;
 			I[i][j] = length(s); 
 		}
 	}
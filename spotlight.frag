@@ -17,6 +17,7 @@ uniform sampler2D DepthBuffer;
 layout(location = 0, index = 0) out vec4 Color;
 
 uniform mat4 InverseProjection;
+uniform vec2 ViewportScale = vec2(1.0);
 
 uniform light
 {
@@ -54,7 +55,7 @@ void main(void)
 	vec3 specularColor = colorBuffer.aaa;
 	float specularPower = normalBuffer.a;
 
-	vec2 xy = In.Texcoord * 2.0 -1.0;
+	vec2 xy = In.Texcoord / ViewportScale * 2.0 -1.0;
 	vec4 wP = InverseProjection * vec4(xy, depth * 2.0 -1.0, 1.0);
 	vec3 p = vec3(wP.xyz / wP.w);
 	vec3 v = normalize(-p);
@@ -0,0 +1,139 @@
+#include "culling.h"
+
+#include <algorithm>
+
+#include "glm/glm.hpp"
+
+// Extract the six clip planes (left, right, bottom, top, near, far) of a
+// projection matrix. Planes are normalized and point inside the frustum.
+void frustum_planes(const glm::mat4 & mvp, glm::vec4 planes[6])
+{
+    glm::mat4 m = glm::transpose(mvp);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+    for (int i = 0; i < 6; ++i)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+int sphere_frustum_test(const glm::vec4 planes[6], const glm::vec3 & center, float radius)
+{
+    int result = 1;
+    for (int i = 0; i < 6; ++i)
+    {
+        float distance = glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+        if (distance < -radius)
+            return -1;
+        if (distance < radius)
+            result = 0;
+    }
+    return result;
+}
+
+void sphere_cull(const glm::vec4 planes[6], const glm::vec4 * spheres, int count, std::vector<unsigned int> & visible)
+{
+    visible.clear();
+    for (int i = 0; i < count; ++i)
+    {
+        if (sphere_frustum_test(planes, glm::vec3(spheres[i]), spheres[i].w) >= 0)
+            visible.push_back(i);
+    }
+}
+
+// Sphere enclosing the spheres of items [first, first + count)
+static glm::vec4 sphere_bvh_bounds(const SphereBvh & bvh, int first, int count)
+{
+    glm::vec3 lower(1e30f), upper(-1e30f);
+    for (int i = first; i < first + count; ++i)
+    {
+        const glm::vec4 & s = bvh.spheres[i];
+        lower = glm::min(lower, glm::vec3(s) - s.w);
+        upper = glm::max(upper, glm::vec3(s) + s.w);
+    }
+    glm::vec3 center = (lower + upper) * 0.5f;
+    float radius = 0.f;
+    for (int i = first; i < first + count; ++i)
+        radius = std::max(radius, glm::length(glm::vec3(bvh.spheres[i]) - center) + bvh.spheres[i].w);
+    return glm::vec4(center, radius);
+}
+
+static void sphere_bvh_split(SphereBvh & bvh, int first, int count)
+{
+    int node = (int) bvh.nodes.size();
+    SphereBvh::Node n = { sphere_bvh_bounds(bvh, first, count), first, count, 0, count <= SphereBvh::LEAF_SIZE };
+    bvh.nodes.push_back(n);
+    if (!n.leaf)
+    {
+        // Median split of the centers along their widest axis
+        glm::vec3 lower(1e30f), upper(-1e30f);
+        for (int i = first; i < first + count; ++i)
+        {
+            lower = glm::min(lower, glm::vec3(bvh.spheres[i]));
+            upper = glm::max(upper, glm::vec3(bvh.spheres[i]));
+        }
+        glm::vec3 extent = upper - lower;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        std::vector<int> order(count);
+        for (int i = 0; i < count; ++i)
+            order[i] = first + i;
+        std::nth_element(order.begin(), order.begin() + count / 2, order.end(), [&bvh, axis](int a, int b) {
+            return bvh.spheres[a][axis] < bvh.spheres[b][axis];
+        });
+        std::vector<glm::vec4> spheres(count);
+        std::vector<unsigned int> items(count);
+        for (int i = 0; i < count; ++i)
+        {
+            spheres[i] = bvh.spheres[order[i]];
+            items[i] = bvh.items[order[i]];
+        }
+        std::copy(spheres.begin(), spheres.end(), bvh.spheres.begin() + first);
+        std::copy(items.begin(), items.end(), bvh.items.begin() + first);
+        sphere_bvh_split(bvh, first, count / 2);
+        sphere_bvh_split(bvh, first + count / 2, count - count / 2);
+    }
+    bvh.nodes[node].skip = (int) bvh.nodes.size();
+}
+
+void sphere_bvh_build(SphereBvh & bvh, const glm::vec4 * spheres, int count)
+{
+    bvh.nodes.clear();
+    bvh.spheres.assign(spheres, spheres + count);
+    bvh.items.resize(count);
+    for (int i = 0; i < count; ++i)
+        bvh.items[i] = i;
+    if (count > 0)
+        sphere_bvh_split(bvh, 0, count);
+}
+
+void sphere_bvh_cull(const SphereBvh & bvh, const glm::vec4 planes[6], std::vector<unsigned int> & visible)
+{
+    visible.clear();
+    int i = 0;
+    const int nodeCount = (int) bvh.nodes.size();
+    while (i < nodeCount)
+    {
+        const SphereBvh::Node & node = bvh.nodes[i];
+        int test = sphere_frustum_test(planes, glm::vec3(node.sphere), node.sphere.w);
+        if (test > 0)
+        {
+            visible.insert(visible.end(), bvh.items.begin() + node.first, bvh.items.begin() + node.first + node.count);
+        }
+        else if (test == 0 && node.leaf)
+        {
+            for (int k = node.first; k < node.first + node.count; ++k)
+            {
+                if (sphere_frustum_test(planes, glm::vec3(bvh.spheres[k]), bvh.spheres[k].w) >= 0)
+                    visible.push_back(bvh.items[k]);
+            }
+        }
+        else if (test == 0)
+        {
+            ++i;
+            continue;
+        }
+        i = node.skip;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef AOGL_CULLING_H
+#define AOGL_CULLING_H
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+
+void frustum_planes(const glm::mat4 & mvp, glm::vec4 planes[6]);
+// -1 when the sphere is outside the frustum, 1 when fully inside, 0 otherwise
+int sphere_frustum_test(const glm::vec4 planes[6], const glm::vec3 & center, float radius);
+// Indices of the spheres (xyz center, w radius) intersecting the frustum
+void sphere_cull(const glm::vec4 planes[6], const glm::vec4 * spheres, int count, std::vector<unsigned int> & visible);
+
+// Bounding sphere hierarchy over a fixed set of spheres. Nodes are stored depth
+// first, the items of a subtree are contiguous and skip is the index of the
+// node following the subtree
+struct SphereBvh
+{
+    static const int LEAF_SIZE = 4;
+    struct Node
+    {
+        glm::vec4 sphere;
+        int first;
+        int count;
+        int skip;
+        bool leaf;
+    };
+    std::vector<Node> nodes;
+    std::vector<unsigned int> items;
+    std::vector<glm::vec4> spheres;
+};
+void sphere_bvh_build(SphereBvh & bvh, const glm::vec4 * spheres, int count);
+// Same result as sphere_cull, subtrees fully inside or outside are not descended
+void sphere_bvh_cull(const SphereBvh & bvh, const glm::vec4 planes[6], std::vector<unsigned int> & visible);
+
+#endif
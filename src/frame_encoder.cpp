@@ -0,0 +1,174 @@
+#include "frame_encoder.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "image_io.h"
+#include "profiler.h"
+
+// Planar 4:2:0, BT.601 video range, top row first
+static void rgba_to_i420(const unsigned char * rgba, int width, int height, std::vector<unsigned char> & yuv)
+{
+    int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    yuv.resize((size_t) width * height + 2 * (size_t) chromaWidth * chromaHeight);
+    unsigned char * yPlane = &yuv[0];
+    unsigned char * uPlane = yPlane + (size_t) width * height;
+    unsigned char * vPlane = uPlane + (size_t) chromaWidth * chromaHeight;
+    size_t rowSize = (size_t) width * 4;
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char * row = rgba + rowSize * (height - 1 - y);
+        unsigned char * out = yPlane + (size_t) width * y;
+        for (int x = 0; x < width; ++x)
+        {
+            const unsigned char * p = row + 4 * x;
+            out[x] = (unsigned char) (16 + ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8));
+        }
+    }
+    for (int cy = 0; cy < chromaHeight; ++cy)
+    {
+        int y0 = 2 * cy, y1 = std::min(2 * cy + 1, height - 1);
+        const unsigned char * row0 = rgba + rowSize * (height - 1 - y0);
+        const unsigned char * row1 = rgba + rowSize * (height - 1 - y1);
+        for (int cx = 0; cx < chromaWidth; ++cx)
+        {
+            int x0 = 2 * cx, x1 = std::min(2 * cx + 1, width - 1);
+            int r = row0[4 * x0] + row0[4 * x1] + row1[4 * x0] + row1[4 * x1];
+            int g = row0[4 * x0 + 1] + row0[4 * x1 + 1] + row1[4 * x0 + 1] + row1[4 * x1 + 1];
+            int b = row0[4 * x0 + 2] + row0[4 * x1 + 2] + row1[4 * x0 + 2] + row1[4 * x1 + 2];
+            // Sums of four pixels, hence the two extra bits of shift
+            uPlane[(size_t) chromaWidth * cy + cx] = (unsigned char) (128 + ((-38 * r - 74 * g + 112 * b + 512) >> 10));
+            vPlane[(size_t) chromaWidth * cy + cx] = (unsigned char) (128 + ((112 * r - 94 * g - 18 * b + 512) >> 10));
+        }
+    }
+}
+
+static void frame_encoder_run(FrameEncoder * encoder)
+{
+    FrameEncoder & e = *encoder;
+    PROFILE_THREAD("frame encoder");
+    std::vector<unsigned char> yuv;
+    for (;;)
+    {
+        FrameJob job;
+        {
+            std::unique_lock<std::mutex> lock(e.mutex);
+            while (e.jobs.empty() && !e.quit)
+                e.wake.wait(lock);
+            if (e.jobs.empty())
+                return;
+            job.frame = e.jobs.front().frame;
+            job.pixels.swap(e.jobs.front().pixels);
+            e.jobs.pop_front();
+            e.done.notify_all();
+        }
+
+        PROFILE_ZONE("frame encode");
+        bool written = true;
+        if (e.format == FRAME_FORMAT_PNG)
+        {
+            char path[1024];
+            snprintf(path, sizeof(path), e.output.c_str(), job.frame);
+            written = write_png(path, e.width, e.height, &job.pixels[0]);
+            if (!written)
+                fprintf(stderr, "Error writing %s\n", path);
+        }
+        else
+            rgba_to_i420(&job.pixels[0], e.width, e.height, yuv);
+
+        std::unique_lock<std::mutex> lock(e.mutex);
+        if (e.format == FRAME_FORMAT_Y4M)
+        {
+            while (e.nextWrite != job.frame)
+                e.done.wait(lock);
+            written = fwrite("FRAME\n", 1, 6, e.stream) == 6 && fwrite(&yuv[0], 1, yuv.size(), e.stream) == yuv.size();
+            ++e.nextWrite;
+        }
+        e.encoded += written ? 1 : 0;
+        e.failed += written ? 0 : 1;
+        e.freeBuffers.push_back(std::vector<unsigned char>());
+        e.freeBuffers.back().swap(job.pixels);
+        e.done.notify_all();
+    }
+}
+
+FrameFormat frame_format_from_path(const char * path)
+{
+    size_t length = strlen(path);
+    return length >= 4 && !strcmp(path + length - 4, ".y4m") ? FRAME_FORMAT_Y4M : FRAME_FORMAT_PNG;
+}
+
+bool frame_encoder_start(FrameEncoder & e, FrameFormat format, const char * output, int width, int height, int fps, int threads)
+{
+    e.format = format;
+    e.output = output;
+    e.width = width;
+    e.height = height;
+    e.stream = NULL;
+    if (format == FRAME_FORMAT_Y4M)
+    {
+        e.stream = fopen(output, "wb");
+        if (!e.stream)
+        {
+            fprintf(stderr, "Error opening %s\n", output);
+            return false;
+        }
+        fprintf(e.stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, fps);
+    }
+    threads = std::max(threads, 1);
+    // Two frames per worker keep them busy without holding many frames
+    e.maxJobs = 2 * threads;
+    e.nextWrite = 0;
+    e.encoded = 0;
+    e.failed = 0;
+    e.quit = false;
+    for (int i = 0; i < threads; ++i)
+        e.workers.push_back(std::thread(frame_encoder_run, &e));
+    return true;
+}
+
+void frame_encoder_buffer(FrameEncoder & e, std::vector<unsigned char> & pixels)
+{
+    {
+        std::lock_guard<std::mutex> lock(e.mutex);
+        if (!e.freeBuffers.empty())
+        {
+            pixels.swap(e.freeBuffers.back());
+            e.freeBuffers.pop_back();
+        }
+    }
+    pixels.resize((size_t) e.width * e.height * 4);
+}
+
+void frame_encoder_submit(FrameEncoder & e, int frame, std::vector<unsigned char> & pixels)
+{
+    std::unique_lock<std::mutex> lock(e.mutex);
+    while (e.jobs.size() >= e.maxJobs)
+        e.done.wait(lock);
+    e.jobs.push_back(FrameJob());
+    e.jobs.back().frame = frame;
+    e.jobs.back().pixels.swap(pixels);
+    e.wake.notify_one();
+}
+
+int frame_encoder_finish(FrameEncoder & e)
+{
+    {
+        std::lock_guard<std::mutex> lock(e.mutex);
+        e.quit = true;
+        e.wake.notify_all();
+    }
+    for (size_t i = 0; i < e.workers.size(); ++i)
+        e.workers[i].join();
+    e.workers.clear();
+    e.freeBuffers.clear();
+    if (e.stream)
+    {
+        if (fclose(e.stream) != 0)
+            ++e.failed;
+        e.stream = NULL;
+    }
+    if (e.failed)
+        fprintf(stderr, "Error : %d frames could not be written\n", e.failed);
+    return e.encoded;
+}
@@ -0,0 +1,62 @@
+#ifndef AOGL_FRAME_ENCODER_H
+#define AOGL_FRAME_ENCODER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Image sequence encoding on a pool of worker threads, for the batch mode.
+// Frames are RGBA rows bottom up as read back from OpenGL. Png frames are
+// written to their own file, y4m frames are converted in parallel and
+// appended to a single stream in frame order. Nothing here touches OpenGL.
+
+enum FrameFormat
+{
+    FRAME_FORMAT_PNG = 0,
+    FRAME_FORMAT_Y4M
+};
+
+struct FrameJob
+{
+    int frame;
+    std::vector<unsigned char> pixels;
+};
+
+struct FrameEncoder
+{
+    FrameFormat format;
+    std::string output;                 // printf pattern of the png files, or the y4m file
+    int width;
+    int height;
+    FILE * stream;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;       // workers, for jobs
+    std::condition_variable done;       // the render thread for buffers, workers for their turn to write
+
+    // Under the mutex
+    std::deque<FrameJob> jobs;
+    std::vector<std::vector<unsigned char> > freeBuffers;
+    size_t maxJobs;                     // submitting waits above it
+    int nextWrite;                      // next y4m frame to append
+    int encoded;
+    int failed;
+    bool quit;
+};
+
+// Png when the output does not end with .y4m, then it needs a %d for the frame
+FrameFormat frame_format_from_path(const char * path);
+bool frame_encoder_start(FrameEncoder & e, FrameFormat format, const char * output, int width, int height, int fps, int threads);
+// A buffer of width * height * 4 bytes to read a frame into, recycled from encoded frames
+void frame_encoder_buffer(FrameEncoder & e, std::vector<unsigned char> & pixels);
+// Takes the pixels, frames are submitted in order starting at 0. Waits
+// while too many frames are queued
+void frame_encoder_submit(FrameEncoder & e, int frame, std::vector<unsigned char> & pixels);
+// Encodes what is queued and stops the workers, returns the frames encoded
+int frame_encoder_finish(FrameEncoder & e);
+
+#endif
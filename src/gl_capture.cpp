@@ -0,0 +1,1656 @@
+#include "gl_capture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Stream;
+
+// A range mapped for writing while recording, stored when it is unmapped
+struct MappedRange
+{
+    GLenum target;
+    GLintptr offset;
+    GLsizeiptr length;
+    GLbitfield access;
+    void * pointer;
+};
+
+struct GlCapture
+{
+    // Live objects, indexed by name, tracked whether recording or not
+    std::vector<char> textures;
+    std::vector<char> buffers;
+    std::vector<char> framebuffers;
+    std::vector<char> vertexArrays;
+    std::vector<char> queries;
+    std::vector<char> shaders;
+    std::vector<char> programs;
+    // Target a texture was first bound to, and whether its mipmaps are generated
+    std::vector<GLenum> textureTargets;
+    std::vector<char> textureMipmapped;
+    int unpackAlignment = 4;
+
+    bool recording = false;
+    std::string path;
+    GlCaptureHeader header;
+    Stream resources;
+    Stream state;
+    Stream frame;
+    std::vector<MappedRange> mapped;
+    // Fences of the frame, their id in the capture is their index plus one
+    std::vector<GLsync> syncs;
+};
+
+static GlCapture cap;
+
+static void name_add(std::vector<char> & names, GLuint name)
+{
+    if (name >= names.size())
+        names.resize(name + 1, 0);
+    names[name] = 1;
+}
+
+static void name_remove(std::vector<char> & names, GLuint name)
+{
+    if (name < names.size())
+        names[name] = 0;
+}
+
+static void put(Stream & s, const void * data, size_t size)
+{
+    const unsigned char * bytes = (const unsigned char *) data;
+    s.insert(s.end(), bytes, bytes + size);
+}
+
+static void put_op(Stream & s, GlCaptureOp op)
+{
+    s.push_back((unsigned char) op);
+}
+
+static void put_u8(Stream & s, unsigned int v)
+{
+    s.push_back((unsigned char) v);
+}
+
+static void put_u32(Stream & s, uint32_t v)
+{
+    put(s, &v, sizeof(v));
+}
+
+static void put_i32(Stream & s, int32_t v)
+{
+    put(s, &v, sizeof(v));
+}
+
+static void put_f32(Stream & s, float v)
+{
+    put(s, &v, sizeof(v));
+}
+
+static void put_u64(Stream & s, uint64_t v)
+{
+    put(s, &v, sizeof(v));
+}
+
+static void put_blob(Stream & s, const void * data, size_t size)
+{
+    put_u32(s, (uint32_t) size);
+    if (size)
+        put(s, data, size);
+}
+
+static void put_string(Stream & s, const char * str)
+{
+    put_blob(s, str, strlen(str));
+}
+
+static int format_components(GLenum format)
+{
+    switch (format)
+    {
+    case GL_RG:
+    case GL_RG_INTEGER:
+        return 2;
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGB_INTEGER:
+        return 3;
+    case GL_RGBA:
+    case GL_BGRA:
+    case GL_RGBA_INTEGER:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+// Bytes of one pixel
+static int pixel_bytes(GLenum format, GLenum type)
+{
+    switch (type)
+    {
+    case GL_UNSIGNED_INT_10F_11F_11F_REV:
+    case GL_UNSIGNED_INT_5_9_9_9_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_24_8:
+        return 4;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+        return 8;
+    case GL_UNSIGNED_BYTE:
+    case GL_BYTE:
+        return format_components(format);
+    case GL_UNSIGNED_SHORT:
+    case GL_SHORT:
+    case GL_HALF_FLOAT:
+        return 2 * format_components(format);
+    default:
+        return 4 * format_components(format);
+    }
+}
+
+// Format and type reading back a texture level as it is stored
+static bool texture_readback_format(GLint internalFormat, GLenum & format, GLenum & type)
+{
+    switch (internalFormat)
+    {
+    case GL_RGBA8: case GL_RGBA: case GL_SRGB8_ALPHA8:
+        format = GL_RGBA; type = GL_UNSIGNED_BYTE; return true;
+    case GL_RGB8: case GL_RGB: case GL_SRGB8:
+        format = GL_RGB; type = GL_UNSIGNED_BYTE; return true;
+    case GL_RG8: case GL_RG:
+        format = GL_RG; type = GL_UNSIGNED_BYTE; return true;
+    case GL_R8: case GL_RED:
+        format = GL_RED; type = GL_UNSIGNED_BYTE; return true;
+    case GL_RGBA32F:
+        format = GL_RGBA; type = GL_FLOAT; return true;
+    case GL_RGB32F:
+        format = GL_RGB; type = GL_FLOAT; return true;
+    case GL_RG32F:
+        format = GL_RG; type = GL_FLOAT; return true;
+    case GL_R32F:
+        format = GL_RED; type = GL_FLOAT; return true;
+    case GL_RGBA16F:
+        format = GL_RGBA; type = GL_HALF_FLOAT; return true;
+    case GL_RGB16F:
+        format = GL_RGB; type = GL_HALF_FLOAT; return true;
+    case GL_RG16F:
+        format = GL_RG; type = GL_HALF_FLOAT; return true;
+    case GL_R16F:
+        format = GL_RED; type = GL_HALF_FLOAT; return true;
+    case GL_R11F_G11F_B10F:
+        format = GL_RGB; type = GL_UNSIGNED_INT_10F_11F_11F_REV; return true;
+    case GL_R32UI:
+        format = GL_RED_INTEGER; type = GL_UNSIGNED_INT; return true;
+    case GL_R32I:
+        format = GL_RED_INTEGER; type = GL_INT; return true;
+    case GL_DEPTH_COMPONENT16: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT:
+        format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; return true;
+    case GL_DEPTH_COMPONENT32F:
+        format = GL_DEPTH_COMPONENT; type = GL_FLOAT; return true;
+    case GL_DEPTH24_STENCIL8:
+        format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; return true;
+    default:
+        return false;
+    }
+}
+
+// Layout of a uniform type as set by GL_OP_PROGRAM_UNIFORM, samplers are ints
+static void uniform_layout(GLenum type, GlCaptureUniformKind & kind, int & components)
+{
+    switch (type)
+    {
+    case GL_FLOAT: kind = GL_UNIFORM_FLOAT; components = 1; return;
+    case GL_FLOAT_VEC2: kind = GL_UNIFORM_FLOAT; components = 2; return;
+    case GL_FLOAT_VEC3: kind = GL_UNIFORM_FLOAT; components = 3; return;
+    case GL_FLOAT_VEC4: kind = GL_UNIFORM_FLOAT; components = 4; return;
+    case GL_INT_VEC2: case GL_BOOL_VEC2: kind = GL_UNIFORM_INT; components = 2; return;
+    case GL_INT_VEC3: case GL_BOOL_VEC3: kind = GL_UNIFORM_INT; components = 3; return;
+    case GL_INT_VEC4: case GL_BOOL_VEC4: kind = GL_UNIFORM_INT; components = 4; return;
+    case GL_UNSIGNED_INT: kind = GL_UNIFORM_UINT; components = 1; return;
+    case GL_UNSIGNED_INT_VEC2: kind = GL_UNIFORM_UINT; components = 2; return;
+    case GL_UNSIGNED_INT_VEC3: kind = GL_UNIFORM_UINT; components = 3; return;
+    case GL_UNSIGNED_INT_VEC4: kind = GL_UNIFORM_UINT; components = 4; return;
+    case GL_FLOAT_MAT2: kind = GL_UNIFORM_MATRIX; components = 4; return;
+    case GL_FLOAT_MAT3: kind = GL_UNIFORM_MATRIX; components = 9; return;
+    case GL_FLOAT_MAT4: kind = GL_UNIFORM_MATRIX; components = 16; return;
+    default: kind = GL_UNIFORM_INT; components = 1; return;
+    }
+}
+
+// Commands, written the same way by the snapshot and by the wrappers
+
+static void emit_name(Stream & s, GlCaptureOp op, GLuint name)
+{
+    put_op(s, op);
+    put_u32(s, name);
+}
+
+static void emit_enum(Stream & s, GlCaptureOp op, GLenum value)
+{
+    put_op(s, op);
+    put_u32(s, value);
+}
+
+static void emit_create_shader(Stream & s, GLuint shader, GLenum type)
+{
+    put_op(s, GL_OP_CREATE_SHADER);
+    put_u32(s, shader);
+    put_u32(s, type);
+}
+
+static void emit_shader_source(Stream & s, GLuint shader, const char * source)
+{
+    put_op(s, GL_OP_SHADER_SOURCE);
+    put_u32(s, shader);
+    put_string(s, source);
+}
+
+static void emit_attach_shader(Stream & s, GLuint program, GLuint shader)
+{
+    put_op(s, GL_OP_ATTACH_SHADER);
+    put_u32(s, program);
+    put_u32(s, shader);
+}
+
+static void emit_uniform_location(Stream & s, GLuint program, GLint location, const char * name)
+{
+    put_op(s, GL_OP_UNIFORM_LOCATION);
+    put_u32(s, program);
+    put_i32(s, location);
+    put_string(s, name);
+}
+
+static void emit_uniform_block_binding(Stream & s, GLuint program, GLuint binding, const char * name)
+{
+    put_op(s, GL_OP_UNIFORM_BLOCK_BINDING);
+    put_u32(s, program);
+    put_u32(s, binding);
+    put_string(s, name);
+}
+
+static void emit_subroutine_index(Stream & s, GLuint program, GLenum stage, GLuint index, const char * name)
+{
+    put_op(s, GL_OP_SUBROUTINE_INDEX);
+    put_u32(s, program);
+    put_u32(s, stage);
+    put_u32(s, index);
+    put_string(s, name);
+}
+
+static void emit_program_uniform(Stream & s, GLuint program, GLint location, GlCaptureUniformKind kind, int components, GLsizei count, GLboolean transpose, const void * values)
+{
+    put_op(s, GL_OP_PROGRAM_UNIFORM);
+    put_u32(s, program);
+    put_i32(s, location);
+    put_u8(s, kind);
+    put_u8(s, components);
+    put_u8(s, transpose);
+    put_u32(s, count);
+    put_blob(s, values, (size_t) count * components * 4);
+}
+
+static void emit_uniform_subroutines(Stream & s, GLenum stage, GLsizei count, const GLuint * indices)
+{
+    put_op(s, GL_OP_UNIFORM_SUBROUTINES);
+    put_u32(s, stage);
+    put_blob(s, indices, count * sizeof(GLuint));
+}
+
+static void emit_bind_texture(Stream & s, GLenum target, GLuint texture)
+{
+    put_op(s, GL_OP_BIND_TEXTURE);
+    put_u32(s, target);
+    put_u32(s, texture);
+}
+
+static void emit_tex_image(Stream & s, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void * pixels, size_t bytes)
+{
+    put_op(s, depth > 0 ? GL_OP_TEX_IMAGE_3D : GL_OP_TEX_IMAGE_2D);
+    put_u32(s, target);
+    put_i32(s, level);
+    put_i32(s, internalFormat);
+    put_i32(s, width);
+    put_i32(s, height);
+    if (depth > 0)
+        put_i32(s, depth);
+    put_u32(s, format);
+    put_u32(s, type);
+    put_blob(s, pixels, pixels ? bytes : 0);
+}
+
+static void emit_tex_parameter_i(Stream & s, GLenum target, GLenum pname, GLint value)
+{
+    put_op(s, GL_OP_TEX_PARAMETER_I);
+    put_u32(s, target);
+    put_u32(s, pname);
+    put_i32(s, value);
+}
+
+static void emit_tex_parameter_fv(Stream & s, GLenum target, GLenum pname, const GLfloat * params, int count)
+{
+    put_op(s, GL_OP_TEX_PARAMETER_FV);
+    put_u32(s, target);
+    put_u32(s, pname);
+    put_blob(s, params, count * sizeof(GLfloat));
+}
+
+static void emit_pixel_store(Stream & s, GLenum pname, GLint value)
+{
+    put_op(s, GL_OP_PIXEL_STORE);
+    put_u32(s, pname);
+    put_i32(s, value);
+}
+
+static void emit_bind_buffer(Stream & s, GLenum target, GLuint buffer)
+{
+    put_op(s, GL_OP_BIND_BUFFER);
+    put_u32(s, target);
+    put_u32(s, buffer);
+}
+
+static void emit_bind_buffer_base(Stream & s, GLenum target, GLuint index, GLuint buffer)
+{
+    put_op(s, GL_OP_BIND_BUFFER_BASE);
+    put_u32(s, target);
+    put_u32(s, index);
+    put_u32(s, buffer);
+}
+
+static void emit_bind_buffer_range(Stream & s, GLenum target, GLuint index, GLuint buffer, GLint64 offset, GLint64 size)
+{
+    put_op(s, GL_OP_BIND_BUFFER_RANGE);
+    put_u32(s, target);
+    put_u32(s, index);
+    put_u32(s, buffer);
+    put_u64(s, offset);
+    put_u64(s, size);
+}
+
+static void emit_buffer_data(Stream & s, GLenum target, GLsizeiptr size, const void * data, GLenum usage)
+{
+    put_op(s, GL_OP_BUFFER_DATA);
+    put_u32(s, target);
+    put_u64(s, size);
+    put_u32(s, usage);
+    put_blob(s, data, data ? size : 0);
+}
+
+static void emit_vertex_attrib_pointer(Stream & s, bool integer, GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, uint64_t offset)
+{
+    put_op(s, integer ? GL_OP_VERTEX_ATTRIB_I_POINTER : GL_OP_VERTEX_ATTRIB_POINTER);
+    put_u32(s, index);
+    put_i32(s, size);
+    put_u32(s, type);
+    if (!integer)
+        put_u8(s, normalized);
+    put_i32(s, stride);
+    put_u64(s, offset);
+}
+
+static void emit_vertex_attrib_divisor(Stream & s, GLuint index, GLuint divisor)
+{
+    put_op(s, GL_OP_VERTEX_ATTRIB_DIVISOR);
+    put_u32(s, index);
+    put_u32(s, divisor);
+}
+
+static void emit_bind_framebuffer(Stream & s, GLenum target, GLuint framebuffer)
+{
+    put_op(s, GL_OP_BIND_FRAMEBUFFER);
+    put_u32(s, target);
+    put_u32(s, framebuffer);
+}
+
+static void emit_framebuffer_texture_2d(Stream & s, GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
+{
+    put_op(s, GL_OP_FRAMEBUFFER_TEXTURE_2D);
+    put_u32(s, target);
+    put_u32(s, attachment);
+    put_u32(s, textarget);
+    put_u32(s, texture);
+    put_i32(s, level);
+}
+
+static void emit_framebuffer_texture_layer(Stream & s, GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer)
+{
+    put_op(s, GL_OP_FRAMEBUFFER_TEXTURE_LAYER);
+    put_u32(s, target);
+    put_u32(s, attachment);
+    put_u32(s, texture);
+    put_i32(s, level);
+    put_i32(s, layer);
+}
+
+static void emit_draw_buffers(Stream & s, GLsizei n, const GLenum * bufs)
+{
+    put_op(s, GL_OP_DRAW_BUFFERS);
+    put_blob(s, bufs, n * sizeof(GLenum));
+}
+
+static void emit_enable(Stream & s, GLenum cap, bool enable)
+{
+    emit_enum(s, enable ? GL_OP_ENABLE : GL_OP_DISABLE, cap);
+}
+
+static void emit_enums(Stream & s, GlCaptureOp op, const GLenum * values, int count)
+{
+    put_op(s, op);
+    for (int i = 0; i < count; ++i)
+        put_u32(s, values[i]);
+}
+
+static void emit_ints(Stream & s, GlCaptureOp op, const GLint * values, int count)
+{
+    put_op(s, op);
+    for (int i = 0; i < count; ++i)
+        put_i32(s, values[i]);
+}
+
+static void emit_floats(Stream & s, GlCaptureOp op, const GLfloat * values, int count)
+{
+    put_op(s, op);
+    for (int i = 0; i < count; ++i)
+        put_f32(s, values[i]);
+}
+
+static void emit_color_mask(Stream & s, GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    put_op(s, GL_OP_COLOR_MASK);
+    put_u8(s, red);
+    put_u8(s, green);
+    put_u8(s, blue);
+    put_u8(s, alpha);
+}
+
+static void emit_map_write(Stream & s, const MappedRange & m)
+{
+    put_op(s, GL_OP_MAP_WRITE);
+    put_u32(s, m.target);
+    put_u64(s, m.offset);
+    put_u32(s, m.access);
+    put_blob(s, m.pointer, m.length);
+}
+
+static uint32_t sync_id(GLsync sync)
+{
+    for (size_t i = 0; i < cap.syncs.size(); ++i)
+        if (cap.syncs[i] == sync)
+            return (uint32_t) i + 1;
+    return 0;
+}
+
+// Snapshot of the live objects and of the state, read back from OpenGL
+
+static void snapshot_buffers(Stream & s)
+{
+    GLint previous = 0;
+    glGetIntegerv(GL_COPY_READ_BUFFER, &previous);
+    std::vector<unsigned char> data;
+    for (GLuint name = 1; name < cap.buffers.size(); ++name)
+    {
+        if (!cap.buffers[name])
+            continue;
+        emit_name(s, GL_OP_GEN_BUFFER, name);
+        if (!glIsBuffer(name))
+            continue;
+        glBindBuffer(GL_COPY_READ_BUFFER, name);
+        GLint64 size = 0;
+        GLint usage = GL_STATIC_DRAW, mapped = GL_FALSE;
+        glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_USAGE, &usage);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_MAPPED, &mapped);
+        data.resize((size_t) size);
+        bool readable = size > 0 && !mapped;
+        if (readable)
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, &data[0]);
+        emit_bind_buffer(s, GL_COPY_WRITE_BUFFER, name);
+        emit_buffer_data(s, GL_COPY_WRITE_BUFFER, size, readable ? &data[0] : NULL, usage);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, previous);
+    emit_bind_buffer(s, GL_COPY_WRITE_BUFFER, 0);
+}
+
+static GLenum texture_binding(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D_ARRAY: return GL_TEXTURE_BINDING_2D_ARRAY;
+    case GL_TEXTURE_CUBE_MAP: return GL_TEXTURE_BINDING_CUBE_MAP;
+    case GL_TEXTURE_CUBE_MAP_ARRAY: return GL_TEXTURE_BINDING_CUBE_MAP_ARRAY;
+    case GL_TEXTURE_3D: return GL_TEXTURE_BINDING_3D;
+    default: return GL_TEXTURE_BINDING_2D;
+    }
+}
+
+static const GLenum TEXTURE_TARGETS[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_3D };
+static const int TEXTURE_TARGET_COUNT = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+static void snapshot_textures(Stream & s)
+{
+    GLint previous[TEXTURE_TARGET_COUNT];
+    for (int t = 0; t < TEXTURE_TARGET_COUNT; ++t)
+        glGetIntegerv(texture_binding(TEXTURE_TARGETS[t]), previous + t);
+    GLint packAlignment = 4, packBuffer = 0;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    emit_pixel_store(s, GL_UNPACK_ALIGNMENT, 1);
+
+    const GLenum INT_PARAMETERS[] = { GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_WRAP_R, GL_TEXTURE_COMPARE_MODE, GL_TEXTURE_COMPARE_FUNC, GL_TEXTURE_BASE_LEVEL, GL_TEXTURE_MAX_LEVEL };
+    std::vector<unsigned char> data;
+    int unreadable = 0;
+    for (GLuint name = 1; name < cap.textures.size(); ++name)
+    {
+        if (!cap.textures[name])
+            continue;
+        emit_name(s, GL_OP_GEN_TEXTURE, name);
+        GLenum target = name < cap.textureTargets.size() ? cap.textureTargets[name] : 0;
+        if (!target)
+            continue;
+        glBindTexture(target, name);
+        emit_bind_texture(s, target, name);
+        for (size_t p = 0; p < sizeof(INT_PARAMETERS) / sizeof(INT_PARAMETERS[0]); ++p)
+        {
+            GLint value = 0;
+            glGetTexParameteriv(target, INT_PARAMETERS[p], &value);
+            emit_tex_parameter_i(s, target, INT_PARAMETERS[p], value);
+        }
+        GLfloat border[4];
+        glGetTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+        emit_tex_parameter_fv(s, target, GL_TEXTURE_BORDER_COLOR, border, 4);
+
+        // Generated mipmaps are generated again from level 0
+        bool mipmapped = name < cap.textureMipmapped.size() && cap.textureMipmapped[name];
+        bool layered = target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_CUBE_MAP_ARRAY || target == GL_TEXTURE_3D;
+        int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+        for (int level = 0; level < 16; ++level)
+        {
+            GLenum levelTarget = faces > 1 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+            GLint width = 0, height = 0, depth = 0, internalFormat = 0;
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_WIDTH, &width);
+            if (width == 0)
+                break;
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_HEIGHT, &height);
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_DEPTH, &depth);
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+            GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+            bool readable = texture_readback_format(internalFormat, format, type);
+            unreadable += readable ? 0 : 1;
+            size_t bytes = gl_capture_image_bytes(width, height, layered ? depth : 1, format, type, 1);
+            data.resize(bytes);
+            for (int face = 0; face < faces; ++face)
+            {
+                GLenum faceTarget = faces > 1 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+                if (readable)
+                    glGetTexImage(faceTarget, level, format, type, &data[0]);
+                emit_tex_image(s, faceTarget, level, internalFormat, width, height, layered ? depth : 0, format, type, readable ? &data[0] : NULL, bytes);
+            }
+            if (mipmapped)
+            {
+                emit_enum(s, GL_OP_GENERATE_MIPMAP, target);
+                break;
+            }
+        }
+    }
+    if (unreadable)
+        fprintf(stderr, "Warning: %d texture levels of unknown format are captured without contents\n", unreadable);
+
+    for (int t = 0; t < TEXTURE_TARGET_COUNT; ++t)
+        glBindTexture(TEXTURE_TARGETS[t], previous[t]);
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+}
+
+static void snapshot_shader(Stream & s, GLuint shader, std::vector<char> & emitted)
+{
+    if (shader < emitted.size() && emitted[shader])
+        return;
+    name_add(emitted, shader);
+    GLint type = 0, length = 0;
+    glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+    glGetShaderiv(shader, GL_SHADER_SOURCE_LENGTH, &length);
+    std::vector<char> source(length + 1, 0);
+    if (length > 0)
+        glGetShaderSource(shader, length + 1, NULL, &source[0]);
+    emit_create_shader(s, shader, type);
+    emit_shader_source(s, shader, &source[0]);
+    emit_name(s, GL_OP_COMPILE_SHADER, shader);
+}
+
+static void snapshot_program(Stream & s, GLuint program, std::vector<char> & emittedShaders)
+{
+    GLint attachedCount = 0;
+    glGetProgramiv(program, GL_ATTACHED_SHADERS, &attachedCount);
+    std::vector<GLuint> attached(attachedCount);
+    if (attachedCount > 0)
+        glGetAttachedShaders(program, attachedCount, NULL, &attached[0]);
+    for (int i = 0; i < attachedCount; ++i)
+        snapshot_shader(s, attached[i], emittedShaders);
+    emit_name(s, GL_OP_CREATE_PROGRAM, program);
+    for (int i = 0; i < attachedCount; ++i)
+        emit_attach_shader(s, program, attached[i]);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+        return;
+    emit_name(s, GL_OP_LINK_PROGRAM, program);
+
+    // Default block uniforms, by name then value of each array element
+    GLint uniformCount = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 16);
+    for (GLuint i = 0; i < (GLuint) uniformCount; ++i)
+    {
+        GLint block = -1;
+        glGetActiveUniformsiv(program, 1, &i, GL_UNIFORM_BLOCK_INDEX, &block);
+        if (block != -1)
+            continue;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, i, maxLength, NULL, &size, &type, &name[0]);
+        std::string base = &name[0];
+        if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+            base.resize(base.size() - 3);
+        GlCaptureUniformKind kind;
+        int components;
+        uniform_layout(type, kind, components);
+        for (int e = 0; e < size; ++e)
+        {
+            char element[16];
+            snprintf(element, sizeof(element), "[%d]", e);
+            std::string elementName = size > 1 ? base + element : base;
+            GLint location = glGetUniformLocation(program, elementName.c_str());
+            if (location < 0)
+                continue;
+            emit_uniform_location(s, program, location, elementName.c_str());
+            union { GLfloat f[16]; GLint i[16]; GLuint u[16]; } value;
+            if (kind == GL_UNIFORM_INT)
+                glGetUniformiv(program, location, value.i);
+            else if (kind == GL_UNIFORM_UINT)
+                glGetUniformuiv(program, location, value.u);
+            else
+                glGetUniformfv(program, location, value.f);
+            emit_program_uniform(s, program, location, kind, components, 1, GL_FALSE, &value);
+        }
+    }
+
+    GLint blockCount = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    for (GLuint b = 0; b < (GLuint) blockCount; ++b)
+    {
+        char blockName[256];
+        GLint binding = 0;
+        glGetActiveUniformBlockName(program, b, sizeof(blockName), NULL, blockName);
+        glGetActiveUniformBlockiv(program, b, GL_UNIFORM_BLOCK_BINDING, &binding);
+        emit_uniform_block_binding(s, program, binding, blockName);
+    }
+
+    const GLenum STAGES[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for (int stage = 0; stage < 2; ++stage)
+    {
+        GLint subroutineCount = 0;
+        glGetProgramStageiv(program, STAGES[stage], GL_ACTIVE_SUBROUTINES, &subroutineCount);
+        for (GLuint i = 0; i < (GLuint) subroutineCount; ++i)
+        {
+            char subroutineName[256];
+            glGetActiveSubroutineName(program, STAGES[stage], i, sizeof(subroutineName), NULL, subroutineName);
+            emit_subroutine_index(s, program, STAGES[stage], i, subroutineName);
+        }
+    }
+}
+
+static void snapshot_programs(Stream & s)
+{
+    std::vector<char> emittedShaders;
+    for (GLuint name = 1; name < cap.shaders.size(); ++name)
+        if (cap.shaders[name] && glIsShader(name))
+            snapshot_shader(s, name, emittedShaders);
+    for (GLuint name = 1; name < cap.programs.size(); ++name)
+        if (cap.programs[name] && glIsProgram(name))
+            snapshot_program(s, name, emittedShaders);
+}
+
+static void snapshot_vertex_arrays(Stream & s)
+{
+    GLint previousArray = 0, previousBuffer = 0, maxAttribs = 16;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousArray);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousBuffer);
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttribs);
+    for (GLuint name = 1; name < cap.vertexArrays.size(); ++name)
+    {
+        if (!cap.vertexArrays[name])
+            continue;
+        emit_name(s, GL_OP_GEN_VERTEX_ARRAY, name);
+        if (!glIsVertexArray(name))
+            continue;
+        glBindVertexArray(name);
+        emit_name(s, GL_OP_BIND_VERTEX_ARRAY, name);
+        for (GLuint a = 0; a < (GLuint) std::min(maxAttribs, 16); ++a)
+        {
+            GLint enabled = 0, buffer = 0, size = 4, type = GL_FLOAT, normalized = 0, stride = 0, integer = 0, divisor = 0;
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_INTEGER, &integer);
+            glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &divisor);
+            void * pointer = NULL;
+            glGetVertexAttribPointerv(a, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+            if (buffer)
+            {
+                emit_bind_buffer(s, GL_ARRAY_BUFFER, buffer);
+                emit_vertex_attrib_pointer(s, integer != 0, a, size, type, (GLboolean) normalized, stride, (uint64_t) (uintptr_t) pointer);
+            }
+            if (divisor)
+                emit_vertex_attrib_divisor(s, a, divisor);
+            if (enabled)
+                emit_name(s, GL_OP_ENABLE_VERTEX_ATTRIB, a);
+        }
+        GLint elements = 0;
+        glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elements);
+        emit_bind_buffer(s, GL_ELEMENT_ARRAY_BUFFER, elements);
+    }
+    glBindVertexArray(previousArray);
+    glBindBuffer(GL_ARRAY_BUFFER, previousBuffer);
+    emit_name(s, GL_OP_BIND_VERTEX_ARRAY, 0);
+}
+
+static void snapshot_framebuffers(Stream & s)
+{
+    GLint previousDraw = 0, previousRead = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+    GLenum attachments[10];
+    for (int i = 0; i < 8; ++i)
+        attachments[i] = GL_COLOR_ATTACHMENT0 + i;
+    attachments[8] = GL_DEPTH_ATTACHMENT;
+    attachments[9] = GL_STENCIL_ATTACHMENT;
+    for (GLuint name = 1; name < cap.framebuffers.size(); ++name)
+    {
+        if (!cap.framebuffers[name])
+            continue;
+        emit_name(s, GL_OP_GEN_FRAMEBUFFER, name);
+        if (!glIsFramebuffer(name))
+            continue;
+        glBindFramebuffer(GL_FRAMEBUFFER, name);
+        emit_bind_framebuffer(s, GL_FRAMEBUFFER, name);
+        for (int i = 0; i < 10; ++i)
+        {
+            GLint type = GL_NONE, texture = 0, level = 0;
+            glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i], GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+            if (type != GL_TEXTURE)
+                continue;
+            glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i], GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &texture);
+            glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i], GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_LEVEL, &level);
+            GLenum target = (GLuint) texture < cap.textureTargets.size() ? cap.textureTargets[texture] : GL_TEXTURE_2D;
+            if (target == GL_TEXTURE_2D)
+                emit_framebuffer_texture_2d(s, GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, texture, level);
+            else if (target == GL_TEXTURE_CUBE_MAP)
+            {
+                GLint face = GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+                glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i], GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_CUBE_MAP_FACE, &face);
+                emit_framebuffer_texture_2d(s, GL_FRAMEBUFFER, attachments[i], face, texture, level);
+            }
+            else
+            {
+                GLint layer = 0;
+                glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i], GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_LAYER, &layer);
+                emit_framebuffer_texture_layer(s, GL_FRAMEBUFFER, attachments[i], texture, level, layer);
+            }
+        }
+        GLenum drawBuffers[8];
+        int drawBufferCount = 1;
+        for (int i = 0; i < 8; ++i)
+        {
+            GLint buffer = GL_NONE;
+            glGetIntegerv(GL_DRAW_BUFFER0 + i, &buffer);
+            drawBuffers[i] = buffer;
+            if (buffer != GL_NONE)
+                drawBufferCount = i + 1;
+        }
+        emit_draw_buffers(s, drawBufferCount, drawBuffers);
+        GLint readBuffer = GL_NONE;
+        glGetIntegerv(GL_READ_BUFFER, &readBuffer);
+        emit_enum(s, GL_OP_READ_BUFFER, readBuffer);
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+    emit_bind_framebuffer(s, GL_FRAMEBUFFER, 0);
+}
+
+static void snapshot_indexed_buffers(Stream & s, GLenum target, GLenum binding, GLenum start, GLenum size, GLenum maxBindings)
+{
+    GLint count = 0;
+    glGetIntegerv(maxBindings, &count);
+    for (GLuint i = 0; i < (GLuint) std::min(count, 16); ++i)
+    {
+        GLint buffer = 0;
+        GLint64 offset = 0, length = 0;
+        glGetIntegeri_v(binding, i, &buffer);
+        glGetInteger64i_v(start, i, &offset);
+        glGetInteger64i_v(size, i, &length);
+        if (length > 0)
+            emit_bind_buffer_range(s, target, i, buffer, offset, length);
+        else
+            emit_bind_buffer_base(s, target, i, buffer);
+    }
+}
+
+static void snapshot_state(Stream & s)
+{
+    GLint value = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+    emit_name(s, GL_OP_USE_PROGRAM, value);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+    emit_name(s, GL_OP_BIND_VERTEX_ARRAY, value);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &value);
+    emit_bind_framebuffer(s, GL_DRAW_FRAMEBUFFER, value);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &value);
+    emit_bind_framebuffer(s, GL_READ_FRAMEBUFFER, value);
+
+    // Indexed bindings also set the generic one, which comes after
+    bool storage = GLEW_VERSION_4_3 != 0;
+    snapshot_indexed_buffers(s, GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING, GL_UNIFORM_BUFFER_START, GL_UNIFORM_BUFFER_SIZE, GL_MAX_UNIFORM_BUFFER_BINDINGS);
+    if (storage)
+        snapshot_indexed_buffers(s, GL_SHADER_STORAGE_BUFFER, GL_SHADER_STORAGE_BUFFER_BINDING, GL_SHADER_STORAGE_BUFFER_START, GL_SHADER_STORAGE_BUFFER_SIZE, GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS);
+    const GLenum BUFFER_TARGETS[][2] = {
+        { GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING },
+        { GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING },
+        { GL_DRAW_INDIRECT_BUFFER, GL_DRAW_INDIRECT_BUFFER_BINDING },
+        { GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING },
+        { GL_SHADER_STORAGE_BUFFER, GL_SHADER_STORAGE_BUFFER_BINDING },
+    };
+    for (int i = 0; i < (storage ? 5 : 4); ++i)
+    {
+        glGetIntegerv(BUFFER_TARGETS[i][1], &value);
+        emit_bind_buffer(s, BUFFER_TARGETS[i][0], value);
+    }
+
+    // Every target of every unit, the frame may bind any of them
+    GLint activeUnit = GL_TEXTURE0, unitCount = 16;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &unitCount);
+    for (int unit = 0; unit < std::min(unitCount, 16); ++unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        emit_enum(s, GL_OP_ACTIVE_TEXTURE, GL_TEXTURE0 + unit);
+        for (int t = 0; t < TEXTURE_TARGET_COUNT; ++t)
+        {
+            glGetIntegerv(texture_binding(TEXTURE_TARGETS[t]), &value);
+            emit_bind_texture(s, TEXTURE_TARGETS[t], value);
+        }
+    }
+    glActiveTexture(activeUnit);
+    emit_enum(s, GL_OP_ACTIVE_TEXTURE, activeUnit);
+
+    const GLenum CAPS[] = { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_POLYGON_OFFSET_FILL, GL_FRAMEBUFFER_SRGB, GL_TEXTURE_CUBE_MAP_SEAMLESS, GL_PROGRAM_POINT_SIZE };
+    for (size_t i = 0; i < sizeof(CAPS) / sizeof(CAPS[0]); ++i)
+        emit_enable(s, CAPS[i], glIsEnabled(CAPS[i]) != GL_FALSE);
+
+    GLint blend[4];
+    glGetIntegerv(GL_BLEND_SRC_RGB, blend);
+    glGetIntegerv(GL_BLEND_DST_RGB, blend + 1);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, blend + 2);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, blend + 3);
+    emit_ints(s, GL_OP_BLEND_FUNC_SEPARATE, blend, 4);
+    glGetIntegerv(GL_BLEND_EQUATION_RGB, blend);
+    glGetIntegerv(GL_BLEND_EQUATION_ALPHA, blend + 1);
+    emit_ints(s, GL_OP_BLEND_EQUATION_SEPARATE, blend, 2);
+    glGetIntegerv(GL_DEPTH_FUNC, &value);
+    emit_enum(s, GL_OP_DEPTH_FUNC, value);
+    GLboolean mask[4];
+    glGetBooleanv(GL_DEPTH_WRITEMASK, mask);
+    put_op(s, GL_OP_DEPTH_MASK);
+    put_u8(s, mask[0]);
+    glGetBooleanv(GL_COLOR_WRITEMASK, mask);
+    emit_color_mask(s, mask[0], mask[1], mask[2], mask[3]);
+    glGetIntegerv(GL_CULL_FACE_MODE, &value);
+    emit_enum(s, GL_OP_CULL_FACE, value);
+    GLfloat floats[4];
+    glGetFloatv(GL_POLYGON_OFFSET_FACTOR, floats);
+    glGetFloatv(GL_POLYGON_OFFSET_UNITS, floats + 1);
+    emit_floats(s, GL_OP_POLYGON_OFFSET, floats, 2);
+    GLint box[4];
+    glGetIntegerv(GL_VIEWPORT, box);
+    emit_ints(s, GL_OP_VIEWPORT, box, 4);
+    glGetIntegerv(GL_SCISSOR_BOX, box);
+    emit_ints(s, GL_OP_SCISSOR, box, 4);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, floats);
+    emit_floats(s, GL_OP_CLEAR_COLOR, floats, 4);
+    glGetFloatv(GL_DEPTH_CLEAR_VALUE, floats);
+    emit_floats(s, GL_OP_CLEAR_DEPTH, floats, 1);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &value);
+    emit_pixel_store(s, GL_UNPACK_ALIGNMENT, value);
+    cap.unpackAlignment = value;
+}
+
+static void write_stream(FILE * file, const Stream & s)
+{
+    if (!s.empty())
+        fwrite(&s[0], 1, s.size(), file);
+}
+
+size_t gl_capture_image_bytes(int width, int height, int depth, GLenum format, GLenum type, int alignment)
+{
+    if (width <= 0 || height <= 0 || depth <= 0)
+        return 0;
+    size_t rowBytes = (size_t) width * pixel_bytes(format, type);
+    size_t alignedRowBytes = (rowBytes + alignment - 1) / alignment * alignment;
+    // The last row is not padded
+    return alignedRowBytes * ((size_t) height * depth - 1) + rowBytes;
+}
+
+bool gl_capture_begin(const char * path, int width, int height)
+{
+    if (cap.recording)
+        return false;
+    cap.path = path;
+    memcpy(cap.header.magic, GL_CAPTURE_MAGIC, sizeof(cap.header.magic));
+    cap.header.version = GL_CAPTURE_VERSION;
+    cap.header.width = width;
+    cap.header.height = height;
+    GLint major = 4, minor = 1;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    cap.header.glMajor = major;
+    cap.header.glMinor = minor;
+    cap.resources.clear();
+    cap.state.clear();
+    cap.frame.clear();
+    cap.mapped.clear();
+    cap.syncs.clear();
+
+    snapshot_buffers(cap.resources);
+    snapshot_textures(cap.resources);
+    snapshot_programs(cap.resources);
+    snapshot_vertex_arrays(cap.resources);
+    snapshot_framebuffers(cap.resources);
+    for (GLuint name = 1; name < cap.queries.size(); ++name)
+        if (cap.queries[name])
+            emit_name(cap.resources, GL_OP_GEN_QUERY, name);
+    snapshot_state(cap.state);
+    cap.recording = true;
+    return true;
+}
+
+bool gl_capture_active()
+{
+    return cap.recording;
+}
+
+bool gl_capture_end()
+{
+    if (!cap.recording)
+        return false;
+    cap.recording = false;
+    cap.header.resourcesBytes = cap.resources.size();
+    cap.header.stateBytes = cap.state.size();
+    cap.header.frameBytes = cap.frame.size();
+    FILE * file = fopen(cap.path.c_str(), "wb");
+    bool written = file != NULL;
+    if (file)
+    {
+        fwrite(&cap.header, sizeof(cap.header), 1, file);
+        write_stream(file, cap.resources);
+        write_stream(file, cap.state);
+        write_stream(file, cap.frame);
+        written = ferror(file) == 0;
+        fclose(file);
+    }
+    Stream().swap(cap.resources);
+    Stream().swap(cap.state);
+    Stream().swap(cap.frame);
+    return written;
+}
+
+GLuint capture_glCreateShader(GLenum type)
+{
+    GLuint shader = glCreateShader(type);
+    name_add(cap.shaders, shader);
+    return shader;
+}
+
+GLuint capture_glCreateProgram()
+{
+    GLuint program = glCreateProgram();
+    name_add(cap.programs, program);
+    return program;
+}
+
+void capture_glGenTextures(GLsizei n, GLuint * textures)
+{
+    glGenTextures(n, textures);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_add(cap.textures, textures[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_GEN_TEXTURE, textures[i]);
+    }
+}
+
+void capture_glDeleteTextures(GLsizei n, const GLuint * textures)
+{
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_remove(cap.textures, textures[i]);
+        if (textures[i] < cap.textureTargets.size())
+            cap.textureTargets[textures[i]] = 0;
+        name_remove(cap.textureMipmapped, textures[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_DELETE_TEXTURE, textures[i]);
+    }
+    glDeleteTextures(n, textures);
+}
+
+void capture_glGenBuffers(GLsizei n, GLuint * buffers)
+{
+    glGenBuffers(n, buffers);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_add(cap.buffers, buffers[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_GEN_BUFFER, buffers[i]);
+    }
+}
+
+void capture_glDeleteBuffers(GLsizei n, const GLuint * buffers)
+{
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_remove(cap.buffers, buffers[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_DELETE_BUFFER, buffers[i]);
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void capture_glGenFramebuffers(GLsizei n, GLuint * framebuffers)
+{
+    glGenFramebuffers(n, framebuffers);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_add(cap.framebuffers, framebuffers[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_GEN_FRAMEBUFFER, framebuffers[i]);
+    }
+}
+
+void capture_glGenVertexArrays(GLsizei n, GLuint * arrays)
+{
+    glGenVertexArrays(n, arrays);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_add(cap.vertexArrays, arrays[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_GEN_VERTEX_ARRAY, arrays[i]);
+    }
+}
+
+void capture_glDeleteVertexArrays(GLsizei n, const GLuint * arrays)
+{
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_remove(cap.vertexArrays, arrays[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_DELETE_VERTEX_ARRAY, arrays[i]);
+    }
+    glDeleteVertexArrays(n, arrays);
+}
+
+void capture_glGenQueries(GLsizei n, GLuint * ids)
+{
+    glGenQueries(n, ids);
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_add(cap.queries, ids[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_GEN_QUERY, ids[i]);
+    }
+}
+
+void capture_glDeleteQueries(GLsizei n, const GLuint * ids)
+{
+    for (GLsizei i = 0; i < n; ++i)
+    {
+        name_remove(cap.queries, ids[i]);
+        if (cap.recording)
+            emit_name(cap.frame, GL_OP_DELETE_QUERY, ids[i]);
+    }
+    glDeleteQueries(n, ids);
+}
+
+void capture_glUseProgram(GLuint program)
+{
+    glUseProgram(program);
+    if (cap.recording)
+        emit_name(cap.frame, GL_OP_USE_PROGRAM, program);
+}
+
+void capture_glProgramUniform1i(GLuint program, GLint location, GLint x)
+{
+    glProgramUniform1i(program, location, x);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_INT, 1, 1, GL_FALSE, &x);
+}
+
+void capture_glProgramUniform2i(GLuint program, GLint location, GLint x, GLint y)
+{
+    glProgramUniform2i(program, location, x, y);
+    const GLint v[2] = { x, y };
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_INT, 2, 1, GL_FALSE, v);
+}
+
+void capture_glProgramUniform1f(GLuint program, GLint location, GLfloat x)
+{
+    glProgramUniform1f(program, location, x);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_FLOAT, 1, 1, GL_FALSE, &x);
+}
+
+void capture_glProgramUniform2f(GLuint program, GLint location, GLfloat x, GLfloat y)
+{
+    glProgramUniform2f(program, location, x, y);
+    const GLfloat v[2] = { x, y };
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_FLOAT, 2, 1, GL_FALSE, v);
+}
+
+void capture_glProgramUniform3f(GLuint program, GLint location, GLfloat x, GLfloat y, GLfloat z)
+{
+    glProgramUniform3f(program, location, x, y, z);
+    const GLfloat v[3] = { x, y, z };
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_FLOAT, 3, 1, GL_FALSE, v);
+}
+
+void capture_glProgramUniform1fv(GLuint program, GLint location, GLsizei count, const GLfloat * value)
+{
+    glProgramUniform1fv(program, location, count, value);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_FLOAT, 1, count, GL_FALSE, value);
+}
+
+void capture_glProgramUniform2fv(GLuint program, GLint location, GLsizei count, const GLfloat * value)
+{
+    glProgramUniform2fv(program, location, count, value);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_FLOAT, 2, count, GL_FALSE, value);
+}
+
+void capture_glProgramUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat * value)
+{
+    glProgramUniform3fv(program, location, count, value);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_FLOAT, 3, count, GL_FALSE, value);
+}
+
+void capture_glProgramUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat * value)
+{
+    glProgramUniform4fv(program, location, count, value);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_FLOAT, 4, count, GL_FALSE, value);
+}
+
+void capture_glProgramUniformMatrix3fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat * value)
+{
+    glProgramUniformMatrix3fv(program, location, count, transpose, value);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_MATRIX, 9, count, transpose, value);
+}
+
+void capture_glProgramUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat * value)
+{
+    glProgramUniformMatrix4fv(program, location, count, transpose, value);
+    if (cap.recording)
+        emit_program_uniform(cap.frame, program, location, GL_UNIFORM_MATRIX, 16, count, transpose, value);
+}
+
+void capture_glUniformSubroutinesuiv(GLenum shadertype, GLsizei count, const GLuint * indices)
+{
+    glUniformSubroutinesuiv(shadertype, count, indices);
+    if (cap.recording)
+        emit_uniform_subroutines(cap.frame, shadertype, count, indices);
+}
+
+void capture_glActiveTexture(GLenum texture)
+{
+    glActiveTexture(texture);
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_ACTIVE_TEXTURE, texture);
+}
+
+void capture_glBindTexture(GLenum target, GLuint texture)
+{
+    glBindTexture(target, texture);
+    if (texture)
+    {
+        if (texture >= cap.textureTargets.size())
+            cap.textureTargets.resize(texture + 1, 0);
+        if (!cap.textureTargets[texture])
+            cap.textureTargets[texture] = target;
+    }
+    if (cap.recording)
+        emit_bind_texture(cap.frame, target, texture);
+}
+
+void capture_glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void * pixels)
+{
+    glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+    if (cap.recording)
+        emit_tex_image(cap.frame, target, level, internalFormat, width, height, 0, format, type, pixels, gl_capture_image_bytes(width, height, 1, format, type, cap.unpackAlignment));
+}
+
+void capture_glTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void * pixels)
+{
+    glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+    if (cap.recording)
+        emit_tex_image(cap.frame, target, level, internalFormat, width, height, depth, format, type, pixels, gl_capture_image_bytes(width, height, depth, format, type, cap.unpackAlignment));
+}
+
+void capture_glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels)
+{
+    glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_TEX_SUB_IMAGE_2D);
+    put_u32(cap.frame, target);
+    put_i32(cap.frame, level);
+    put_i32(cap.frame, xoffset);
+    put_i32(cap.frame, yoffset);
+    put_i32(cap.frame, width);
+    put_i32(cap.frame, height);
+    put_u32(cap.frame, format);
+    put_u32(cap.frame, type);
+    put_blob(cap.frame, pixels, pixels ? gl_capture_image_bytes(width, height, 1, format, type, cap.unpackAlignment) : 0);
+}
+
+void capture_glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    glTexParameteri(target, pname, param);
+    if (cap.recording)
+        emit_tex_parameter_i(cap.frame, target, pname, param);
+}
+
+void capture_glTexParameterf(GLenum target, GLenum pname, GLfloat param)
+{
+    glTexParameterf(target, pname, param);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_TEX_PARAMETER_F);
+    put_u32(cap.frame, target);
+    put_u32(cap.frame, pname);
+    put_f32(cap.frame, param);
+}
+
+void capture_glTexParameterfv(GLenum target, GLenum pname, const GLfloat * params)
+{
+    glTexParameterfv(target, pname, params);
+    if (cap.recording)
+        emit_tex_parameter_fv(cap.frame, target, pname, params, pname == GL_TEXTURE_BORDER_COLOR ? 4 : 1);
+}
+
+void capture_glGenerateMipmap(GLenum target)
+{
+    glGenerateMipmap(target);
+    GLint texture = 0;
+    glGetIntegerv(texture_binding(target), &texture);
+    if (texture > 0)
+    {
+        if ((GLuint) texture >= cap.textureMipmapped.size())
+            cap.textureMipmapped.resize(texture + 1, 0);
+        cap.textureMipmapped[texture] = 1;
+    }
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_GENERATE_MIPMAP, target);
+}
+
+void capture_glPixelStorei(GLenum pname, GLint param)
+{
+    glPixelStorei(pname, param);
+    if (pname == GL_UNPACK_ALIGNMENT)
+        cap.unpackAlignment = param;
+    if (cap.recording)
+        emit_pixel_store(cap.frame, pname, param);
+}
+
+void capture_glBindBuffer(GLenum target, GLuint buffer)
+{
+    glBindBuffer(target, buffer);
+    if (cap.recording)
+        emit_bind_buffer(cap.frame, target, buffer);
+}
+
+void capture_glBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    glBindBufferBase(target, index, buffer);
+    if (cap.recording)
+        emit_bind_buffer_base(cap.frame, target, index, buffer);
+}
+
+void capture_glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    glBindBufferRange(target, index, buffer, offset, size);
+    if (cap.recording)
+        emit_bind_buffer_range(cap.frame, target, index, buffer, offset, size);
+}
+
+void capture_glBufferData(GLenum target, GLsizeiptr size, const void * data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    if (cap.recording)
+        emit_buffer_data(cap.frame, target, size, data, usage);
+}
+
+void capture_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void * data)
+{
+    glBufferSubData(target, offset, size, data);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_BUFFER_SUB_DATA);
+    put_u32(cap.frame, target);
+    put_u64(cap.frame, offset);
+    put_blob(cap.frame, data, size);
+}
+
+// Replayed as mutable storage, the contents are the same
+void capture_glBufferStorage(GLenum target, GLsizeiptr size, const void * data, GLbitfield flags)
+{
+    glBufferStorage(target, size, data, flags);
+    if (cap.recording)
+        emit_buffer_data(cap.frame, target, size, data, GL_STATIC_DRAW);
+}
+
+void capture_glCopyBufferSubData(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size)
+{
+    glCopyBufferSubData(readTarget, writeTarget, readOffset, writeOffset, size);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_COPY_BUFFER_SUB_DATA);
+    put_u32(cap.frame, readTarget);
+    put_u32(cap.frame, writeTarget);
+    put_u64(cap.frame, readOffset);
+    put_u64(cap.frame, writeOffset);
+    put_u64(cap.frame, size);
+}
+
+void * capture_glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    void * pointer = glMapBufferRange(target, offset, length, access);
+    if (cap.recording && pointer && (access & GL_MAP_WRITE_BIT))
+    {
+        MappedRange m = { target, offset, length, access, pointer };
+        cap.mapped.push_back(m);
+    }
+    return pointer;
+}
+
+GLboolean capture_glUnmapBuffer(GLenum target)
+{
+    for (size_t i = 0; i < cap.mapped.size(); ++i)
+    {
+        if (cap.mapped[i].target != target)
+            continue;
+        if (cap.recording)
+            emit_map_write(cap.frame, cap.mapped[i]);
+        cap.mapped.erase(cap.mapped.begin() + i);
+        break;
+    }
+    return glUnmapBuffer(target);
+}
+
+void capture_glBindVertexArray(GLuint array)
+{
+    glBindVertexArray(array);
+    if (cap.recording)
+        emit_name(cap.frame, GL_OP_BIND_VERTEX_ARRAY, array);
+}
+
+void capture_glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void * pointer)
+{
+    glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    if (cap.recording)
+        emit_vertex_attrib_pointer(cap.frame, false, index, size, type, normalized, stride, (uint64_t) (uintptr_t) pointer);
+}
+
+void capture_glEnableVertexAttribArray(GLuint index)
+{
+    glEnableVertexAttribArray(index);
+    if (cap.recording)
+        emit_name(cap.frame, GL_OP_ENABLE_VERTEX_ATTRIB, index);
+}
+
+void capture_glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    glBindFramebuffer(target, framebuffer);
+    if (cap.recording)
+        emit_bind_framebuffer(cap.frame, target, framebuffer);
+}
+
+void capture_glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
+{
+    glFramebufferTexture2D(target, attachment, textarget, texture, level);
+    if (cap.recording)
+        emit_framebuffer_texture_2d(cap.frame, target, attachment, textarget, texture, level);
+}
+
+void capture_glFramebufferTextureLayer(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer)
+{
+    glFramebufferTextureLayer(target, attachment, texture, level, layer);
+    if (cap.recording)
+        emit_framebuffer_texture_layer(cap.frame, target, attachment, texture, level, layer);
+}
+
+void capture_glDrawBuffers(GLsizei n, const GLenum * bufs)
+{
+    glDrawBuffers(n, bufs);
+    if (cap.recording)
+        emit_draw_buffers(cap.frame, n, bufs);
+}
+
+void capture_glDrawBuffer(GLenum buf)
+{
+    glDrawBuffer(buf);
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_DRAW_BUFFER, buf);
+}
+
+void capture_glReadBuffer(GLenum src)
+{
+    glReadBuffer(src);
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_READ_BUFFER, src);
+}
+
+void capture_glEnable(GLenum cap_)
+{
+    glEnable(cap_);
+    if (cap.recording)
+        emit_enable(cap.frame, cap_, true);
+}
+
+void capture_glDisable(GLenum cap_)
+{
+    glDisable(cap_);
+    if (cap.recording)
+        emit_enable(cap.frame, cap_, false);
+}
+
+void capture_glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+    glBlendFunc(sfactor, dfactor);
+    const GLenum factors[2] = { sfactor, dfactor };
+    if (cap.recording)
+        emit_enums(cap.frame, GL_OP_BLEND_FUNC, factors, 2);
+}
+
+void capture_glDepthFunc(GLenum func)
+{
+    glDepthFunc(func);
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_DEPTH_FUNC, func);
+}
+
+void capture_glDepthMask(GLboolean flag)
+{
+    glDepthMask(flag);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_DEPTH_MASK);
+    put_u8(cap.frame, flag);
+}
+
+void capture_glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    glColorMask(red, green, blue, alpha);
+    if (cap.recording)
+        emit_color_mask(cap.frame, red, green, blue, alpha);
+}
+
+void capture_glPolygonOffset(GLfloat factor, GLfloat units)
+{
+    glPolygonOffset(factor, units);
+    const GLfloat v[2] = { factor, units };
+    if (cap.recording)
+        emit_floats(cap.frame, GL_OP_POLYGON_OFFSET, v, 2);
+}
+
+void capture_glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    glViewport(x, y, width, height);
+    const GLint v[4] = { x, y, width, height };
+    if (cap.recording)
+        emit_ints(cap.frame, GL_OP_VIEWPORT, v, 4);
+}
+
+void capture_glClear(GLbitfield mask)
+{
+    glClear(mask);
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_CLEAR, mask);
+}
+
+void capture_glDrawElements(GLenum mode, GLsizei count, GLenum type, const void * indices)
+{
+    glDrawElements(mode, count, type, indices);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_DRAW_ELEMENTS);
+    put_u32(cap.frame, mode);
+    put_i32(cap.frame, count);
+    put_u32(cap.frame, type);
+    put_u64(cap.frame, (uint64_t) (uintptr_t) indices);
+}
+
+void capture_glDrawElementsIndirect(GLenum mode, GLenum type, const void * indirect)
+{
+    glDrawElementsIndirect(mode, type, indirect);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_DRAW_ELEMENTS_INDIRECT);
+    put_u32(cap.frame, mode);
+    put_u32(cap.frame, type);
+    put_u64(cap.frame, (uint64_t) (uintptr_t) indirect);
+}
+
+void capture_glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei instanceCount)
+{
+    glDrawElementsInstanced(mode, count, type, indices, instanceCount);
+    if (!cap.recording)
+        return;
+    put_op(cap.frame, GL_OP_DRAW_ELEMENTS_INSTANCED);
+    put_u32(cap.frame, mode);
+    put_i32(cap.frame, count);
+    put_u32(cap.frame, type);
+    put_u64(cap.frame, (uint64_t) (uintptr_t) indices);
+    put_i32(cap.frame, instanceCount);
+}
+
+void capture_glDispatchCompute(GLuint x, GLuint y, GLuint z)
+{
+    glDispatchCompute(x, y, z);
+    const GLenum groups[3] = { x, y, z };
+    if (cap.recording)
+        emit_enums(cap.frame, GL_OP_DISPATCH_COMPUTE, groups, 3);
+}
+
+void capture_glMemoryBarrier(GLbitfield barriers)
+{
+    glMemoryBarrier(barriers);
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_MEMORY_BARRIER, barriers);
+}
+
+void capture_glQueryCounter(GLuint id, GLenum target)
+{
+    glQueryCounter(id, target);
+    const GLenum v[2] = { id, target };
+    if (cap.recording)
+        emit_enums(cap.frame, GL_OP_QUERY_COUNTER, v, 2);
+}
+
+void capture_glBeginQuery(GLenum target, GLuint id)
+{
+    glBeginQuery(target, id);
+    const GLenum v[2] = { target, id };
+    if (cap.recording)
+        emit_enums(cap.frame, GL_OP_BEGIN_QUERY, v, 2);
+}
+
+void capture_glEndQuery(GLenum target)
+{
+    glEndQuery(target);
+    if (cap.recording)
+        emit_enum(cap.frame, GL_OP_END_QUERY, target);
+}
+
+GLsync capture_glFenceSync(GLenum condition, GLbitfield flags)
+{
+    GLsync sync = glFenceSync(condition, flags);
+    if (cap.recording)
+    {
+        cap.syncs.push_back(sync);
+        emit_name(cap.frame, GL_OP_FENCE_SYNC, (GLuint) cap.syncs.size());
+    }
+    return sync;
+}
+
+GLenum capture_glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    GLenum result = glClientWaitSync(sync, flags, timeout);
+    uint32_t id = cap.recording ? sync_id(sync) : 0;
+    if (id)
+    {
+        put_op(cap.frame, GL_OP_CLIENT_WAIT_SYNC);
+        put_u32(cap.frame, id);
+        put_u32(cap.frame, flags);
+        put_u64(cap.frame, timeout);
+    }
+    return result;
+}
+
+void capture_glDeleteSync(GLsync sync)
+{
+    uint32_t id = cap.recording ? sync_id(sync) : 0;
+    if (id)
+    {
+        emit_name(cap.frame, GL_OP_DELETE_SYNC, id);
+        cap.syncs[id - 1] = 0;
+    }
+    glDeleteSync(sync);
+}
+
+void capture_glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void * pixels)
+{
+    glReadPixels(x, y, width, height, format, type, pixels);
+    const GLint v[6] = { x, y, width, height, (GLint) format, (GLint) type };
+    if (cap.recording)
+        emit_ints(cap.frame, GL_OP_READ_PIXELS, v, 6);
+}
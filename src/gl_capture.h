@@ -0,0 +1,215 @@
+#ifndef AOGL_GL_CAPTURE_H
+#define AOGL_GL_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "glew/glew.h"
+
+// Capture of the OpenGL command stream of one frame, replayed by aogl_replay
+// without the scene assets. Code built with gl_capture_hooks.h calls the
+// capture_gl* wrappers below instead of OpenGL: they keep track of the live
+// objects all along and record their call while a capture is open.
+//
+// A capture file holds three command streams, little endian :
+// - resources : every live buffer, texture, shader, program, vertex array,
+//   framebuffer and query with their contents when the capture began
+// - state : bindings and fixed function state when the capture began
+// - frame : the calls recorded until gl_capture_end
+// Object names, uniform locations and subroutine indices are the ones of the
+// capturing driver, the replay maps them to its own.
+
+static const char GL_CAPTURE_MAGIC[8] = { 'A', 'O', 'G', 'L', 'C', 'A', 'P', 0 };
+static const uint32_t GL_CAPTURE_VERSION = 1;
+
+struct GlCaptureHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;             // of the default framebuffer
+    uint32_t height;
+    uint32_t glMajor;           // context version the frame needs
+    uint32_t glMinor;
+    uint64_t resourcesBytes;
+    uint64_t stateBytes;
+    uint64_t frameBytes;
+};
+
+// Commands, one byte followed by their arguments. Pointers to client memory
+// are stored as a 32 bits size and the bytes, offsets into buffers as 64 bits
+enum GlCaptureOp
+{
+    GL_OP_GEN_TEXTURE = 1,
+    GL_OP_DELETE_TEXTURE,
+    GL_OP_GEN_BUFFER,
+    GL_OP_DELETE_BUFFER,
+    GL_OP_GEN_FRAMEBUFFER,
+    GL_OP_GEN_VERTEX_ARRAY,
+    GL_OP_DELETE_VERTEX_ARRAY,
+    GL_OP_GEN_QUERY,
+    GL_OP_DELETE_QUERY,
+    GL_OP_CREATE_SHADER,
+    GL_OP_SHADER_SOURCE,
+    GL_OP_COMPILE_SHADER,
+    GL_OP_CREATE_PROGRAM,
+    GL_OP_ATTACH_SHADER,
+    GL_OP_LINK_PROGRAM,
+    GL_OP_UNIFORM_LOCATION,         // capture location and name of a uniform
+    GL_OP_UNIFORM_BLOCK_BINDING,
+    GL_OP_SUBROUTINE_INDEX,         // capture index and name of a subroutine
+    GL_OP_PROGRAM_UNIFORM,          // every glProgramUniform* variant
+    GL_OP_USE_PROGRAM,
+    GL_OP_UNIFORM_SUBROUTINES,
+    GL_OP_ACTIVE_TEXTURE,
+    GL_OP_BIND_TEXTURE,
+    GL_OP_TEX_IMAGE_2D,
+    GL_OP_TEX_IMAGE_3D,
+    GL_OP_TEX_SUB_IMAGE_2D,
+    GL_OP_TEX_PARAMETER_I,
+    GL_OP_TEX_PARAMETER_F,
+    GL_OP_TEX_PARAMETER_FV,
+    GL_OP_GENERATE_MIPMAP,
+    GL_OP_PIXEL_STORE,
+    GL_OP_BIND_BUFFER,
+    GL_OP_BIND_BUFFER_BASE,
+    GL_OP_BIND_BUFFER_RANGE,
+    GL_OP_BUFFER_DATA,
+    GL_OP_BUFFER_SUB_DATA,
+    GL_OP_MAP_WRITE,                // a mapped range, written before unmapping
+    GL_OP_BIND_VERTEX_ARRAY,
+    GL_OP_VERTEX_ATTRIB_POINTER,
+    GL_OP_VERTEX_ATTRIB_I_POINTER,
+    GL_OP_VERTEX_ATTRIB_DIVISOR,
+    GL_OP_ENABLE_VERTEX_ATTRIB,
+    GL_OP_DISABLE_VERTEX_ATTRIB,
+    GL_OP_BIND_FRAMEBUFFER,
+    GL_OP_FRAMEBUFFER_TEXTURE_2D,
+    GL_OP_FRAMEBUFFER_TEXTURE_LAYER,
+    GL_OP_DRAW_BUFFERS,
+    GL_OP_DRAW_BUFFER,
+    GL_OP_READ_BUFFER,
+    GL_OP_ENABLE,
+    GL_OP_DISABLE,
+    GL_OP_BLEND_FUNC,
+    GL_OP_BLEND_FUNC_SEPARATE,
+    GL_OP_BLEND_EQUATION_SEPARATE,
+    GL_OP_DEPTH_FUNC,
+    GL_OP_DEPTH_MASK,
+    GL_OP_COLOR_MASK,
+    GL_OP_CULL_FACE,
+    GL_OP_POLYGON_OFFSET,
+    GL_OP_VIEWPORT,
+    GL_OP_SCISSOR,
+    GL_OP_CLEAR_COLOR,
+    GL_OP_CLEAR_DEPTH,
+    GL_OP_CLEAR,
+    GL_OP_DRAW_ARRAYS,
+    GL_OP_DRAW_ELEMENTS,
+    GL_OP_DRAW_ELEMENTS_INDIRECT,
+    GL_OP_DISPATCH_COMPUTE,
+    GL_OP_MEMORY_BARRIER,
+    GL_OP_QUERY_COUNTER,
+    GL_OP_BEGIN_QUERY,
+    GL_OP_END_QUERY,
+    GL_OP_FENCE_SYNC,
+    GL_OP_CLIENT_WAIT_SYNC,
+    GL_OP_DELETE_SYNC,
+    GL_OP_READ_PIXELS,
+    GL_OP_DRAW_ELEMENTS_INSTANCED,
+    GL_OP_COPY_BUFFER_SUB_DATA,
+    GL_OP_COUNT
+};
+
+// Kinds of GL_OP_PROGRAM_UNIFORM values
+enum GlCaptureUniformKind
+{
+    GL_UNIFORM_FLOAT = 0,
+    GL_UNIFORM_INT,
+    GL_UNIFORM_UINT,
+    GL_UNIFORM_MATRIX
+};
+
+// Starts recording, after a snapshot of the live objects and of the state.
+// Needs the context current, the width and height are the default framebuffer's
+bool gl_capture_begin(const char * path, int width, int height);
+bool gl_capture_active();
+// Writes the capture file, returns false when it cannot be written
+bool gl_capture_end();
+// Bytes of client memory read by an upload or written by a read back
+size_t gl_capture_image_bytes(int width, int height, int depth, GLenum format, GLenum type, int alignment);
+
+GLuint capture_glCreateShader(GLenum type);
+GLuint capture_glCreateProgram();
+void capture_glGenTextures(GLsizei n, GLuint * textures);
+void capture_glDeleteTextures(GLsizei n, const GLuint * textures);
+void capture_glGenBuffers(GLsizei n, GLuint * buffers);
+void capture_glDeleteBuffers(GLsizei n, const GLuint * buffers);
+void capture_glGenFramebuffers(GLsizei n, GLuint * framebuffers);
+void capture_glGenVertexArrays(GLsizei n, GLuint * arrays);
+void capture_glDeleteVertexArrays(GLsizei n, const GLuint * arrays);
+void capture_glGenQueries(GLsizei n, GLuint * ids);
+void capture_glDeleteQueries(GLsizei n, const GLuint * ids);
+void capture_glUseProgram(GLuint program);
+void capture_glProgramUniform1i(GLuint program, GLint location, GLint x);
+void capture_glProgramUniform2i(GLuint program, GLint location, GLint x, GLint y);
+void capture_glProgramUniform1f(GLuint program, GLint location, GLfloat x);
+void capture_glProgramUniform2f(GLuint program, GLint location, GLfloat x, GLfloat y);
+void capture_glProgramUniform3f(GLuint program, GLint location, GLfloat x, GLfloat y, GLfloat z);
+void capture_glProgramUniform1fv(GLuint program, GLint location, GLsizei count, const GLfloat * value);
+void capture_glProgramUniform2fv(GLuint program, GLint location, GLsizei count, const GLfloat * value);
+void capture_glProgramUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat * value);
+void capture_glProgramUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat * value);
+void capture_glProgramUniformMatrix3fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat * value);
+void capture_glProgramUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat * value);
+void capture_glUniformSubroutinesuiv(GLenum shadertype, GLsizei count, const GLuint * indices);
+void capture_glActiveTexture(GLenum texture);
+void capture_glBindTexture(GLenum target, GLuint texture);
+void capture_glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void * pixels);
+void capture_glTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void * pixels);
+void capture_glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels);
+void capture_glTexParameteri(GLenum target, GLenum pname, GLint param);
+void capture_glTexParameterf(GLenum target, GLenum pname, GLfloat param);
+void capture_glTexParameterfv(GLenum target, GLenum pname, const GLfloat * params);
+void capture_glGenerateMipmap(GLenum target);
+void capture_glPixelStorei(GLenum pname, GLint param);
+void capture_glBindBuffer(GLenum target, GLuint buffer);
+void capture_glBindBufferBase(GLenum target, GLuint index, GLuint buffer);
+void capture_glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+void capture_glBufferData(GLenum target, GLsizeiptr size, const void * data, GLenum usage);
+void capture_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void * data);
+void capture_glBufferStorage(GLenum target, GLsizeiptr size, const void * data, GLbitfield flags);
+void capture_glCopyBufferSubData(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size);
+void * capture_glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+GLboolean capture_glUnmapBuffer(GLenum target);
+void capture_glBindVertexArray(GLuint array);
+void capture_glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void * pointer);
+void capture_glEnableVertexAttribArray(GLuint index);
+void capture_glBindFramebuffer(GLenum target, GLuint framebuffer);
+void capture_glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+void capture_glFramebufferTextureLayer(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer);
+void capture_glDrawBuffers(GLsizei n, const GLenum * bufs);
+void capture_glDrawBuffer(GLenum buf);
+void capture_glReadBuffer(GLenum src);
+void capture_glEnable(GLenum cap);
+void capture_glDisable(GLenum cap);
+void capture_glBlendFunc(GLenum sfactor, GLenum dfactor);
+void capture_glDepthFunc(GLenum func);
+void capture_glDepthMask(GLboolean flag);
+void capture_glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+void capture_glPolygonOffset(GLfloat factor, GLfloat units);
+void capture_glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void capture_glClear(GLbitfield mask);
+void capture_glDrawElements(GLenum mode, GLsizei count, GLenum type, const void * indices);
+void capture_glDrawElementsIndirect(GLenum mode, GLenum type, const void * indirect);
+void capture_glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei instanceCount);
+void capture_glDispatchCompute(GLuint x, GLuint y, GLuint z);
+void capture_glMemoryBarrier(GLbitfield barriers);
+void capture_glQueryCounter(GLuint id, GLenum target);
+void capture_glBeginQuery(GLenum target, GLuint id);
+void capture_glEndQuery(GLenum target);
+GLsync capture_glFenceSync(GLenum condition, GLbitfield flags);
+GLenum capture_glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+void capture_glDeleteSync(GLsync sync);
+void capture_glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void * pixels);
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef AOGL_GL_CAPTURE_HOOKS_H
+#define AOGL_GL_CAPTURE_HOOKS_H
+
+// Routes the OpenGL calls of the including file through the frame capture,
+// include it after glew.h and only from renderer code. Calls not listed here,
+// queries mostly, go straight to OpenGL and are not recorded
+
+#include "gl_capture.h"
+
+#undef glCreateShader
+#define glCreateShader capture_glCreateShader
+#undef glCreateProgram
+#define glCreateProgram capture_glCreateProgram
+#undef glGenTextures
+#define glGenTextures capture_glGenTextures
+#undef glDeleteTextures
+#define glDeleteTextures capture_glDeleteTextures
+#undef glGenBuffers
+#define glGenBuffers capture_glGenBuffers
+#undef glDeleteBuffers
+#define glDeleteBuffers capture_glDeleteBuffers
+#undef glGenFramebuffers
+#define glGenFramebuffers capture_glGenFramebuffers
+#undef glGenVertexArrays
+#define glGenVertexArrays capture_glGenVertexArrays
+#undef glDeleteVertexArrays
+#define glDeleteVertexArrays capture_glDeleteVertexArrays
+#undef glGenQueries
+#define glGenQueries capture_glGenQueries
+#undef glDeleteQueries
+#define glDeleteQueries capture_glDeleteQueries
+#undef glUseProgram
+#define glUseProgram capture_glUseProgram
+#undef glProgramUniform1i
+#define glProgramUniform1i capture_glProgramUniform1i
+#undef glProgramUniform2i
+#define glProgramUniform2i capture_glProgramUniform2i
+#undef glProgramUniform1f
+#define glProgramUniform1f capture_glProgramUniform1f
+#undef glProgramUniform2f
+#define glProgramUniform2f capture_glProgramUniform2f
+#undef glProgramUniform3f
+#define glProgramUniform3f capture_glProgramUniform3f
+#undef glProgramUniform1fv
+#define glProgramUniform1fv capture_glProgramUniform1fv
+#undef glProgramUniform2fv
+#define glProgramUniform2fv capture_glProgramUniform2fv
+#undef glProgramUniform3fv
+#define glProgramUniform3fv capture_glProgramUniform3fv
+#undef glProgramUniform4fv
+#define glProgramUniform4fv capture_glProgramUniform4fv
+#undef glProgramUniformMatrix4fv
+#define glProgramUniformMatrix4fv capture_glProgramUniformMatrix4fv
+#undef glProgramUniformMatrix3fv
+#define glProgramUniformMatrix3fv capture_glProgramUniformMatrix3fv
+#undef glUniformSubroutinesuiv
+#define glUniformSubroutinesuiv capture_glUniformSubroutinesuiv
+#undef glActiveTexture
+#define glActiveTexture capture_glActiveTexture
+#undef glBindTexture
+#define glBindTexture capture_glBindTexture
+#undef glTexImage2D
+#define glTexImage2D capture_glTexImage2D
+#undef glTexImage3D
+#define glTexImage3D capture_glTexImage3D
+#undef glTexSubImage2D
+#define glTexSubImage2D capture_glTexSubImage2D
+#undef glTexParameteri
+#define glTexParameteri capture_glTexParameteri
+#undef glTexParameterf
+#define glTexParameterf capture_glTexParameterf
+#undef glTexParameterfv
+#define glTexParameterfv capture_glTexParameterfv
+#undef glGenerateMipmap
+#define glGenerateMipmap capture_glGenerateMipmap
+#undef glPixelStorei
+#define glPixelStorei capture_glPixelStorei
+#undef glBindBuffer
+#define glBindBuffer capture_glBindBuffer
+#undef glBindBufferBase
+#define glBindBufferBase capture_glBindBufferBase
+#undef glBindBufferRange
+#define glBindBufferRange capture_glBindBufferRange
+#undef glBufferData
+#define glBufferData capture_glBufferData
+#undef glBufferSubData
+#define glBufferSubData capture_glBufferSubData
+#undef glBufferStorage
+#define glBufferStorage capture_glBufferStorage
+#undef glCopyBufferSubData
+#define glCopyBufferSubData capture_glCopyBufferSubData
+#undef glMapBufferRange
+#define glMapBufferRange capture_glMapBufferRange
+#undef glUnmapBuffer
+#define glUnmapBuffer capture_glUnmapBuffer
+#undef glBindVertexArray
+#define glBindVertexArray capture_glBindVertexArray
+#undef glVertexAttribPointer
+#define glVertexAttribPointer capture_glVertexAttribPointer
+#undef glEnableVertexAttribArray
+#define glEnableVertexAttribArray capture_glEnableVertexAttribArray
+#undef glBindFramebuffer
+#define glBindFramebuffer capture_glBindFramebuffer
+#undef glFramebufferTexture2D
+#define glFramebufferTexture2D capture_glFramebufferTexture2D
+#undef glFramebufferTextureLayer
+#define glFramebufferTextureLayer capture_glFramebufferTextureLayer
+#undef glDrawBuffers
+#define glDrawBuffers capture_glDrawBuffers
+#undef glDrawBuffer
+#define glDrawBuffer capture_glDrawBuffer
+#undef glReadBuffer
+#define glReadBuffer capture_glReadBuffer
+#undef glEnable
+#define glEnable capture_glEnable
+#undef glDisable
+#define glDisable capture_glDisable
+#undef glBlendFunc
+#define glBlendFunc capture_glBlendFunc
+#undef glDepthFunc
+#define glDepthFunc capture_glDepthFunc
+#undef glDepthMask
+#define glDepthMask capture_glDepthMask
+#undef glColorMask
+#define glColorMask capture_glColorMask
+#undef glPolygonOffset
+#define glPolygonOffset capture_glPolygonOffset
+#undef glViewport
+#define glViewport capture_glViewport
+#undef glClear
+#define glClear capture_glClear
+#undef glDrawElements
+#define glDrawElements capture_glDrawElements
+#undef glDrawElementsIndirect
+#define glDrawElementsIndirect capture_glDrawElementsIndirect
+#undef glDrawElementsInstanced
+#define glDrawElementsInstanced capture_glDrawElementsInstanced
+#undef glDispatchCompute
+#define glDispatchCompute capture_glDispatchCompute
+#undef glMemoryBarrier
+#define glMemoryBarrier capture_glMemoryBarrier
+#undef glQueryCounter
+#define glQueryCounter capture_glQueryCounter
+#undef glBeginQuery
+#define glBeginQuery capture_glBeginQuery
+#undef glEndQuery
+#define glEndQuery capture_glEndQuery
+#undef glFenceSync
+#define glFenceSync capture_glFenceSync
+#undef glClientWaitSync
+#define glClientWaitSync capture_glClientWaitSync
+#undef glDeleteSync
+#define glDeleteSync capture_glDeleteSync
+#undef glReadPixels
+#define glReadPixels capture_glReadPixels
+
+#endif
@@ -0,0 +1,865 @@
+#include "gl_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+struct Reader
+{
+    const unsigned char * p;
+    const unsigned char * end;
+    bool failed;
+};
+
+static void get(Reader & in, void * value, size_t size)
+{
+    if ((size_t) (in.end - in.p) < size)
+    {
+        in.failed = true;
+        memset(value, 0, size);
+        return;
+    }
+    memcpy(value, in.p, size);
+    in.p += size;
+}
+
+static unsigned int get_u8(Reader & in)
+{
+    unsigned char v;
+    get(in, &v, sizeof(v));
+    return v;
+}
+
+static uint32_t get_u32(Reader & in)
+{
+    uint32_t v;
+    get(in, &v, sizeof(v));
+    return v;
+}
+
+static int32_t get_i32(Reader & in)
+{
+    int32_t v;
+    get(in, &v, sizeof(v));
+    return v;
+}
+
+static float get_f32(Reader & in)
+{
+    float v;
+    get(in, &v, sizeof(v));
+    return v;
+}
+
+static uint64_t get_u64(Reader & in)
+{
+    uint64_t v;
+    get(in, &v, sizeof(v));
+    return v;
+}
+
+// Points into the stream, NULL for an empty blob
+static const void * get_blob(Reader & in, uint32_t & size)
+{
+    size = get_u32(in);
+    if ((size_t) (in.end - in.p) < size)
+    {
+        in.failed = true;
+        size = 0;
+    }
+    const void * data = size ? in.p : NULL;
+    in.p += size;
+    return data;
+}
+
+static std::string get_string(Reader & in)
+{
+    uint32_t size;
+    const char * data = (const char *) get_blob(in, size);
+    return data ? std::string(data, size) : std::string();
+}
+
+static const void * get_offset(Reader & in)
+{
+    return (const void *) (uintptr_t) get_u64(in);
+}
+
+static GLuint & slot(std::vector<GLuint> & names, GLuint name)
+{
+    if (name >= names.size())
+        names.resize(name + 1, 0);
+    return names[name];
+}
+
+static GLuint mapped(const std::vector<GLuint> & names, GLuint name)
+{
+    return name < names.size() ? names[name] : 0;
+}
+
+static GlReplay::ProgramTables & program_tables(GlReplay & r, GLuint program)
+{
+    if (program >= r.programTables.size())
+        r.programTables.resize(program + 1);
+    return r.programTables[program];
+}
+
+static int stage_index(GLenum stage)
+{
+    return stage == GL_FRAGMENT_SHADER ? 1 : 0;
+}
+
+static GLuint framebuffer(const GlReplay & r, GLuint name)
+{
+    return name ? mapped(r.framebuffers, name) : r.defaultFramebuffer;
+}
+
+// Buffers of the default framebuffer are the color attachment of its stand in
+static GLenum color_buffer(GLenum buffer, GLuint boundFramebuffer)
+{
+    if (boundFramebuffer == 0 && buffer != GL_NONE)
+        return GL_COLOR_ATTACHMENT0;
+    return buffer;
+}
+
+static void check_shader(GLuint shader)
+{
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled)
+        return;
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    fprintf(stderr, "Replay : shader compilation failed\n%s\n", log);
+}
+
+static void check_program(GLuint program)
+{
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked)
+        return;
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), NULL, log);
+    fprintf(stderr, "Replay : program link failed\n%s\n", log);
+}
+
+static void program_uniform(GLuint program, GLint location, unsigned int kind, unsigned int components, GLsizei count, GLboolean transpose, const void * values)
+{
+    const GLfloat * f = (const GLfloat *) values;
+    const GLint * i = (const GLint *) values;
+    const GLuint * u = (const GLuint *) values;
+    switch (kind * 32 + components)
+    {
+    case GL_UNIFORM_FLOAT * 32 + 1: glProgramUniform1fv(program, location, count, f); break;
+    case GL_UNIFORM_FLOAT * 32 + 2: glProgramUniform2fv(program, location, count, f); break;
+    case GL_UNIFORM_FLOAT * 32 + 3: glProgramUniform3fv(program, location, count, f); break;
+    case GL_UNIFORM_FLOAT * 32 + 4: glProgramUniform4fv(program, location, count, f); break;
+    case GL_UNIFORM_INT * 32 + 1: glProgramUniform1iv(program, location, count, i); break;
+    case GL_UNIFORM_INT * 32 + 2: glProgramUniform2iv(program, location, count, i); break;
+    case GL_UNIFORM_INT * 32 + 3: glProgramUniform3iv(program, location, count, i); break;
+    case GL_UNIFORM_INT * 32 + 4: glProgramUniform4iv(program, location, count, i); break;
+    case GL_UNIFORM_UINT * 32 + 1: glProgramUniform1uiv(program, location, count, u); break;
+    case GL_UNIFORM_UINT * 32 + 2: glProgramUniform2uiv(program, location, count, u); break;
+    case GL_UNIFORM_UINT * 32 + 3: glProgramUniform3uiv(program, location, count, u); break;
+    case GL_UNIFORM_UINT * 32 + 4: glProgramUniform4uiv(program, location, count, u); break;
+    case GL_UNIFORM_MATRIX * 32 + 4: glProgramUniformMatrix2fv(program, location, count, transpose, f); break;
+    case GL_UNIFORM_MATRIX * 32 + 9: glProgramUniformMatrix3fv(program, location, count, transpose, f); break;
+    case GL_UNIFORM_MATRIX * 32 + 16: glProgramUniformMatrix4fv(program, location, count, transpose, f); break;
+    default: break;
+    }
+}
+
+static bool replay_stream(GlReplay & r, const std::vector<unsigned char> & stream)
+{
+    Reader in = { stream.empty() ? NULL : &stream[0], stream.empty() ? NULL : &stream[0] + stream.size(), false };
+    r.commands = 0;
+    r.drawCalls = 0;
+    r.dispatches = 0;
+    while (in.p < in.end && !in.failed)
+    {
+        unsigned int op = get_u8(in);
+        ++r.commands;
+        switch (op)
+        {
+        case GL_OP_GEN_TEXTURE:
+        {
+            GLuint & name = slot(r.textures, get_u32(in));
+            if (!name)
+                glGenTextures(1, &name);
+            break;
+        }
+        case GL_OP_DELETE_TEXTURE:
+        {
+            GLuint & name = slot(r.textures, get_u32(in));
+            glDeleteTextures(1, &name);
+            name = 0;
+            break;
+        }
+        case GL_OP_GEN_BUFFER:
+        {
+            GLuint & name = slot(r.buffers, get_u32(in));
+            if (!name)
+                glGenBuffers(1, &name);
+            break;
+        }
+        case GL_OP_DELETE_BUFFER:
+        {
+            GLuint & name = slot(r.buffers, get_u32(in));
+            glDeleteBuffers(1, &name);
+            name = 0;
+            break;
+        }
+        case GL_OP_GEN_FRAMEBUFFER:
+        {
+            GLuint & name = slot(r.framebuffers, get_u32(in));
+            if (!name)
+                glGenFramebuffers(1, &name);
+            break;
+        }
+        case GL_OP_GEN_VERTEX_ARRAY:
+        {
+            GLuint & name = slot(r.vertexArrays, get_u32(in));
+            if (!name)
+                glGenVertexArrays(1, &name);
+            break;
+        }
+        case GL_OP_DELETE_VERTEX_ARRAY:
+        {
+            GLuint & name = slot(r.vertexArrays, get_u32(in));
+            glDeleteVertexArrays(1, &name);
+            name = 0;
+            break;
+        }
+        case GL_OP_GEN_QUERY:
+        {
+            GLuint & name = slot(r.queries, get_u32(in));
+            if (!name)
+                glGenQueries(1, &name);
+            break;
+        }
+        case GL_OP_DELETE_QUERY:
+        {
+            GLuint & name = slot(r.queries, get_u32(in));
+            glDeleteQueries(1, &name);
+            name = 0;
+            break;
+        }
+        case GL_OP_CREATE_SHADER:
+        {
+            GLuint & name = slot(r.shaders, get_u32(in));
+            GLenum type = get_u32(in);
+            if (!name)
+                name = glCreateShader(type);
+            break;
+        }
+        case GL_OP_SHADER_SOURCE:
+        {
+            GLuint shader = mapped(r.shaders, get_u32(in));
+            uint32_t size;
+            const GLchar * source = (const GLchar *) get_blob(in, size);
+            GLint length = size;
+            if (source)
+                glShaderSource(shader, 1, &source, &length);
+            break;
+        }
+        case GL_OP_COMPILE_SHADER:
+        {
+            GLuint shader = mapped(r.shaders, get_u32(in));
+            glCompileShader(shader);
+            check_shader(shader);
+            break;
+        }
+        case GL_OP_CREATE_PROGRAM:
+        {
+            GLuint & name = slot(r.programs, get_u32(in));
+            if (!name)
+                name = glCreateProgram();
+            break;
+        }
+        case GL_OP_ATTACH_SHADER:
+        {
+            GLuint program = mapped(r.programs, get_u32(in));
+            glAttachShader(program, mapped(r.shaders, get_u32(in)));
+            break;
+        }
+        case GL_OP_LINK_PROGRAM:
+        {
+            GLuint program = mapped(r.programs, get_u32(in));
+            glLinkProgram(program);
+            check_program(program);
+            break;
+        }
+        case GL_OP_UNIFORM_LOCATION:
+        {
+            GLuint captured = get_u32(in);
+            GLint location = get_i32(in);
+            std::string name = get_string(in);
+            if (location < 0)
+                break;
+            std::vector<GLint> & locations = program_tables(r, captured).locations;
+            if ((size_t) location >= locations.size())
+                locations.resize(location + 1, -1);
+            locations[location] = glGetUniformLocation(mapped(r.programs, captured), name.c_str());
+            break;
+        }
+        case GL_OP_UNIFORM_BLOCK_BINDING:
+        {
+            GLuint program = mapped(r.programs, get_u32(in));
+            GLuint binding = get_u32(in);
+            std::string name = get_string(in);
+            GLuint index = glGetUniformBlockIndex(program, name.c_str());
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(program, index, binding);
+            break;
+        }
+        case GL_OP_SUBROUTINE_INDEX:
+        {
+            GLuint captured = get_u32(in);
+            GLenum stage = get_u32(in);
+            GLuint index = get_u32(in);
+            std::string name = get_string(in);
+            std::vector<GLuint> & subroutines = program_tables(r, captured).subroutines[stage_index(stage)];
+            if (index >= subroutines.size())
+                subroutines.resize(index + 1, 0);
+            subroutines[index] = glGetSubroutineIndex(mapped(r.programs, captured), stage, name.c_str());
+            break;
+        }
+        case GL_OP_PROGRAM_UNIFORM:
+        {
+            GLuint captured = get_u32(in);
+            GLint location = get_i32(in);
+            unsigned int kind = get_u8(in);
+            unsigned int components = get_u8(in);
+            GLboolean transpose = (GLboolean) get_u8(in);
+            GLsizei count = get_u32(in);
+            uint32_t size;
+            const void * values = get_blob(in, size);
+            const std::vector<GLint> & locations = program_tables(r, captured).locations;
+            if (location >= 0 && (size_t) location < locations.size() && locations[location] >= 0 && values)
+                program_uniform(mapped(r.programs, captured), locations[location], kind, components, count, transpose, values);
+            break;
+        }
+        case GL_OP_USE_PROGRAM:
+            r.currentProgram = get_u32(in);
+            glUseProgram(mapped(r.programs, r.currentProgram));
+            break;
+        case GL_OP_UNIFORM_SUBROUTINES:
+        {
+            GLenum stage = get_u32(in);
+            uint32_t size;
+            const GLuint * indices = (const GLuint *) get_blob(in, size);
+            const std::vector<GLuint> & subroutines = program_tables(r, r.currentProgram).subroutines[stage_index(stage)];
+            GLuint remapped[64];
+            GLsizei count = (GLsizei) (size / sizeof(GLuint));
+            if (count > 64)
+                count = 64;
+            for (GLsizei i = 0; i < count; ++i)
+                remapped[i] = indices[i] < subroutines.size() ? subroutines[indices[i]] : 0;
+            if (count)
+                glUniformSubroutinesuiv(stage, count, remapped);
+            break;
+        }
+        case GL_OP_ACTIVE_TEXTURE:
+            glActiveTexture(get_u32(in));
+            break;
+        case GL_OP_BIND_TEXTURE:
+        {
+            GLenum target = get_u32(in);
+            glBindTexture(target, mapped(r.textures, get_u32(in)));
+            break;
+        }
+        case GL_OP_TEX_IMAGE_2D:
+        case GL_OP_TEX_IMAGE_3D:
+        {
+            GLenum target = get_u32(in);
+            GLint level = get_i32(in);
+            GLint internalFormat = get_i32(in);
+            GLsizei width = get_i32(in);
+            GLsizei height = get_i32(in);
+            GLsizei depth = op == GL_OP_TEX_IMAGE_3D ? get_i32(in) : 0;
+            GLenum format = get_u32(in);
+            GLenum type = get_u32(in);
+            uint32_t size;
+            const void * pixels = get_blob(in, size);
+            if (op == GL_OP_TEX_IMAGE_3D)
+                glTexImage3D(target, level, internalFormat, width, height, depth, 0, format, type, pixels);
+            else
+                glTexImage2D(target, level, internalFormat, width, height, 0, format, type, pixels);
+            break;
+        }
+        case GL_OP_TEX_SUB_IMAGE_2D:
+        {
+            GLenum target = get_u32(in);
+            GLint level = get_i32(in);
+            GLint x = get_i32(in);
+            GLint y = get_i32(in);
+            GLsizei width = get_i32(in);
+            GLsizei height = get_i32(in);
+            GLenum format = get_u32(in);
+            GLenum type = get_u32(in);
+            uint32_t size;
+            const void * pixels = get_blob(in, size);
+            if (pixels)
+                glTexSubImage2D(target, level, x, y, width, height, format, type, pixels);
+            break;
+        }
+        case GL_OP_TEX_PARAMETER_I:
+        {
+            GLenum target = get_u32(in);
+            GLenum pname = get_u32(in);
+            glTexParameteri(target, pname, get_i32(in));
+            break;
+        }
+        case GL_OP_TEX_PARAMETER_F:
+        {
+            GLenum target = get_u32(in);
+            GLenum pname = get_u32(in);
+            glTexParameterf(target, pname, get_f32(in));
+            break;
+        }
+        case GL_OP_TEX_PARAMETER_FV:
+        {
+            GLenum target = get_u32(in);
+            GLenum pname = get_u32(in);
+            uint32_t size;
+            const GLfloat * params = (const GLfloat *) get_blob(in, size);
+            if (params)
+                glTexParameterfv(target, pname, params);
+            break;
+        }
+        case GL_OP_GENERATE_MIPMAP:
+            glGenerateMipmap(get_u32(in));
+            break;
+        case GL_OP_PIXEL_STORE:
+        {
+            GLenum pname = get_u32(in);
+            glPixelStorei(pname, get_i32(in));
+            break;
+        }
+        case GL_OP_BIND_BUFFER:
+        {
+            GLenum target = get_u32(in);
+            glBindBuffer(target, mapped(r.buffers, get_u32(in)));
+            break;
+        }
+        case GL_OP_BIND_BUFFER_BASE:
+        {
+            GLenum target = get_u32(in);
+            GLuint index = get_u32(in);
+            glBindBufferBase(target, index, mapped(r.buffers, get_u32(in)));
+            break;
+        }
+        case GL_OP_BIND_BUFFER_RANGE:
+        {
+            GLenum target = get_u32(in);
+            GLuint index = get_u32(in);
+            GLuint buffer = mapped(r.buffers, get_u32(in));
+            GLintptr offset = (GLintptr) get_u64(in);
+            GLsizeiptr size = (GLsizeiptr) get_u64(in);
+            glBindBufferRange(target, index, buffer, offset, size);
+            break;
+        }
+        case GL_OP_BUFFER_DATA:
+        {
+            GLenum target = get_u32(in);
+            GLsizeiptr size = (GLsizeiptr) get_u64(in);
+            GLenum usage = get_u32(in);
+            uint32_t dataSize;
+            const void * data = get_blob(in, dataSize);
+            glBufferData(target, size, data, usage);
+            break;
+        }
+        case GL_OP_BUFFER_SUB_DATA:
+        {
+            GLenum target = get_u32(in);
+            GLintptr offset = (GLintptr) get_u64(in);
+            uint32_t size;
+            const void * data = get_blob(in, size);
+            if (data)
+                glBufferSubData(target, offset, size, data);
+            break;
+        }
+        case GL_OP_COPY_BUFFER_SUB_DATA:
+        {
+            GLenum readTarget = get_u32(in);
+            GLenum writeTarget = get_u32(in);
+            GLintptr readOffset = (GLintptr) get_u64(in);
+            GLintptr writeOffset = (GLintptr) get_u64(in);
+            glCopyBufferSubData(readTarget, writeTarget, readOffset, writeOffset, (GLsizeiptr) get_u64(in));
+            break;
+        }
+        case GL_OP_MAP_WRITE:
+        {
+            GLenum target = get_u32(in);
+            GLintptr offset = (GLintptr) get_u64(in);
+            GLbitfield access = get_u32(in);
+            uint32_t size;
+            const void * data = get_blob(in, size);
+            // Flushes are left to the unmap
+            void * pointer = data ? glMapBufferRange(target, offset, size, access & ~GL_MAP_FLUSH_EXPLICIT_BIT) : NULL;
+            if (pointer)
+            {
+                memcpy(pointer, data, size);
+                glUnmapBuffer(target);
+            }
+            break;
+        }
+        case GL_OP_BIND_VERTEX_ARRAY:
+            glBindVertexArray(mapped(r.vertexArrays, get_u32(in)));
+            break;
+        case GL_OP_VERTEX_ATTRIB_POINTER:
+        {
+            GLuint index = get_u32(in);
+            GLint size = get_i32(in);
+            GLenum type = get_u32(in);
+            GLboolean normalized = (GLboolean) get_u8(in);
+            GLsizei stride = get_i32(in);
+            glVertexAttribPointer(index, size, type, normalized, stride, get_offset(in));
+            break;
+        }
+        case GL_OP_VERTEX_ATTRIB_I_POINTER:
+        {
+            GLuint index = get_u32(in);
+            GLint size = get_i32(in);
+            GLenum type = get_u32(in);
+            GLsizei stride = get_i32(in);
+            glVertexAttribIPointer(index, size, type, stride, get_offset(in));
+            break;
+        }
+        case GL_OP_VERTEX_ATTRIB_DIVISOR:
+        {
+            GLuint index = get_u32(in);
+            glVertexAttribDivisor(index, get_u32(in));
+            break;
+        }
+        case GL_OP_ENABLE_VERTEX_ATTRIB:
+            glEnableVertexAttribArray(get_u32(in));
+            break;
+        case GL_OP_DISABLE_VERTEX_ATTRIB:
+            glDisableVertexAttribArray(get_u32(in));
+            break;
+        case GL_OP_BIND_FRAMEBUFFER:
+        {
+            GLenum target = get_u32(in);
+            GLuint name = get_u32(in);
+            if (target != GL_READ_FRAMEBUFFER)
+                r.drawFramebuffer = name;
+            if (target != GL_DRAW_FRAMEBUFFER)
+                r.readFramebuffer = name;
+            glBindFramebuffer(target, framebuffer(r, name));
+            break;
+        }
+        case GL_OP_FRAMEBUFFER_TEXTURE_2D:
+        {
+            GLenum target = get_u32(in);
+            GLenum attachment = get_u32(in);
+            GLenum textarget = get_u32(in);
+            GLuint texture = mapped(r.textures, get_u32(in));
+            glFramebufferTexture2D(target, attachment, textarget, texture, get_i32(in));
+            break;
+        }
+        case GL_OP_FRAMEBUFFER_TEXTURE_LAYER:
+        {
+            GLenum target = get_u32(in);
+            GLenum attachment = get_u32(in);
+            GLuint texture = mapped(r.textures, get_u32(in));
+            GLint level = get_i32(in);
+            glFramebufferTextureLayer(target, attachment, texture, level, get_i32(in));
+            break;
+        }
+        case GL_OP_DRAW_BUFFERS:
+        {
+            uint32_t size;
+            const GLenum * bufs = (const GLenum *) get_blob(in, size);
+            GLenum remapped[16];
+            GLsizei count = (GLsizei) (size / sizeof(GLenum));
+            if (count > 16)
+                count = 16;
+            for (GLsizei i = 0; i < count; ++i)
+                remapped[i] = color_buffer(bufs[i], r.drawFramebuffer);
+            glDrawBuffers(count, remapped);
+            break;
+        }
+        case GL_OP_DRAW_BUFFER:
+            glDrawBuffer(color_buffer(get_u32(in), r.drawFramebuffer));
+            break;
+        case GL_OP_READ_BUFFER:
+            glReadBuffer(color_buffer(get_u32(in), r.readFramebuffer));
+            break;
+        case GL_OP_ENABLE:
+            glEnable(get_u32(in));
+            break;
+        case GL_OP_DISABLE:
+            glDisable(get_u32(in));
+            break;
+        case GL_OP_BLEND_FUNC:
+        {
+            GLenum sfactor = get_u32(in);
+            glBlendFunc(sfactor, get_u32(in));
+            break;
+        }
+        case GL_OP_BLEND_FUNC_SEPARATE:
+        {
+            GLint f[4];
+            for (int i = 0; i < 4; ++i)
+                f[i] = get_i32(in);
+            glBlendFuncSeparate(f[0], f[1], f[2], f[3]);
+            break;
+        }
+        case GL_OP_BLEND_EQUATION_SEPARATE:
+        {
+            GLenum rgb = get_u32(in);
+            glBlendEquationSeparate(rgb, get_u32(in));
+            break;
+        }
+        case GL_OP_DEPTH_FUNC:
+            glDepthFunc(get_u32(in));
+            break;
+        case GL_OP_DEPTH_MASK:
+            glDepthMask((GLboolean) get_u8(in));
+            break;
+        case GL_OP_COLOR_MASK:
+        {
+            GLboolean m[4];
+            for (int i = 0; i < 4; ++i)
+                m[i] = (GLboolean) get_u8(in);
+            glColorMask(m[0], m[1], m[2], m[3]);
+            break;
+        }
+        case GL_OP_CULL_FACE:
+            glCullFace(get_u32(in));
+            break;
+        case GL_OP_POLYGON_OFFSET:
+        {
+            GLfloat factor = get_f32(in);
+            glPolygonOffset(factor, get_f32(in));
+            break;
+        }
+        case GL_OP_VIEWPORT:
+        case GL_OP_SCISSOR:
+        {
+            GLint b[4];
+            for (int i = 0; i < 4; ++i)
+                b[i] = get_i32(in);
+            if (op == GL_OP_VIEWPORT)
+                glViewport(b[0], b[1], b[2], b[3]);
+            else
+                glScissor(b[0], b[1], b[2], b[3]);
+            break;
+        }
+        case GL_OP_CLEAR_COLOR:
+        {
+            GLfloat c[4];
+            for (int i = 0; i < 4; ++i)
+                c[i] = get_f32(in);
+            glClearColor(c[0], c[1], c[2], c[3]);
+            break;
+        }
+        case GL_OP_CLEAR_DEPTH:
+            glClearDepth(get_f32(in));
+            break;
+        case GL_OP_CLEAR:
+            glClear(get_u32(in));
+            break;
+        case GL_OP_DRAW_ARRAYS:
+        {
+            GLenum mode = get_u32(in);
+            GLint first = get_i32(in);
+            glDrawArrays(mode, first, get_i32(in));
+            ++r.drawCalls;
+            break;
+        }
+        case GL_OP_DRAW_ELEMENTS:
+        {
+            GLenum mode = get_u32(in);
+            GLsizei count = get_i32(in);
+            GLenum type = get_u32(in);
+            glDrawElements(mode, count, type, get_offset(in));
+            ++r.drawCalls;
+            break;
+        }
+        case GL_OP_DRAW_ELEMENTS_INSTANCED:
+        {
+            GLenum mode = get_u32(in);
+            GLsizei count = get_i32(in);
+            GLenum type = get_u32(in);
+            const void * indices = get_offset(in);
+            glDrawElementsInstanced(mode, count, type, indices, get_i32(in));
+            ++r.drawCalls;
+            break;
+        }
+        case GL_OP_DRAW_ELEMENTS_INDIRECT:
+        {
+            GLenum mode = get_u32(in);
+            GLenum type = get_u32(in);
+            glDrawElementsIndirect(mode, type, get_offset(in));
+            ++r.drawCalls;
+            break;
+        }
+        case GL_OP_DISPATCH_COMPUTE:
+        {
+            GLuint x = get_u32(in);
+            GLuint y = get_u32(in);
+            glDispatchCompute(x, y, get_u32(in));
+            ++r.dispatches;
+            break;
+        }
+        case GL_OP_MEMORY_BARRIER:
+            glMemoryBarrier(get_u32(in));
+            break;
+        case GL_OP_QUERY_COUNTER:
+        {
+            GLuint id = mapped(r.queries, get_u32(in));
+            glQueryCounter(id, get_u32(in));
+            break;
+        }
+        case GL_OP_BEGIN_QUERY:
+        {
+            GLenum target = get_u32(in);
+            glBeginQuery(target, mapped(r.queries, get_u32(in)));
+            break;
+        }
+        case GL_OP_END_QUERY:
+            glEndQuery(get_u32(in));
+            break;
+        case GL_OP_FENCE_SYNC:
+        {
+            uint32_t id = get_u32(in);
+            if (id >= r.syncs.size())
+                r.syncs.resize(id + 1, 0);
+            if (r.syncs[id])
+                glDeleteSync(r.syncs[id]);
+            r.syncs[id] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            break;
+        }
+        case GL_OP_CLIENT_WAIT_SYNC:
+        {
+            uint32_t id = get_u32(in);
+            GLbitfield flags = get_u32(in);
+            GLuint64 timeout = get_u64(in);
+            if (id < r.syncs.size() && r.syncs[id])
+                glClientWaitSync(r.syncs[id], flags, timeout);
+            break;
+        }
+        case GL_OP_DELETE_SYNC:
+        {
+            uint32_t id = get_u32(in);
+            if (id < r.syncs.size() && r.syncs[id])
+            {
+                glDeleteSync(r.syncs[id]);
+                r.syncs[id] = 0;
+            }
+            break;
+        }
+        case GL_OP_READ_PIXELS:
+        {
+            GLint v[6];
+            for (int i = 0; i < 6; ++i)
+                v[i] = get_i32(in);
+            r.readback.resize(gl_capture_image_bytes(v[2], v[3], 1, v[4], v[5], 4));
+            if (!r.readback.empty())
+                glReadPixels(v[0], v[1], v[2], v[3], v[4], v[5], &r.readback[0]);
+            break;
+        }
+        default:
+            fprintf(stderr, "Replay : unknown command %u\n", op);
+            return false;
+        }
+    }
+    if (in.failed)
+        fprintf(stderr, "Replay : truncated command stream\n");
+    return !in.failed;
+}
+
+static bool read_stream(FILE * file, std::vector<unsigned char> & stream, uint64_t bytes)
+{
+    stream.resize((size_t) bytes);
+    return bytes == 0 || fread(&stream[0], 1, (size_t) bytes, file) == bytes;
+}
+
+bool gl_replay_load(GlReplay & r, const char * path)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening capture %s\n", path);
+        return false;
+    }
+    bool loaded = fread(&r.header, sizeof(r.header), 1, file) == 1
+        && memcmp(r.header.magic, GL_CAPTURE_MAGIC, sizeof(r.header.magic)) == 0
+        && r.header.version == GL_CAPTURE_VERSION;
+    if (!loaded)
+        fprintf(stderr, "Error : %s is not a capture of version %u\n", path, GL_CAPTURE_VERSION);
+    loaded = loaded
+        && read_stream(file, r.resources, r.header.resourcesBytes)
+        && read_stream(file, r.state, r.header.stateBytes)
+        && read_stream(file, r.frame, r.header.frameBytes);
+    fclose(file);
+    return loaded;
+}
+
+bool gl_replay_init(GlReplay & r)
+{
+    r.currentProgram = 0;
+    r.drawFramebuffer = 0;
+    r.readFramebuffer = 0;
+
+    // Stand in for the default framebuffer
+    glGenTextures(2, r.defaultTextures);
+    glBindTexture(GL_TEXTURE_2D, r.defaultTextures[0]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, r.header.width, r.header.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindTexture(GL_TEXTURE_2D, r.defaultTextures[1]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, r.header.width, r.header.height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &r.defaultFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, r.defaultFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, r.defaultTextures[0], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, r.defaultTextures[1], 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Error building the replay framebuffer\n");
+        return false;
+    }
+    return replay_stream(r, r.resources);
+}
+
+bool gl_replay_state(GlReplay & r)
+{
+    return replay_stream(r, r.state);
+}
+
+bool gl_replay_frame(GlReplay & r)
+{
+    return replay_stream(r, r.frame);
+}
+
+void gl_replay_shutdown(GlReplay & r)
+{
+    for (size_t i = 0; i < r.syncs.size(); ++i)
+        if (r.syncs[i])
+            glDeleteSync(r.syncs[i]);
+    for (size_t i = 0; i < r.programs.size(); ++i)
+        if (r.programs[i])
+            glDeleteProgram(r.programs[i]);
+    for (size_t i = 0; i < r.shaders.size(); ++i)
+        if (r.shaders[i])
+            glDeleteShader(r.shaders[i]);
+    for (size_t i = 0; i < r.textures.size(); ++i)
+        if (r.textures[i])
+            glDeleteTextures(1, &r.textures[i]);
+    for (size_t i = 0; i < r.buffers.size(); ++i)
+        if (r.buffers[i])
+            glDeleteBuffers(1, &r.buffers[i]);
+    for (size_t i = 0; i < r.framebuffers.size(); ++i)
+        if (r.framebuffers[i])
+            glDeleteFramebuffers(1, &r.framebuffers[i]);
+    for (size_t i = 0; i < r.vertexArrays.size(); ++i)
+        if (r.vertexArrays[i])
+            glDeleteVertexArrays(1, &r.vertexArrays[i]);
+    for (size_t i = 0; i < r.queries.size(); ++i)
+        if (r.queries[i])
+            glDeleteQueries(1, &r.queries[i]);
+    glDeleteFramebuffers(1, &r.defaultFramebuffer);
+    glDeleteTextures(2, r.defaultTextures);
+    r = GlReplay();
+}
@@ -0,0 +1,58 @@
+#ifndef AOGL_GL_REPLAY_H
+#define AOGL_GL_REPLAY_H
+
+#include <vector>
+
+#include "gl_capture.h"
+
+// Replay of a frame captured by gl_capture, on the current context. Names of
+// the capture are mapped to objects created by the replay, framebuffer 0 to
+// an offscreen framebuffer the size of the captured one
+struct GlReplay
+{
+    GlCaptureHeader header;
+    std::vector<unsigned char> resources;
+    std::vector<unsigned char> state;
+    std::vector<unsigned char> frame;
+
+    // Capture names to replay names
+    std::vector<GLuint> textures;
+    std::vector<GLuint> buffers;
+    std::vector<GLuint> framebuffers;
+    std::vector<GLuint> vertexArrays;
+    std::vector<GLuint> queries;
+    std::vector<GLuint> shaders;
+    std::vector<GLuint> programs;
+    std::vector<GLsync> syncs;
+    // Per capture program, capture uniform locations and subroutine indices to replay ones
+    struct ProgramTables
+    {
+        std::vector<GLint> locations;
+        std::vector<GLuint> subroutines[2];
+    };
+    std::vector<ProgramTables> programTables;
+
+    // Capture names bound, GL_BACK is replayed on the offscreen framebuffer
+    GLuint currentProgram;
+    GLuint drawFramebuffer;
+    GLuint readFramebuffer;
+    GLuint defaultFramebuffer;
+    GLuint defaultTextures[2];
+    std::vector<unsigned char> readback;
+
+    // Of the last stream replayed
+    int commands;
+    int drawCalls;
+    int dispatches;
+};
+
+// Reads a capture file, no context needed
+bool gl_replay_load(GlReplay & r, const char * path);
+// Creates the offscreen framebuffer and the captured objects
+bool gl_replay_init(GlReplay & r);
+// Restores the state the frame began with
+bool gl_replay_state(GlReplay & r);
+bool gl_replay_frame(GlReplay & r);
+void gl_replay_shutdown(GlReplay & r);
+
+#endif
@@ -0,0 +1,120 @@
+#include "image_io.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+static void write_be32(unsigned char * p, unsigned int v)
+{
+    p[0] = (unsigned char) (v >> 24);
+    p[1] = (unsigned char) (v >> 16);
+    p[2] = (unsigned char) (v >> 8);
+    p[3] = (unsigned char) v;
+}
+
+// Built during static initialization, pngs are written from several threads
+struct PngCrcTable
+{
+    unsigned int entries[256];
+    PngCrcTable()
+    {
+        for (unsigned int n = 0; n < 256; ++n)
+        {
+            unsigned int c = n;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+static const PngCrcTable pngCrcTable;
+
+static unsigned int png_crc(const unsigned char * data, size_t size, unsigned int crc)
+{
+    for (size_t i = 0; i < size; ++i)
+        crc = pngCrcTable.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static void write_png_chunk(FILE * file, const char * type, const unsigned char * data, size_t size)
+{
+    unsigned char header[8];
+    write_be32(header, (unsigned int) size);
+    memcpy(header + 4, type, 4);
+    fwrite(header, 1, 8, file);
+    if (size > 0)
+        fwrite(data, 1, size, file);
+    unsigned int crc = png_crc(header + 4, 4, 0xffffffffu);
+    crc = png_crc(data, size, crc) ^ 0xffffffffu;
+    unsigned char footer[4];
+    write_be32(footer, crc);
+    fwrite(footer, 1, 4, file);
+}
+
+bool write_png(const char * path, int width, int height, const unsigned char * rgba)
+{
+    FILE * file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    // Filter type 0 before each row, top row first
+    size_t rowSize = (size_t) width * 4;
+    std::vector<unsigned char> raw((rowSize + 1) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        unsigned char * row = &raw[(rowSize + 1) * y];
+        row[0] = 0;
+        memcpy(row + 1, rgba + rowSize * (height - 1 - y), rowSize);
+    }
+
+    // Zlib stream made of stored deflate blocks
+    std::vector<unsigned char> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t offset = 0;
+    do
+    {
+        size_t blockSize = std::min(raw.size() - offset, (size_t) 65535);
+        bool last = offset + blockSize == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((unsigned char) (blockSize & 0xff));
+        zlib.push_back((unsigned char) (blockSize >> 8));
+        zlib.push_back((unsigned char) (~blockSize & 0xff));
+        zlib.push_back((unsigned char) ((~blockSize >> 8) & 0xff));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < raw.size());
+    // Adler-32, reduced every 5552 bytes, the most that cannot overflow
+    unsigned int a = 1, b = 0;
+    for (size_t start = 0; start < raw.size(); start += 5552)
+    {
+        size_t end = std::min(raw.size(), start + 5552);
+        for (size_t i = start; i < end; ++i)
+        {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    unsigned char adler[4];
+    write_be32(adler, (b << 16) | a);
+    zlib.insert(zlib.end(), adler, adler + 4);
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(signature, 1, 8, file);
+    unsigned char ihdr[13];
+    write_be32(ihdr, width);
+    write_be32(ihdr + 4, height);
+    ihdr[8] = 8; // Bit depth
+    ihdr[9] = 6; // RGBA
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    write_png_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+    write_png_chunk(file, "IDAT", &zlib[0], zlib.size());
+    write_png_chunk(file, "IEND", NULL, 0);
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,7 @@
+#ifndef AOGL_IMAGE_IO_H
+#define AOGL_IMAGE_IO_H
+
+// Uncompressed RGBA png, rows are given bottom up as read back from OpenGL
+bool write_png(const char * path, int width, int height, const unsigned char * rgba);
+
+#endif
@@ -0,0 +1,280 @@
+#include "mesh_lod.h"
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+
+// Symmetric 4x4 error quadric stored as its upper triangle, and the
+// accumulated area it was built from
+struct Quadric
+{
+    double m[10];
+    double weight;
+};
+
+static void quadric_add_plane(Quadric & q, double a, double b, double c, double d, double w)
+{
+    q.m[0] += w*a*a; q.m[1] += w*a*b; q.m[2] += w*a*c; q.m[3] += w*a*d;
+    q.m[4] += w*b*b; q.m[5] += w*b*c; q.m[6] += w*b*d;
+    q.m[7] += w*c*c; q.m[8] += w*c*d;
+    q.m[9] += w*d*d;
+    q.weight += w;
+}
+
+static void quadric_add(Quadric & q, const Quadric & other)
+{
+    for (int i = 0; i < 10; ++i)
+        q.m[i] += other.m[i];
+    q.weight += other.weight;
+}
+
+// Mean distance to the planes of the quadric
+static double quadric_distance(const Quadric & q, const float * p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double e = q.m[0]*x*x + 2*q.m[1]*x*y + 2*q.m[2]*x*z + 2*q.m[3]*x
+             + q.m[4]*y*y + 2*q.m[5]*y*z + 2*q.m[6]*y
+             + q.m[7]*z*z + 2*q.m[8]*z + q.m[9];
+    return q.weight > 0.0 ? sqrt(std::max(e, 0.0) / q.weight) : 0.0;
+}
+
+static glm::vec3 triangle_normal(const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c)
+{
+    return glm::cross(b - a, c - a);
+}
+
+int simplify_mesh(const float * positions, int vertexCount, const GLuint * indices, int indexCount, int targetIndexCount, GLuint * destination, float * error)
+{
+    std::vector<GLuint> result(indices, indices + indexCount);
+    const glm::vec3 * p = (const glm::vec3 *) positions;
+    *error = 0.f;
+
+    // Vertices sharing a position with another vertex sit on an attribute
+    // seam, moving them would tear the mesh apart
+    std::vector<bool> locked(vertexCount, false);
+    std::vector<GLuint> order(vertexCount);
+    for (int i = 0; i < vertexCount; ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [p](GLuint a, GLuint b) {
+        if (p[a].x != p[b].x) return p[a].x < p[b].x;
+        if (p[a].y != p[b].y) return p[a].y < p[b].y;
+        return p[a].z < p[b].z;
+    });
+    for (int i = 1; i < vertexCount; ++i)
+    {
+        if (p[order[i]] == p[order[i-1]])
+            locked[order[i]] = locked[order[i-1]] = true;
+    }
+
+    // Border edges are used by a single triangle, their vertices are locked
+    std::vector<unsigned long long> edges;
+    edges.reserve(indexCount);
+    for (int i = 0; i < indexCount; i += 3)
+    {
+        for (int e = 0; e < 3; ++e)
+        {
+            unsigned long long a = result[i+e], b = result[i+(e+1)%3];
+            edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); )
+    {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j] == edges[i])
+            ++j;
+        if (j - i == 1)
+            locked[edges[i] >> 32] = locked[edges[i] & 0xffffffffull] = true;
+        i = j;
+    }
+
+    // Area weighted plane quadrics of the triangles around each vertex
+    std::vector<Quadric> quadrics(vertexCount);
+    memset(&quadrics[0], 0, vertexCount * sizeof(Quadric));
+    for (int i = 0; i < indexCount; i += 3)
+    {
+        glm::vec3 n = triangle_normal(p[result[i]], p[result[i+1]], p[result[i+2]]);
+        float area = glm::length(n);
+        if (area <= 0.f)
+            continue;
+        n /= area;
+        double d = -glm::dot(n, p[result[i]]);
+        for (int k = 0; k < 3; ++k)
+            quadric_add_plane(quadrics[result[i+k]], n.x, n.y, n.z, d, area * 0.5);
+    }
+
+    struct Collapse
+    {
+        GLuint from;
+        GLuint to;
+        double cost;
+        bool operator<(const Collapse & other) const { return cost < other.cost; }
+    };
+    std::vector<Collapse> collapses;
+    std::vector<GLuint> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<GLuint> adjacencyOffsets(vertexCount + 1);
+    std::vector<GLuint> adjacency;
+
+    // Greedy passes of independent collapses, cheapest first
+    while ((int) result.size() > targetIndexCount)
+    {
+        int triangleCount = (int) result.size() / 3;
+
+        collapses.clear();
+        for (int i = 0; i < (int) result.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                GLuint a = result[i+e], b = result[i+(e+1)%3];
+                Quadric q = quadrics[a];
+                quadric_add(q, quadrics[b]);
+                if (!locked[a])
+                {
+                    Collapse c = { a, b, quadric_distance(q, &p[b].x) };
+                    collapses.push_back(c);
+                }
+                if (!locked[b])
+                {
+                    Collapse c = { b, a, quadric_distance(q, &p[a].x) };
+                    collapses.push_back(c);
+                }
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end());
+
+        // Triangles around each vertex
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (size_t i = 0; i < result.size(); ++i)
+            ++adjacencyOffsets[result[i] + 1];
+        for (int i = 0; i < vertexCount; ++i)
+            adjacencyOffsets[i+1] += adjacencyOffsets[i];
+        adjacency.resize(result.size());
+        std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i)
+            adjacency[fill[result[i]]++] = (GLuint) (i / 3);
+
+        for (int i = 0; i < vertexCount; ++i)
+            remap[i] = i;
+        std::fill(touched.begin(), touched.end(), false);
+        int removable = triangleCount - targetIndexCount / 3;
+        int removed = 0;
+        for (size_t c = 0; c < collapses.size() && removed < removable; ++c)
+        {
+            GLuint from = collapses[c].from, to = collapses[c].to;
+            if (touched[from] || touched[to])
+                continue;
+
+            // Reject collapses flipping a triangle around the moving vertex
+            bool flips = false;
+            int shared = 0;
+            for (GLuint k = adjacencyOffsets[from]; k < adjacencyOffsets[from+1] && !flips; ++k)
+            {
+                const GLuint * t = &result[adjacency[k] * 3];
+                if (t[0] == to || t[1] == to || t[2] == to)
+                {
+                    ++shared;
+                    continue;
+                }
+                glm::vec3 moved[3];
+                for (int v = 0; v < 3; ++v)
+                    moved[v] = p[t[v] == from ? to : t[v]];
+                glm::vec3 before = triangle_normal(p[t[0]], p[t[1]], p[t[2]]);
+                glm::vec3 after = triangle_normal(moved[0], moved[1], moved[2]);
+                flips = glm::dot(before, after) <= 0.f;
+            }
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            quadric_add(quadrics[to], quadrics[from]);
+            *error = std::max(*error, (float) collapses[c].cost);
+            removed += shared;
+            for (GLuint k = adjacencyOffsets[from]; k < adjacencyOffsets[from+1]; ++k)
+            {
+                const GLuint * t = &result[adjacency[k] * 3];
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = true;
+            }
+        }
+        if (removed == 0)
+            break;
+
+        // Apply the collapses and drop the degenerate triangles
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            GLuint a = remap[result[i]], b = remap[result[i+1]], c = remap[result[i+2]];
+            if (a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    std::copy(result.begin(), result.end(), destination);
+    return (int) result.size();
+}
+
+void mesh_bounds(const float * positions, int vertexCount, glm::vec3 & center, float & radius)
+{
+    glm::vec3 minimum(0.f), maximum(0.f);
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        glm::vec3 v(positions[i*3], positions[i*3+1], positions[i*3+2]);
+        minimum = i == 0 ? v : glm::min(minimum, v);
+        maximum = i == 0 ? v : glm::max(maximum, v);
+    }
+    center = (minimum + maximum) * 0.5f;
+    radius = glm::length(maximum - minimum) * 0.5f;
+}
+
+void mesh_lod_build(MeshLod & lod, const float * positions, int vertexCount, const GLuint * indices, int indexCount, std::vector<GLuint> & lodIndices)
+{
+    mesh_bounds(positions, vertexCount, lod.center, lod.radius);
+    lod.current = 0;
+
+    lodIndices.assign(indices, indices + indexCount);
+    lod.lodCount = 1;
+    lod.indexOffset[0] = 0;
+    lod.indexCount[0] = indexCount;
+    lod.error[0] = 0.f;
+
+    // Each level halves the triangle count of the full mesh, small meshes
+    // and meshes that cannot be reduced further keep fewer levels
+    const int MIN_LOD_INDEX_COUNT = 64 * 3;
+    std::vector<GLuint> simplified(indexCount);
+    while (lod.lodCount < MeshLod::MAX_LODS)
+    {
+        int previousCount = lod.indexCount[lod.lodCount-1];
+        int target = (indexCount >> lod.lodCount) / 3 * 3;
+        if (target < MIN_LOD_INDEX_COUNT)
+            break;
+        float error;
+        int count = simplify_mesh(positions, vertexCount, indices, indexCount, target, &simplified[0], &error);
+        if (count > previousCount * 3 / 4)
+            break;
+        lod.indexOffset[lod.lodCount] = (GLuint) lodIndices.size();
+        lod.indexCount[lod.lodCount] = count;
+        lod.error[lod.lodCount] = std::max(error, lod.error[lod.lodCount-1]);
+        lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.begin() + count);
+        ++lod.lodCount;
+    }
+}
+
+int mesh_lod_select(MeshLod & lod, float pixelsPerUnit, float threshold)
+{
+    // Refine as soon as the error is visible, coarsen only once the coarser
+    // level is well below the threshold so levels do not flicker
+    const float hysteresis = 0.75f;
+    while (lod.current > 0 && lod.error[lod.current] * pixelsPerUnit > threshold)
+        --lod.current;
+    while (lod.current + 1 < lod.lodCount && lod.error[lod.current+1] * pixelsPerUnit < threshold * hysteresis)
+        ++lod.current;
+    return lod.current;
+}
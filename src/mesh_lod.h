@@ -0,0 +1,30 @@
+#ifndef AOGL_MESH_LOD_H
+#define AOGL_MESH_LOD_H
+
+#include <vector>
+
+#include "glew/glew.h"
+#include "glm/vec3.hpp"
+
+// Levels of detail of an imported mesh, finest first. Every level indexes the
+// mesh vertex buffer, the index ranges are packed in one index buffer
+struct MeshLod
+{
+    static const int MAX_LODS = 4;
+    int lodCount;
+    GLuint indexOffset[MAX_LODS];
+    GLuint indexCount[MAX_LODS];
+    // Object space geometric error of each level
+    float error[MAX_LODS];
+    // Object space bounding sphere
+    glm::vec3 center;
+    float radius;
+    int current;
+};
+int simplify_mesh(const float * positions, int vertexCount, const GLuint * indices, int indexCount, int targetIndexCount, GLuint * destination, float * error);
+// Sphere around the bounding box, as stored in MeshLod
+void mesh_bounds(const float * positions, int vertexCount, glm::vec3 & center, float & radius);
+void mesh_lod_build(MeshLod & lod, const float * positions, int vertexCount, const GLuint * indices, int indexCount, std::vector<GLuint> & lodIndices);
+int mesh_lod_select(MeshLod & lod, float pixelsPerUnit, float threshold);
+
+#endif
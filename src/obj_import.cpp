@@ -0,0 +1,776 @@
+#include "obj_import.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "profiler.h"
+
+struct MappedFile
+{
+    const char * data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+static bool map_file(const char * path, MappedFile & f)
+{
+    f.data = NULL;
+    f.size = 0;
+#if defined(_WIN32)
+    f.mapping = NULL;
+    f.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (f.file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(f.file, &size);
+    f.size = (size_t) size.QuadPart;
+    if (f.size == 0)
+        return true;
+    f.mapping = CreateFileMappingA(f.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (f.mapping)
+        f.data = (const char *) MapViewOfFile(f.mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!f.data)
+    {
+        if (f.mapping)
+            CloseHandle(f.mapping);
+        CloseHandle(f.file);
+        return false;
+    }
+#else
+    f.fd = open(path, O_RDONLY);
+    if (f.fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(f.fd, &st) != 0)
+    {
+        close(f.fd);
+        return false;
+    }
+    f.size = (size_t) st.st_size;
+    if (f.size == 0)
+        return true;
+    void * data = mmap(NULL, f.size, PROT_READ, MAP_PRIVATE, f.fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(f.fd);
+        return false;
+    }
+    // Read front to back by each chunk
+    madvise(data, f.size, MADV_SEQUENTIAL);
+    f.data = (const char *) data;
+#endif
+    return true;
+}
+
+static void unmap_file(MappedFile & f)
+{
+#if defined(_WIN32)
+    if (f.data)
+        UnmapViewOfFile(f.data);
+    if (f.mapping)
+        CloseHandle(f.mapping);
+    CloseHandle(f.file);
+#else
+    if (f.data)
+        munmap((void *) f.data, f.size);
+    close(f.fd);
+#endif
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_digit(char c)
+{
+    return (unsigned char) (c - '0') < 10;
+}
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// SWAR digit parsing : 8 ASCII characters are loaded in one little endian
+// 64 bit word, checked and converted with three multiplies
+static inline uint64_t load_eight(const char * p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline bool is_eight_digits(uint64_t v)
+{
+    return (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull);
+}
+
+static inline uint32_t parse_eight_digits(uint64_t v)
+{
+    v = ((v & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+    v = ((v & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+    return (uint32_t) (((v & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32);
+}
+
+// Appends the digits at p to the mantissa, false when it would not fit the
+// 19 digits the fast path handles
+static inline bool parse_digits(const char *& p, const char * end, uint64_t & mantissa, int & digits)
+{
+    while (end - p >= 8 && digits <= 11)
+    {
+        uint64_t v = load_eight(p);
+        if (!is_eight_digits(v))
+            break;
+        mantissa = mantissa * 100000000 + parse_eight_digits(v);
+        digits += 8;
+        p += 8;
+    }
+    while (p < end && is_digit(*p))
+    {
+        if (digits >= 19)
+            return false;
+        mantissa = mantissa * 10 + (*p - '0');
+        // Leading zeros do not use the mantissa range
+        digits += mantissa != 0;
+        ++p;
+    }
+    return true;
+}
+
+// Rare numbers (long mantissas, large exponents) go through strtod on a
+// terminated copy since the mapping is not
+static const char * parse_float_slow(const char * start, const char * end, float & value)
+{
+    char buffer[128];
+    size_t n = 0;
+    while (start + n < end && n < sizeof(buffer) - 1 && !is_blank(start[n]) && start[n] != '\n' && start[n] != '/')
+    {
+        buffer[n] = start[n];
+        ++n;
+    }
+    buffer[n] = 0;
+    char * stop;
+    value = (float) strtod(buffer, &stop);
+    return start + (stop - buffer);
+}
+
+static inline const char * skip_blanks(const char * p, const char * end)
+{
+    while (p < end && is_blank(*p))
+        ++p;
+    return p;
+}
+
+static inline const char * next_line(const char * p, const char * end)
+{
+    if (p >= end)
+        return end;
+    const char * eol = (const char *) memchr(p, '\n', end - p);
+    return eol ? eol + 1 : end;
+}
+
+// Index as written in the file : 1 based, negative when relative to the
+// current end of the stream, 0 when missing
+static inline const char * parse_index(const char * p, const char * end, int & index)
+{
+    bool negative = p < end && *p == '-';
+    if (negative)
+        ++p;
+    int i = 0;
+    while (p < end && is_digit(*p))
+        i = i * 10 + (*p++ - '0');
+    index = negative ? -i : i;
+    return p;
+}
+
+// Face corner indices. A value >= 0 is an absolute 0 based index, INT_MIN
+// is missing, other negative values are i - RELATIVE_BIAS with i relative to
+// the chunk start (negative when it points before the chunk) : chunks do
+// not know how many elements come before them until the merge
+struct Corner
+{
+    int v;
+    int vt;
+    int vn;
+};
+
+static const int ENCODED_NONE = INT_MIN;
+static const int RELATIVE_BIAS = 1 << 30;
+
+static inline int encode_index(int index, size_t chunkCount)
+{
+    if (index > 0)
+        return index - 1;
+    if (index < 0)
+        return (int) chunkCount + index - RELATIVE_BIAS;
+    return ENCODED_NONE;
+}
+
+// Faces using one material. The first run of a chunk uses the material
+// active at the end of the previous chunk unless it starts with usemtl
+struct Run
+{
+    std::string material;
+    bool inherit;
+    std::vector<Corner> corners;
+};
+
+struct Chunk
+{
+    const char * begin;
+    const char * end;
+    std::vector<float> v;
+    std::vector<float> vt;
+    std::vector<float> vn;
+    std::vector<Run> runs;
+    std::vector<std::string> mtllibs;
+    size_t vOffset;
+    size_t vtOffset;
+    size_t vnOffset;
+};
+
+static std::string line_rest(const char * p, const char * end)
+{
+    p = skip_blanks(p, end);
+    const char * eol = p < end ? (const char *) memchr(p, '\n', end - p) : NULL;
+    const char * last = eol ? eol : end;
+    while (last > p && is_blank(last[-1]))
+        --last;
+    return std::string(p, last);
+}
+
+static inline bool keyword(const char * p, const char * end, const char * word, size_t length)
+{
+    return (size_t) (end - p) > length && !memcmp(p, word, length) && is_blank(p[length]);
+}
+
+static void parse_chunk(Chunk & c)
+{
+    PROFILE_ZONE("obj parse chunk");
+    const char * p = c.begin;
+    const char * end = c.end;
+    Run first;
+    first.inherit = true;
+    c.runs.push_back(first);
+    std::vector<Corner> polygon;
+    while (p < end)
+    {
+        p = skip_blanks(p, end);
+        if (p + 1 < end && p[0] == 'v')
+        {
+            std::vector<float> * stream = NULL;
+            int components = 3;
+            const char * q = p + 1;
+            if (is_blank(p[1]))
+                stream = &c.v;
+            else if (p[1] == 't' && p + 2 < end && is_blank(p[2]))
+            {
+                stream = &c.vt;
+                components = 2;
+                ++q;
+            }
+            else if (p[1] == 'n' && p + 2 < end && is_blank(p[2]))
+            {
+                stream = &c.vn;
+                ++q;
+            }
+            if (stream)
+            {
+                for (int k = 0; k < components; ++k)
+                {
+                    float f = 0.f;
+                    q = obj_parse_float(skip_blanks(q, end), end, f);
+                    stream->push_back(f);
+                }
+            }
+        }
+        else if (p + 1 < end && p[0] == 'f' && is_blank(p[1]))
+        {
+            polygon.clear();
+            const char * q = p + 1;
+            for (;;)
+            {
+                q = skip_blanks(q, end);
+                if (q >= end || !(is_digit(*q) || *q == '-'))
+                    break;
+                int v = 0, vt = 0, vn = 0;
+                q = parse_index(q, end, v);
+                if (q < end && *q == '/')
+                {
+                    ++q;
+                    if (q < end && *q != '/')
+                        q = parse_index(q, end, vt);
+                    if (q < end && *q == '/')
+                        q = parse_index(q + 1, end, vn);
+                }
+                Corner corner = { encode_index(v, c.v.size() / 3), encode_index(vt, c.vt.size() / 2), encode_index(vn, c.vn.size() / 3) };
+                polygon.push_back(corner);
+            }
+            // Triangle fan
+            std::vector<Corner> & corners = c.runs.back().corners;
+            for (size_t k = 2; k < polygon.size(); ++k)
+            {
+                corners.push_back(polygon[0]);
+                corners.push_back(polygon[k - 1]);
+                corners.push_back(polygon[k]);
+            }
+        }
+        else if (keyword(p, end, "usemtl", 6))
+        {
+            Run run;
+            run.material = line_rest(p + 6, end);
+            run.inherit = false;
+            if (c.runs.back().corners.empty())
+                c.runs.back() = run;
+            else
+                c.runs.push_back(run);
+        }
+        else if (keyword(p, end, "mtllib", 6))
+            c.mtllibs.push_back(line_rest(p + 6, end));
+        p = next_line(p, end);
+    }
+}
+
+static inline uint32_t corner_hash(const Corner & c)
+{
+    uint64_t h = (uint64_t) (uint32_t) c.v * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t) (uint32_t) c.vt * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+    h ^= (uint64_t) (uint32_t) c.vn * 0x165667B19E3779F9ull + (h >> 32);
+    return (uint32_t) (h ^ (h >> 32));
+}
+
+// Open addressing corner to vertex table, linear probing, never more than
+// half full
+struct WeldTable
+{
+    std::vector<Corner> keys;
+    std::vector<GLuint> vertices;
+    uint32_t mask;
+
+    explicit WeldTable(size_t count)
+    {
+        size_t capacity = 16;
+        while (capacity < count * 2)
+            capacity *= 2;
+        keys.resize(capacity);
+        vertices.assign(capacity, ~0u);
+        mask = (uint32_t) capacity - 1;
+    }
+
+    // Vertex of the corner, next when it is new
+    GLuint insert(const Corner & c, GLuint next, bool & inserted)
+    {
+        for (uint32_t slot = corner_hash(c) & mask;; slot = (slot + 1) & mask)
+        {
+            if (vertices[slot] == ~0u)
+            {
+                keys[slot] = c;
+                vertices[slot] = next;
+                inserted = true;
+                return next;
+            }
+            const Corner & k = keys[slot];
+            if (k.v == c.v && k.vt == c.vt && k.vn == c.vn)
+            {
+                inserted = false;
+                return vertices[slot];
+            }
+        }
+    }
+};
+
+// Index in the merged streams, INDEX_NONE when missing, INDEX_INVALID when
+// out of range
+static const int INDEX_NONE = -1;
+static const int INDEX_INVALID = -2;
+
+static inline int resolve_index(int index, size_t offset, size_t count)
+{
+    if (index == ENCODED_NONE)
+        return INDEX_NONE;
+    long long i = index >= 0 ? index : (long long) offset + index + RELATIVE_BIAS;
+    return i >= 0 && i < (long long) count ? (int) i : INDEX_INVALID;
+}
+
+struct MeshSource
+{
+    const Chunk * chunk;
+    const Run * run;
+};
+
+// Welds the corners of every run using a material into one indexed mesh
+static void build_mesh(const std::vector<MeshSource> & sources, const std::vector<float> & v, const std::vector<float> & vt, const std::vector<float> & vn, SceneMesh & mesh)
+{
+    PROFILE_ZONE("obj weld mesh");
+    size_t cornerCount = 0;
+    for (size_t i = 0; i < sources.size(); ++i)
+        cornerCount += sources[i].run->corners.size();
+    WeldTable welded(cornerCount);
+    mesh.indices.reserve(cornerCount);
+    std::vector<unsigned char> missingNormal;
+    bool anyMissingNormal = false;
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        const Chunk & c = *sources[i].chunk;
+        const std::vector<Corner> & corners = sources[i].run->corners;
+        for (size_t k = 0; k + 2 < corners.size(); k += 3)
+        {
+            Corner resolved[3];
+            bool valid = true;
+            for (int j = 0; j < 3; ++j)
+            {
+                resolved[j].v = resolve_index(corners[k + j].v, c.vOffset, v.size() / 3);
+                resolved[j].vt = resolve_index(corners[k + j].vt, c.vtOffset, vt.size() / 2);
+                resolved[j].vn = resolve_index(corners[k + j].vn, c.vnOffset, vn.size() / 3);
+                valid = valid && resolved[j].v >= 0 && resolved[j].vt != INDEX_INVALID && resolved[j].vn != INDEX_INVALID;
+            }
+            // Out of range references drop the triangle
+            if (!valid)
+                continue;
+            for (int j = 0; j < 3; ++j)
+            {
+                bool inserted;
+                GLuint vertex = welded.insert(resolved[j], (GLuint) (mesh.positions.size() / 3), inserted);
+                if (inserted)
+                {
+                    const Corner & r = resolved[j];
+                    mesh.positions.insert(mesh.positions.end(), &v[r.v * 3], &v[r.v * 3] + 3);
+                    if (r.vt >= 0)
+                        mesh.uvs.insert(mesh.uvs.end(), &vt[r.vt * 2], &vt[r.vt * 2] + 2);
+                    else
+                        mesh.uvs.resize(mesh.uvs.size() + 2, 0.f);
+                    if (r.vn >= 0)
+                        mesh.normals.insert(mesh.normals.end(), &vn[r.vn * 3], &vn[r.vn * 3] + 3);
+                    else
+                        mesh.normals.resize(mesh.normals.size() + 3, 0.f);
+                    missingNormal.push_back(r.vn < 0);
+                    anyMissingNormal = anyMissingNormal || r.vn < 0;
+                }
+                mesh.indices.push_back(vertex);
+            }
+        }
+    }
+
+    if (!anyMissingNormal)
+        return;
+    // Area weighted face normals accumulated on the vertices without one,
+    // corners sharing a position and no normal were welded together
+    for (size_t k = 0; k < mesh.indices.size(); k += 3)
+    {
+        const float * a = &mesh.positions[mesh.indices[k] * 3];
+        const float * b = &mesh.positions[mesh.indices[k + 1] * 3];
+        const float * c = &mesh.positions[mesh.indices[k + 2] * 3];
+        float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+        for (int j = 0; j < 3; ++j)
+        {
+            GLuint vertex = mesh.indices[k + j];
+            if (!missingNormal[vertex])
+                continue;
+            mesh.normals[vertex * 3] += n[0];
+            mesh.normals[vertex * 3 + 1] += n[1];
+            mesh.normals[vertex * 3 + 2] += n[2];
+        }
+    }
+    for (size_t i = 0; i < missingNormal.size(); ++i)
+    {
+        if (!missingNormal[i])
+            continue;
+        float * n = &mesh.normals[i * 3];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.f)
+        {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+    }
+}
+
+// Materials of an MTL file, only what the renderer uses
+static void parse_mtl(const char * path, const std::vector<std::string> & names, std::vector<SceneMaterial> & materials)
+{
+    PROFILE_ZONE("obj parse mtl");
+    MappedFile f;
+    if (!map_file(path, f))
+    {
+        fprintf(stderr, "Warning: cannot open material library %s\n", path);
+        return;
+    }
+    const char * p = f.data;
+    const char * end = f.data + f.size;
+    SceneMaterial * current = NULL;
+    while (p < end)
+    {
+        p = skip_blanks(p, end);
+        if (keyword(p, end, "newmtl", 6))
+        {
+            std::string name = line_rest(p + 6, end);
+            std::vector<std::string>::const_iterator it = std::find(names.begin(), names.end(), name);
+            current = it != names.end() ? &materials[it - names.begin()] : NULL;
+        }
+        else if (current && keyword(p, end, "Kd", 2))
+        {
+            const char * q = p + 2;
+            for (int k = 0; k < 3; ++k)
+                q = obj_parse_float(skip_blanks(q, end), end, current->diffuse[k]);
+        }
+        else if (current && keyword(p, end, "map_Kd", 6))
+        {
+            // Options come first, the file name is what remains
+            std::string texture = line_rest(p + 6, end);
+            if (!texture.empty() && texture[0] == '-')
+            {
+                size_t pos = texture.find_last_of(" \t");
+                texture = pos == std::string::npos ? std::string() : texture.substr(pos + 1);
+            }
+            current->diffuseTexture = texture;
+        }
+        p = next_line(p, end);
+    }
+    unmap_file(f);
+}
+
+bool obj_is_obj_path(const char * path)
+{
+    size_t length = strlen(path);
+    return length > 4 && path[length - 4] == '.' && tolower(path[length - 3]) == 'o' && tolower(path[length - 2]) == 'b' && tolower(path[length - 1]) == 'j';
+}
+
+const char * obj_parse_float(const char * p, const char * end, float & value)
+{
+    const char * start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    const char * integer = p;
+    if (!parse_digits(p, end, mantissa, digits))
+        return parse_float_slow(start, end, value);
+    bool any = p > integer;
+    if (p < end && *p == '.')
+    {
+        const char * fraction = ++p;
+        if (!parse_digits(p, end, mantissa, digits))
+            return parse_float_slow(start, end, value);
+        exponent -= (int) (p - fraction);
+        any = any || p > fraction;
+    }
+    if (!any)
+        return start;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char * q = p + 1;
+        bool negativeExponent = q < end && *q == '-';
+        if (q < end && (*q == '-' || *q == '+'))
+            ++q;
+        if (q < end && is_digit(*q))
+        {
+            int e = 0;
+            while (q < end && is_digit(*q))
+            {
+                e = std::min(e * 10 + (*q - '0'), 10000);
+                ++q;
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+    if (exponent < -22 || exponent > 22)
+        return parse_float_slow(start, end, value);
+    double d = (double) mantissa;
+    d = exponent < 0 ? d / POW10[-exponent] : d * POW10[exponent];
+    value = (float) (negative ? -d : d);
+    return p;
+}
+
+bool obj_import(const char * path, SceneData & data, ObjImportStats * stats)
+{
+    PROFILE_ZONE("obj import");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    MappedFile file;
+    if (!map_file(path, file))
+        return false;
+
+    // Line aligned chunks, at least a megabyte each
+    const size_t MIN_CHUNK_BYTES = 1 << 20;
+    int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    int chunkCount = (int) std::max<size_t>(1, std::min<size_t>(threads, file.size / MIN_CHUNK_BYTES));
+    std::vector<Chunk> chunks(chunkCount);
+    const char * end = file.data + file.size;
+    const char * p = file.data;
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].begin = p;
+        const char * split = file.data + file.size * (i + 1) / chunkCount;
+        chunks[i].end = i + 1 == chunkCount ? end : std::max(p, next_line(split, end));
+        p = chunks[i].end;
+    }
+    std::vector<std::thread> workers;
+    for (int i = 1; i < chunkCount; ++i)
+    {
+        workers.push_back(std::thread([](Chunk * c)
+        {
+            PROFILE_THREAD("obj parse");
+            parse_chunk(*c);
+        }, &chunks[i]));
+    }
+    parse_chunk(chunks[0]);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    workers.clear();
+    double parseMs = elapsed_ms(start);
+
+    // Streams of all the chunks end to end
+    std::chrono::steady_clock::time_point mergeStart = std::chrono::steady_clock::now();
+    PROFILE_PHASE_BEGIN(mergeZone, "obj merge");
+    std::vector<float> v, vt, vn;
+    size_t vCount = 0, vtCount = 0, vnCount = 0;
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].vOffset = vCount;
+        chunks[i].vtOffset = vtCount;
+        chunks[i].vnOffset = vnCount;
+        vCount += chunks[i].v.size() / 3;
+        vtCount += chunks[i].vt.size() / 2;
+        vnCount += chunks[i].vn.size() / 3;
+    }
+    v.reserve(vCount * 3);
+    vt.reserve(vtCount * 2);
+    vn.reserve(vnCount * 3);
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        v.insert(v.end(), chunks[i].v.begin(), chunks[i].v.end());
+        vt.insert(vt.end(), chunks[i].vt.begin(), chunks[i].vt.end());
+        vn.insert(vn.end(), chunks[i].vn.begin(), chunks[i].vn.end());
+        std::vector<float>().swap(chunks[i].v);
+        std::vector<float>().swap(chunks[i].vt);
+        std::vector<float>().swap(chunks[i].vn);
+    }
+
+    // Materials in order of first use, faces before any usemtl use the default one
+    std::vector<std::string> names;
+    std::vector<std::vector<MeshSource> > sources;
+    std::string current;
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        for (size_t r = 0; r < chunks[i].runs.size(); ++r)
+        {
+            Run & run = chunks[i].runs[r];
+            if (!run.inherit)
+                current = run.material;
+            if (run.corners.empty())
+                continue;
+            size_t m = std::find(names.begin(), names.end(), current) - names.begin();
+            if (m == names.size())
+            {
+                names.push_back(current);
+                sources.push_back(std::vector<MeshSource>());
+            }
+            MeshSource source = { &chunks[i], &run };
+            sources[m].push_back(source);
+        }
+    }
+
+    // One welded mesh per material, materials are spread over the threads
+    data.meshes.clear();
+    data.meshes.resize(names.size());
+    std::atomic<int> next(0);
+    auto build = [&]()
+    {
+        PROFILE_THREAD("obj weld");
+        for (int m = next++; m < (int) names.size(); m = next++)
+        {
+            build_mesh(sources[m], v, vt, vn, data.meshes[m]);
+            data.meshes[m].material = m;
+            data.meshes[m].source = -1;
+        }
+    };
+    for (int i = 1; i < std::min(threads, (int) names.size()); ++i)
+        workers.push_back(std::thread(build));
+    build();
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    // Materials whose faces all referenced missing elements
+    size_t kept = 0;
+    for (size_t m = 0; m < data.meshes.size(); ++m)
+    {
+        if (data.meshes[m].indices.empty())
+            continue;
+        if (kept != m)
+            std::swap(data.meshes[kept], data.meshes[m]);
+        ++kept;
+    }
+    data.meshes.resize(kept);
+    double mergeMs = elapsed_ms(mergeStart);
+    PROFILE_PHASE_END(mergeZone);
+
+    // Material libraries are relative to the OBJ file
+    std::chrono::steady_clock::time_point mtlStart = std::chrono::steady_clock::now();
+    std::vector<std::string> mtllibs;
+    for (int i = 0; i < chunkCount; ++i)
+        mtllibs.insert(mtllibs.end(), chunks[i].mtllibs.begin(), chunks[i].mtllibs.end());
+    SceneMaterial defaultMaterial;
+    defaultMaterial.diffuse[0] = SCENE_DEFAULT_DIFFUSE[0];
+    defaultMaterial.diffuse[1] = SCENE_DEFAULT_DIFFUSE[1];
+    defaultMaterial.diffuse[2] = SCENE_DEFAULT_DIFFUSE[2];
+    data.materials.assign(names.size(), defaultMaterial);
+    std::string directory = path;
+    size_t slash = directory.find_last_of("\\/");
+    directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+    for (size_t i = 0; i < mtllibs.size(); ++i)
+        parse_mtl((directory + mtllibs[i]).c_str(), names, data.materials);
+    double mtlMs = elapsed_ms(mtlStart);
+
+    unmap_file(file);
+    if (stats)
+    {
+        stats->threads = chunkCount;
+        stats->fileBytes = file.size;
+        stats->parseMs = parseMs;
+        stats->mergeMs = mergeMs;
+        stats->mtlMs = mtlMs;
+        stats->totalMs = elapsed_ms(start);
+    }
+    return true;
+}
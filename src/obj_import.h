@@ -0,0 +1,30 @@
+#ifndef AOGL_OBJ_IMPORT_H
+#define AOGL_OBJ_IMPORT_H
+
+#include <stddef.h>
+
+#include "scene.h"
+
+// Native Wavefront OBJ/MTL importer. The file is memory mapped, split into
+// line aligned chunks parsed on all cores, then merged into one mesh per
+// material with the (position, uv, normal) triplets welded.
+// Smooth normals are generated for faces without any.
+
+struct ObjImportStats
+{
+    int threads;
+    size_t fileBytes;
+    double parseMs;     // chunks, in parallel
+    double mergeMs;     // streams, materials and welded meshes
+    double mtlMs;
+    double totalMs;
+};
+
+// True for paths ending in .obj, whatever the case
+bool obj_is_obj_path(const char * path);
+// Returns false when the file cannot be read, stats may be NULL
+bool obj_import(const char * path, SceneData & data, ObjImportStats * stats);
+// Parses a float at p, returns the character after it or p when there is no number
+const char * obj_parse_float(const char * p, const char * end, float & value);
+
+#endif
@@ -0,0 +1,260 @@
+#include "profiler.h"
+
+#ifdef AOGL_PROFILE
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+std::atomic<bool> profilerRecording(false);
+std::atomic<uint32_t> profilerGeneration(0);
+thread_local ProfileThreadBuffer * profilerThreadBuffer = NULL;
+
+struct GpuEvent
+{
+    const char * name;
+    int64_t begin;
+    int64_t end;
+};
+
+struct Profiler
+{
+    // Buffers live until exit, the threads they belong to may not
+    std::mutex mutex;
+    std::vector<ProfileThreadBuffer *> buffers;
+    std::vector<const char *> zoneNames;
+    bool open;
+    uint64_t beginTicks;
+    uint64_t endTicks;
+    // First capture, the conversion from ticks to time is measured from there
+    bool clockBaseValid;
+    uint64_t clockBaseTicks;
+    std::chrono::steady_clock::time_point clockBaseTime;
+    int64_t gpuCalibrationNs;
+    uint64_t gpuCalibrationTicks;
+    bool gpuCalibrated;
+    std::vector<GpuEvent> gpuEvents;
+};
+
+static Profiler & profiler()
+{
+    static Profiler p;
+    return p;
+}
+
+// Releases the buffer of the thread when it exits
+struct ThreadBufferOwner
+{
+    ProfileThreadBuffer * buffer;
+    ~ThreadBufferOwner()
+    {
+        if (buffer)
+            buffer->released.store(true, std::memory_order_release);
+    }
+};
+
+static thread_local ThreadBufferOwner threadBufferOwner = { NULL };
+
+static void write_json_string(FILE * file, const char * s)
+{
+    fputc('"', file);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', file);
+        if ((unsigned char) *s >= 0x20)
+            fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+uint32_t profiler_zone(const char * name)
+{
+    Profiler & p = profiler();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.zoneNames.push_back(name);
+    return (uint32_t) p.zoneNames.size() - 1;
+}
+
+ProfileThreadBuffer * profiler_thread_buffer()
+{
+    Profiler & p = profiler();
+    uint32_t generation = profilerGeneration.load(std::memory_order_relaxed);
+    ProfileThreadBuffer * b = profilerThreadBuffer;
+    if (b)
+    {
+        // First event of a new capture
+        if (b->generation.load(std::memory_order_relaxed) != generation)
+        {
+            b->count.store(0, std::memory_order_relaxed);
+            b->dropped.store(0, std::memory_order_relaxed);
+            b->generation.store(generation, std::memory_order_release);
+        }
+        return b;
+    }
+    std::lock_guard<std::mutex> lock(p.mutex);
+    for (size_t i = 0; i < p.buffers.size() && !b; ++i)
+    {
+        if (p.buffers[i]->released.load(std::memory_order_acquire) && p.buffers[i]->generation.load(std::memory_order_relaxed) != generation)
+            b = p.buffers[i];
+    }
+    if (!b)
+    {
+        b = new ProfileThreadBuffer;
+        b->tid = (int) p.buffers.size() + 1;
+        p.buffers.push_back(b);
+    }
+    snprintf(b->name, sizeof(b->name), "thread %d", b->tid);
+    b->released.store(false, std::memory_order_relaxed);
+    b->count.store(0, std::memory_order_relaxed);
+    b->dropped.store(0, std::memory_order_relaxed);
+    b->generation.store(generation, std::memory_order_relaxed);
+    threadBufferOwner.buffer = b;
+    profilerThreadBuffer = b;
+    return b;
+}
+
+void profiler_thread_name(const char * name)
+{
+    ProfileThreadBuffer * b = profilerThreadBuffer ? profilerThreadBuffer : profiler_thread_buffer();
+    std::lock_guard<std::mutex> lock(profiler().mutex);
+    snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+void profiler_gpu_calibrate(int64_t gpuTimeNs)
+{
+    Profiler & p = profiler();
+    p.gpuCalibrationNs = gpuTimeNs;
+    p.gpuCalibrationTicks = profiler_ticks();
+    p.gpuCalibrated = true;
+}
+
+void profiler_gpu_zone(const char * name, int64_t beginNs, int64_t endNs)
+{
+    Profiler & p = profiler();
+    if (!p.open || !p.gpuCalibrated)
+        return;
+    GpuEvent e = { name, beginNs, endNs };
+    p.gpuEvents.push_back(e);
+}
+
+void profiler_capture_begin()
+{
+    Profiler & p = profiler();
+    if (!p.clockBaseValid)
+    {
+        p.clockBaseTicks = profiler_ticks();
+        p.clockBaseTime = std::chrono::steady_clock::now();
+        p.clockBaseValid = true;
+    }
+    profilerGeneration.fetch_add(1, std::memory_order_relaxed);
+    p.gpuEvents.clear();
+    p.open = true;
+    p.beginTicks = profiler_ticks();
+    p.endTicks = p.beginTicks;
+    profilerRecording.store(true, std::memory_order_relaxed);
+}
+
+void profiler_capture_end()
+{
+    Profiler & p = profiler();
+    if (!profilerRecording.load(std::memory_order_relaxed))
+        return;
+    profilerRecording.store(false, std::memory_order_relaxed);
+    p.endTicks = profiler_ticks();
+}
+
+bool profiler_capture_open()
+{
+    return profiler().open;
+}
+
+bool profiler_write_trace(const char * path)
+{
+    Profiler & p = profiler();
+    if (!p.open)
+        return false;
+    profiler_capture_end();
+    p.open = false;
+
+    // Ticks to microseconds since the capture began
+    double usPerTick = 1e-3;
+    uint64_t nowTicks = profiler_ticks();
+    double baseUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - p.clockBaseTime).count();
+    if (nowTicks > p.clockBaseTicks)
+        usPerTick = baseUs / (double) (nowTicks - p.clockBaseTicks);
+
+    FILE * file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"aogl\"}},\n");
+    fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"GPU\"}}");
+
+    uint32_t generation = profilerGeneration.load(std::memory_order_relaxed);
+    std::vector<ProfileThreadBuffer *> buffers;
+    std::vector<const char *> zoneNames;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        for (size_t i = 0; i < p.buffers.size(); ++i)
+        {
+            if (p.buffers[i]->generation.load(std::memory_order_acquire) == generation)
+                buffers.push_back(p.buffers[i]);
+        }
+        zoneNames = p.zoneNames;
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", buffers[i]->tid);
+            write_json_string(file, buffers[i]->name);
+            fprintf(file, "}}");
+        }
+    }
+    unsigned int dropped = 0;
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        ProfileThreadBuffer & b = *buffers[i];
+        uint32_t count = b.count.load(std::memory_order_acquire);
+        dropped += b.dropped.load(std::memory_order_relaxed);
+        for (uint32_t j = 0; j < count; ++j)
+        {
+            // Zones begun before the capture are left out
+            const ProfileEvent & e = b.events[j];
+            if (e.start < p.beginTicks)
+                continue;
+            fprintf(file, ",\n{\"name\": ");
+            write_json_string(file, zoneNames[e.zone]);
+            fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f", b.tid, ((double) e.start - (double) p.beginTicks) * usPerTick, (double) (e.end - e.start) * usPerTick);
+            if (e.detail)
+            {
+                fprintf(file, ", \"args\": {\"detail\": ");
+                write_json_string(file, e.detail);
+                fprintf(file, "}");
+            }
+            fprintf(file, "}");
+        }
+    }
+
+    // GPU zones starting outside of the capture belong to other frames
+    double gpuOffsetUs = ((double) p.gpuCalibrationTicks - (double) p.beginTicks) * usPerTick;
+    double captureUs = ((double) p.endTicks - (double) p.beginTicks) * usPerTick;
+    for (size_t i = 0; i < p.gpuEvents.size(); ++i)
+    {
+        const GpuEvent & e = p.gpuEvents[i];
+        double start = gpuOffsetUs + (e.begin - p.gpuCalibrationNs) * 1e-3;
+        if (start < 0.0 || start > captureUs)
+            continue;
+        fprintf(file, ",\n{\"name\": ");
+        write_json_string(file, e.name);
+        fprintf(file, ", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}", start, (e.end - e.begin) * 1e-3);
+    }
+    p.gpuEvents.clear();
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    if (dropped)
+        fprintf(stderr, "Profiler : %u zones dropped, thread buffers are full\n", dropped);
+    return true;
+}
+
+#endif
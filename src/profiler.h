@@ -0,0 +1,152 @@
+#ifndef AOGL_PROFILER_H
+#define AOGL_PROFILER_H
+
+#include <stdint.h>
+
+// Timeline profiler writing Chrome trace event JSON, viewable in Perfetto or
+// chrome://tracing. Scoped zones are recorded per thread into buffers only
+// their thread writes, GPU zones are pass timestamps mapped onto the CPU
+// clock. Everything compiles out unless AOGL_PROFILE is defined, the
+// premake --profile option defines it.
+//
+// A capture records the zones of every thread between profiler_capture_begin
+// and profiler_capture_end, profiler_write_trace then writes them. GPU zones
+// resolve a few frames late, they are accepted until the trace is written
+// and kept when they start within the capture.
+
+#ifdef AOGL_PROFILE
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Time stamp counter where available, converted to time when the trace is written
+inline uint64_t profiler_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+extern std::atomic<bool> profilerRecording;
+// Bumped by each capture, thread buffers of an older capture are reset
+extern std::atomic<uint32_t> profilerGeneration;
+
+// Zone names are registered once per call site, events only keep the index
+// and the names are resolved when the trace is written. Names and details
+// must outlive the capture, string literals usually
+uint32_t profiler_zone(const char * name);
+
+struct ProfileEvent
+{
+    uint64_t start;
+    uint64_t end;
+    const char * detail;
+    uint32_t zone;
+};
+
+// Preallocated, written by its thread only. The count is published after the
+// event so the writer of the trace reads complete events, zones past the
+// capacity are dropped and counted. Buffers of exited threads are reused by
+// new threads once their events are out of the capture
+struct ProfileThreadBuffer
+{
+    static const uint32_t CAPACITY = 1 << 14;
+    int tid;
+    char name[32];
+    std::atomic<bool> released;
+    std::atomic<uint32_t> generation;
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> dropped;
+    ProfileEvent events[CAPACITY];
+};
+
+extern thread_local ProfileThreadBuffer * profilerThreadBuffer;
+
+// Takes a buffer for the calling thread, or resets it for a new capture
+ProfileThreadBuffer * profiler_thread_buffer();
+
+inline void profiler_record(uint32_t zone, const char * detail, uint64_t start, uint64_t end)
+{
+    ProfileThreadBuffer * b = profilerThreadBuffer;
+    if (!b || b->generation.load(std::memory_order_relaxed) != profilerGeneration.load(std::memory_order_relaxed))
+        b = profiler_thread_buffer();
+    uint32_t count = b->count.load(std::memory_order_relaxed);
+    if (count >= ProfileThreadBuffer::CAPACITY)
+    {
+        b->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ProfileEvent & e = b->events[count];
+    e.start = start;
+    e.end = end;
+    e.detail = detail;
+    e.zone = zone;
+    b->count.store(count + 1, std::memory_order_release);
+}
+
+struct ProfileZone
+{
+    uint32_t zone;
+    const char * detail;
+    uint64_t start;
+    ProfileZone(uint32_t zone, const char * detail) : zone(zone), detail(detail)
+    {
+        start = profilerRecording.load(std::memory_order_relaxed) ? profiler_ticks() : 0;
+    }
+    ~ProfileZone()
+    {
+        end();
+    }
+    // Ends the zone before its scope does
+    void end()
+    {
+        if (start)
+            profiler_record(zone, detail, start, profiler_ticks());
+        start = 0;
+    }
+};
+
+// Names the calling thread in the trace
+void profiler_thread_name(const char * name);
+// Pairs a GL_TIMESTAMP value, in nanoseconds, with the CPU clock now
+void profiler_gpu_calibrate(int64_t gpuTimeNs);
+// A GPU interval in GL_TIMESTAMP nanoseconds, from the thread owning the context
+void profiler_gpu_zone(const char * name, int64_t beginNs, int64_t endNs);
+void profiler_capture_begin();
+void profiler_capture_end();
+bool profiler_capture_open();
+// Ends the capture if needed, returns false when the file cannot be written
+bool profiler_write_trace(const char * path);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE_INDEX(NAME, INDEX) static const uint32_t INDEX = profiler_zone(NAME)
+#define PROFILE_ZONE(NAME) PROFILE_ZONE_INDEX(NAME, PROFILE_CONCAT(profileZoneIndex, __LINE__)); \
+    ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(PROFILE_CONCAT(profileZoneIndex, __LINE__), 0)
+#define PROFILE_ZONE_DETAIL(NAME, DETAIL) PROFILE_ZONE_INDEX(NAME, PROFILE_CONCAT(profileZoneIndex, __LINE__)); \
+    ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(PROFILE_CONCAT(profileZoneIndex, __LINE__), DETAIL)
+// Phases of straight line code, where a scope would hide the variables declared in them
+#define PROFILE_PHASE_BEGIN(VAR, NAME) PROFILE_ZONE_INDEX(NAME, VAR##Index); ProfileZone VAR(VAR##Index, 0)
+#define PROFILE_PHASE_END(VAR) VAR.end()
+#define PROFILE_THREAD(NAME) profiler_thread_name(NAME)
+
+#else
+
+#define PROFILE_ZONE(NAME) ((void) 0)
+#define PROFILE_ZONE_DETAIL(NAME, DETAIL) ((void) 0)
+#define PROFILE_PHASE_BEGIN(VAR, NAME) ((void) 0)
+#define PROFILE_PHASE_END(VAR) ((void) 0)
+#define PROFILE_THREAD(NAME) ((void) 0)
+
+#endif
+
+#endif
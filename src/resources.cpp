@@ -0,0 +1,76 @@
+#include "resources.h"
+
+#include <algorithm>
+
+const char * const RESOURCE_CATEGORY_NAMES[RESOURCE_CATEGORY_COUNT] = { "geometry", "material_textures", "render_targets", "uniforms" };
+const char * const CPU_SUBSYSTEM_NAMES[CPU_SUBSYSTEM_COUNT] = { "import", "images", "scene", "frame" };
+
+void resource_registry_init(ResourceRegistry & rr)
+{
+    rr.resources.clear();
+    for (int i = 0; i < RESOURCE_CATEGORY_COUNT; ++i)
+        rr.gpuBytes[i] = rr.gpuPeak[i] = 0;
+    for (int i = 0; i < CPU_SUBSYSTEM_COUNT; ++i)
+        rr.cpuBytes[i] = rr.cpuPeak[i] = 0;
+    rr.gpuTotal = rr.gpuPeakTotal = 0;
+    rr.cpuTotal = rr.cpuPeakTotal = 0;
+}
+
+void resource_track(ResourceRegistry & rr, GLenum type, GLuint name, ResourceCategory category, size_t bytes)
+{
+    resource_release(rr, type, name);
+    ResourceRegistry::Resource resource = { type, name, category, bytes };
+    rr.resources.push_back(resource);
+    rr.gpuBytes[category] += bytes;
+    rr.gpuTotal += bytes;
+    rr.gpuPeak[category] = std::max(rr.gpuPeak[category], rr.gpuBytes[category]);
+    rr.gpuPeakTotal = std::max(rr.gpuPeakTotal, rr.gpuTotal);
+}
+
+void resource_release(ResourceRegistry & rr, GLenum type, GLuint name)
+{
+    for (size_t i = 0; i < rr.resources.size(); ++i)
+    {
+        const ResourceRegistry::Resource & resource = rr.resources[i];
+        if (resource.type != type || resource.name != name)
+            continue;
+        rr.gpuBytes[resource.category] -= resource.bytes;
+        rr.gpuTotal -= resource.bytes;
+        rr.resources[i] = rr.resources.back();
+        rr.resources.pop_back();
+        return;
+    }
+}
+
+void cpu_heap_alloc(ResourceRegistry & rr, CpuSubsystem subsystem, size_t bytes)
+{
+    rr.cpuBytes[subsystem] += bytes;
+    rr.cpuTotal += bytes;
+    rr.cpuPeak[subsystem] = std::max(rr.cpuPeak[subsystem], rr.cpuBytes[subsystem]);
+    rr.cpuPeakTotal = std::max(rr.cpuPeakTotal, rr.cpuTotal);
+}
+
+void cpu_heap_free(ResourceRegistry & rr, CpuSubsystem subsystem, size_t bytes)
+{
+    bytes = std::min(bytes, rr.cpuBytes[subsystem]);
+    rr.cpuBytes[subsystem] -= bytes;
+    rr.cpuTotal -= bytes;
+}
+
+size_t texture_bytes(GLenum internalFormat, int width, int height, int depth, bool mipmaps)
+{
+    size_t texelBytes = 4;
+    switch (internalFormat)
+    {
+    case GL_RED: case GL_R8: texelBytes = 1; break;
+    case GL_RG32F: texelBytes = 8; break;
+    case GL_R11F_G11F_B10F: texelBytes = 4; break;
+    case GL_RGBA16F: texelBytes = 8; break;
+    case GL_RGBA32F: texelBytes = 16; break;
+    // Drivers store 24 bit formats padded to 32 bits
+    default: texelBytes = 4; break;
+    }
+    size_t bytes = texelBytes * width * height * depth;
+    // A full mip chain adds a third
+    return mipmaps ? bytes + bytes / 3 : bytes;
+}
@@ -0,0 +1,56 @@
+#ifndef AOGL_RESOURCES_H
+#define AOGL_RESOURCES_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "glew/glew.h"
+
+// GPU memory by resource category and CPU heap by subsystem. Sizes are the
+// ones requested by the program, drivers may pad or compress them
+enum ResourceCategory
+{
+    RESOURCE_GEOMETRY = 0,
+    RESOURCE_MATERIAL_TEXTURES,
+    RESOURCE_RENDER_TARGETS,
+    RESOURCE_UNIFORMS,
+    RESOURCE_CATEGORY_COUNT
+};
+extern const char * const RESOURCE_CATEGORY_NAMES[RESOURCE_CATEGORY_COUNT];
+enum CpuSubsystem
+{
+    CPU_IMPORT = 0,
+    CPU_IMAGES,
+    CPU_SCENE,
+    CPU_FRAME,
+    CPU_SUBSYSTEM_COUNT
+};
+extern const char * const CPU_SUBSYSTEM_NAMES[CPU_SUBSYSTEM_COUNT];
+struct ResourceRegistry
+{
+    // A GL buffer or texture, tracking a name again replaces its size
+    struct Resource
+    {
+        GLenum type;
+        GLuint name;
+        ResourceCategory category;
+        size_t bytes;
+    };
+    std::vector<Resource> resources;
+    size_t gpuBytes[RESOURCE_CATEGORY_COUNT];
+    size_t gpuPeak[RESOURCE_CATEGORY_COUNT];
+    size_t gpuTotal;
+    size_t gpuPeakTotal;
+    size_t cpuBytes[CPU_SUBSYSTEM_COUNT];
+    size_t cpuPeak[CPU_SUBSYSTEM_COUNT];
+    size_t cpuTotal;
+    size_t cpuPeakTotal;
+};
+void resource_registry_init(ResourceRegistry & rr);
+void resource_track(ResourceRegistry & rr, GLenum type, GLuint name, ResourceCategory category, size_t bytes);
+void resource_release(ResourceRegistry & rr, GLenum type, GLuint name);
+void cpu_heap_alloc(ResourceRegistry & rr, CpuSubsystem subsystem, size_t bytes);
+void cpu_heap_free(ResourceRegistry & rr, CpuSubsystem subsystem, size_t bytes);
+size_t texture_bytes(GLenum internalFormat, int width, int height, int depth, bool mipmaps);
+
+#endif
@@ -0,0 +1,167 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <assimp/scene.h>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+// The diffuse assimp gives to OBJ materials without Kd or missing from the MTL
+const float SCENE_DEFAULT_DIFFUSE[3] = { 0.6f, 0.6f, 0.6f };
+
+static GLuint find_root(std::vector<GLuint> & parents, GLuint v)
+{
+    while (parents[v] != v)
+    {
+        parents[v] = parents[parents[v]];
+        v = parents[v];
+    }
+    return v;
+}
+
+size_t ai_scene_bytes(const aiScene * scene)
+{
+    size_t bytes = sizeof(aiScene);
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+        const aiMesh * m = scene->mMeshes[i];
+        int streams = 0;
+        streams += m->HasPositions() + m->HasNormals() + 2 * m->HasTangentsAndBitangents();
+        for (unsigned int k = 0; k < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++k)
+            streams += m->HasTextureCoords(k);
+        bytes += sizeof(aiMesh) + (size_t) m->mNumVertices * sizeof(aiVector3D) * streams;
+        for (unsigned int k = 0; k < AI_MAX_NUMBER_OF_COLOR_SETS; ++k)
+            bytes += m->HasVertexColors(k) ? (size_t) m->mNumVertices * sizeof(aiColor4D) : 0;
+        bytes += (size_t) m->mNumFaces * (sizeof(aiFace) + 3 * sizeof(unsigned int));
+    }
+    return bytes;
+}
+
+void scene_mesh_indices(const aiMesh * m, GLuint * indices)
+{
+    for (unsigned int j = 0; j < m->mNumFaces; ++j)
+    {
+        const aiFace& f = m->mFaces[j];
+        indices[j*3] = f.mIndices[0];
+        indices[j*3+1] = f.mIndices[1];
+        indices[j*3+2] = f.mIndices[2];
+    }
+}
+
+void scene_from_ai(const aiScene * scene, SceneData & data)
+{
+    data.meshes.resize(scene->mNumMeshes);
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+        const aiMesh * m = scene->mMeshes[i];
+        SceneMesh & mesh = data.meshes[i];
+        mesh.positions.resize(m->mNumVertices * 3);
+        mesh.normals.assign(m->mNumVertices * 3, 0.f);
+        mesh.uvs.assign(m->mNumVertices * 2, 0.f);
+        for (unsigned int j = 0; j < m->mNumVertices; ++j)
+        {
+            mesh.positions[j*3] = m->mVertices[j].x;
+            mesh.positions[j*3+1] = m->mVertices[j].y;
+            mesh.positions[j*3+2] = m->mVertices[j].z;
+            if (m->HasNormals())
+            {
+                mesh.normals[j*3] = m->mNormals[j].x;
+                mesh.normals[j*3+1] = m->mNormals[j].y;
+                mesh.normals[j*3+2] = m->mNormals[j].z;
+            }
+            if (m->HasTextureCoords(0))
+            {
+                mesh.uvs[j*2] = m->mTextureCoords[0][j].x;
+                mesh.uvs[j*2+1] = m->mTextureCoords[0][j].y;
+            }
+        }
+        mesh.indices.resize(m->mNumFaces * 3);
+        if (m->mNumFaces)
+            scene_mesh_indices(m, &mesh.indices[0]);
+        mesh.material = m->mMaterialIndex;
+        mesh.source = -1;
+    }
+
+    data.materials.resize(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    {
+        const aiMaterial * mat = scene->mMaterials[i];
+        SceneMaterial & material = data.materials[i];
+        aiString texPath;
+        if (AI_SUCCESS == mat->GetTexture(aiTextureType_DIFFUSE, 0, &texPath))
+            material.diffuseTexture = texPath.data;
+        aiColor4D diffuse;
+        if (AI_SUCCESS == aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &diffuse))
+        {
+            material.diffuse[0] = diffuse.r;
+            material.diffuse[1] = diffuse.g;
+            material.diffuse[2] = diffuse.b;
+        }
+        else
+        {
+            material.diffuse[0] = SCENE_DEFAULT_DIFFUSE[0];
+            material.diffuse[1] = SCENE_DEFAULT_DIFFUSE[1];
+            material.diffuse[2] = SCENE_DEFAULT_DIFFUSE[2];
+        }
+    }
+
+    // Node hierarchy, assimp matrices are row major
+    std::vector<std::pair<const aiNode *, glm::mat4> > stack;
+    if (scene->mRootNode)
+        stack.push_back(std::make_pair((const aiNode *) scene->mRootNode, glm::mat4()));
+    while (!stack.empty())
+    {
+        const aiNode * node = stack.back().first;
+        glm::mat4 parentToWorld = stack.back().second;
+        stack.pop_back();
+        const aiMatrix4x4 & t = node->mTransformation;
+        glm::mat4 nodeToWorld = parentToWorld * glm::transpose(glm::make_mat4(&t.a1));
+        for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+            data.meshes[node->mMeshes[i]].objectToWorld = nodeToWorld;
+        for (unsigned int i = 0; i < node->mNumChildren; ++i)
+            stack.push_back(std::make_pair((const aiNode *) node->mChildren[i], nodeToWorld));
+    }
+}
+
+size_t scene_data_bytes(const SceneData & data)
+{
+    size_t bytes = sizeof(SceneData) + data.meshes.capacity() * sizeof(SceneMesh) + data.materials.capacity() * sizeof(SceneMaterial);
+    for (size_t i = 0; i < data.meshes.size(); ++i)
+    {
+        const SceneMesh & m = data.meshes[i];
+        bytes += (m.positions.capacity() + m.normals.capacity() + m.uvs.capacity()) * sizeof(float) + m.indices.capacity() * sizeof(GLuint);
+    }
+    for (size_t i = 0; i < data.materials.size(); ++i)
+        bytes += data.materials[i].diffuseTexture.capacity();
+    return bytes;
+}
+
+void scene_mesh_pieces(const SceneMesh & m, std::vector<GLuint> & pieces)
+{
+    const GLuint vertexCount = (GLuint) (m.positions.size() / 3);
+    const size_t triangleCount = m.indices.size() / 3;
+    pieces.resize(vertexCount);
+    for (GLuint v = 0; v < vertexCount; ++v)
+        pieces[v] = v;
+    std::vector<GLuint> byPosition(pieces);
+    const float * positions = m.positions.empty() ? NULL : &m.positions[0];
+    std::sort(byPosition.begin(), byPosition.end(), [positions](GLuint a, GLuint b) {
+        return std::lexicographical_compare(positions + 3*a, positions + 3*a + 3, positions + 3*b, positions + 3*b + 3);
+    });
+    for (GLuint k = 1; k < vertexCount; ++k)
+    {
+        GLuint a = byPosition[k - 1], b = byPosition[k];
+        if (std::equal(positions + 3*a, positions + 3*a + 3, positions + 3*b))
+            pieces[find_root(pieces, b)] = find_root(pieces, a);
+    }
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        GLuint a = find_root(pieces, m.indices[t*3]);
+        pieces[find_root(pieces, m.indices[t*3+1])] = a;
+        pieces[find_root(pieces, m.indices[t*3+2])] = a;
+    }
+    for (GLuint v = 0; v < vertexCount; ++v)
+        pieces[v] = find_root(pieces, v);
+}
@@ -0,0 +1,57 @@
+#ifndef AOGL_SCENE_H
+#define AOGL_SCENE_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "glew/glew.h"
+#include "glm/mat4x4.hpp"
+
+struct aiScene;
+struct aiMesh;
+
+// Triangle mesh as uploaded by the renderer, streams are tightly packed
+struct SceneMesh
+{
+    std::vector<float> positions;   // xyz per vertex
+    std::vector<float> normals;     // xyz per vertex
+    std::vector<float> uvs;         // uv per vertex, zero when the source has none
+    std::vector<GLuint> indices;
+    int material;
+    // Mesh whose streams this copy draws, its own streams are empty. -1 when
+    // the mesh is not a copy
+    int source;
+    glm::mat4 objectToWorld;
+};
+
+struct SceneMaterial
+{
+    std::string diffuseTexture;     // relative to the scene file, empty when none
+    float diffuse[3];
+};
+
+// Diffuse color of the materials missing from the scene, the same for every
+// importer so their renders can be compared
+extern const float SCENE_DEFAULT_DIFFUSE[3];
+
+// What the renderer needs from an imported scene, whatever the importer
+struct SceneData
+{
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneMaterial> materials;
+};
+
+// Heap used by an imported scene, estimated from its vertex streams and faces
+size_t ai_scene_bytes(const aiScene * scene);
+// Triangle list of a triangulated mesh, indices holds mNumFaces * 3 entries
+void scene_mesh_indices(const aiMesh * m, GLuint * indices);
+// Copy of a scene imported by assimp, meshes get their node transforms
+void scene_from_ai(const aiScene * scene, SceneData & data);
+size_t scene_data_bytes(const SceneData & data);
+// Connected pieces of a mesh, pieces[v] is the vertex standing for the piece
+// of vertex v. Triangles sharing a vertex or a vertex position are connected,
+// the faces of a flat shaded object do not share vertices
+void scene_mesh_pieces(const SceneMesh & m, std::vector<GLuint> & pieces);
+
+#endif
@@ -0,0 +1,225 @@
+#include "scene_batch.h"
+
+#include <float.h>
+#include <algorithm>
+#include <chrono>
+
+#include "glm/glm.hpp"
+
+#include "profiler.h"
+
+static const GLuint NO_VERTEX = ~0u;
+
+// Triangles of one mesh falling in one cell
+struct BatchFragment
+{
+    long long cell;
+    int mesh;
+    size_t first;       // in the triangles of the mesh sorted by cell
+    size_t count;
+};
+
+static inline glm::vec3 world_position(const SceneMesh & m, GLuint v)
+{
+    return glm::vec3(m.objectToWorld * glm::vec4(m.positions[3*v], m.positions[3*v+1], m.positions[3*v+2], 1.f));
+}
+
+static inline long long grid_cell(const glm::vec3 & p, const glm::vec3 & lo, float cellSize, int cellsPerAxis)
+{
+    glm::ivec3 c = glm::clamp(glm::ivec3((p - lo) / cellSize), glm::ivec3(0), glm::ivec3(cellsPerAxis - 1));
+    return ((long long) c.z * cellsPerAxis + c.y) * cellsPerAxis + c.x;
+}
+
+// Cell of each triangle of a mesh. Connected pieces fitting in a cell go to
+// the cell of their bounds center, larger ones are cut along the cells by
+// triangle centroid
+static void triangle_cells(const SceneMesh & m, const glm::vec3 & lo, float cellSize, int cellsPerAxis, std::vector<long long> & cells)
+{
+    const GLuint vertexCount = (GLuint) (m.positions.size() / 3);
+    const size_t triangleCount = m.indices.size() / 3;
+    std::vector<GLuint> pieces;
+    scene_mesh_pieces(m, pieces);
+    std::vector<glm::vec3> pieceLo(vertexCount, glm::vec3(FLT_MAX)), pieceHi(vertexCount, glm::vec3(-FLT_MAX));
+    std::vector<glm::vec3> world(vertexCount);
+    for (GLuint v = 0; v < vertexCount; ++v)
+    {
+        world[v] = world_position(m, v);
+        GLuint root = pieces[v];
+        pieceLo[root] = glm::min(pieceLo[root], world[v]);
+        pieceHi[root] = glm::max(pieceHi[root], world[v]);
+    }
+    cells.resize(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        GLuint root = pieces[m.indices[t*3]];
+        glm::vec3 extent = pieceHi[root] - pieceLo[root];
+        if (std::max(std::max(extent.x, extent.y), extent.z) <= cellSize)
+            cells[t] = grid_cell((pieceLo[root] + pieceHi[root]) * 0.5f, lo, cellSize, cellsPerAxis);
+        else
+            cells[t] = grid_cell((world[m.indices[t*3]] + world[m.indices[t*3+1]] + world[m.indices[t*3+2]]) / 3.f, lo, cellSize, cellsPerAxis);
+    }
+}
+
+// Appends triangles of a mesh to a merged one, moved to world space. remap
+// holds NO_VERTEX for every vertex of the mesh and is left so
+static void append_world_triangles(SceneMesh & merged, const SceneMesh & m, const GLuint * triangles, size_t count, std::vector<GLuint> & remap)
+{
+    glm::mat3 linear = glm::mat3(m.objectToWorld);
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+    // Mirroring transforms reverse the winding
+    bool flip = glm::determinant(linear) < 0.f;
+    for (size_t k = 0; k < count; ++k)
+    {
+        const GLuint * triangle = &m.indices[triangles[k] * 3];
+        for (int j = 0; j < 3; ++j)
+        {
+            GLuint v = triangle[j == 0 ? 0 : (flip ? 3 - j : j)];
+            if (remap[v] == NO_VERTEX)
+            {
+                remap[v] = (GLuint) (merged.positions.size() / 3);
+                glm::vec3 p = world_position(m, v);
+                glm::vec3 n = normalMatrix * glm::vec3(m.normals[3*v], m.normals[3*v+1], m.normals[3*v+2]);
+                float length = glm::length(n);
+                n = length > 0.f ? n / length : n;
+                merged.positions.push_back(p.x);
+                merged.positions.push_back(p.y);
+                merged.positions.push_back(p.z);
+                merged.normals.push_back(n.x);
+                merged.normals.push_back(n.y);
+                merged.normals.push_back(n.z);
+                merged.uvs.push_back(m.uvs[2*v]);
+                merged.uvs.push_back(m.uvs[2*v+1]);
+            }
+            merged.indices.push_back(remap[v]);
+        }
+    }
+    for (size_t k = 0; k < count; ++k)
+        for (int j = 0; j < 3; ++j)
+            remap[m.indices[triangles[k] * 3 + j]] = NO_VERTEX;
+}
+
+void scene_batch(SceneData & data, int cellsPerAxis, SceneBatchStats * stats)
+{
+    PROFILE_ZONE("scene batch");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int meshCount = (int) data.meshes.size();
+    cellsPerAxis = glm::clamp(cellsPerAxis, 1, 1024);
+
+    // The grid covers the world space bounds of the scene
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (int i = 0; i < meshCount; ++i)
+    {
+        const SceneMesh & m = data.meshes[i];
+        for (GLuint v = 0; v < (GLuint) (m.positions.size() / 3); ++v)
+        {
+            glm::vec3 p = world_position(m, v);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+    }
+    glm::vec3 extent = lo.x <= hi.x ? hi - lo : glm::vec3(0.f);
+    float cellSize = std::max(std::max(extent.x, extent.y), extent.z) / cellsPerAxis;
+    cellSize = cellSize > 0.f ? cellSize : 1.f;
+
+    // Triangles of each mesh sorted by cell, one fragment per cell they fall in
+    std::vector<std::vector<GLuint> > sortedTriangles(meshCount);
+    std::vector<BatchFragment> fragments;
+    std::vector<int> meshFragments(meshCount, 0);
+    std::vector<long long> cells;
+    std::vector<std::pair<long long, GLuint> > keyed;
+    for (int i = 0; i < meshCount; ++i)
+    {
+        const SceneMesh & m = data.meshes[i];
+        triangle_cells(m, lo, cellSize, cellsPerAxis, cells);
+        keyed.resize(cells.size());
+        for (size_t t = 0; t < cells.size(); ++t)
+            keyed[t] = std::make_pair(cells[t], (GLuint) t);
+        std::sort(keyed.begin(), keyed.end());
+        std::vector<GLuint> & triangles = sortedTriangles[i];
+        triangles.resize(keyed.size());
+        for (size_t t = 0; t < keyed.size(); ++t)
+            triangles[t] = keyed[t].second;
+        for (size_t first = 0, last = 0; first < keyed.size(); first = last)
+        {
+            last = first + 1;
+            while (last < keyed.size() && keyed[last].first == keyed[first].first)
+                ++last;
+            BatchFragment f = { keyed[first].first, i, first, last - first };
+            fragments.push_back(f);
+            ++meshFragments[i];
+        }
+        // Meshes without triangles stay as they are, in the first cell
+        if (keyed.empty())
+        {
+            BatchFragment f = { 0, i, 0, 0 };
+            fragments.push_back(f);
+            ++meshFragments[i];
+        }
+    }
+    int splitMeshes = 0;
+    for (int i = 0; i < meshCount; ++i)
+        splitMeshes += meshFragments[i] > 1;
+
+    // Runs of fragments sharing a cell and a material, source order within a run
+    std::sort(fragments.begin(), fragments.end(), [&](const BatchFragment & a, const BatchFragment & b) {
+        if (a.cell != b.cell)
+            return a.cell < b.cell;
+        if (data.meshes[a.mesh].material != data.meshes[b.mesh].material)
+            return data.meshes[a.mesh].material < data.meshes[b.mesh].material;
+        return a.mesh < b.mesh;
+    });
+
+    std::vector<SceneMesh> batched;
+    std::vector<GLuint> remap;
+    const int fragmentCount = (int) fragments.size();
+    int chunks = 0;
+    for (int first = 0, last = 0; first < fragmentCount; first = last)
+    {
+        last = first + 1;
+        while (last < fragmentCount && fragments[last].cell == fragments[first].cell && data.meshes[fragments[last].mesh].material == data.meshes[fragments[first].mesh].material)
+            ++last;
+        chunks += first == 0 || fragments[first - 1].cell != fragments[first].cell;
+        batched.push_back(SceneMesh());
+        SceneMesh & merged = batched.back();
+        // A mesh whole in its cell and alone with its material is kept as it is
+        if (last - first == 1 && fragments[first].count == data.meshes[fragments[first].mesh].indices.size() / 3)
+        {
+            std::swap(merged, data.meshes[fragments[first].mesh]);
+            continue;
+        }
+        size_t triangles = 0;
+        for (int k = first; k < last; ++k)
+            triangles += fragments[k].count;
+        merged.positions.reserve(triangles * 3);
+        merged.normals.reserve(triangles * 3);
+        merged.uvs.reserve(triangles * 2);
+        merged.indices.reserve(triangles * 3);
+        merged.material = data.meshes[fragments[first].mesh].material;
+        merged.source = -1;
+        merged.objectToWorld = glm::mat4(1.f);
+        for (int k = first; k < last; ++k)
+        {
+            const BatchFragment & f = fragments[k];
+            const SceneMesh & m = data.meshes[f.mesh];
+            remap.resize(std::max(remap.size(), m.positions.size() / 3), NO_VERTEX);
+            if (f.count)
+                append_world_triangles(merged, m, &sortedTriangles[f.mesh][f.first], f.count, remap);
+            // The source streams are not needed once its last fragment is merged
+            if (--meshFragments[f.mesh] == 0)
+            {
+                data.meshes[f.mesh] = SceneMesh();
+                std::vector<GLuint>().swap(sortedTriangles[f.mesh]);
+            }
+        }
+    }
+    data.meshes.swap(batched);
+
+    if (stats)
+    {
+        stats->sourceMeshes = meshCount;
+        stats->splitMeshes = splitMeshes;
+        stats->meshes = (int) data.meshes.size();
+        stats->chunks = chunks;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
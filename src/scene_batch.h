@@ -0,0 +1,28 @@
+#ifndef AOGL_SCENE_BATCH_H
+#define AOGL_SCENE_BATCH_H
+
+#include "scene.h"
+
+// Static batching at import : the triangles of every mesh are sorted into the
+// cells of a uniform grid over the scene, then pre-transformed and merged,
+// one merged mesh per material in each cell, so culling keeps a spatial
+// granularity even when the importer gives one mesh per material. Connected
+// pieces smaller than a cell stay whole, larger ones are cut by triangle
+// centroid. Meshes whole in their cell and alone with their material there
+// are left as they are.
+
+struct SceneBatchStats
+{
+    int sourceMeshes;
+    int splitMeshes;    // source meshes cut across several cells
+    int meshes;
+    int chunks;         // cells holding at least one mesh
+    double ms;
+};
+
+// cellsPerAxis divides the longest side of the box around the scene, the
+// other axes get cells of the same size. Merged meshes are in world space
+// with an identity transform, every mesh ends up ordered chunk by chunk
+void scene_batch(SceneData & data, int cellsPerAxis, SceneBatchStats * stats);
+
+#endif
@@ -0,0 +1,304 @@
+#include "scene_instances.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "glm/glm.hpp"
+
+#include "profiler.h"
+
+static const GLuint NO_VERTEX = ~0u;
+// Earlier pieces with the same hash a piece is compared to, a bound on the
+// work when unrelated pieces collide
+static const int MAX_CANDIDATES = 8;
+
+// Connected triangles of a mesh, vertices numbered in order of first use.
+// Faces meeting at a position are connected, as in scene_mesh_pieces
+struct Piece
+{
+    int mesh;
+    std::vector<GLuint> vertices;       // mesh vertex of each piece vertex
+    std::vector<GLuint> indices;        // piece vertices
+    std::vector<GLuint> triangles;      // mesh triangles
+    uint64_t hash;
+};
+
+static inline uint64_t hash_mix(uint64_t h, uint64_t value)
+{
+    return h ^ (value * 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2));
+}
+
+static void split_pieces(const SceneMesh & m, int mesh, int minTriangles, std::vector<Piece> & pieces)
+{
+    const GLuint vertexCount = (GLuint) (m.positions.size() / 3);
+    const size_t triangleCount = m.indices.size() / 3;
+    std::vector<GLuint> roots;
+    scene_mesh_pieces(m, roots);
+    std::vector<GLuint> triangleCounts(vertexCount, 0);
+    for (size_t t = 0; t < triangleCount; ++t)
+        ++triangleCounts[roots[m.indices[t*3]]];
+
+    // Pieces in order of their first triangle, a vertex belongs to one piece
+    std::vector<int> pieceOfRoot(vertexCount, -1);
+    std::vector<GLuint> local(vertexCount, NO_VERTEX);
+    size_t firstPiece = pieces.size();
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        GLuint root = roots[m.indices[t*3]];
+        if (triangleCounts[root] < (GLuint) minTriangles)
+            continue;
+        if (pieceOfRoot[root] < 0)
+        {
+            pieceOfRoot[root] = (int) pieces.size();
+            pieces.push_back(Piece());
+            pieces.back().mesh = mesh;
+            pieces.back().triangles.reserve(triangleCounts[root]);
+            pieces.back().indices.reserve(triangleCounts[root] * 3);
+        }
+        Piece & p = pieces[pieceOfRoot[root]];
+        p.triangles.push_back((GLuint) t);
+        for (int j = 0; j < 3; ++j)
+        {
+            GLuint v = m.indices[t*3+j];
+            if (local[v] == NO_VERTEX)
+            {
+                local[v] = (GLuint) p.vertices.size();
+                p.vertices.push_back(v);
+            }
+            p.indices.push_back(local[v]);
+        }
+    }
+
+    // Topology and uvs do not change with the transform
+    for (size_t k = firstPiece; k < pieces.size(); ++k)
+    {
+        Piece & p = pieces[k];
+        uint64_t h = hash_mix(hash_mix(0, (uint64_t) (int64_t) m.material), p.vertices.size());
+        for (size_t i = 0; i < p.indices.size(); ++i)
+            h = hash_mix(h, p.indices[i]);
+        for (size_t i = 0; i < p.vertices.size(); ++i)
+        {
+            uint64_t uv;
+            memcpy(&uv, &m.uvs[p.vertices[i] * 2], sizeof(uv));
+            h = hash_mix(h, uv);
+        }
+        p.hash = h;
+    }
+}
+
+static inline glm::dvec3 mesh_vec3(const std::vector<float> & stream, GLuint v)
+{
+    return glm::dvec3(stream[v*3], stream[v*3+1], stream[v*3+2]);
+}
+
+// Least squares affine transform from the vertices of a piece to those of
+// another, false when they do not match through it
+static bool fit_piece(const SceneMesh & sm, const Piece & s, const SceneMesh & cm, const Piece & c, glm::mat4 & transform)
+{
+    const size_t n = s.vertices.size();
+    if (n != c.vertices.size() || s.indices != c.indices)
+        return false;
+    for (size_t i = 0; i < n; ++i)
+        if (memcmp(&sm.uvs[s.vertices[i] * 2], &cm.uvs[c.vertices[i] * 2], 2 * sizeof(float)))
+            return false;
+
+    glm::dvec3 sCenter(0.0), cCenter(0.0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        sCenter += mesh_vec3(sm.positions, s.vertices[i]);
+        cCenter += mesh_vec3(cm.positions, c.vertices[i]);
+    }
+    sCenter /= (double) n;
+    cCenter /= (double) n;
+    glm::dmat3 ss(0.0), cs(0.0);
+    double radius = 0.0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        glm::dvec3 a = mesh_vec3(sm.positions, s.vertices[i]) - sCenter;
+        glm::dvec3 b = mesh_vec3(cm.positions, c.vertices[i]) - cCenter;
+        ss += glm::outerProduct(a, a);
+        cs += glm::outerProduct(b, a);
+        radius = std::max(radius, glm::length(b));
+    }
+    // Flat pieces leave the transform undetermined
+    double spread = (ss[0][0] + ss[1][1] + ss[2][2]) / 3.0;
+    if (spread <= 0.0 || glm::determinant(ss) < 1e-9 * spread * spread * spread)
+        return false;
+    glm::dmat3 linear = cs * glm::inverse(ss);
+    glm::dvec3 translation = cCenter - linear * sCenter;
+
+    // Tolerance relative to the piece size and to the float precision of its coordinates
+    double tolerance = 1e-4 * radius + 1e-6 * (glm::length(cCenter) + radius);
+    glm::dmat3 normalMatrix = glm::transpose(glm::inverse(linear));
+    for (size_t i = 0; i < n; ++i)
+    {
+        glm::dvec3 q = linear * mesh_vec3(sm.positions, s.vertices[i]) + translation;
+        if (glm::length(q - mesh_vec3(cm.positions, c.vertices[i])) > tolerance)
+            return false;
+        glm::dvec3 sn = normalMatrix * mesh_vec3(sm.normals, s.vertices[i]);
+        glm::dvec3 cn = mesh_vec3(cm.normals, c.vertices[i]);
+        double lengths = glm::length(sn) * glm::length(cn);
+        if (lengths > 0.0 && glm::dot(sn, cn) < 0.999 * lengths)
+            return false;
+    }
+    glm::dmat4 affine(linear);
+    affine[3] = glm::dvec4(translation, 1.0);
+    transform = glm::mat4(affine);
+    return true;
+}
+
+void scene_find_instances(SceneData & data, int minTriangles, SceneInstanceStats * stats)
+{
+    PROFILE_ZONE("scene instances");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int meshCount = (int) data.meshes.size();
+    std::vector<Piece> pieces;
+    for (int m = 0; m < meshCount; ++m)
+        split_pieces(data.meshes[m], m, std::max(minTriangles, 1), pieces);
+
+    // Pieces matching an earlier one become its copies, the transform takes
+    // the object space of the original to that of the copy
+    const int pieceCount = (int) pieces.size();
+    std::vector<int> copyOf(pieceCount, -1);
+    std::vector<int> copyCount(pieceCount, 0);
+    std::vector<glm::mat4> transforms(pieceCount);
+    std::unordered_map<uint64_t, std::vector<int> > originals;
+    for (int p = 0; p < pieceCount; ++p)
+    {
+        std::vector<int> & candidates = originals[pieces[p].hash];
+        const Piece & c = pieces[p];
+        for (size_t k = 0; k < candidates.size() && (int) k < MAX_CANDIDATES && copyOf[p] < 0; ++k)
+        {
+            const Piece & s = pieces[candidates[k]];
+            if (fit_piece(data.meshes[s.mesh], s, data.meshes[c.mesh], c, transforms[p]))
+            {
+                copyOf[p] = candidates[k];
+                ++copyCount[candidates[k]];
+            }
+        }
+        if (copyOf[p] < 0)
+            candidates.push_back(p);
+    }
+
+    // Repeated geometries, with the streams of the first piece, then copies
+    std::vector<SceneMesh> geometries;
+    std::vector<SceneMesh> copies;
+    std::vector<int> geometryOfPiece(pieceCount, -1);
+    std::vector<std::vector<char> > moved(meshCount);
+    size_t bytesSaved = 0;
+    for (int p = 0; p < pieceCount; ++p)
+    {
+        const Piece & piece = pieces[p];
+        const SceneMesh & m = data.meshes[piece.mesh];
+        if (copyOf[p] < 0 && copyCount[p] == 0)
+            continue;
+        if (moved[piece.mesh].empty())
+            moved[piece.mesh].assign(m.indices.size() / 3, 0);
+        for (size_t t = 0; t < piece.triangles.size(); ++t)
+            moved[piece.mesh][piece.triangles[t]] = 1;
+        if (copyOf[p] >= 0)
+        {
+            copies.push_back(SceneMesh());
+            SceneMesh & copy = copies.back();
+            copy.material = m.material;
+            copy.source = geometryOfPiece[copyOf[p]];
+            copy.objectToWorld = m.objectToWorld * transforms[p];
+            bytesSaved += piece.vertices.size() * 8 * sizeof(float) + piece.indices.size() * sizeof(GLuint);
+            continue;
+        }
+        geometryOfPiece[p] = (int) geometries.size();
+        geometries.push_back(SceneMesh());
+        SceneMesh & geometry = geometries.back();
+        geometry.positions.reserve(piece.vertices.size() * 3);
+        geometry.normals.reserve(piece.vertices.size() * 3);
+        geometry.uvs.reserve(piece.vertices.size() * 2);
+        for (size_t i = 0; i < piece.vertices.size(); ++i)
+        {
+            GLuint v = piece.vertices[i];
+            geometry.positions.insert(geometry.positions.end(), &m.positions[v*3], &m.positions[v*3] + 3);
+            geometry.normals.insert(geometry.normals.end(), &m.normals[v*3], &m.normals[v*3] + 3);
+            geometry.uvs.insert(geometry.uvs.end(), &m.uvs[v*2], &m.uvs[v*2] + 2);
+        }
+        geometry.indices = piece.indices;
+        geometry.material = m.material;
+        geometry.source = -1;
+        geometry.objectToWorld = m.objectToWorld;
+    }
+
+    // What is left of the meshes, vertices compacted, empty meshes dropped
+    std::vector<SceneMesh> meshes;
+    meshes.reserve(meshCount + geometries.size() + copies.size());
+    for (int m = 0; m < meshCount; ++m)
+    {
+        SceneMesh & mesh = data.meshes[m];
+        meshes.push_back(SceneMesh());
+        SceneMesh & kept = meshes.back();
+        if (moved[m].empty())
+        {
+            std::swap(kept, mesh);
+            continue;
+        }
+        kept.material = mesh.material;
+        kept.source = -1;
+        kept.objectToWorld = mesh.objectToWorld;
+        std::vector<GLuint> remap(mesh.positions.size() / 3, NO_VERTEX);
+        for (size_t t = 0; t < moved[m].size(); ++t)
+        {
+            if (moved[m][t])
+                continue;
+            for (int j = 0; j < 3; ++j)
+            {
+                GLuint v = mesh.indices[t*3+j];
+                if (remap[v] == NO_VERTEX)
+                {
+                    remap[v] = (GLuint) (kept.positions.size() / 3);
+                    kept.positions.insert(kept.positions.end(), &mesh.positions[v*3], &mesh.positions[v*3] + 3);
+                    kept.normals.insert(kept.normals.end(), &mesh.normals[v*3], &mesh.normals[v*3] + 3);
+                    kept.uvs.insert(kept.uvs.end(), &mesh.uvs[v*2], &mesh.uvs[v*2] + 2);
+                }
+                kept.indices.push_back(remap[v]);
+            }
+        }
+        mesh = SceneMesh();
+        if (kept.indices.empty())
+            meshes.pop_back();
+    }
+    const int firstGeometry = (int) meshes.size();
+    for (size_t g = 0; g < geometries.size(); ++g)
+    {
+        meshes.push_back(SceneMesh());
+        std::swap(meshes.back(), geometries[g]);
+    }
+    for (size_t c = 0; c < copies.size(); ++c)
+    {
+        copies[c].source += firstGeometry;
+        meshes.push_back(copies[c]);
+    }
+    data.meshes.swap(meshes);
+
+    if (stats)
+    {
+        stats->geometries = (int) geometries.size();
+        stats->copies = (int) copies.size();
+        stats->bytesSaved = bytesSaved;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int scene_instance_group(unsigned int mesh, unsigned int source, const std::vector<unsigned int> & copies, const char * visible, const int * levels, char * drawn, unsigned int * group, int maxInstances)
+{
+    int instances = 0;
+    // The mesh itself first, then the source and its copies
+    for (size_t c = 0; c < copies.size() + 2 && instances < maxInstances; ++c)
+    {
+        unsigned int j = c == 0 ? mesh : (c == 1 ? source : copies[c - 2]);
+        if (c > 0 && (j == mesh || !visible[j] || drawn[j] || levels[j] != levels[mesh]))
+            continue;
+        drawn[j] = 1;
+        group[instances++] = j;
+    }
+    return instances;
+}
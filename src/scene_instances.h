@@ -0,0 +1,30 @@
+#ifndef AOGL_SCENE_INSTANCES_H
+#define AOGL_SCENE_INSTANCES_H
+
+#include "scene.h"
+
+// Repeated geometry at import : the connected pieces of every mesh are hashed
+// on their topology and uvs, pieces with the same hash are compared once the
+// affine transform between their vertices is fitted. A piece found again
+// becomes its own mesh, and each copy an entry with no streams of its own, a
+// source mesh and the fitted transform as object to world.
+
+struct SceneInstanceStats
+{
+    int geometries;     // meshes with copies
+    int copies;
+    size_t bytesSaved;  // vertex and index streams of the copies
+    double ms;
+};
+
+// Meshes keep their order, minus the pieces moved out and those left empty,
+// followed by the repeated geometries and then their copies. Pieces under
+// minTriangles are left in place
+void scene_find_instances(SceneData & data, int minTriangles, SceneInstanceStats * stats);
+
+// Meshes drawn by one instanced draw of mesh : the mesh, then its source and
+// the copies of the source, those visible at the level of mesh and not drawn
+// yet, maxInstances at most. Marks them drawn and returns their count
+int scene_instance_group(unsigned int mesh, unsigned int source, const std::vector<unsigned int> & copies, const char * visible, const int * levels, char * drawn, unsigned int * group, int maxInstances);
+
+#endif
@@ -0,0 +1,292 @@
+#include "scene_stream.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "stb/stb_image.h"
+
+#include "glm/glm.hpp"
+
+#include "obj_import.h"
+#include "profiler.h"
+
+static size_t mesh_stream_bytes(const SceneMesh & m)
+{
+    return (m.positions.capacity() + m.normals.capacity() + m.uvs.capacity()) * sizeof(float) + m.indices.capacity() * sizeof(GLuint);
+}
+
+static bool scene_stream_import(SceneStream & s)
+{
+    PROFILE_ZONE_DETAIL("scene import", s.path.c_str());
+    bool imported = false;
+    if (!s.forceAssimp && obj_is_obj_path(s.path.c_str()))
+    {
+        ObjImportStats stats;
+        imported = obj_import(s.path.c_str(), s.data, &stats);
+        if (imported)
+        {
+            s.importPathName = "native OBJ";
+            printf("Native OBJ import : %.1f MB, parse %.1f ms on %d threads, merge %.1f ms, materials %.1f ms\n", stats.fileBytes / (1024.0 * 1024.0), stats.parseMs, stats.threads, stats.mergeMs, stats.mtlMs);
+        }
+    }
+    if (!imported)
+    {
+        PROFILE_PHASE_BEGIN(assimpZone, "assimp import");
+        const aiScene * scene = aiImportFile(s.path.c_str(), aiProcessPreset_TargetRealtime_MaxQuality);
+        PROFILE_PHASE_END(assimpZone);
+        if (scene)
+        {
+            PROFILE_ZONE("scene convert");
+            s.importPathName = "assimp";
+            scene_from_ai(scene, s.data);
+            aiReleaseImport(scene);
+            imported = true;
+        }
+    }
+    return imported;
+}
+
+// Texture paths are relative to the scene file, Windows separators are converted
+static std::string texture_path(const std::string & scenePath, const std::string & texture)
+{
+    size_t pos = scenePath.find_last_of("\\/");
+    std::string basePath = (std::string::npos == pos) ? "" : scenePath.substr(0, pos + 1);
+    std::string fileloc = basePath + texture;
+    std::replace(fileloc.begin(), fileloc.end(), '\\', '/');
+    return fileloc;
+}
+
+static void scene_stream_run(SceneStream * stream)
+{
+    SceneStream & s = *stream;
+    PROFILE_THREAD("scene stream");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool imported = scene_stream_import(s);
+    if (imported && s.batchCells > 0)
+    {
+        scene_batch(s.data, s.batchCells, &s.batchStats);
+        printf("Static batching : %d meshes, %d split across cells, into %d in %d chunks, %.1f ms\n", s.batchStats.sourceMeshes, s.batchStats.splitMeshes, s.batchStats.meshes, s.batchStats.chunks, s.batchStats.ms);
+    }
+    if (imported && s.instanceMinTriangles > 0)
+    {
+        scene_find_instances(s.data, s.instanceMinTriangles, &s.instanceStats);
+        printf("Repeated geometry : %d meshes with %d copies, %.1f MB saved, %.1f ms\n", s.instanceStats.geometries, s.instanceStats.copies, s.instanceStats.bytesSaved / (1024.0 * 1024.0), s.instanceStats.ms);
+    }
+    const int meshCount = (int) s.data.meshes.size();
+    std::vector<glm::vec3> centers(meshCount);
+    if (imported)
+    {
+        s.bounds.resize(meshCount);
+        for (int i = 0; i < meshCount; ++i)
+        {
+            const SceneMesh & m = s.data.meshes[i];
+            glm::vec3 center;
+            float radius;
+            // Copies come after their source and share its object space
+            if (m.source >= 0)
+                s.bounds[i] = s.bounds[m.source];
+            else
+            {
+                mesh_bounds(m.positions.empty() ? NULL : &m.positions[0], (int) m.positions.size() / 3, center, radius);
+                s.bounds[i] = glm::vec4(center, radius);
+            }
+            centers[i] = glm::vec3(m.objectToWorld * glm::vec4(glm::vec3(s.bounds[i]), 1.f));
+        }
+    }
+    s.importMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.imported = imported;
+        s.failed = !imported;
+        s.cpuBytes += imported ? scene_data_bytes(s.data) : 0;
+    }
+    if (!imported)
+        return;
+
+    // Meshes nearest to the viewpoint first, sorted again every few meshes
+    // as the camera moves. The last pending mesh is the nearest
+    const int RESORT_INTERVAL = 64;
+    std::vector<int> pending;
+    pending.reserve(meshCount);
+    for (int i = meshCount - 1; i >= 0; --i)
+        if (s.data.meshes[i].source < 0)
+            pending.push_back(i);
+    std::vector<char> materialPrepared(s.data.materials.size(), 0);
+    for (int picked = 0; !pending.empty(); ++picked)
+    {
+        glm::vec3 viewpoint;
+        {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            while (s.preparedBytes > s.maxPreparedBytes && !s.quit)
+                s.wake.wait(lock);
+            if (s.quit)
+                return;
+            viewpoint = s.viewpoint;
+        }
+        if (picked % RESORT_INTERVAL == 0)
+        {
+            std::vector<float> distances(meshCount);
+            for (int i = 0; i < meshCount; ++i)
+                distances[i] = glm::length(centers[i] - viewpoint) - s.bounds[i].w;
+            std::sort(pending.begin(), pending.end(), [&](int a, int b) { return distances[a] > distances[b]; });
+        }
+        int i = pending.back();
+        pending.pop_back();
+        const SceneMesh & m = s.data.meshes[i];
+        PROFILE_ZONE("mesh prepare");
+
+        // The material texture comes with the first mesh using it
+        StreamedTexture * texture = NULL;
+        if (m.material >= 0 && m.material < (int) materialPrepared.size() && !materialPrepared[m.material])
+        {
+            materialPrepared[m.material] = 1;
+            const SceneMaterial & material = s.data.materials[m.material];
+            PROFILE_ZONE("texture decode");
+            int comp;
+            int width, height;
+            unsigned char * pixels = material.diffuseTexture.empty() ? NULL : stbi_load(texture_path(s.path, material.diffuseTexture).c_str(), &width, &height, &comp, 3);
+            if (pixels)
+            {
+                texture = new StreamedTexture;
+                texture->material = m.material;
+                texture->pixels = pixels;
+                texture->width = width;
+                texture->height = height;
+            }
+        }
+
+        StreamedMesh * mesh = new StreamedMesh;
+        mesh->mesh = i;
+        if (!m.indices.empty())
+            mesh_lod_build(mesh->lod, &m.positions[0], (int) m.positions.size() / 3, &m.indices[0], (int) m.indices.size(), mesh->lodIndices);
+        else
+            mesh->lod = MeshLod();
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (texture)
+        {
+            size_t bytes = (size_t) texture->width * texture->height * 3;
+            s.readyTextures.push_back(texture);
+            s.preparedBytes += bytes;
+            s.cpuBytes += bytes;
+        }
+        size_t bytes = mesh->lodIndices.capacity() * sizeof(GLuint);
+        s.readyMeshes.push_back(mesh);
+        s.preparedBytes += bytes;
+        s.cpuBytes += bytes;
+    }
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.prepared = true;
+}
+
+void scene_stream_start(SceneStream & s, const char * path, bool forceAssimp, int batchCells, int instanceMinTriangles, const glm::vec3 & viewpoint, size_t maxPreparedBytes)
+{
+    s.path = path;
+    s.forceAssimp = forceAssimp;
+    s.batchCells = batchCells;
+    s.instanceMinTriangles = instanceMinTriangles;
+    s.maxPreparedBytes = maxPreparedBytes;
+    s.importPathName = "";
+    s.importMs = 0.0;
+    s.batchStats = SceneBatchStats();
+    s.instanceStats = SceneInstanceStats();
+    s.imported = false;
+    s.failed = false;
+    s.prepared = false;
+    s.quit = false;
+    s.viewpoint = viewpoint;
+    s.preparedBytes = 0;
+    s.cpuBytes = 0;
+    s.worker = std::thread(scene_stream_run, &s);
+}
+
+void scene_stream_set_viewpoint(SceneStream & s, const glm::vec3 & viewpoint)
+{
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.viewpoint = viewpoint;
+}
+
+void scene_stream_poll(SceneStream & s, std::vector<StreamedMesh *> & meshes, std::vector<StreamedTexture *> & textures)
+{
+    std::lock_guard<std::mutex> lock(s.mutex);
+    meshes.insert(meshes.end(), s.readyMeshes.begin(), s.readyMeshes.end());
+    textures.insert(textures.end(), s.readyTextures.begin(), s.readyTextures.end());
+    s.readyMeshes.clear();
+    s.readyTextures.clear();
+}
+
+void scene_stream_release_mesh(SceneStream & s, StreamedMesh * mesh)
+{
+    // The worker is done with the streams of a mesh once it is prepared
+    SceneMesh & m = s.data.meshes[mesh->mesh];
+    size_t streamBytes = mesh_stream_bytes(m);
+    SceneMesh released;
+    released.material = m.material;
+    released.source = m.source;
+    released.objectToWorld = m.objectToWorld;
+    std::swap(m, released);
+    size_t bytes = mesh->lodIndices.capacity() * sizeof(GLuint);
+    delete mesh;
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.preparedBytes -= std::min(bytes, s.preparedBytes);
+    s.cpuBytes -= std::min(bytes + streamBytes, s.cpuBytes);
+    s.wake.notify_one();
+}
+
+void scene_stream_release_texture(SceneStream & s, StreamedTexture * texture)
+{
+    size_t bytes = (size_t) texture->width * texture->height * 3;
+    stbi_image_free(texture->pixels);
+    delete texture;
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.preparedBytes -= std::min(bytes, s.preparedBytes);
+    s.cpuBytes -= std::min(bytes, s.cpuBytes);
+    s.wake.notify_one();
+}
+
+SceneStreamState scene_stream_state(SceneStream & s)
+{
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.failed)
+        return SCENE_STREAM_FAILED;
+    if (!s.imported)
+        return SCENE_STREAM_IMPORTING;
+    return s.prepared && s.readyMeshes.empty() && s.readyTextures.empty() ? SCENE_STREAM_PREPARED : SCENE_STREAM_PREPARING;
+}
+
+size_t scene_stream_cpu_bytes(SceneStream & s)
+{
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.cpuBytes;
+}
+
+void scene_stream_stop(SceneStream & s)
+{
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.quit = true;
+        s.wake.notify_one();
+    }
+    if (s.worker.joinable())
+        s.worker.join();
+    for (size_t i = 0; i < s.readyMeshes.size(); ++i)
+        delete s.readyMeshes[i];
+    for (size_t i = 0; i < s.readyTextures.size(); ++i)
+    {
+        stbi_image_free(s.readyTextures[i]->pixels);
+        delete s.readyTextures[i];
+    }
+    s.readyMeshes.clear();
+    s.readyTextures.clear();
+    s.data = SceneData();
+    s.bounds.clear();
+    s.preparedBytes = 0;
+    s.cpuBytes = 0;
+}
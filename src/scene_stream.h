@@ -0,0 +1,95 @@
+#ifndef AOGL_SCENE_STREAM_H
+#define AOGL_SCENE_STREAM_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "glew/glew.h"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+
+#include "mesh_lod.h"
+#include "scene.h"
+#include "scene_batch.h"
+#include "scene_instances.h"
+
+// Background scene loading : a worker thread imports the scene, optionally
+// batches its static meshes and finds its repeated geometry, then builds the
+// levels of detail of its meshes and decodes their material textures,
+// nearest to the viewpoint first. The render thread polls what is ready and
+// uploads it under its own budget, nothing here touches OpenGL.
+
+struct StreamedMesh
+{
+    int mesh;
+    MeshLod lod;
+    std::vector<GLuint> lodIndices;
+};
+
+struct StreamedTexture
+{
+    int material;
+    unsigned char * pixels;     // RGB rows
+    int width;
+    int height;
+};
+
+struct SceneStream
+{
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::string path;
+    bool forceAssimp;
+    int batchCells;                     // cells per axis of the static batching, 0 keeps the meshes
+    int instanceMinTriangles;           // smallest repeated piece made a copy, 0 keeps them in place
+    // Prepared data waiting for the render thread, the worker pauses above it
+    size_t maxPreparedBytes;
+
+    // Written by the worker before imported is set, read only afterwards.
+    // The streams of a mesh stay valid until scene_stream_release_mesh
+    SceneData data;
+    std::vector<glm::vec4> bounds;      // object space center and radius
+    const char * importPathName;
+    double importMs;
+    SceneBatchStats batchStats;         // zero when not batched
+    SceneInstanceStats instanceStats;   // zero when repeated geometry is kept
+
+    // Under the mutex
+    bool imported;
+    bool failed;
+    bool prepared;                      // every mesh was handed out
+    bool quit;
+    glm::vec3 viewpoint;                // scene space
+    std::vector<StreamedMesh *> readyMeshes;
+    std::vector<StreamedTexture *> readyTextures;
+    size_t preparedBytes;
+    size_t cpuBytes;                    // scene data not yet released and prepared data
+};
+
+enum SceneStreamState
+{
+    SCENE_STREAM_IMPORTING = 0,
+    SCENE_STREAM_PREPARING,     // imported, data and bounds can be read
+    SCENE_STREAM_PREPARED,      // every mesh was handed out
+    SCENE_STREAM_FAILED
+};
+
+void scene_stream_start(SceneStream & s, const char * path, bool forceAssimp, int batchCells, int instanceMinTriangles, const glm::vec3 & viewpoint, size_t maxPreparedBytes);
+void scene_stream_set_viewpoint(SceneStream & s, const glm::vec3 & viewpoint);
+// Moves the ready items to the caller, which releases them once uploaded.
+// Copies of repeated geometry are never handed out, they draw their source
+void scene_stream_poll(SceneStream & s, std::vector<StreamedMesh *> & meshes, std::vector<StreamedTexture *> & textures);
+// Frees the mesh streams in the scene data along with the prepared mesh
+void scene_stream_release_mesh(SceneStream & s, StreamedMesh * mesh);
+void scene_stream_release_texture(SceneStream & s, StreamedTexture * texture);
+SceneStreamState scene_stream_state(SceneStream & s);
+size_t scene_stream_cpu_bytes(SceneStream & s);
+// Stops the worker and frees what was not handed out
+void scene_stream_stop(SceneStream & s);
+
+#endif
@@ -0,0 +1,257 @@
+#include "tlsf.h"
+
+#include <assert.h>
+#include <algorithm>
+
+static int lowest_bit(uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int bit = 0;
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+static int highest_bit(uint64_t bits)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(bits);
+#else
+    int bit = 0;
+    while (bits >>= 1)
+        ++bit;
+    return bit;
+#endif
+}
+
+// Size class of a size in granules. Below SL_COUNT granules the classes are
+// one granule apart, above they split each power of two in SL_COUNT
+static void mapping(size_t units, int & fl, int & sl)
+{
+    if (units < (size_t) Tlsf::SL_COUNT)
+    {
+        fl = 0;
+        sl = (int) units;
+        return;
+    }
+    int bit = highest_bit(units);
+    fl = bit - Tlsf::SL_LOG2 + 1;
+    sl = (int) (units >> (bit - Tlsf::SL_LOG2)) - Tlsf::SL_COUNT;
+}
+
+static int new_block(Tlsf & t)
+{
+    int b;
+    if (!t.unusedBlocks.empty())
+    {
+        b = t.unusedBlocks.back();
+        t.unusedBlocks.pop_back();
+    }
+    else
+    {
+        b = (int) t.blocks.size();
+        t.blocks.push_back(Tlsf::Block());
+    }
+    Tlsf::Block & block = t.blocks[b];
+    block.prevPhysical = block.nextPhysical = -1;
+    block.prevFree = block.nextFree = -1;
+    block.free = false;
+    block.live = true;
+    return b;
+}
+
+static void release_block(Tlsf & t, int b)
+{
+    t.blocks[b].live = false;
+    t.unusedBlocks.push_back(b);
+}
+
+static void insert_free(Tlsf & t, int b)
+{
+    Tlsf::Block & block = t.blocks[b];
+    int fl, sl;
+    mapping(block.size / t.granularity, fl, sl);
+    block.free = true;
+    block.prevFree = -1;
+    block.nextFree = t.heads[fl][sl];
+    if (block.nextFree != -1)
+        t.blocks[block.nextFree].prevFree = b;
+    t.heads[fl][sl] = b;
+    t.flBitmap |= (uint64_t) 1 << fl;
+    t.slBitmap[fl] |= 1u << sl;
+}
+
+static void remove_free(Tlsf & t, int b)
+{
+    Tlsf::Block & block = t.blocks[b];
+    int fl, sl;
+    mapping(block.size / t.granularity, fl, sl);
+    if (block.prevFree != -1)
+        t.blocks[block.prevFree].nextFree = block.nextFree;
+    else
+        t.heads[fl][sl] = block.nextFree;
+    if (block.nextFree != -1)
+        t.blocks[block.nextFree].prevFree = block.prevFree;
+    if (t.heads[fl][sl] == -1)
+    {
+        t.slBitmap[fl] &= ~(1u << sl);
+        if (!t.slBitmap[fl])
+            t.flBitmap &= ~((uint64_t) 1 << fl);
+    }
+    block.free = false;
+    block.prevFree = block.nextFree = -1;
+}
+
+// Absorbs the physical next block into b
+static void absorb_next(Tlsf & t, int b)
+{
+    int next = t.blocks[b].nextPhysical;
+    Tlsf::Block & block = t.blocks[b];
+    block.size += t.blocks[next].size;
+    block.nextPhysical = t.blocks[next].nextPhysical;
+    if (block.nextPhysical != -1)
+        t.blocks[block.nextPhysical].prevPhysical = b;
+    if (t.lastBlock == next)
+        t.lastBlock = b;
+    release_block(t, next);
+}
+
+void tlsf_init(Tlsf & t, size_t capacity, size_t granularity)
+{
+    assert(granularity && !(granularity & (granularity - 1)));
+    t.blocks.clear();
+    t.unusedBlocks.clear();
+    t.flBitmap = 0;
+    for (int fl = 0; fl < Tlsf::FL_COUNT; ++fl)
+    {
+        t.slBitmap[fl] = 0;
+        for (int sl = 0; sl < Tlsf::SL_COUNT; ++sl)
+            t.heads[fl][sl] = -1;
+    }
+    t.granularity = granularity;
+    t.capacity = capacity / granularity * granularity;
+    t.used = 0;
+    t.allocations = 0;
+    t.lastBlock = -1;
+    if (!t.capacity)
+        return;
+    int b = new_block(t);
+    t.blocks[b].offset = 0;
+    t.blocks[b].size = t.capacity;
+    t.lastBlock = b;
+    insert_free(t, b);
+}
+
+int tlsf_alloc(Tlsf & t, size_t size)
+{
+    size_t units = std::max((size + t.granularity - 1) / t.granularity, (size_t) 1);
+    // Round up to the next class so that any block of the class found fits
+    size_t search = units;
+    if (units >= (size_t) Tlsf::SL_COUNT)
+        search += ((size_t) 1 << (highest_bit(units) - Tlsf::SL_LOG2)) - 1;
+    int fl, sl;
+    mapping(search, fl, sl);
+    if (fl >= Tlsf::FL_COUNT)
+        return -1;
+    uint32_t slBits = t.slBitmap[fl] & (~0u << sl);
+    if (!slBits)
+    {
+        uint64_t flBits = fl + 1 < Tlsf::FL_COUNT ? t.flBitmap & (~(uint64_t) 0 << (fl + 1)) : 0;
+        if (!flBits)
+            return -1;
+        fl = lowest_bit(flBits);
+        slBits = t.slBitmap[fl];
+    }
+    sl = lowest_bit(slBits);
+    int b = t.heads[fl][sl];
+    remove_free(t, b);
+
+    // Split off the remainder
+    size_t bytes = units * t.granularity;
+    if (t.blocks[b].size > bytes)
+    {
+        int rest = new_block(t);
+        Tlsf::Block & block = t.blocks[b];
+        Tlsf::Block & remainder = t.blocks[rest];
+        remainder.offset = block.offset + bytes;
+        remainder.size = block.size - bytes;
+        remainder.prevPhysical = b;
+        remainder.nextPhysical = block.nextPhysical;
+        if (remainder.nextPhysical != -1)
+            t.blocks[remainder.nextPhysical].prevPhysical = rest;
+        block.nextPhysical = rest;
+        block.size = bytes;
+        if (t.lastBlock == b)
+            t.lastBlock = rest;
+        insert_free(t, rest);
+    }
+    t.used += t.blocks[b].size;
+    ++t.allocations;
+    return b;
+}
+
+void tlsf_free(Tlsf & t, int b)
+{
+    assert(t.blocks[b].live && !t.blocks[b].free);
+    t.used -= t.blocks[b].size;
+    --t.allocations;
+    int next = t.blocks[b].nextPhysical;
+    if (next != -1 && t.blocks[next].free)
+    {
+        remove_free(t, next);
+        absorb_next(t, b);
+    }
+    int prev = t.blocks[b].prevPhysical;
+    if (prev != -1 && t.blocks[prev].free)
+    {
+        remove_free(t, prev);
+        absorb_next(t, prev);
+        b = prev;
+    }
+    insert_free(t, b);
+}
+
+int tlsf_last_allocated(const Tlsf & t)
+{
+    int b = t.lastBlock;
+    // Free neighbours are merged, so at most one free block ends the range
+    if (b != -1 && t.blocks[b].free)
+        b = t.blocks[b].prevPhysical;
+    return b;
+}
+
+int tlsf_compact_step(Tlsf & t, int & last)
+{
+    last = tlsf_last_allocated(t);
+    if (last == -1)
+        return -1;
+    int block = tlsf_alloc(t, tlsf_size(t, last));
+    if (block != -1 && tlsf_offset(t, block) > tlsf_offset(t, last))
+    {
+        // Only the free end of the range has room, it is compact
+        tlsf_free(t, block);
+        block = -1;
+    }
+    return block;
+}
+
+void tlsf_stats(const Tlsf & t, TlsfStats & stats)
+{
+    stats.capacity = t.capacity;
+    stats.used = t.used;
+    stats.largestFree = 0;
+    stats.freeBlocks = 0;
+    stats.allocations = t.allocations;
+    for (size_t i = 0; i < t.blocks.size(); ++i)
+        if (t.blocks[i].live && t.blocks[i].free)
+        {
+            stats.largestFree = std::max(stats.largestFree, t.blocks[i].size);
+            ++stats.freeBlocks;
+        }
+}
@@ -0,0 +1,66 @@
+#ifndef AOGL_TLSF_H
+#define AOGL_TLSF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Two level segregated fit allocator over a range of offsets, for memory it
+// does not touch such as OpenGL buffers. Free blocks are kept in lists by
+// power of two and SL_COUNT subdivisions of it, so allocating and freeing are
+// constant time. Neighbour free blocks are merged on free. Sizes are rounded
+// up to the granularity, which is also the alignment of every offset.
+
+struct Tlsf
+{
+    static const int FL_COUNT = 48;
+    static const int SL_LOG2 = 4;
+    static const int SL_COUNT = 1 << SL_LOG2;
+    struct Block
+    {
+        size_t offset;
+        size_t size;
+        int prevPhysical;               // neighbours by offset, -1 at the ends
+        int nextPhysical;
+        int prevFree;                   // free list of the block size class
+        int nextFree;
+        bool free;
+        bool live;                      // false when the slot is unused
+    };
+    std::vector<Block> blocks;
+    std::vector<int> unusedBlocks;
+    uint64_t flBitmap;
+    uint32_t slBitmap[FL_COUNT];
+    int heads[FL_COUNT][SL_COUNT];
+    size_t granularity;
+    size_t capacity;
+    size_t used;
+    int allocations;
+    int lastBlock;                      // highest offset
+};
+
+struct TlsfStats
+{
+    size_t capacity;
+    size_t used;
+    size_t largestFree;
+    int freeBlocks;
+    int allocations;
+};
+
+// granularity is a power of two
+void tlsf_init(Tlsf & t, size_t capacity, size_t granularity);
+// Block handle, -1 when no free block is large enough
+int tlsf_alloc(Tlsf & t, size_t size);
+void tlsf_free(Tlsf & t, int block);
+inline size_t tlsf_offset(const Tlsf & t, int block) { return t.blocks[block].offset; }
+inline size_t tlsf_size(const Tlsf & t, int block) { return t.blocks[block].size; }
+// Allocated block with the highest offset, -1 when there is none
+int tlsf_last_allocated(const Tlsf & t);
+// One step of compaction : allocates a block below the last allocated one
+// and of its size, and sets last to the latter. The caller moves the
+// contents, then frees last. -1 when no lower free block is large enough
+int tlsf_compact_step(Tlsf & t, int & last);
+void tlsf_stats(const Tlsf & t, TlsfStats & stats);
+
+#endif
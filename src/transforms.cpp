@@ -0,0 +1,194 @@
+#include "transforms.h"
+
+#include "glm/glm.hpp"
+
+void mesh_transforms(const glm::mat4 & projection, const glm::mat4 & worldToView, const glm::mat4 & model, const glm::mat4 * objectToWorld, int count, glm::mat4 * mv, glm::mat4 * mvp)
+{
+    const glm::mat4 worldToViewModel = worldToView * model;
+    for (int i = 0; i < count; ++i)
+    {
+        mv[i] = worldToViewModel * objectToWorld[i];
+        mvp[i] = projection * mv[i];
+    }
+}
+
+void points_to_view(const glm::mat4 & worldToView, const glm::vec3 * positions, int count, glm::vec3 * viewPositions)
+{
+    for (int i = 0; i < count; ++i)
+        viewPositions[i] = glm::vec3(worldToView * glm::vec4(positions[i], 1.f));
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_X86 1
+#define TRANSFORM_TARGET(ISA) __attribute__((target(ISA)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define TRANSFORM_X86 1
+#define TRANSFORM_TARGET(ISA)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+const char * TRANSFORM_PATH_NAMES[TRANSFORM_PATH_COUNT] = { "scalar", "sse", "avx" };
+
+void transform_soa_assign(TransformSoa & soa, const glm::mat4 * matrices, int count)
+{
+    soa.count = count;
+    soa.stride = (count + 7) & ~7;
+    soa.elements.assign(16 * soa.stride, 0.f);
+    for (int i = 0; i < count; ++i)
+        for (int e = 0; e < 16; ++e)
+            soa.elements[e * soa.stride + i] = matrices[i][e / 4][e % 4];
+}
+
+TransformPath transform_path_best()
+{
+    static int best = -1;
+    if (best >= 0)
+        return (TransformPath) best;
+    best = TRANSFORM_PATH_SCALAR;
+#if defined(TRANSFORM_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        best = TRANSFORM_PATH_SSE;
+    if (__builtin_cpu_supports("avx"))
+        best = TRANSFORM_PATH_AVX;
+#elif defined(TRANSFORM_X86)
+    int info[4];
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26))
+        best = TRANSFORM_PATH_SSE;
+    // AVX needs the OS to save the ymm registers too
+    if ((info[2] & (1 << 28)) && (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6)
+        best = TRANSFORM_PATH_AVX;
+#endif
+    return (TransformPath) best;
+}
+
+// Matrices [first, count) of the batch, one at a time. a is worldToView *
+// model, p the projection
+static void mesh_transforms_soa_scalar(const glm::mat4 & a, const glm::mat4 & p, const TransformSoa & soa, int first, glm::mat4 * mv, glm::mat4 * mvp)
+{
+    for (int i = first; i < soa.count; ++i)
+    {
+        glm::mat4 m;
+        for (int e = 0; e < 16; ++e)
+            m[e / 4][e % 4] = soa.elements[e * soa.stride + i];
+        mv[i] = a * m;
+        mvp[i] = p * mv[i];
+    }
+}
+
+#ifdef TRANSFORM_X86
+// Each output element of 4 meshes is a dot product of a row of the constant
+// matrix, broadcast, with a column of the 4 object matrices. Rows are then
+// transposed back to glm column major matrices. Products are summed left to
+// right and the projection is applied to the model view, in the same order as
+// glm, so every path gives bit identical matrices and culling decisions
+TRANSFORM_TARGET("sse2")
+static int mesh_transforms_soa_sse(const glm::mat4 & a, const glm::mat4 & p, const TransformSoa & soa, glm::mat4 * mv, glm::mat4 * mvp)
+{
+    __m128 ak[4][4], pk[4][4];
+    for (int k = 0; k < 4; ++k)
+        for (int r = 0; r < 4; ++r)
+        {
+            ak[k][r] = _mm_set1_ps(a[k][r]);
+            pk[k][r] = _mm_set1_ps(p[k][r]);
+        }
+    const float * e = &soa.elements[0];
+    const int stride = soa.stride;
+    int i = 0;
+    for (; i + 4 <= soa.count; i += 4)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            __m128 m0 = _mm_loadu_ps(e + (c * 4 + 0) * stride + i);
+            __m128 m1 = _mm_loadu_ps(e + (c * 4 + 1) * stride + i);
+            __m128 m2 = _mm_loadu_ps(e + (c * 4 + 2) * stride + i);
+            __m128 m3 = _mm_loadu_ps(e + (c * 4 + 3) * stride + i);
+            __m128 rows[4], projectedRows[4];
+            for (int r = 0; r < 4; ++r)
+                rows[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ak[0][r], m0), _mm_mul_ps(ak[1][r], m1)),
+                                                _mm_mul_ps(ak[2][r], m2)), _mm_mul_ps(ak[3][r], m3));
+            for (int r = 0; r < 4; ++r)
+                projectedRows[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(pk[0][r], rows[0]), _mm_mul_ps(pk[1][r], rows[1])),
+                                                         _mm_mul_ps(pk[2][r], rows[2])), _mm_mul_ps(pk[3][r], rows[3]));
+            _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+            _MM_TRANSPOSE4_PS(projectedRows[0], projectedRows[1], projectedRows[2], projectedRows[3]);
+            for (int j = 0; j < 4; ++j)
+            {
+                _mm_storeu_ps(&mv[i + j][c][0], rows[j]);
+                _mm_storeu_ps(&mvp[i + j][c][0], projectedRows[j]);
+            }
+        }
+    }
+    return i;
+}
+
+TRANSFORM_TARGET("avx")
+static int mesh_transforms_soa_avx(const glm::mat4 & a, const glm::mat4 & p, const TransformSoa & soa, glm::mat4 * mv, glm::mat4 * mvp)
+{
+    __m256 ak[4][4], pk[4][4];
+    for (int k = 0; k < 4; ++k)
+        for (int r = 0; r < 4; ++r)
+        {
+            ak[k][r] = _mm256_set1_ps(a[k][r]);
+            pk[k][r] = _mm256_set1_ps(p[k][r]);
+        }
+    const float * e = &soa.elements[0];
+    const int stride = soa.stride;
+    int i = 0;
+    for (; i + 8 <= soa.count; i += 8)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            __m256 m0 = _mm256_loadu_ps(e + (c * 4 + 0) * stride + i);
+            __m256 m1 = _mm256_loadu_ps(e + (c * 4 + 1) * stride + i);
+            __m256 m2 = _mm256_loadu_ps(e + (c * 4 + 2) * stride + i);
+            __m256 m3 = _mm256_loadu_ps(e + (c * 4 + 3) * stride + i);
+            __m256 row[4];
+            __m128 rows[2][4], projectedRows[2][4];
+            for (int r = 0; r < 4; ++r)
+            {
+                row[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ak[0][r], m0), _mm256_mul_ps(ak[1][r], m1)),
+                                                     _mm256_mul_ps(ak[2][r], m2)), _mm256_mul_ps(ak[3][r], m3));
+                rows[0][r] = _mm256_castps256_ps128(row[r]);
+                rows[1][r] = _mm256_extractf128_ps(row[r], 1);
+            }
+            for (int r = 0; r < 4; ++r)
+            {
+                __m256 projectedRow = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pk[0][r], row[0]), _mm256_mul_ps(pk[1][r], row[1])),
+                                                                  _mm256_mul_ps(pk[2][r], row[2])), _mm256_mul_ps(pk[3][r], row[3]));
+                projectedRows[0][r] = _mm256_castps256_ps128(projectedRow);
+                projectedRows[1][r] = _mm256_extractf128_ps(projectedRow, 1);
+            }
+            for (int h = 0; h < 2; ++h)
+            {
+                _MM_TRANSPOSE4_PS(rows[h][0], rows[h][1], rows[h][2], rows[h][3]);
+                _MM_TRANSPOSE4_PS(projectedRows[h][0], projectedRows[h][1], projectedRows[h][2], projectedRows[h][3]);
+                for (int j = 0; j < 4; ++j)
+                {
+                    _mm_storeu_ps(&mv[i + h * 4 + j][c][0], rows[h][j]);
+                    _mm_storeu_ps(&mvp[i + h * 4 + j][c][0], projectedRows[h][j]);
+                }
+            }
+        }
+    }
+    return i;
+}
+#endif
+
+void mesh_transforms_soa(const glm::mat4 & projection, const glm::mat4 & worldToView, const glm::mat4 & model, const TransformSoa & objectToWorld, glm::mat4 * mv, glm::mat4 * mvp, TransformPath path)
+{
+    const glm::mat4 a = worldToView * model;
+    int done = 0;
+#ifdef TRANSFORM_X86
+    if (path == TRANSFORM_PATH_AVX)
+        done = mesh_transforms_soa_avx(a, projection, objectToWorld, mv, mvp);
+    else if (path == TRANSFORM_PATH_SSE)
+        done = mesh_transforms_soa_sse(a, projection, objectToWorld, mv, mvp);
+#else
+    (void) path;
+#endif
+    mesh_transforms_soa_scalar(a, projection, objectToWorld, done, mv, mvp);
+}
@@ -0,0 +1,39 @@
+#ifndef AOGL_TRANSFORMS_H
+#define AOGL_TRANSFORMS_H
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+// Model view and model view projection of each mesh, the shared model matrix
+// is applied after the mesh own object to world matrix
+void mesh_transforms(const glm::mat4 & projection, const glm::mat4 & worldToView, const glm::mat4 & model, const glm::mat4 * objectToWorld, int count, glm::mat4 * mv, glm::mat4 * mvp);
+// World space positions to view space
+void points_to_view(const glm::mat4 & worldToView, const glm::vec3 * positions, int count, glm::vec3 * viewPositions);
+
+// Matrices stored as a structure of arrays : element e (column * 4 + row) of
+// matrix i is at elements[e * stride + i], stride being a multiple of 8
+struct TransformSoa
+{
+    int count;
+    int stride;
+    std::vector<float> elements;
+};
+void transform_soa_assign(TransformSoa & soa, const glm::mat4 * matrices, int count);
+
+enum TransformPath
+{
+    TRANSFORM_PATH_SCALAR = 0,
+    TRANSFORM_PATH_SSE,
+    TRANSFORM_PATH_AVX,
+    TRANSFORM_PATH_COUNT
+};
+extern const char * TRANSFORM_PATH_NAMES[TRANSFORM_PATH_COUNT];
+// Widest path supported by the CPU and the OS, detected once
+TransformPath transform_path_best();
+// Same result as mesh_transforms bit for bit, 4 (SSE) or 8 (AVX) meshes at a
+// time. The path must not be wider than transform_path_best()
+void mesh_transforms_soa(const glm::mat4 & projection, const glm::mat4 & worldToView, const glm::mat4 & model, const TransformSoa & objectToWorld, glm::mat4 * mv, glm::mat4 * mvp, TransformPath path);
+
+#endif
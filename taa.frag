@@ -0,0 +1,58 @@
+#version 410 core
+
+in block
+{
+	vec2 Texcoord;
+} In; 
+
+// Temporal anti-aliasing : blends the jittered current frame with the
+// reprojected history, clamped to the 3x3 neighbourhood of the current frame
+
+uniform sampler2D Texture;
+uniform sampler2D History;
+uniform sampler2D Velocity;
+uniform sampler2D Depth;
+uniform float Feedback = 0.9;
+uniform bool HistoryValid = false;
+uniform mat4 CurrentToPrevious;
+uniform vec2 Jitter;
+uniform vec2 ViewportScale = vec2(1.0);
+
+layout(location = 0, index = 0) out vec4 Color;
+
+vec2 previousTexcoord(ivec2 coord)
+{
+	float depth = texelFetch(Depth, coord, 0).r;
+	if (depth < 1.0)
+		return In.Texcoord - texelFetch(Velocity, coord, 0).rg * ViewportScale;
+	// Background has no velocity, reproject it with the camera matrices
+	vec4 ndc = vec4(In.Texcoord / ViewportScale * 2.0 - 1.0 - Jitter, depth * 2.0 - 1.0, 1.0);
+	vec4 previous = CurrentToPrevious * ndc;
+	return (previous.xy / previous.w * 0.5 + 0.5) * ViewportScale;
+}
+
+void main(void)
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	ivec2 maxCoord = ivec2(vec2(textureSize(Texture, 0)) * ViewportScale) - 1;
+
+	vec3 current = texelFetch(Texture, coord, 0).rgb;
+	vec3 mn = current;
+	vec3 mx = current;
+	for (int i = -1; i <= 1; ++i)
+	for (int j = -1; j <= 1; ++j)
+	{
+		vec3 s = texelFetch(Texture, clamp(coord + ivec2(i, j), ivec2(0), maxCoord), 0).rgb;
+		mn = min(mn, s);
+		mx = max(mx, s);
+	}
+
+	vec2 uv = previousTexcoord(coord);
+	if (!HistoryValid || any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, ViewportScale)))
+	{
+		Color = vec4(current, 1.0);
+		return;
+	}
+	vec3 history = clamp(texture(History, uv).rgb, mn, mx);
+	Color = vec4(mix(current, history, Feedback), 1.0);
+}
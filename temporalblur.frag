@@ -0,0 +1,74 @@
+#version 410 core
+
+in block
+{
+	vec2 Texcoord;
+} In; 
+
+// Temporally accumulated blur : each frame takes a few jittered taps in a
+// disk of SampleCount pixels and blends them with the reprojected blur of
+// the previous frames. History is clamped to the range of the current taps
+// to reject ghosting.
+
+const float TWOPI = 6.28318530718;
+const float GOLDEN_ANGLE = 2.39996322973;
+const int TAP_COUNT = 8;
+
+uniform sampler2D Texture;
+uniform sampler2D History;
+uniform sampler2D Velocity;
+uniform sampler2D Depth;
+uniform int SampleCount;
+uniform int Frame;
+uniform float Feedback = 0.9;
+uniform bool HistoryValid = false;
+uniform mat4 CurrentToPrevious;
+uniform vec2 Jitter;
+uniform vec2 ViewportScale = vec2(1.0);
+
+layout(location = 0, index = 0) out vec4 Color;
+
+vec2 previousTexcoord(ivec2 coord)
+{
+	float depth = texelFetch(Depth, coord, 0).r;
+	if (depth < 1.0)
+		return In.Texcoord - texelFetch(Velocity, coord, 0).rg * ViewportScale;
+	// Background has no velocity, reproject it with the camera matrices
+	vec4 ndc = vec4(In.Texcoord / ViewportScale * 2.0 - 1.0 - Jitter, depth * 2.0 - 1.0, 1.0);
+	vec4 previous = CurrentToPrevious * ndc;
+	return (previous.xy / previous.w * 0.5 + 0.5) * ViewportScale;
+}
+
+void main(void)
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	ivec2 maxCoord = ivec2(vec2(textureSize(Texture, 0)) * ViewportScale) - 1;
+
+	// Interleaved gradient noise rotates the tap pattern per pixel and per frame
+	float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy + 5.588238 * float(Frame % 64), vec2(0.06711056, 0.00583715))));
+	float rotation = TWOPI * noise;
+
+	vec3 current = vec3(0.0);
+	vec3 mn = vec3(1e9);
+	vec3 mx = vec3(-1e9);
+	for (int i = 0; i < TAP_COUNT; ++i)
+	{
+		float r = SampleCount * sqrt((float(i) + 0.5) / float(TAP_COUNT));
+		float a = rotation + float(i) * GOLDEN_ANGLE;
+		ivec2 tap = clamp(coord + ivec2(round(r * vec2(cos(a), sin(a)))), ivec2(0), maxCoord);
+		vec3 s = texelFetch(Texture, tap, 0).rgb;
+		current += s;
+		mn = min(mn, s);
+		mx = max(mx, s);
+	}
+	current /= float(TAP_COUNT);
+
+	vec2 uv = previousTexcoord(coord);
+	if (!HistoryValid || any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, ViewportScale)))
+	{
+		Color = vec4(current, 1.0);
+		return;
+	}
+	vec3 history = clamp(texture(History, uv).rgb, mn, mx);
+	Color = vec4(mix(current, history, Feedback), 1.0);
+}
@@ -0,0 +1,540 @@
+// Consistency checks of the renderer CPU code. Like aogl_bench nothing here
+// needs an OpenGL context, every case runs on the code shared with aogl
+// through aoglcore. Exits with 1 when a case fails.
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "culling.h"
+#include "scene_batch.h"
+#include "scene_instances.h"
+#include "tlsf.h"
+#include "transforms.h"
+
+struct TestCase
+{
+    const char * name;
+    // Returns false on failure, after printing what differed
+    bool (*run)();
+};
+
+#define TEST_CHECK(condition, ...) \
+    do { if (!(condition)) { printf("  %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); return false; } } while (0)
+
+// -1 when the box is outside the frustum, 1 when fully inside, 0 otherwise.
+// A box touching a plane intersects it
+static int box_frustum_test(const glm::vec4 planes[6], const glm::vec3 & lower, const glm::vec3 & upper)
+{
+    int result = 1;
+    for (int i = 0; i < 6; ++i)
+    {
+        glm::vec3 normal = glm::vec3(planes[i]);
+        glm::vec3 positive = glm::mix(lower, upper, glm::step(glm::vec3(0.f), normal));
+        glm::vec3 negative = glm::mix(upper, lower, glm::step(glm::vec3(0.f), normal));
+        if (glm::dot(normal, positive) + planes[i].w < 0.f)
+            return -1;
+        if (glm::dot(normal, negative) + planes[i].w < 0.f)
+            result = 0;
+    }
+    return result;
+}
+
+// The SIMD transform paths against the scalar reference : matrices must be
+// bit identical, and so the culling of object space boxes against the
+// planes of each mesh MVP. A third of the boxes are moved onto one of the
+// planes, where a difference of one ulp in the matrix flips the result
+static bool test_transforms_soa_cull()
+{
+    // Not a multiple of 8, the tail goes through the scalar loop
+    const int COUNT = 2051;
+    const int BOXES = 16;
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> position(-50.f, 50.f);
+    std::uniform_real_distribution<float> angle(0.f, 6.2831853f);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::vector<glm::mat4> objectToWorld(COUNT);
+    for (int i = 0; i < COUNT; ++i)
+    {
+        glm::mat4 m = glm::translate(glm::mat4(), glm::vec3(position(rng), position(rng), position(rng)));
+        m = glm::rotate(m, angle(rng), glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + 0.1f));
+        objectToWorld[i] = glm::scale(m, glm::vec3(0.5f + 2.f * unit(rng)));
+    }
+    TransformSoa soa;
+    transform_soa_assign(soa, &objectToWorld[0], COUNT);
+    const glm::mat4 projection = glm::perspective(0.8f, 16.f / 9.f, 0.1f, 80.f);
+    const glm::mat4 worldToView = glm::lookAt(glm::vec3(3.f, 2.f, 10.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+    const glm::mat4 model = glm::scale(glm::mat4(), glm::vec3(0.01f));
+
+    std::vector<glm::mat4> referenceMv(COUNT), referenceMvp(COUNT);
+    mesh_transforms(projection, worldToView, model, &objectToWorld[0], COUNT, &referenceMv[0], &referenceMvp[0]);
+
+    // Boxes in the object space of each mesh, the same for every path
+    std::vector<glm::vec3> lower(COUNT * BOXES), upper(COUNT * BOXES);
+    int onPlane = 0;
+    for (int i = 0; i < COUNT; ++i)
+    {
+        glm::vec4 planes[6];
+        frustum_planes(referenceMvp[i], planes);
+        for (int b = 0; b < BOXES; ++b)
+        {
+            glm::vec3 center(position(rng) * 40.f, position(rng) * 40.f, position(rng) * 40.f);
+            glm::vec3 extent = glm::vec3(unit(rng), unit(rng), unit(rng)) * 20.f;
+            if (b % 3 == 0)
+            {
+                // Slide the box along the plane normal until its positive vertex is on the plane
+                const glm::vec4 & plane = planes[b % 6];
+                glm::vec3 normal = glm::vec3(plane);
+                glm::vec3 positive = center + extent * glm::sign(normal);
+                center -= normal * (glm::dot(normal, positive) + plane.w);
+                float distance = glm::dot(normal, center + extent * glm::sign(normal)) + plane.w;
+                onPlane += std::fabs(distance) < 1e-3f;
+            }
+            lower[i * BOXES + b] = center - extent;
+            upper[i * BOXES + b] = center + extent;
+        }
+    }
+
+    std::vector<int> referenceCull(COUNT * BOXES);
+    int outside = 0, intersecting = 0;
+    for (int i = 0; i < COUNT; ++i)
+    {
+        glm::vec4 planes[6];
+        frustum_planes(referenceMvp[i], planes);
+        for (int b = 0; b < BOXES; ++b)
+        {
+            int result = box_frustum_test(planes, lower[i * BOXES + b], upper[i * BOXES + b]);
+            referenceCull[i * BOXES + b] = result;
+            outside += result < 0;
+            intersecting += result == 0;
+        }
+    }
+
+    for (int path = TRANSFORM_PATH_SCALAR; path <= transform_path_best(); ++path)
+    {
+        std::vector<glm::mat4> mv(COUNT), mvp(COUNT);
+        mesh_transforms_soa(projection, worldToView, model, soa, &mv[0], &mvp[0], (TransformPath) path);
+        int matrixMismatches = 0, cullMismatches = 0;
+        for (int i = 0; i < COUNT; ++i)
+        {
+            if (memcmp(&mv[i], &referenceMv[i], sizeof(glm::mat4)) || memcmp(&mvp[i], &referenceMvp[i], sizeof(glm::mat4)))
+                ++matrixMismatches;
+            glm::vec4 planes[6];
+            frustum_planes(mvp[i], planes);
+            for (int b = 0; b < BOXES; ++b)
+                cullMismatches += box_frustum_test(planes, lower[i * BOXES + b], upper[i * BOXES + b]) != referenceCull[i * BOXES + b];
+        }
+        printf("  %-6s %d meshes, %d boxes (%d on a plane, %d outside, %d intersecting) : %d matrices and %d cull results differ\n",
+               TRANSFORM_PATH_NAMES[path], COUNT, COUNT * BOXES, onPlane, outside, intersecting, matrixMismatches, cullMismatches);
+        TEST_CHECK(matrixMismatches == 0 && cullMismatches == 0, "%s path differs from the scalar reference", TRANSFORM_PATH_NAMES[path]);
+    }
+    return true;
+}
+
+// Appends a quad with its face normal, vertices counter clockwise seen from the normal
+static void add_quad(SceneMesh & m, const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c, const glm::vec3 & d)
+{
+    glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+    GLuint base = (GLuint) (m.positions.size() / 3);
+    const glm::vec3 corners[4] = { a, b, c, d };
+    for (int i = 0; i < 4; ++i)
+    {
+        m.positions.insert(m.positions.end(), &corners[i].x, &corners[i].x + 3);
+        m.normals.insert(m.normals.end(), &n.x, &n.x + 3);
+        m.uvs.push_back((float) (i & 1));
+        m.uvs.push_back((float) (i >> 1));
+    }
+    const GLuint indices[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+    m.indices.insert(m.indices.end(), indices, indices + 6);
+}
+
+// Appends a flat shaded box, faces outward, its corners moved by transform
+static void add_box(SceneMesh & m, const glm::vec3 & lo, const glm::vec3 & hi, const glm::mat4 & transform)
+{
+    glm::vec3 c[8];
+    for (int i = 0; i < 8; ++i)
+        c[i] = glm::vec3(transform * glm::vec4(i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z, 1.f));
+    add_quad(m, c[2], c[6], c[7], c[3]);
+    add_quad(m, c[0], c[1], c[5], c[4]);
+    add_quad(m, c[0], c[4], c[6], c[2]);
+    add_quad(m, c[1], c[3], c[7], c[5]);
+    add_quad(m, c[0], c[2], c[3], c[1]);
+    add_quad(m, c[4], c[5], c[7], c[6]);
+}
+
+// Sum of the world space triangle areas, and false when a triangle faces away
+// from the normal of its first vertex, the other way for mirrored meshes
+static bool scene_world_triangles(const SceneData & data, double & area, size_t & triangles)
+{
+    bool facing = true;
+    for (size_t i = 0; i < data.meshes.size(); ++i)
+    {
+        const SceneMesh & m = data.meshes[i];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(m.objectToWorld)));
+        float mirror = glm::determinant(glm::mat3(m.objectToWorld)) < 0.f ? -1.f : 1.f;
+        for (size_t t = 0; t + 2 < m.indices.size(); t += 3)
+        {
+            glm::vec3 p[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                GLuint v = m.indices[t + j];
+                p[j] = glm::vec3(m.objectToWorld * glm::vec4(m.positions[3*v], m.positions[3*v+1], m.positions[3*v+2], 1.f));
+            }
+            glm::vec3 face = glm::cross(p[1] - p[0], p[2] - p[0]);
+            GLuint v = m.indices[t];
+            glm::vec3 n = normalMatrix * glm::vec3(m.normals[3*v], m.normals[3*v+1], m.normals[3*v+2]);
+            facing = facing && mirror * glm::dot(face, n) > 0.f;
+            area += 0.5 * glm::length(face);
+            ++triangles;
+        }
+    }
+    return facing;
+}
+
+// Static batching of a scene as the native importer gives it, one mesh per
+// material : a ground spanning the scene and a mesh of small boxes, mirrored.
+// Both are cut into the grid cells, the boxes stay whole, the triangles, their
+// areas and their facing are kept
+static bool test_scene_batch_cells()
+{
+    const int CELLS = 4;
+    const int BOXES = 60;
+    SceneData data;
+    data.meshes.resize(2);
+    SceneMesh & ground = data.meshes[0];
+    for (int z = 0; z < 16; ++z)
+        for (int x = 0; x < 16; ++x)
+            add_quad(ground, glm::vec3(x, 0.f, z), glm::vec3(x, 0.f, z + 1), glm::vec3(x + 1, 0.f, z + 1), glm::vec3(x + 1, 0.f, z));
+    ground.material = 0;
+    ground.source = -1;
+    ground.objectToWorld = glm::scale(glm::mat4(), glm::vec3(5.f));
+    SceneMesh & boxes = data.meshes[1];
+    std::mt19937 rng(46);
+    std::uniform_real_distribution<float> position(1.f, 79.f);
+    for (int b = 0; b < BOXES; ++b)
+    {
+        glm::vec3 lo(position(rng), 0.f, position(rng));
+        glm::vec3 hi = lo + glm::vec3(0.5f, 2.f, 0.5f);
+        add_box(boxes, lo, hi, glm::mat4());
+    }
+    boxes.material = 1;
+    boxes.source = -1;
+    // Mirrored in x, moved back over the ground
+    boxes.objectToWorld = glm::scale(glm::translate(glm::mat4(), glm::vec3(80.f, 0.f, 0.f)), glm::vec3(-1.f, 1.f, 1.f));
+
+    double areaBefore = 0.0, areaAfter = 0.0;
+    size_t trianglesBefore = 0, trianglesAfter = 0;
+    TEST_CHECK(scene_world_triangles(data, areaBefore, trianglesBefore), "the test scene faces away from its normals");
+    SceneBatchStats stats;
+    scene_batch(data, CELLS, &stats);
+    bool facing = scene_world_triangles(data, areaAfter, trianglesAfter);
+    printf("  %d meshes, %d split, into %d in %d chunks : %zu triangles, area %.3f, after %zu triangles, area %.3f\n",
+           stats.sourceMeshes, stats.splitMeshes, stats.meshes, stats.chunks, trianglesBefore, areaBefore, trianglesAfter, areaAfter);
+    TEST_CHECK(stats.splitMeshes == 2, "%d meshes cut across cells, expected 2", stats.splitMeshes);
+    TEST_CHECK(trianglesAfter == trianglesBefore, "triangle count changed");
+    TEST_CHECK(std::fabs(areaAfter - areaBefore) <= 1e-5 * areaBefore, "triangle areas changed");
+    TEST_CHECK(facing, "a triangle changed winding");
+
+    // The grid is 80 units over 4 cells, the boxes are half a unit wide and
+    // the ground quads 5 units : each merged mesh fits in its cell once its
+    // last boxes or quads are added
+    const float cellSize = 80.f / CELLS;
+    int groundMeshes = 0;
+    for (size_t i = 0; i < data.meshes.size(); ++i)
+    {
+        const SceneMesh & m = data.meshes[i];
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (size_t v = 0; v < m.positions.size() / 3; ++v)
+        {
+            glm::vec3 p = glm::vec3(m.objectToWorld * glm::vec4(m.positions[3*v], m.positions[3*v+1], m.positions[3*v+2], 1.f));
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        float margin = m.material == 0 ? 5.f : 0.5f;
+        TEST_CHECK(hi.x - lo.x <= cellSize + margin && hi.z - lo.z <= cellSize + margin, "mesh %zu spans %.1f x %.1f, over a cell", i, hi.x - lo.x, hi.z - lo.z);
+        TEST_CHECK(m.material == 1 || m.indices.size() % 6 == 0, "a ground quad was cut");
+        TEST_CHECK(m.material == 0 || m.indices.size() % 36 == 0, "a box was cut");
+        groundMeshes += m.material == 0;
+    }
+    TEST_CHECK(groundMeshes == CELLS * CELLS, "the ground is in %d meshes, expected %d", groundMeshes, CELLS * CELLS);
+    return true;
+}
+
+// Repeated geometry at import : flat shaded boxes, whose faces share no
+// vertex, moved, turned and scaled in two meshes, over a ground of quads.
+// Pieces meeting at a vertex position are one, the ground is kept clear of
+// the boxes. Each box is one piece, the first becomes the geometry and the others its
+// copies, with transforms that put its vertices back where the boxes were
+static bool test_scene_find_instances()
+{
+    const glm::vec3 lo(0.f), hi(0.5f, 2.f, 0.5f);
+    const glm::mat4 placed[4] = {
+        glm::mat4(),
+        glm::scale(glm::rotate(glm::translate(glm::mat4(), glm::vec3(10.f, 0.f, 3.f)), 0.5f, glm::vec3(0.f, 1.f, 0.f)), glm::vec3(1.5f)),
+        glm::translate(glm::mat4(), glm::vec3(-5.f, 0.f, 8.f)),
+        // In the second mesh, moved by its object to world
+        glm::scale(glm::mat4(), glm::vec3(1.f, 0.5f, 1.f)),
+    };
+    const glm::mat4 secondToWorld = glm::translate(glm::mat4(), glm::vec3(0.f, 0.f, 20.f));
+    SceneData data;
+    data.meshes.resize(2);
+    SceneMesh & first = data.meshes[0];
+    for (int b = 0; b < 3; ++b)
+        add_box(first, lo, hi, placed[b]);
+    for (int z = 0; z < 4; ++z)
+        for (int x = 0; x < 4; ++x)
+            add_quad(first, glm::vec3(x, -0.1f, z), glm::vec3(x, -0.1f, z + 1), glm::vec3(x + 1, -0.1f, z + 1), glm::vec3(x + 1, -0.1f, z));
+    first.material = 0;
+    first.source = -1;
+    first.objectToWorld = glm::mat4();
+    SceneMesh & second = data.meshes[1];
+    add_box(second, lo, hi, placed[3]);
+    second.material = 0;
+    second.source = -1;
+    second.objectToWorld = secondToWorld;
+
+    SceneInstanceStats stats;
+    scene_find_instances(data, 2, &stats);
+    const size_t boxBytes = 24 * 8 * sizeof(float) + 36 * sizeof(GLuint);
+    printf("  4 flat shaded boxes and 16 ground quads : %d geometries, %d copies, %zu bytes saved, %d meshes\n",
+           stats.geometries, stats.copies, stats.bytesSaved, (int) data.meshes.size());
+    TEST_CHECK(stats.geometries == 1 && stats.copies == 3, "%d geometries and %d copies, expected 1 and 3", stats.geometries, stats.copies);
+    TEST_CHECK(stats.bytesSaved == 3 * boxBytes, "%zu bytes saved, expected %zu", stats.bytesSaved, 3 * boxBytes);
+    // The ground, then the geometry and its copies, the second mesh is left empty
+    TEST_CHECK(data.meshes.size() == 5, "%d meshes, expected 5", (int) data.meshes.size());
+    TEST_CHECK(data.meshes[0].indices.size() == 16 * 6 && data.meshes[0].source == -1, "the ground was changed");
+    const SceneMesh & geometry = data.meshes[1];
+    TEST_CHECK(geometry.indices.size() == 36 && geometry.positions.size() == 24 * 3 && geometry.source == -1, "the geometry is not a box");
+
+    // Copies put the geometry vertices on the corners of their box, each box once
+    SceneMesh expected;
+    bool found[4] = { true, false, false, false };
+    for (size_t c = 2; c < data.meshes.size(); ++c)
+    {
+        const SceneMesh & copy = data.meshes[c];
+        TEST_CHECK(copy.source == 1 && copy.positions.empty() && copy.indices.empty(), "mesh %zu is not a copy of the geometry", c);
+        int match = -1;
+        for (int b = 1; b < 4 && match < 0; ++b)
+        {
+            expected = SceneMesh();
+            add_box(expected, lo, hi, (b == 3 ? secondToWorld : glm::mat4()) * placed[b]);
+            float error = 0.f;
+            for (size_t v = 0; v < 24; ++v)
+            {
+                glm::vec3 p = glm::vec3(copy.objectToWorld * glm::vec4(geometry.positions[3*v], geometry.positions[3*v+1], geometry.positions[3*v+2], 1.f));
+                error = std::max(error, glm::length(p - glm::vec3(expected.positions[3*v], expected.positions[3*v+1], expected.positions[3*v+2])));
+            }
+            if (error < 1e-4f && !found[b])
+                match = b;
+        }
+        TEST_CHECK(match > 0, "the transform of copy %zu puts the box nowhere expected", c);
+        found[match] = true;
+    }
+    return true;
+}
+
+// Grouping of repeated geometry into instanced draws, as the scene pass does
+// it : a source with N visible copies at its level goes out as one draw of
+// N + 1 instances, whichever of them is drawn first. Copies not visible or
+// at another level are left out, groups stop at the instance limit
+static bool test_scene_instance_groups()
+{
+    const int MAX_INSTANCES = 16;
+    for (int copyCount = 1; copyCount <= 2 * MAX_INSTANCES; ++copyCount)
+    {
+        // The source is mesh 0, its copies follow
+        const int meshCount = copyCount + 1;
+        std::vector<unsigned int> copies;
+        for (int c = 1; c <= copyCount; ++c)
+            copies.push_back((unsigned int) c);
+        std::vector<char> visible(meshCount, 1);
+        std::vector<int> levels(meshCount, 0);
+        for (int first = 0; first < meshCount; first += copyCount)
+        {
+            std::vector<char> drawn(meshCount, 0);
+            unsigned int group[MAX_INSTANCES];
+            int draws = 0, instances = 0;
+            for (int i = first; i < meshCount + first; ++i)
+            {
+                unsigned int mesh = (unsigned int) (i % meshCount);
+                if (drawn[mesh])
+                    continue;
+                int count = scene_instance_group(mesh, 0, copies, &visible[0], &levels[0], &drawn[0], group, MAX_INSTANCES);
+                TEST_CHECK(group[0] == mesh, "%d copies : the group of mesh %u starts with mesh %u", copyCount, mesh, group[0]);
+                ++draws;
+                instances += count;
+            }
+            int expectedDraws = (meshCount + MAX_INSTANCES - 1) / MAX_INSTANCES;
+            TEST_CHECK(instances == meshCount && draws == expectedDraws, "%d copies from mesh %d : %d instances in %d draws, expected %d in %d",
+                       copyCount, first, instances, draws, meshCount, expectedDraws);
+        }
+    }
+
+    // Hidden copies and copies at another level
+    std::vector<unsigned int> copies;
+    for (unsigned int c = 1; c <= 6; ++c)
+        copies.push_back(c);
+    const char visible[7] = { 1, 1, 0, 1, 1, 1, 1 };
+    const int levels[7] = { 0, 0, 0, 1, 0, 0, 0 };
+    char drawn[7] = { 0, 0, 0, 0, 0, 0, 0 };
+    unsigned int group[16];
+    int count = scene_instance_group(4, 0, copies, visible, levels, drawn, group, 16);
+    TEST_CHECK(count == 5 && group[0] == 4 && group[1] == 0 && group[2] == 1 && group[3] == 5 && group[4] == 6,
+               "a group of %d instances with hidden or other level copies", count);
+    TEST_CHECK(!drawn[2] && !drawn[3], "a hidden or other level copy was drawn");
+    printf("  1 to %d copies of a source, drawn first or last : N + 1 instances per draw, %d at most\n", 2 * MAX_INSTANCES, MAX_INSTANCES);
+    return true;
+}
+
+// Compaction of a TLSF range as the buffer heaps do it, on a byte array in
+// place of the buffer : after allocations and frees in random order, steps
+// move the last block down until none fits lower. Every block keeps its
+// contents, none overlaps another, the used bytes do not change and the
+// largest free block grows
+static bool test_tlsf_compaction()
+{
+    const size_t CAPACITY = 1 << 20;
+    const size_t GRANULARITY = 256;
+    Tlsf tlsf;
+    tlsf_init(tlsf, CAPACITY, GRANULARITY);
+    std::vector<unsigned char> memory(CAPACITY, 0);
+    std::mt19937 rng(48);
+    std::uniform_int_distribution<int> size(1, 24 * 1024);
+    // Block of each live allocation, its contents are the allocation number
+    std::vector<int> blocks;
+    std::vector<int> ids;
+    int nextId = 1;
+    for (int round = 0; round < 2000; ++round)
+    {
+        if (!blocks.empty() && rng() % 3 == 0)
+        {
+            size_t k = rng() % blocks.size();
+            tlsf_free(tlsf, blocks[k]);
+            blocks[k] = blocks.back();
+            ids[k] = ids.back();
+            blocks.pop_back();
+            ids.pop_back();
+            continue;
+        }
+        int block = tlsf_alloc(tlsf, (size_t) size(rng));
+        if (block == -1)
+            continue;
+        memset(&memory[tlsf_offset(tlsf, block)], nextId & 0xff, tlsf_size(tlsf, block));
+        blocks.push_back(block);
+        ids.push_back(nextId++);
+    }
+    TlsfStats before;
+    tlsf_stats(tlsf, before);
+
+    int moves = 0;
+    size_t movedBytes = 0;
+    for (;;)
+    {
+        int last;
+        int block = tlsf_compact_step(tlsf, last);
+        if (block == -1)
+            break;
+        TEST_CHECK(tlsf_offset(tlsf, block) + tlsf_size(tlsf, block) <= tlsf_offset(tlsf, last), "block %d moved to an overlapping or higher range", last);
+        memcpy(&memory[tlsf_offset(tlsf, block)], &memory[tlsf_offset(tlsf, last)], tlsf_size(tlsf, last));
+        tlsf_free(tlsf, last);
+        size_t k = std::find(blocks.begin(), blocks.end(), last) - blocks.begin();
+        TEST_CHECK(k < blocks.size(), "compaction moved block %d, not allocated", last);
+        blocks[k] = block;
+        ++moves;
+        movedBytes += tlsf_size(tlsf, block);
+    }
+    TlsfStats after;
+    tlsf_stats(tlsf, after);
+    printf("  %d blocks, %zu KB used : %d moves, %zu KB copied, free blocks %d -> %d, largest free %zu -> %zu KB\n",
+           (int) blocks.size(), before.used / 1024, moves, movedBytes / 1024, before.freeBlocks, after.freeBlocks, before.largestFree / 1024, after.largestFree / 1024);
+    TEST_CHECK(after.used == before.used && after.allocations == before.allocations, "used bytes or allocations changed");
+    TEST_CHECK(moves > 0 && after.largestFree > before.largestFree, "compaction did not grow the largest free block");
+
+    // Contents in place, and no two blocks share a byte
+    std::vector<char> owned(CAPACITY, 0);
+    for (size_t k = 0; k < blocks.size(); ++k)
+    {
+        size_t offset = tlsf_offset(tlsf, blocks[k]);
+        for (size_t b = offset; b < offset + tlsf_size(tlsf, blocks[k]); ++b)
+        {
+            TEST_CHECK(!owned[b], "byte %zu belongs to two blocks", b);
+            TEST_CHECK(memory[b] == (ids[k] & 0xff), "allocation %d lost its contents at byte %zu", ids[k], b);
+            owned[b] = 1;
+        }
+    }
+    return true;
+}
+
+static const TestCase TEST_CASES[] = {
+    { "transforms_soa_cull", test_transforms_soa_cull },
+    { "scene_batch_cells", test_scene_batch_cells },
+    { "scene_find_instances", test_scene_find_instances },
+    { "scene_instance_groups", test_scene_instance_groups },
+    { "tlsf_compaction", test_tlsf_compaction },
+};
+static const int TEST_CASE_COUNT = sizeof(TEST_CASES) / sizeof(TEST_CASES[0]);
+
+// Comma separated substrings, a case runs when its name contains one of them
+static bool test_filter_match(const char * filter, const char * name)
+{
+    if (!filter)
+        return true;
+    std::string list = filter;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string pattern = list.substr(start, end - start);
+        if (!pattern.empty() && strstr(name, pattern.c_str()))
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+int main( int argc, char **argv )
+{
+    const char * filter = NULL;
+    bool list = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+            filter = argv[++i];
+        else if (!strcmp(argv[i], "--list"))
+            list = true;
+        else
+        {
+            fprintf(stderr, "Usage : %s [--filter <name,...>] [--list]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int failures = 0;
+    for (int i = 0; i < TEST_CASE_COUNT; ++i)
+    {
+        const TestCase & c = TEST_CASES[i];
+        if (!test_filter_match(filter, c.name))
+            continue;
+        if (list)
+        {
+            printf("%s\n", c.name);
+            continue;
+        }
+        printf("%s\n", c.name);
+        bool passed = c.run();
+        printf("%s %s\n", passed ? "  passed" : "  FAILED", c.name);
+        failures += !passed;
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+#version 410 core
+
+uniform sampler2D LightCount;
+uniform sampler2D Overdraw;
+uniform int TileSize = 16;
+uniform ivec2 RenderSize;
+
+layout(location = 0, index = 0) out vec4 Color;
+
+// One fragment per tile : a tiled light culling evaluates for every pixel
+// the lights touching the tile, approximated by the largest per pixel count
+void main(void)
+{
+	ivec2 origin = ivec2(gl_FragCoord.xy) * TileSize;
+	ivec2 end = min(origin + ivec2(TileSize), RenderSize);
+	float maxLights = 0.0;
+	float overdraw = 0.0;
+	for (int y = origin.y; y < end.y; ++y)
+	{
+		for (int x = origin.x; x < end.x; ++x)
+		{
+			maxLights = max(maxLights, texelFetch(LightCount, ivec2(x, y), 0).r);
+			overdraw += texelFetch(Overdraw, ivec2(x, y), 0).r;
+		}
+	}
+	ivec2 size = max(end - origin, ivec2(1));
+	Color = vec4(maxLights, overdraw / float(size.x * size.y), 0.0, 1.0);
+}
@@ -4,20 +4,26 @@
 #define NORMAL		1
 #define TEXCOORD	2
 #define FRAG_COLOR	0
+#define VELOCITY	2
 
 precision highp int;
 
 uniform sampler2D Diffuse;
 uniform vec3 DiffuseColor;
+// Sub-pixel offset of the projection, excluded from the velocity
+uniform vec2 Jitter;
 
 in block
 {
 	vec2 TexCoord;
 	vec3 Normal;
+	vec4 Position;
+	vec4 PreviousPosition;
 } In;
 
 layout(location = FRAG_COLOR, index = 0) out vec4 FragColor;
 layout(location = NORMAL) out vec4 Normal;
+layout(location = VELOCITY) out vec2 Velocity;
 
 subroutine vec3 diffuseColor();
 
@@ -44,4 +50,5 @@ void main()
 	vec3 diffuse = cdiff * ndotl;
 	FragColor = vec4(diffuse, 1.0);
 	Normal = vec4(n, 30);
+	Velocity = (In.Position.xy / In.Position.w - Jitter - In.PreviousPosition.xy / In.PreviousPosition.w) * 0.5;
 }
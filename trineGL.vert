@@ -9,6 +9,7 @@ precision highp float;
 precision highp int;
 
 uniform mat4 MVP;
+uniform mat4 PrevMVP;
 
 layout(location = POSITION) in vec3 Position;
 layout(location = NORMAL) in vec3 Normal;
@@ -19,10 +20,15 @@ out gl_PerVertex
 	vec4 gl_Position;
 };
 
+// Must match the depth pre-pass
+invariant gl_Position;
+
 out block
 {
 	vec2 TexCoord;
 	vec3 Normal;
+	vec4 Position;
+	vec4 PreviousPosition;
 } Out;
 
 void main()
@@ -30,4 +36,6 @@ void main()
 	gl_Position = MVP * vec4(Position, 1.0);
 	Out.TexCoord = TexCoord;
 	Out.Normal = Normal;
+	Out.Position = gl_Position;
+	Out.PreviousPosition = PrevMVP * vec4(Position, 1.0);
 }
\ No newline at end of file
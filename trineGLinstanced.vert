@@ -0,0 +1,46 @@
+#version 410 core
+
+#define POSITION	0
+#define NORMAL		1
+#define TEXCOORD	2
+#define FRAG_COLOR	0
+
+precision highp float;
+precision highp int;
+
+#define MAX_INSTANCES	16
+
+// Copies of a repeated mesh drawn together, one instance each
+uniform mat4 MVPs[MAX_INSTANCES];
+uniform mat4 PrevMVPs[MAX_INSTANCES];
+// Turns the normals of the source mesh into those of each copy
+uniform mat3 NormalMatrices[MAX_INSTANCES];
+
+layout(location = POSITION) in vec3 Position;
+layout(location = NORMAL) in vec3 Normal;
+layout(location = TEXCOORD) in vec2 TexCoord;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+// Must match the depth pre-pass
+invariant gl_Position;
+
+out block
+{
+	vec2 TexCoord;
+	vec3 Normal;
+	vec4 Position;
+	vec4 PreviousPosition;
+} Out;
+
+void main()
+{	
+	gl_Position = MVPs[gl_InstanceID] * vec4(Position, 1.0);
+	Out.TexCoord = TexCoord;
+	Out.Normal = NormalMatrices[gl_InstanceID] * Normal;
+	Out.Position = gl_Position;
+	Out.PreviousPosition = PrevMVPs[gl_InstanceID] * vec4(Position, 1.0);
+}
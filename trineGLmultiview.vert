@@ -0,0 +1,40 @@
+#version 410 core
+
+#define POSITION	0
+#define NORMAL		1
+#define TEXCOORD	2
+
+precision highp float;
+precision highp int;
+
+#define MAX_VIEWS	8
+
+// Object to world of the mesh, each instance of a draw is one view
+uniform mat4 Model;
+// Turns the normals of the source mesh into those of a copy
+uniform mat3 NormalMatrix;
+uniform mat4 ViewProjections[MAX_VIEWS];
+uniform mat4 PrevViewProjections[MAX_VIEWS];
+
+layout(location = POSITION) in vec3 Position;
+layout(location = NORMAL) in vec3 Normal;
+layout(location = TEXCOORD) in vec2 TexCoord;
+
+out block
+{
+	vec2 TexCoord;
+	vec3 Normal;
+	vec4 Position;
+	vec4 PreviousPosition;
+	flat int View;
+} Out;
+
+void main()
+{	
+	vec4 p = Model * vec4(Position, 1.0);
+	Out.TexCoord = TexCoord;
+	Out.Normal = NormalMatrix * Normal;
+	Out.Position = ViewProjections[gl_InstanceID] * p;
+	Out.PreviousPosition = PrevViewProjections[gl_InstanceID] * p;
+	Out.View = gl_InstanceID;
+}
@@ -0,0 +1,104 @@
+#version 410 core
+
+in block
+{
+	vec2 Texcoord;
+} In; 
+
+// Edge adaptive spatial upscaler in the spirit of AMD FidelityFX EASU :
+// a 12 taps lanczos-like kernel stretched along the local edge direction,
+// clamped to the nearest 2x2 texels to avoid ringing.
+
+uniform sampler2D Texture;
+uniform vec2 ViewportScale = vec2(1.0);
+
+layout(location = 0, index = 0) out vec4  Color;
+
+float luma(vec3 c)
+{
+	return dot(c, vec3(0.5, 1.0, 0.5));
+}
+
+vec3 fetch(ivec2 coord, ivec2 maxCoord)
+{
+	return texelFetch(Texture, clamp(coord, ivec2(0), maxCoord), 0).rgb;
+}
+
+void main(void)
+{
+	ivec2 maxCoord = ivec2(vec2(textureSize(Texture, 0)) * ViewportScale) - 1;
+	vec2 p = In.Texcoord * vec2(textureSize(Texture, 0)) - 0.5;
+	ivec2 base = ivec2(floor(p));
+	vec2 pp = fract(p);
+
+	// 12 taps pattern around the 2x2 quad f g / j k
+	//    b c
+	//  e f g h
+	//  i j k l
+	//    n o
+	const ivec2 offsets[12] = ivec2[](
+		ivec2(0, -1), ivec2(1, -1),
+		ivec2(-1, 0), ivec2(0, 0), ivec2(1, 0), ivec2(2, 0),
+		ivec2(-1, 1), ivec2(0, 1), ivec2(1, 1), ivec2(2, 1),
+		ivec2(0, 2), ivec2(1, 2));
+	vec3 taps[12];
+	float l[12];
+	for (int i = 0; i < 12; ++i)
+	{
+		taps[i] = fetch(base + offsets[i], maxCoord);
+		l[i] = luma(taps[i]);
+	}
+
+	// Edge direction and strength from the central quad, weighted bilinearly
+	vec2 dir = vec2(0.0);
+	float len = 0.0;
+	// f : 3, g : 4, j : 7, k : 8 ; neighbours b c e h i l n o
+	float w[4] = float[]((1.0 - pp.x) * (1.0 - pp.y), pp.x * (1.0 - pp.y), (1.0 - pp.x) * pp.y, pp.x * pp.y);
+	int centers[4] = int[](3, 4, 7, 8);
+	int lefts[4] = int[](2, 3, 6, 7);
+	int rights[4] = int[](4, 5, 8, 9);
+	int tops[4] = int[](0, 1, 3, 4);
+	int bottoms[4] = int[](7, 8, 10, 11);
+	for (int i = 0; i < 4; ++i)
+	{
+		float lc = l[centers[i]];
+		float dc = l[rights[i]] - l[lefts[i]];
+		float ax = clamp(abs(dc) / max(max(abs(l[rights[i]] - lc), abs(lc - l[lefts[i]])), 1e-5), 0.0, 1.0);
+		float dr = l[bottoms[i]] - l[tops[i]];
+		float ay = clamp(abs(dr) / max(max(abs(l[bottoms[i]] - lc), abs(lc - l[tops[i]])), 1e-5), 0.0, 1.0);
+		dir += w[i] * vec2(dc, dr);
+		len += w[i] * 0.5 * (ax * ax + ay * ay);
+	}
+	float dirLength = dot(dir, dir);
+	dir = dirLength < 1.0 / 32768.0 ? vec2(1.0, 0.0) : dir * inversesqrt(dirLength);
+	len = len * len;
+
+	// Stretch kernel along the edge, shrink it across
+	float stretch = dot(dir, dir) / max(abs(dir.x), abs(dir.y));
+	vec2 len2 = vec2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);
+	float lob = 0.5 + ((1.0 / 4.0 - 0.04) - 0.5) * len;
+	float clp = 1.0 / lob;
+
+	vec3 color = vec3(0.0);
+	float weight = 0.0;
+	for (int i = 0; i < 12; ++i)
+	{
+		vec2 off = vec2(offsets[i]) - pp;
+		vec2 v = vec2(off.x * dir.x + off.y * dir.y, off.x * -dir.y + off.y * dir.x) * len2;
+		float d2 = min(dot(v, v), clp);
+		float wB = 2.0 / 5.0 * d2 - 1.0;
+		float wA = lob * d2 - 1.0;
+		wB *= wB;
+		wA *= wA;
+		wB = 25.0 / 16.0 * wB - (25.0 / 16.0 - 1.0);
+		float wt = wB * wA;
+		color += taps[i] * wt;
+		weight += wt;
+	}
+	color /= weight;
+
+	// Deringing
+	vec3 mn = min(min(taps[3], taps[4]), min(taps[7], taps[8]));
+	vec3 mx = max(max(taps[3], taps[4]), max(taps[7], taps[8]));
+	Color = vec4(clamp(color, mn, mx), 1.0);
+}
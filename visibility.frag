@@ -0,0 +1,17 @@
+#version 410 core
+
+#define ID	0
+
+precision highp int;
+
+// Low bits of the id hold the triangle, high bits the draw record
+uniform uint TriangleBits;
+
+flat in uint DrawId;
+
+layout(location = ID) out uint Id;
+
+void main()
+{
+	Id = (DrawId << TriangleBits) | uint(gl_PrimitiveID);
+}
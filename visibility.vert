@@ -0,0 +1,31 @@
+#version 410 core
+
+#define POSITION	0
+
+precision highp float;
+precision highp int;
+
+#define MAX_INSTANCES	16
+
+// Copies of a repeated mesh drawn together, one instance each
+uniform mat4 MVPs[MAX_INSTANCES];
+// Record of the first instance, the records of the others follow
+uniform int DrawBase;
+
+layout(location = POSITION) in vec3 Position;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+// The resolve projects the same positions with the same matrices
+invariant gl_Position;
+
+flat out uint DrawId;
+
+void main()
+{	
+	gl_Position = MVPs[gl_InstanceID] * vec4(Position, 1.0);
+	DrawId = uint(DrawBase + gl_InstanceID);
+}
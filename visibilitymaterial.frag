@@ -0,0 +1,24 @@
+#version 410 core
+
+precision highp int;
+
+// Must match VisibilityBuffer
+#define RECORD_TEXELS	13
+#define NO_DRAW			0xffffffffu
+#define MATERIAL_DEPTH_SCALE	(1.0 / 65536.0)
+
+// Depth of the material of each pixel, the resolve then draws one quad per
+// material at that depth and the equal depth test keeps only its pixels
+
+uniform usampler2D Ids;
+uniform usamplerBuffer RecordInts;
+uniform uint TriangleBits;
+
+void main(void)
+{
+	uint id = texelFetch(Ids, ivec2(gl_FragCoord.xy), 0).r;
+	if (id == NO_DRAW)
+		discard;
+	uint material = texelFetch(RecordInts, int(id >> TriangleBits) * RECORD_TEXELS + 11).a;
+	gl_FragDepth = float(material + 1u) * MATERIAL_DEPTH_SCALE;
+}
@@ -0,0 +1,135 @@
+#version 410 core
+
+#define FRAG_COLOR	0
+#define NORMAL		1
+#define VELOCITY	2
+
+precision highp float;
+precision highp int;
+
+// Must match VisibilityBuffer
+#define RECORD_TEXELS	13
+
+// G-buffer of the pixels of one material from the visibility buffer : the
+// triangle of the pixel is fetched from the geometry heap and projected
+// again, its attributes are interpolated with perspective correct
+// barycentrics and the material is sampled once, with the gradients of the
+// barycentrics in place of the derivatives of a scene pass
+
+uniform sampler2D Diffuse;
+uniform usampler2D Ids;
+// Per draw records, the same texels read as floats or as integers
+uniform samplerBuffer Records;
+uniform usamplerBuffer RecordInts;
+// Buffers of the geometry heap, indices and vertex data as 32 bit words
+uniform usamplerBuffer Arena0;
+uniform usamplerBuffer Arena1;
+uniform usamplerBuffer Arena2;
+uniform usamplerBuffer Arena3;
+uniform uint TriangleBits;
+uniform bool Textured;
+uniform vec2 RenderSize;
+// Sub-pixel offset of the projection, excluded from the velocity
+uniform vec2 Jitter;
+
+layout(location = FRAG_COLOR, index = 0) out vec4 FragColor;
+layout(location = NORMAL) out vec4 Normal;
+layout(location = VELOCITY) out vec2 Velocity;
+
+uint arenaWord(uint arena, int texel)
+{
+	if (arena == 0u)
+		return texelFetch(Arena0, texel).r;
+	if (arena == 1u)
+		return texelFetch(Arena1, texel).r;
+	if (arena == 2u)
+		return texelFetch(Arena2, texel).r;
+	return texelFetch(Arena3, texel).r;
+}
+
+vec3 arenaVec3(uint arena, int texel)
+{
+	return uintBitsToFloat(uvec3(arenaWord(arena, texel), arenaWord(arena, texel + 1), arenaWord(arena, texel + 2)));
+}
+
+vec2 arenaVec2(uint arena, int texel)
+{
+	return uintBitsToFloat(uvec2(arenaWord(arena, texel), arenaWord(arena, texel + 1)));
+}
+
+// Barycentrics of ndc in the triangle of clip positions p, and their change
+// to the next pixel in x and y. Barycentrics over w are affine on screen
+void barycentrics(vec4 p0, vec4 p1, vec4 p2, vec2 ndc, out vec3 lambda, out vec3 ddx, out vec3 ddy)
+{
+	vec3 invW = 1.0 / vec3(p0.w, p1.w, p2.w);
+	vec2 ndc0 = p0.xy * invW.x;
+	vec2 ndc1 = p1.xy * invW.y;
+	vec2 ndc2 = p2.xy * invW.z;
+	float invDet = 1.0 / determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+	vec3 dx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+	vec3 dy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+	vec2 delta = ndc - ndc0;
+	vec3 overW = vec3(invW.x, 0.0, 0.0) + delta.x * dx + delta.y * dy;
+	float interpInvW = overW.x + overW.y + overW.z;
+	lambda = overW / interpInvW;
+	// One pixel is 2 / RenderSize in ndc
+	dx *= 2.0 / RenderSize.x;
+	dy *= 2.0 / RenderSize.y;
+	ddx = (overW + dx) / (interpInvW + dx.x + dx.y + dx.z) - lambda;
+	ddy = (overW + dy) / (interpInvW + dy.x + dy.y + dy.z) - lambda;
+}
+
+void main()
+{
+	// The material depth test only lets pixels covered by this material through
+	uint id = texelFetch(Ids, ivec2(gl_FragCoord.xy), 0).r;
+	int record = int(id >> TriangleBits) * RECORD_TEXELS;
+	int triangle = int(id & ((1u << TriangleBits) - 1u));
+	mat4 mvp = mat4(texelFetch(Records, record), texelFetch(Records, record + 1), texelFetch(Records, record + 2), texelFetch(Records, record + 3));
+	mat4 prevMvp = mat4(texelFetch(Records, record + 4), texelFetch(Records, record + 5), texelFetch(Records, record + 6), texelFetch(Records, record + 7));
+	mat3 normalMatrix = mat3(texelFetch(Records, record + 8).xyz, texelFetch(Records, record + 9).xyz, texelFetch(Records, record + 10).xyz);
+	vec3 diffuseColor = texelFetch(Records, record + 11).rgb;
+	// First position, vertex count, first index of the level, index and vertex arenas
+	uvec4 geometry = texelFetch(RecordInts, record + 12);
+	uint indexArena = geometry.w & 0xffffu;
+	uint vertexArena = geometry.w >> 16;
+	int vertexBase = int(geometry.x);
+	int vertexCount = int(geometry.y);
+	int indexTexel = int(geometry.z) + 3 * triangle;
+	ivec3 indices = ivec3(arenaWord(indexArena, indexTexel), arenaWord(indexArena, indexTexel + 1), arenaWord(indexArena, indexTexel + 2));
+
+	// Positions, then normals, then uvs
+	vec3 position0 = arenaVec3(vertexArena, vertexBase + 3 * indices.x);
+	vec3 position1 = arenaVec3(vertexArena, vertexBase + 3 * indices.y);
+	vec3 position2 = arenaVec3(vertexArena, vertexBase + 3 * indices.z);
+	int normalBase = vertexBase + 3 * vertexCount;
+	mat3 normals = mat3(arenaVec3(vertexArena, normalBase + 3 * indices.x),
+						arenaVec3(vertexArena, normalBase + 3 * indices.y),
+						arenaVec3(vertexArena, normalBase + 3 * indices.z));
+	int uvBase = vertexBase + 6 * vertexCount;
+	mat3x2 uvs = mat3x2(arenaVec2(vertexArena, uvBase + 2 * indices.x),
+						arenaVec2(vertexArena, uvBase + 2 * indices.y),
+						arenaVec2(vertexArena, uvBase + 2 * indices.z));
+
+	vec2 ndc = gl_FragCoord.xy / RenderSize * 2.0 - 1.0;
+	vec3 lambda, ddx, ddy;
+	barycentrics(mvp * vec4(position0, 1.0), mvp * vec4(position1, 1.0), mvp * vec4(position2, 1.0), ndc, lambda, ddx, ddy);
+
+	vec3 cdiff = diffuseColor;
+	if (Textured)
+	{
+		vec2 uv = uvs * lambda;
+		vec2 uvDx = uvs * ddx;
+		vec2 uvDy = uvs * ddy;
+		cdiff = textureGrad(Diffuse, vec2(uv.x, 1. - uv.y), vec2(uvDx.x, -uvDx.y), vec2(uvDy.x, -uvDy.y)).rgb;
+	}
+	// Same shading as the scene pass
+	vec3 n = normalize(normalMatrix * (normals * lambda));
+	vec3 l = vec3(1., 1., 1.);
+	float ndotl = clamp(dot(n,l), 0., 1.);
+	vec3 diffuse = cdiff * ndotl;
+	FragColor = vec4(diffuse, 1.0);
+	Normal = vec4(n, 30);
+	vec4 previous = prevMvp * vec4(position0, 1.0) * lambda.x + prevMvp * vec4(position1, 1.0) * lambda.y + prevMvp * vec4(position2, 1.0) * lambda.z;
+	Velocity = (ndc - Jitter - previous.xy / previous.w) * 0.5;
+}
@@ -0,0 +1,13 @@
+#version 410 core
+
+#define POSITION 0
+
+layout(location = POSITION) in vec2 Position;
+
+// Window depth of the material resolved, as written by the classification
+uniform float MaterialDepth;
+
+void main()
+{	
+	gl_Position = vec4(Position.xy, MaterialDepth * 2.0 - 1.0, 1.0);
+}